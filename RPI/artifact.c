@@ -0,0 +1,302 @@
+#include "artifact.h"
+#include "util.h"
+
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "uthash.h"
+#include "utlist.h"
+
+struct artifact_entry {
+	struct artifact base; /* must be first */
+	unsigned int ref_count;
+	int task_id;
+	bool persist;
+	bool in_store;
+	struct artifact_entry* prev; /* lru order, oldest first */
+	struct artifact_entry* next;
+	UT_hash_handle hh;
+};
+
+static char* s_persist_dir = NULL;
+static size_t s_memory_cap = 0;
+static size_t s_memory_used = 0;
+
+static struct artifact_entry* s_entries = NULL;
+static struct artifact_entry* s_lru = NULL;
+
+static pthread_mutex_t s_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static bool s_artifact_initialized = false;
+
+static void detach_entry(struct artifact_entry* entry, bool unlink_file);
+static void unref_entry(struct artifact_entry* entry);
+static void enforce_memory_cap(void);
+static void make_persist_path(char* buf, size_t buf_size, const char* name);
+
+bool artifact_init(const char* persist_dir, size_t memory_cap) {
+	if (s_artifact_initialized) {
+		goto done;
+	}
+
+	if (!persist_dir) {
+		EPRINTF("No persist directory specified.\n");
+		goto err;
+	}
+
+	s_persist_dir = strdup(persist_dir);
+	if (!s_persist_dir) {
+		EPRINTF("No memory.\n");
+		goto err;
+	}
+
+	s_memory_cap = memory_cap;
+	s_memory_used = 0;
+
+	s_artifact_initialized = true;
+
+done:
+	return true;
+
+err:
+	return false;
+}
+
+void artifact_fini(void) {
+	struct artifact_entry* entry;
+	struct artifact_entry* tmp;
+
+	if (!s_artifact_initialized) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	HASH_ITER(hh, s_entries, entry, tmp) {
+		detach_entry(entry, false);
+	}
+	pthread_mutex_unlock(&s_mtx);
+
+	free(s_persist_dir);
+	s_persist_dir = NULL;
+
+	s_artifact_initialized = false;
+}
+
+bool artifact_put(const char* name, const char* content_type, uint8_t* data, size_t size, bool persist) {
+	struct artifact_entry* entry = NULL;
+	struct artifact_entry* old_entry;
+	char path[1024];
+
+	assert(name != NULL);
+	assert(content_type != NULL);
+
+	if (!s_artifact_initialized) {
+		goto err;
+	}
+	if (strlen(name) >= sizeof(entry->base.name)) {
+		EPRINTF("Too long artifact name: %s\n", name);
+		goto err;
+	}
+
+	if (persist) {
+		make_persist_path(path, sizeof(path), name);
+		if (!write_file_trunc(path, data, size, NULL, S_IRUSR | S_IWUSR)) {
+			EPRINTF("Unable to write artifact file: %s\n", path);
+			goto err;
+		}
+	}
+
+	entry = (struct artifact_entry*)malloc(sizeof(*entry));
+	if (!entry) {
+		EPRINTF("No memory.\n");
+		goto err_unlink;
+	}
+	memset(entry, 0, sizeof(*entry));
+
+	strlcpy(entry->base.name, name, sizeof(entry->base.name));
+	entry->base.content_type = content_type;
+	entry->base.data = data;
+	entry->base.size = size;
+	snprintf(entry->base.content_length, sizeof(entry->base.content_length), "%" PRIuMAX, (uintmax_t)size);
+	entry->ref_count = 1; /* owned by store */
+	entry->task_id = -1;
+	entry->persist = persist;
+	entry->in_store = true;
+
+	pthread_mutex_lock(&s_mtx);
+
+	HASH_FIND_STR(s_entries, name, old_entry);
+	if (old_entry) {
+		detach_entry(old_entry, false);
+	}
+
+	HASH_ADD_STR(s_entries, base.name, entry);
+	DL_APPEND(s_lru, entry);
+	s_memory_used += size;
+
+	enforce_memory_cap();
+
+	pthread_mutex_unlock(&s_mtx);
+
+	return true;
+
+err_unlink:
+	if (persist) {
+		unlink(path);
+	}
+
+err:
+	if (data) {
+		free(data);
+	}
+
+	return false;
+}
+
+bool artifact_bind_task(const char* name, int task_id) {
+	struct artifact_entry* entry;
+
+	assert(name != NULL);
+
+	pthread_mutex_lock(&s_mtx);
+
+	HASH_FIND_STR(s_entries, name, entry);
+	if (entry) {
+		entry->task_id = task_id;
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+
+	return entry != NULL;
+}
+
+struct artifact* artifact_acquire(const char* name) {
+	struct artifact_entry* entry;
+
+	assert(name != NULL);
+
+	pthread_mutex_lock(&s_mtx);
+
+	HASH_FIND_STR(s_entries, name, entry);
+	if (entry) {
+		++entry->ref_count;
+
+		DL_DELETE(s_lru, entry);
+		DL_APPEND(s_lru, entry);
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+
+	return entry ? &entry->base : NULL;
+}
+
+void artifact_release(struct artifact* artifact) {
+	if (!artifact) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	unref_entry((struct artifact_entry*)artifact);
+	pthread_mutex_unlock(&s_mtx);
+}
+
+void artifact_remove(const char* name) {
+	struct artifact_entry* entry;
+	char path[1024];
+
+	assert(name != NULL);
+
+	pthread_mutex_lock(&s_mtx);
+
+	HASH_FIND_STR(s_entries, name, entry);
+	if (entry) {
+		detach_entry(entry, true);
+	} else if (s_persist_dir) {
+		/* May have been evicted from memory earlier. */
+		make_persist_path(path, sizeof(path), name);
+		unlink(path);
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+}
+
+void artifact_evict_task(int task_id) {
+	struct artifact_entry* entry;
+	struct artifact_entry* tmp;
+
+	if (task_id < 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	HASH_ITER(hh, s_entries, entry, tmp) {
+		if (entry->task_id == task_id) {
+			detach_entry(entry, true);
+		}
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+}
+
+/* Must be called with the lock held. */
+static void detach_entry(struct artifact_entry* entry, bool unlink_file) {
+	char path[1024];
+
+	assert(entry != NULL);
+	assert(entry->in_store);
+
+	HASH_DEL(s_entries, entry);
+	DL_DELETE(s_lru, entry);
+	s_memory_used -= entry->base.size;
+	entry->in_store = false;
+
+	if (unlink_file && entry->persist && s_persist_dir) {
+		make_persist_path(path, sizeof(path), entry->base.name);
+		unlink(path);
+	}
+
+	unref_entry(entry);
+}
+
+/* Must be called with the lock held. */
+static void unref_entry(struct artifact_entry* entry) {
+	assert(entry != NULL);
+	assert(entry->ref_count > 0);
+
+	if (--entry->ref_count > 0) {
+		return;
+	}
+
+	if (entry->base.data) {
+		free(entry->base.data);
+	}
+
+	free(entry);
+}
+
+/* Must be called with the lock held. Persisted artifacts can still be served from disk after eviction. */
+static void enforce_memory_cap(void) {
+	struct artifact_entry* entry;
+	struct artifact_entry* tmp;
+
+	if (s_memory_cap == 0) {
+		return;
+	}
+
+	DL_FOREACH_SAFE(s_lru, entry, tmp) {
+		if (s_memory_used <= s_memory_cap) {
+			break;
+		}
+		if (entry == s_lru->prev) {
+			/* Always keep most recent one. */
+			break;
+		}
+
+		detach_entry(entry, false);
+	}
+}
+
+static void make_persist_path(char* buf, size_t buf_size, const char* name) {
+	snprintf(buf, buf_size, "%s/%s", s_persist_dir, name);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "common.h"
+
+#define ARTIFACT_NAME_SIZE 64
+
+struct artifact {
+	char name[ARTIFACT_NAME_SIZE];
+	const char* content_type;
+	uint8_t* data;
+	size_t size;
+	char content_length[24]; /* precomputed Content-Length header value */
+};
+
+bool artifact_init(const char* persist_dir, size_t memory_cap);
+void artifact_fini(void);
+
+/* Takes ownership of data, even on failure. */
+bool artifact_put(const char* name, const char* content_type, uint8_t* data, size_t size, bool persist);
+
+bool artifact_bind_task(const char* name, int task_id);
+
+/* Returned artifact stays valid until released, even if it was evicted meanwhile. */
+struct artifact* artifact_acquire(const char* name);
+void artifact_release(struct artifact* artifact);
+
+void artifact_remove(const char* name);
+void artifact_evict_task(int task_id);
@@ -0,0 +1,32 @@
+#include "bench.h"
+
+int main(int argc, char* argv[]) {
+	static const struct {
+		const char* name;
+		void (*fn)(void);
+	} benches[] = {
+		{ "uri", &bench_uri },
+		{ "sfo", &bench_sfo },
+		{ "json", &bench_json },
+	};
+	size_t i;
+	int j;
+
+	printf("%-8s %-36s %18s\n", "group", "case", "time");
+
+	for (i = 0; i < ARRAY_SIZE(benches); ++i) {
+		/* Benches named on the command line only, or all of them. */
+		for (j = 1; j < argc; ++j) {
+			if (strcmp(argv[j], benches[i].name) == 0) {
+				break;
+			}
+		}
+		if (argc > 1 && j == argc) {
+			continue;
+		}
+
+		benches[i].fn();
+	}
+
+	return 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "../common.h"
+#include "../tiny-json.h"
+
+/* Each case runs at least this long, rates are noisy otherwise. */
+#define BENCH_MIN_NSECS (INT64_C(200) * 1000 * 1000)
+
+/* Results are folded here, so the compiler cannot drop the work being timed. */
+extern volatile uint64_t g_bench_sink;
+
+/* Silences error output of the modules, for tests feeding them bad input on purpose. */
+extern bool g_bench_quiet;
+
+typedef void bench_fn(void* arg);
+
+uint64_t bench_now_nsecs(void);
+
+/* Calls the function until the minimum time has passed, returns average nanoseconds per call. */
+double bench_run(bench_fn* fn, void* arg);
+
+void bench_report(const char* group, const char* name, double nsecs_per_call, size_t items_per_call, size_t bytes_per_call);
+
+/* Deterministic generator, so every variant sees the same inputs. */
+uint32_t bench_random(uint32_t* state);
+
+/* Piece URLs of split packages as served by common PC servers, about half of them percent-encoded. */
+char** corpus_make_urls(size_t count, uint32_t seed);
+void corpus_free_strings(char** strs, size_t count);
+
+/* Install requests with hundreds of percent-encoded piece URLs, and ref-package manifests. */
+char** corpus_make_json_documents(size_t* count);
+
+/* param.sfo laid out like the ones of real packages, with localized titles. */
+void* corpus_make_sfo(size_t* size);
+
+/* Scanner entry points of both builds of uri.c. */
+size_t uri_find_percent_simd(const char* str, size_t len);
+size_t uri_safe_prefix_length_simd(const char* str, size_t len);
+size_t uri_find_percent_scalar(const char* str, size_t len);
+size_t uri_safe_prefix_length_scalar(const char* str, size_t len);
+size_t uri_decode_in_place_scalar(char* str);
+char* uri_encode_scalar(const char* in, size_t* out_len);
+
+json_t const* json_create_scalar(char* str, json_t mem[], unsigned int qty);
+
+void bench_uri(void);
+void bench_sfo(void);
+void bench_json(void);
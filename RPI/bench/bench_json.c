@@ -0,0 +1,80 @@
+#include "bench.h"
+
+#include "../tiny-json.h"
+
+/* Enough for the widest document of the corpus. */
+#define PARSE_MAX_NODES 4096
+
+struct parse_arg {
+	char** docs;
+	size_t* lengths;
+	size_t count;
+	char* buf;
+	json_t* mem;
+	bool simd;
+};
+
+/* Parser modifies its input, so every round starts from a fresh copy. */
+static void run_parse(void* arg) {
+	const struct parse_arg* a = (const struct parse_arg*)arg;
+	json_t const* root;
+	size_t total = 0;
+	size_t i;
+
+	for (i = 0; i < a->count; ++i) {
+		memcpy(a->buf, a->docs[i], a->lengths[i] + 1);
+		root = a->simd ? json_create(a->buf, a->mem, PARSE_MAX_NODES) : json_create_scalar(a->buf, a->mem, PARSE_MAX_NODES);
+		total += root != NULL;
+	}
+
+	g_bench_sink += total;
+}
+
+static void bench_parse(void) {
+	struct parse_arg arg;
+	size_t max_len = 0;
+	size_t bytes = 0;
+	size_t i;
+
+	memset(&arg, 0, sizeof(arg));
+
+	arg.docs = corpus_make_json_documents(&arg.count);
+	if (!arg.docs) {
+		fprintf(stderr, "No memory.\n");
+		return;
+	}
+
+	arg.lengths = (size_t*)calloc(arg.count, sizeof(*arg.lengths));
+	arg.mem = (json_t*)calloc(PARSE_MAX_NODES, sizeof(*arg.mem));
+	if (!arg.lengths || !arg.mem) {
+		fprintf(stderr, "No memory.\n");
+		goto done;
+	}
+
+	for (i = 0; i < arg.count; ++i) {
+		arg.lengths[i] = strlen(arg.docs[i]);
+		max_len = MAX(max_len, arg.lengths[i]);
+		bytes += arg.lengths[i];
+	}
+
+	arg.buf = (char*)malloc(max_len + 1);
+	if (!arg.buf) {
+		fprintf(stderr, "No memory.\n");
+		goto done;
+	}
+
+	arg.simd = true;
+	bench_report("json", "create/sse2", bench_run(&run_parse, &arg), arg.count, bytes);
+	arg.simd = false;
+	bench_report("json", "create/scalar", bench_run(&run_parse, &arg), arg.count, bytes);
+
+done:
+	free(arg.buf);
+	free(arg.mem);
+	free(arg.lengths);
+	corpus_free_strings(arg.docs, arg.count);
+}
+
+void bench_json(void) {
+	bench_parse();
+}
@@ -0,0 +1,118 @@
+#include "bench.h"
+
+#include "../sfo.h"
+
+/* Keys the install path reads, localized title first. */
+static const char* const s_lookup_keys[] = { "TITLE_05", "TITLE", "CONTENT_ID" };
+
+struct sfo_arg {
+	const void* data;
+	size_t size;
+};
+
+static void run_list(void* arg) {
+	const struct sfo_arg* a = (const struct sfo_arg*)arg;
+	struct sfo_entry* entry;
+	struct sfo* sfo;
+	size_t total = 0;
+	size_t i;
+
+	sfo = sfo_alloc();
+	if (!sfo) {
+		return;
+	}
+
+	if (sfo_load_from_memory(sfo, a->data, a->size)) {
+		for (i = 0; i < ARRAY_SIZE(s_lookup_keys); ++i) {
+			entry = sfo_find_entry(sfo, s_lookup_keys[i]);
+			if (entry) {
+				total += entry->size + ((const char*)entry->value)[0];
+			}
+		}
+	}
+
+	sfo_free(sfo);
+
+	g_bench_sink += total;
+}
+
+static void run_view(void* arg) {
+	const struct sfo_arg* a = (const struct sfo_arg*)arg;
+	struct sfo_view_entry entry;
+	struct sfo_view view;
+	size_t total = 0;
+	size_t i;
+
+	if (sfo_view_init(&view, a->data, a->size)) {
+		for (i = 0; i < ARRAY_SIZE(s_lookup_keys); ++i) {
+			if (sfo_view_find(&view, s_lookup_keys[i], &entry)) {
+				total += entry.size + ((const char*)entry.value)[0];
+			}
+		}
+	}
+
+	g_bench_sink += total;
+}
+
+struct find_arg {
+	struct sfo* sfo;
+	struct sfo_view view;
+	const char* keys[SFO_VIEW_MAX_ENTRIES];
+	size_t key_count;
+};
+
+/* Lookups alone, of every key of a table loaded once. */
+static void run_list_find(void* arg) {
+	struct find_arg* a = (struct find_arg*)arg;
+	size_t total = 0;
+	size_t i;
+
+	for (i = 0; i < a->key_count; ++i) {
+		total += sfo_find_entry(a->sfo, a->keys[i]) != NULL;
+	}
+
+	g_bench_sink += total;
+}
+
+static void run_view_find(void* arg) {
+	struct find_arg* a = (struct find_arg*)arg;
+	size_t total = 0;
+	size_t i;
+
+	for (i = 0; i < a->key_count; ++i) {
+		total += sfo_view_find(&a->view, a->keys[i], NULL);
+	}
+
+	g_bench_sink += total;
+}
+
+void bench_sfo(void) {
+	struct sfo_entry* entry;
+	struct find_arg find;
+	struct sfo_arg arg;
+
+	arg.data = corpus_make_sfo(&arg.size);
+	if (!arg.data) {
+		fprintf(stderr, "No memory.\n");
+		return;
+	}
+
+	bench_report("sfo", "load+find/list", bench_run(&run_list, &arg), ARRAY_SIZE(s_lookup_keys), 0);
+	bench_report("sfo", "load+find/view", bench_run(&run_view, &arg), ARRAY_SIZE(s_lookup_keys), 0);
+
+	memset(&find, 0, sizeof(find));
+	find.sfo = sfo_alloc();
+	if (find.sfo && sfo_load_from_memory(find.sfo, arg.data, arg.size) && sfo_view_init(&find.view, arg.data, arg.size)) {
+		for (entry = find.sfo->entries; entry && find.key_count < ARRAY_SIZE(find.keys); entry = entry->next) {
+			find.keys[find.key_count++] = entry->key;
+		}
+
+		bench_report("sfo", "find every key/list", bench_run(&run_list_find, &find), find.key_count, 0);
+		bench_report("sfo", "find every key/view", bench_run(&run_view_find, &find), find.key_count, 0);
+	}
+	if (find.sfo) {
+		sfo_free(find.sfo);
+	}
+
+	free((void*)arg.data);
+}
@@ -0,0 +1,160 @@
+#include "bench.h"
+
+#include "../uri.h"
+
+#define URL_COUNT 1024
+
+typedef size_t scan_fn(const char* str, size_t len);
+
+struct uri_corpus {
+	char** urls; /* as sent by clients */
+	char** decoded;
+	size_t* lengths;
+	size_t* decoded_lengths;
+	size_t bytes;
+	size_t decoded_bytes;
+	char* buf;
+};
+
+struct scan_arg {
+	const struct uri_corpus* corpus;
+	scan_fn* fn;
+};
+
+struct codec_arg {
+	const struct uri_corpus* corpus;
+	bool simd;
+};
+
+/* Walks each URL run by run, like the decoder does. */
+static void run_find_percent(void* arg) {
+	const struct scan_arg* a = (const struct scan_arg*)arg;
+	const char* url;
+	size_t count = 0;
+	size_t len, pos, i;
+
+	for (i = 0; i < URL_COUNT; ++i) {
+		url = a->corpus->urls[i];
+		len = a->corpus->lengths[i];
+		for (pos = 0; pos < len; ++pos) {
+			pos += a->fn(url + pos, len - pos);
+			count += pos < len;
+		}
+	}
+
+	g_bench_sink += count;
+}
+
+/* Walks each decoded URL run by run, like the encoder does. */
+static void run_safe_prefix_length(void* arg) {
+	const struct scan_arg* a = (const struct scan_arg*)arg;
+	const char* url;
+	size_t count = 0;
+	size_t len, pos, i;
+
+	for (i = 0; i < URL_COUNT; ++i) {
+		url = a->corpus->decoded[i];
+		len = a->corpus->decoded_lengths[i];
+		for (pos = 0; pos < len; ++pos) {
+			pos += a->fn(url + pos, len - pos);
+			count += pos < len;
+		}
+	}
+
+	g_bench_sink += count;
+}
+
+static void run_decode(void* arg) {
+	const struct codec_arg* a = (const struct codec_arg*)arg;
+	size_t total = 0;
+	size_t i;
+
+	for (i = 0; i < URL_COUNT; ++i) {
+		memcpy(a->corpus->buf, a->corpus->urls[i], a->corpus->lengths[i] + 1);
+		total += a->simd ? uri_decode_in_place(a->corpus->buf) : uri_decode_in_place_scalar(a->corpus->buf);
+	}
+
+	g_bench_sink += total;
+}
+
+static void run_encode(void* arg) {
+	const struct codec_arg* a = (const struct codec_arg*)arg;
+	size_t total = 0;
+	size_t len, i;
+	char* out;
+
+	for (i = 0; i < URL_COUNT; ++i) {
+		out = a->simd ? uri_encode(a->corpus->decoded[i], &len) : uri_encode_scalar(a->corpus->decoded[i], &len);
+		if (out) {
+			total += len;
+			free(out);
+		}
+	}
+
+	g_bench_sink += total;
+}
+
+static void scan_case(const char* name, bench_fn* fn, const struct uri_corpus* corpus, scan_fn* scan, size_t bytes) {
+	struct scan_arg arg = { corpus, scan };
+
+	bench_report("uri", name, bench_run(fn, &arg), URL_COUNT, bytes);
+}
+
+static void codec_case(const char* name, bench_fn* fn, const struct uri_corpus* corpus, bool simd, size_t bytes) {
+	struct codec_arg arg = { corpus, simd };
+
+	bench_report("uri", name, bench_run(fn, &arg), URL_COUNT, bytes);
+}
+
+void bench_uri(void) {
+	struct uri_corpus corpus;
+	size_t max_len = 0;
+	size_t i;
+
+	memset(&corpus, 0, sizeof(corpus));
+
+	corpus.urls = corpus_make_urls(URL_COUNT, 0x5EED);
+	corpus.decoded = (char**)calloc(URL_COUNT, sizeof(*corpus.decoded));
+	corpus.lengths = (size_t*)calloc(URL_COUNT, sizeof(*corpus.lengths));
+	corpus.decoded_lengths = (size_t*)calloc(URL_COUNT, sizeof(*corpus.decoded_lengths));
+	if (!corpus.urls || !corpus.decoded || !corpus.lengths || !corpus.decoded_lengths) {
+		fprintf(stderr, "No memory.\n");
+		goto done;
+	}
+
+	for (i = 0; i < URL_COUNT; ++i) {
+		corpus.lengths[i] = strlen(corpus.urls[i]);
+		corpus.bytes += corpus.lengths[i];
+		max_len = MAX(max_len, corpus.lengths[i]);
+
+		corpus.decoded[i] = uri_decode(corpus.urls[i], &corpus.decoded_lengths[i]);
+		if (!corpus.decoded[i]) {
+			fprintf(stderr, "No memory.\n");
+			goto done;
+		}
+		corpus.decoded_bytes += corpus.decoded_lengths[i];
+	}
+
+	corpus.buf = (char*)malloc(max_len + 1);
+	if (!corpus.buf) {
+		fprintf(stderr, "No memory.\n");
+		goto done;
+	}
+
+	scan_case("find_percent/sse2", &run_find_percent, &corpus, &uri_find_percent_simd, corpus.bytes);
+	scan_case("find_percent/scalar", &run_find_percent, &corpus, &uri_find_percent_scalar, corpus.bytes);
+	scan_case("safe_prefix_length/sse2", &run_safe_prefix_length, &corpus, &uri_safe_prefix_length_simd, corpus.decoded_bytes);
+	scan_case("safe_prefix_length/scalar", &run_safe_prefix_length, &corpus, &uri_safe_prefix_length_scalar, corpus.decoded_bytes);
+
+	codec_case("decode_in_place/sse2", &run_decode, &corpus, true, corpus.bytes);
+	codec_case("decode_in_place/scalar", &run_decode, &corpus, false, corpus.bytes);
+	codec_case("encode/sse2", &run_encode, &corpus, true, corpus.decoded_bytes);
+	codec_case("encode/scalar", &run_encode, &corpus, false, corpus.decoded_bytes);
+
+done:
+	free(corpus.buf);
+	free(corpus.decoded_lengths);
+	free(corpus.lengths);
+	corpus_free_strings(corpus.decoded, corpus.decoded ? URL_COUNT : 0);
+	corpus_free_strings(corpus.urls, corpus.urls ? URL_COUNT : 0);
+}
@@ -0,0 +1,381 @@
+#include "bench.h"
+
+#include "../sfo.h"
+
+#include <stdarg.h>
+#include <time.h>
+
+volatile uint64_t g_bench_sink;
+
+bool g_bench_quiet = false;
+
+static const char* const s_title_words[] = {
+	"Shadow", "Legends", "of", "the", "Ancient", "Kingdom", "Remastered", "Deluxe",
+	"Edition", "Racing", "Soul", "Knight", "Chronicles", "Final", "Dark", "Origins",
+};
+
+/* Host replacement of the kernel debug output. */
+void KernelPrintOut(const char* fmt, ...) {
+	va_list args;
+
+	if (g_bench_quiet) {
+		return;
+	}
+
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+}
+
+uint64_t bench_now_nsecs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 * 1000 * 1000 + (uint64_t)ts.tv_nsec;
+}
+
+double bench_run(bench_fn* fn, void* arg) {
+	uint64_t start, elapsed;
+	uint64_t calls = 0;
+
+	/* Warm up caches and lazily built tables. */
+	fn(arg);
+
+	start = bench_now_nsecs();
+	do {
+		fn(arg);
+		++calls;
+		elapsed = bench_now_nsecs() - start;
+	} while (elapsed < (uint64_t)BENCH_MIN_NSECS);
+
+	return (double)elapsed / (double)calls;
+}
+
+void bench_report(const char* group, const char* name, double nsecs_per_call, size_t items_per_call, size_t bytes_per_call) {
+	printf("%-8s %-36s %10.1f ns/item", group, name, nsecs_per_call / (double)(items_per_call ? items_per_call : 1));
+	if (bytes_per_call > 0) {
+		printf(" %10.1f MB/s", (double)bytes_per_call * 1000.0 / nsecs_per_call);
+	}
+	printf("\n");
+}
+
+uint32_t bench_random(uint32_t* state) {
+	/* xorshift32 */
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+
+	return *state;
+}
+
+char** corpus_make_urls(size_t count, uint32_t seed) {
+	static const char alnum[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+	char title[256], content_id[17];
+	uint32_t state = seed ? seed : 1;
+	unsigned int title_num;
+	size_t word_count, i, j;
+	bool escaped;
+	char** urls;
+	size_t len;
+
+	urls = (char**)calloc(count, sizeof(*urls));
+	if (!urls) {
+		return NULL;
+	}
+
+	for (i = 0; i < count; ++i) {
+		escaped = bench_random(&state) & 1;
+
+		title[0] = '\0';
+		word_count = 2 + bench_random(&state) % 5;
+		for (j = 0; j < word_count; ++j) {
+			if (j > 0) {
+				strcat(title, escaped ? "%20" : "_");
+			}
+			strcat(title, s_title_words[bench_random(&state) % ARRAY_SIZE(s_title_words)]);
+		}
+
+		for (j = 0; j < sizeof(content_id) - 1; ++j) {
+			content_id[j] = alnum[bench_random(&state) % (sizeof(alnum) - 1)];
+		}
+		content_id[sizeof(content_id) - 1] = '\0';
+
+		title_num = bench_random(&state) % 100000;
+
+		len = 512;
+		urls[i] = (char*)malloc(len);
+		if (!urls[i]) {
+			corpus_free_strings(urls, i);
+			return NULL;
+		}
+		snprintf(urls[i], len, "http://192.168.1.%u:%u/Games/%s%sCUSA%05u%s/UP%04u-CUSA%05u_00-%s-A0100-V0100_%u.pkg",
+			2 + bench_random(&state) % 250, 8000 + bench_random(&state) % 4000,
+			title, escaped ? "%20%5B" : "_", title_num, escaped ? "%5D" : "",
+			bench_random(&state) % 10000, title_num, content_id, (unsigned int)(i % 16));
+	}
+
+	return urls;
+}
+
+/* Appends to a growing document, returns false when out of memory. */
+static bool doc_append(char** doc, size_t* len, size_t* size, const char* fmt, ...) {
+	va_list args;
+	char* new_doc;
+	int n;
+
+	for (;;) {
+		va_start(args, fmt);
+		n = vsnprintf(*doc ? *doc + *len : NULL, *doc ? *size - *len : 0, fmt, args);
+		va_end(args);
+		if (n < 0) {
+			return false;
+		}
+		if (*doc && *len + (size_t)n < *size) {
+			*len += (size_t)n;
+			return true;
+		}
+
+		new_doc = (char*)realloc(*doc, *size * 2 + (size_t)n + 1);
+		if (!new_doc) {
+			return false;
+		}
+		*doc = new_doc;
+		*size = *size * 2 + (size_t)n + 1;
+	}
+}
+
+static char* make_install_request(size_t url_count, bool pretty, uint32_t seed) {
+	const char* nl = pretty ? "\n\t\t" : "";
+	size_t len = 0, size = 0;
+	char* doc = NULL;
+	char** urls;
+	bool ok;
+	size_t i;
+
+	urls = corpus_make_urls(url_count, seed);
+	if (!urls) {
+		return NULL;
+	}
+
+	ok = doc_append(&doc, &len, &size, "{%s\"type\":%s\"direct\",%s\"packages\":%s[", pretty ? "\n\t" : "", pretty ? " " : "", pretty ? "\n\t" : "", pretty ? " " : "");
+	for (i = 0; ok && i < url_count; ++i) {
+		ok = doc_append(&doc, &len, &size, "%s%s\"%s\"", i > 0 ? "," : "", nl, urls[i]);
+	}
+	ok = ok && doc_append(&doc, &len, &size, "%s]%s}", pretty ? "\n\t" : "", pretty ? "\n" : "");
+
+	corpus_free_strings(urls, url_count);
+
+	if (!ok) {
+		free(doc);
+		return NULL;
+	}
+
+	return doc;
+}
+
+static char* make_manifest(size_t piece_count, bool escape_slashes, uint32_t seed) {
+	static const char hex[] = "0123456789ABCDEF";
+	char digest[65], hash[41];
+	size_t len = 0, size = 0;
+	uint32_t state = seed;
+	char* doc = NULL;
+	char** urls;
+	char* url;
+	char* p;
+	bool ok;
+	size_t i, j;
+
+	urls = corpus_make_urls(piece_count, seed);
+	if (!urls) {
+		return NULL;
+	}
+
+	for (j = 0; j < sizeof(digest) - 1; ++j) {
+		digest[j] = hex[bench_random(&state) & 0xF];
+	}
+	digest[sizeof(digest) - 1] = '\0';
+
+	ok = doc_append(&doc, &len, &size, "{\"originalFileSize\":%" PRIu64 ",\"packageDigest\":\"%s\",\"numberOfSplitFiles\":%zu,\"pieces\":[",
+		(uint64_t)piece_count * UINT64_C(4294967296), digest, piece_count);
+	for (i = 0; ok && i < piece_count; ++i) {
+		for (j = 0; j < sizeof(hash) - 1; ++j) {
+			hash[j] = hex[bench_random(&state) & 0xF];
+		}
+		hash[sizeof(hash) - 1] = '\0';
+
+		/* Some servers escape slashes, like the official manifests do. */
+		url = urls[i];
+		if (escape_slashes) {
+			url = (char*)malloc(strlen(urls[i]) * 2 + 1);
+			if (!url) {
+				ok = false;
+				break;
+			}
+			for (p = url, j = 0; urls[i][j] != '\0'; ++j) {
+				if (urls[i][j] == '/') {
+					*p++ = '\\';
+				}
+				*p++ = urls[i][j];
+			}
+			*p = '\0';
+		}
+
+		ok = doc_append(&doc, &len, &size, "%s{\"url\":\"%s\",\"fileOffset\":%" PRIu64 ",\"fileSize\":%" PRIu64 ",\"hashValue\":\"%s\"}",
+			i > 0 ? "," : "", url, (uint64_t)i * UINT64_C(4294967296), UINT64_C(4294967296), hash);
+
+		if (url != urls[i]) {
+			free(url);
+		}
+	}
+	ok = ok && doc_append(&doc, &len, &size, "]}");
+
+	corpus_free_strings(urls, piece_count);
+
+	if (!ok) {
+		free(doc);
+		return NULL;
+	}
+
+	return doc;
+}
+
+char** corpus_make_json_documents(size_t* count) {
+	char** docs;
+	size_t i;
+
+	*count = 6;
+
+	docs = (char**)calloc(*count, sizeof(*docs));
+	if (!docs) {
+		return NULL;
+	}
+
+	docs[0] = make_install_request(100, false, 11);
+	docs[1] = make_install_request(400, false, 12);
+	docs[2] = make_install_request(200, true, 13);
+	docs[3] = make_manifest(16, false, 14);
+	docs[4] = make_manifest(64, false, 15);
+	docs[5] = make_manifest(64, true, 16);
+
+	for (i = 0; i < *count; ++i) {
+		if (!docs[i]) {
+			corpus_free_strings(docs, *count);
+			return NULL;
+		}
+	}
+
+	return docs;
+}
+
+struct sfo_item {
+	char key[32];
+	const char* value; /* NULL for integers */
+};
+
+static int compare_sfo_items(const void* a, const void* b) {
+	return strcmp(((const struct sfo_item*)a)->key, ((const struct sfo_item*)b)->key);
+}
+
+void* corpus_make_sfo(size_t* size) {
+	static const char* const string_keys[][2] = {
+		{ "APP_VER", "01.00" },
+		{ "CATEGORY", "gd" },
+		{ "CONTENT_ID", "UP0001-CUSA12345_00-GAMEGAMEGAMEGAME" },
+		{ "FORMAT", "obs" },
+		{ "PUBTOOLINFO", "c_date=20200101,sdk_ver=07508001,st_type=digital50,img0_l0_size=8192,img0_l1_size=0,img0_sc_ksize=512,img0_pc_ksize=3072" },
+		{ "TITLE", "Shadow Legends of the Ancient Kingdom" },
+		{ "TITLE_ID", "CUSA12345" },
+		{ "VERSION", "01.00" },
+	};
+	static const char* const integer_keys[] = {
+		"APP_TYPE", "ATTRIBUTE", "ATTRIBUTE2", "DOWNLOAD_DATA_SIZE", "PARENTAL_LEVEL", "PUBTOOLVER",
+		"REMOTE_PLAY_KEY_ASSIGN", "SYSTEM_VER",
+	};
+	/* Localized titles, TITLE_00 to TITLE_29 on real packages. */
+	struct sfo_item items[ARRAY_SIZE(string_keys) + ARRAY_SIZE(integer_keys) + 30];
+	const size_t value_area = 128;
+	size_t key_table_size = 0;
+	size_t key_table_offset, value_table_offset, data_size;
+	size_t key_offset = 0;
+	size_t count = 0;
+	uint8_t* entry;
+	uint8_t* data;
+	uint32_t value;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(string_keys); ++i, ++count) {
+		strcpy(items[count].key, string_keys[i][0]);
+		items[count].value = string_keys[i][1];
+	}
+	for (i = 0; i < ARRAY_SIZE(integer_keys); ++i, ++count) {
+		strcpy(items[count].key, integer_keys[i]);
+		items[count].value = NULL;
+	}
+	for (i = 0; count < ARRAY_SIZE(items); ++i, ++count) {
+		snprintf(items[count].key, sizeof(items[count].key), "TITLE_%02zu", i);
+		items[count].value = string_keys[5][1];
+	}
+
+	/* Real key tables are sorted. */
+	qsort(items, count, sizeof(*items), &compare_sfo_items);
+
+	for (i = 0; i < count; ++i) {
+		key_table_size += strlen(items[i].key) + 1;
+	}
+
+	key_table_offset = 0x14 + count * 0x10;
+	value_table_offset = key_table_offset + ALIGN_UP(key_table_size, 4);
+	data_size = value_table_offset + count * value_area;
+
+	data = (uint8_t*)calloc(1, data_size);
+	if (!data) {
+		return NULL;
+	}
+
+	memcpy(data, "\0PSF", 4);
+	*(uint32_t*)(data + 0x04) = LE32(0x101);
+	*(uint32_t*)(data + 0x08) = LE32((uint32_t)key_table_offset);
+	*(uint32_t*)(data + 0x0C) = LE32((uint32_t)value_table_offset);
+	*(uint32_t*)(data + 0x10) = LE32((uint32_t)count);
+
+	for (i = 0; i < count; ++i) {
+		entry = data + 0x14 + i * 0x10;
+
+		*(uint16_t*)(entry + 0x00) = LE16((uint16_t)key_offset);
+		*(uint32_t*)(entry + 0x08) = LE32((uint32_t)value_area);
+		*(uint32_t*)(entry + 0x0C) = LE32((uint32_t)(i * value_area));
+
+		strcpy((char*)data + key_table_offset + key_offset, items[i].key);
+		key_offset += strlen(items[i].key) + 1;
+
+		if (items[i].value) {
+			*(uint16_t*)(entry + 0x02) = LE16(SFO_FORMAT_STRING);
+			*(uint32_t*)(entry + 0x04) = LE32((uint32_t)strlen(items[i].value) + 1);
+			strcpy((char*)data + value_table_offset + i * value_area, items[i].value);
+		} else {
+			value = (uint32_t)i;
+			*(uint16_t*)(entry + 0x02) = LE16(SFO_FORMAT_UINT32);
+			*(uint32_t*)(entry + 0x04) = LE32(sizeof(value));
+			memcpy(data + value_table_offset + i * value_area, &value, sizeof(value));
+		}
+	}
+
+	*size = data_size;
+
+	return data;
+}
+
+void corpus_free_strings(char** strs, size_t count) {
+	size_t i;
+
+	if (!strs) {
+		return;
+	}
+
+	for (i = 0; i < count; ++i) {
+		free(strs[i]);
+	}
+
+	free(strs);
+}
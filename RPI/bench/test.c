@@ -0,0 +1,309 @@
+#include "bench.h"
+
+#include "../sfo.h"
+#include "../tiny-json.h"
+#include "../uri.h"
+
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s(%d): check failed: %s: ", __FUNCTION__, __LINE__, #cond); \
+			fprintf(stderr, __VA_ARGS__); \
+			fprintf(stderr, "\n"); \
+			++s_failures; \
+		} \
+	} while (0)
+
+static unsigned int s_failures = 0;
+
+/* Bytes the scanners treat differently, plus ones around the edges of their ranges. */
+static const char s_interesting[] = "%%%aZ09-_.~+:/@ \"#?&[]{}<>\\^`|,;=!$'()*\x7F\x80\xFF\x01";
+
+static void random_string(uint32_t* state, char* buf, size_t len) {
+	size_t i;
+
+	for (i = 0; i < len; ++i) {
+		buf[i] = s_interesting[bench_random(state) % (sizeof(s_interesting) - 1)];
+	}
+	buf[len] = '\0';
+}
+
+static void test_uri_scanners(void) {
+	char buf[128];
+	uint32_t state = 1;
+	size_t offset, len, round;
+	const char* str;
+
+	/* Every alignment and every tail length of the vector loops. */
+	for (round = 0; round < 64; ++round) {
+		random_string(&state, buf, sizeof(buf) - 1);
+		for (offset = 0; offset < 16; ++offset) {
+			str = buf + offset;
+			for (len = 0; len + offset < sizeof(buf) - 1; ++len) {
+				CHECK(uri_find_percent_simd(str, len) == uri_find_percent_scalar(str, len), "offset %zu, length %zu", offset, len);
+				CHECK(uri_safe_prefix_length_simd(str, len) == uri_safe_prefix_length_scalar(str, len), "offset %zu, length %zu", offset, len);
+			}
+		}
+	}
+
+	/* Long safe runs, where the vector loops do all of the work. */
+	memset(buf, 'a', sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+	for (offset = 0; offset < sizeof(buf) - 1; ++offset) {
+		buf[offset] = '%';
+		CHECK(uri_find_percent_simd(buf, sizeof(buf) - 1) == offset, "offset %zu", offset);
+		CHECK(uri_safe_prefix_length_simd(buf, sizeof(buf) - 1) == offset, "offset %zu", offset);
+		buf[offset] = 'a';
+	}
+}
+
+static void check_codec(const char* str) {
+	char* encoded_simd;
+	char* encoded_scalar;
+	char* decoded_simd;
+	char* decoded_scalar;
+	size_t len_simd, len_scalar;
+
+	encoded_simd = uri_encode(str, &len_simd);
+	encoded_scalar = uri_encode_scalar(str, &len_scalar);
+	CHECK(encoded_simd && encoded_scalar, "'%s'", str);
+	if (!encoded_simd || !encoded_scalar) {
+		goto done;
+	}
+	CHECK(len_simd == len_scalar && strcmp(encoded_simd, encoded_scalar) == 0, "'%s'", str);
+
+	decoded_simd = strdup(encoded_simd);
+	decoded_scalar = strdup(str);
+	if (decoded_simd && decoded_scalar) {
+		/* Round trip gives back the input. */
+		len_simd = uri_decode_in_place(decoded_simd);
+		CHECK(len_simd == strlen(str) && strcmp(decoded_simd, str) == 0, "'%s'", str);
+
+		/* Both builds decode arbitrary input, malformed escapes included, the same way. */
+		strcpy(decoded_simd, str);
+		len_simd = uri_decode_in_place(decoded_simd);
+		len_scalar = uri_decode_in_place_scalar(decoded_scalar);
+		CHECK(len_simd == len_scalar && memcmp(decoded_simd, decoded_scalar, len_simd + 1) == 0, "'%s'", str);
+	}
+	free(decoded_simd);
+	free(decoded_scalar);
+
+done:
+	free(encoded_simd);
+	free(encoded_scalar);
+}
+
+static void test_uri_codec(void) {
+	char buf[128];
+	uint32_t state = 7;
+	char** urls;
+	size_t i;
+
+	urls = corpus_make_urls(256, 3);
+	CHECK(urls != NULL, "no memory");
+	for (i = 0; urls && i < 256; ++i) {
+		check_codec(urls[i]);
+	}
+	corpus_free_strings(urls, urls ? 256 : 0);
+
+	for (i = 0; i < 1024; ++i) {
+		random_string(&state, buf, bench_random(&state) % (sizeof(buf) - 1));
+		check_codec(buf);
+	}
+
+	check_codec("");
+	check_codec("%");
+	check_codec("%4");
+	check_codec("%zz%41%4a");
+}
+
+static void test_sfo_view(void) {
+	struct sfo_view_entry view_entry;
+	struct sfo_entry* entry;
+	struct sfo_view view;
+	struct sfo* sfo;
+	uint8_t* data;
+	size_t size, i;
+	char buf[8];
+
+	data = (uint8_t*)corpus_make_sfo(&size);
+	sfo = sfo_alloc();
+	CHECK(data && sfo, "no memory");
+	if (!data || !sfo) {
+		goto done;
+	}
+
+	CHECK(sfo_load_from_memory(sfo, data, size), "list loader failed");
+	CHECK(sfo_view_init(&view, data, size), "view failed");
+
+	/* Every key resolves to the same value either way. */
+	for (entry = sfo->entries; entry; entry = entry->next) {
+		CHECK(sfo_view_find(&view, entry->key, &view_entry), "%s", entry->key);
+		CHECK(view_entry.size == entry->size && view_entry.area == entry->area && view_entry.format == entry->format, "%s", entry->key);
+		CHECK(memcmp(view_entry.value, entry->value, entry->size) == 0, "%s", entry->key);
+	}
+
+	CHECK(!sfo_view_find(&view, "TITLE_30", NULL), "missing key found");
+	CHECK(!sfo_view_find(&view, "", NULL), "empty key found");
+	CHECK(!sfo_view_find(&view, "ZZZ", NULL), "key past the end found");
+
+	/* Strings are cut to the buffer, integers are not strings. */
+	CHECK(sfo_view_get_string(&view, "TITLE", buf, sizeof(buf)) && strcmp(buf, "Shadow ") == 0, "TITLE");
+	CHECK(!sfo_view_get_string(&view, "APP_TYPE", buf, sizeof(buf)), "APP_TYPE");
+	CHECK(sfo_view_get_string(&view, "CATEGORY", buf, sizeof(buf)) && strcmp(buf, "gd") == 0, "CATEGORY");
+
+	/* Truncated data is refused, never read past. */
+	g_bench_quiet = true;
+	for (i = 0; i < size; ++i) {
+		if (!sfo_view_init(&view, data, i)) {
+			continue;
+		}
+		for (entry = sfo->entries; entry; entry = entry->next) {
+			if (sfo_view_find(&view, entry->key, &view_entry)) {
+				CHECK((const uint8_t*)view_entry.value + view_entry.size <= data + i, "size %zu, %s", i, entry->key);
+			}
+		}
+	}
+	g_bench_quiet = false;
+
+done:
+	if (sfo) {
+		sfo_free(sfo);
+	}
+	free(data);
+}
+
+/* Same shape, names, types and values. */
+static bool json_equal(json_t const* a, json_t const* b) {
+	json_t const* ca;
+	json_t const* cb;
+
+	if (!a || !b) {
+		return a == b;
+	}
+	if (json_getType(a) != json_getType(b)) {
+		return false;
+	}
+	if ((json_getName(a) == NULL) != (json_getName(b) == NULL) || (json_getName(a) && strcmp(json_getName(a), json_getName(b)) != 0)) {
+		return false;
+	}
+
+	if (json_getType(a) == JSON_OBJ || json_getType(a) == JSON_ARRAY) {
+		for (ca = json_getChild(a), cb = json_getChild(b); ca && cb; ca = json_getSibling(ca), cb = json_getSibling(cb)) {
+			if (!json_equal(ca, cb)) {
+				return false;
+			}
+		}
+		return ca == cb;
+	}
+
+	return strcmp(json_getValue(a), json_getValue(b)) == 0;
+}
+
+static void check_parse(const char* doc, size_t len, json_t* mem_simd, json_t* mem_scalar, unsigned int qty, const char* what) {
+	json_t const* root_simd;
+	json_t const* root_scalar;
+	char* buf_simd;
+	char* buf_scalar;
+
+	buf_simd = (char*)malloc(len + 1);
+	buf_scalar = (char*)malloc(len + 1);
+	if (buf_simd && buf_scalar) {
+		memcpy(buf_simd, doc, len);
+		buf_simd[len] = '\0';
+		memcpy(buf_scalar, doc, len);
+		buf_scalar[len] = '\0';
+
+		root_simd = json_create(buf_simd, mem_simd, qty);
+		root_scalar = json_create_scalar(buf_scalar, mem_scalar, qty);
+		CHECK((root_simd == NULL) == (root_scalar == NULL), "%s", what);
+		CHECK(json_equal(root_simd, root_scalar), "%s", what);
+	}
+
+	free(buf_simd);
+	free(buf_scalar);
+}
+
+static void test_json_parse(void) {
+	static const char specials[] = "\"\\ \t\n\r\x01\x1F{}[],:0e-.tfn\x7F\x80\xFF";
+	static const char* const edge_cases[] = {
+		"{}", "[]", " { } ", "{\"a\":\"\\u0041\\n\\/\"}", "{\"a\":\"\x01\"}", "{\"a\":\"\\x\"}", "{\"a\":\"unterminated}",
+		"{\"a\":1}\t\n\r\f ", "{\"a\" :\t1 ,\n\"b\"\r:\f[ 1 , 2 ]}", "{\"a\":-1.5e+10,\"b\":true,\"c\":null}",
+	};
+	const unsigned int qty = 8192;
+	json_t* mem_simd;
+	json_t* mem_scalar;
+	uint32_t state = 5;
+	char what[64];
+	size_t count, len, i, j, k;
+	char** docs;
+	char* doc;
+
+	mem_simd = (json_t*)calloc(qty, sizeof(*mem_simd));
+	mem_scalar = (json_t*)calloc(qty, sizeof(*mem_scalar));
+	docs = corpus_make_json_documents(&count);
+	CHECK(mem_simd && mem_scalar && docs, "no memory");
+	if (!mem_simd || !mem_scalar || !docs) {
+		goto done;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(edge_cases); ++i) {
+		snprintf(what, sizeof(what), "edge case %zu", i);
+		check_parse(edge_cases[i], strlen(edge_cases[i]), mem_simd, mem_scalar, qty, what);
+	}
+
+	for (i = 0; i < count; ++i) {
+		len = strlen(docs[i]);
+
+		/* Corpus itself is valid. */
+		doc = strdup(docs[i]);
+		CHECK(doc && json_create(doc, mem_simd, qty) != NULL, "document %zu", i);
+		free(doc);
+
+		snprintf(what, sizeof(what), "document %zu", i);
+		check_parse(docs[i], len, mem_simd, mem_scalar, qty, what);
+
+		/* Truncations and corruptions hit every block boundary of the vector loops. */
+		for (j = 0; j < 64; ++j) {
+			snprintf(what, sizeof(what), "document %zu cut at %zu", i, len - j);
+			check_parse(docs[i], len - j, mem_simd, mem_scalar, qty, what);
+		}
+
+		doc = strdup(docs[i]);
+		for (j = 0; doc && j < 256; ++j) {
+			k = bench_random(&state) % len;
+			doc[k] = specials[bench_random(&state) % (sizeof(specials) - 1)];
+			snprintf(what, sizeof(what), "document %zu corrupted at %zu", i, k);
+			check_parse(doc, len, mem_simd, mem_scalar, qty, what);
+			doc[k] = docs[i][k];
+		}
+		free(doc);
+	}
+
+done:
+	corpus_free_strings(docs, docs ? count : 0);
+	free(mem_simd);
+	free(mem_scalar);
+}
+
+int main(void) {
+	static const struct {
+		const char* name;
+		void (*fn)(void);
+	} tests[] = {
+		{ "uri_scanners", &test_uri_scanners },
+		{ "uri_codec", &test_uri_codec },
+		{ "sfo_view", &test_sfo_view },
+		{ "json_parse", &test_json_parse },
+	};
+	unsigned int failures;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(tests); ++i) {
+		failures = s_failures;
+		tests[i].fn();
+		printf("%-24s %s\n", tests[i].name, s_failures == failures ? "ok" : "FAILED");
+	}
+
+	return s_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
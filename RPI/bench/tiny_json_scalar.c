@@ -0,0 +1,9 @@
+/* Scalar build of tiny-json.c, the makefile keeps only the *_scalar symbols global. */
+
+#define JSON_NO_SIMD
+
+#include "../tiny-json.c"
+
+json_t const* json_create_scalar(char* str, json_t mem[], unsigned int qty) {
+	return json_create(str, mem, qty);
+}
@@ -0,0 +1,23 @@
+/* Scalar build of uri.c, the makefile keeps only the *_scalar symbols global. */
+
+#define URI_NO_SIMD
+
+#include "../uri.c"
+
+size_t uri_find_percent_scalar(const char* str, size_t len) {
+	return find_percent(str, len);
+}
+
+size_t uri_safe_prefix_length_scalar(const char* str, size_t len) {
+	pthread_once(&s_tables_once, &init_tables);
+
+	return safe_prefix_length(str, len);
+}
+
+size_t uri_decode_in_place_scalar(char* str) {
+	return uri_decode_in_place(str);
+}
+
+char* uri_encode_scalar(const char* in, size_t* out_len) {
+	return uri_encode(in, out_len);
+}
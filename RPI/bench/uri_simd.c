@@ -0,0 +1,13 @@
+/* Regular build of uri.c, with its scanners exposed to the bench. */
+
+#include "../uri.c"
+
+size_t uri_find_percent_simd(const char* str, size_t len) {
+	return find_percent(str, len);
+}
+
+size_t uri_safe_prefix_length_simd(const char* str, size_t len) {
+	pthread_once(&s_tables_once, &init_tables);
+
+	return safe_prefix_length(str, len);
+}
@@ -0,0 +1,562 @@
+#include "catalog.h"
+#include "sfo.h"
+#include "util.h"
+#include "dirent.h"
+
+#include <orbis/libkernel.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "uthash.h"
+
+#define CATALOG_MAX_ROOTS 8
+#define CATALOG_MAX_DEPTH 2
+#define CATALOG_SCAN_INTERVAL_SECS 30
+#define CATALOG_MAX_PARAM_SFO_SIZE (64 * 1024)
+
+struct catalog_entry {
+	struct catalog_entry_info info;
+	unsigned int generation;
+	bool is_valid;
+	struct catalog_entry* title_next;
+	UT_hash_handle hh;     /* by path */
+	UT_hash_handle hh_cid; /* by content id */
+};
+
+struct catalog_title {
+	char title_id[PKG_TITLE_ID_SIZE + 1];
+	struct catalog_entry* entries;
+	size_t entry_count;
+	UT_hash_handle hh;
+};
+
+static char* s_roots[CATALOG_MAX_ROOTS];
+static size_t s_root_count = 0;
+
+static struct catalog_entry* s_entries_by_path = NULL;
+static struct catalog_entry* s_entries_by_content_id = NULL;
+static struct catalog_title* s_titles = NULL;
+
+static unsigned int s_generation = 0;
+
+static pthread_mutex_t s_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t s_thread;
+static bool s_rescan_requested = false;
+static bool s_stop_requested = false;
+
+static bool s_catalog_initialized = false;
+
+static void* scan_thread(void* arg);
+static void scan_all(void);
+static void scan_dir(const char* dir_path, int depth, unsigned int generation, bool* changed);
+static void scan_file(const char* path, unsigned int generation, bool* changed);
+static bool parse_package(const char* path, struct catalog_entry_info* info);
+static void rebuild_indexes(void);
+static void clear_titles(void);
+
+bool catalog_init(const char* const* roots, size_t root_count) {
+	size_t i;
+	int ret;
+
+	if (s_catalog_initialized) {
+		goto done;
+	}
+
+	if (!roots || root_count == 0 || root_count > CATALOG_MAX_ROOTS) {
+		EPRINTF("Invalid catalog roots specified.\n");
+		goto err;
+	}
+
+	for (i = 0; i < root_count; ++i) {
+		s_roots[i] = strdup(roots[i]);
+		if (!s_roots[i]) {
+			EPRINTF("No memory.\n");
+			goto err_roots_free;
+		}
+	}
+	s_root_count = root_count;
+
+	s_rescan_requested = true;
+	s_stop_requested = false;
+
+	ret = pthread_create(&s_thread, NULL, &scan_thread, NULL);
+	if (ret) {
+		EPRINTF("pthread_create failed: %d\n", ret);
+		goto err_roots_free;
+	}
+
+	s_catalog_initialized = true;
+
+done:
+	return true;
+
+err_roots_free:
+	for (i = 0; i < root_count; ++i) {
+		free(s_roots[i]);
+		s_roots[i] = NULL;
+	}
+	s_root_count = 0;
+
+err:
+	return false;
+}
+
+void catalog_fini(void) {
+	struct catalog_entry* entry;
+	struct catalog_entry* tmp;
+	size_t i;
+
+	if (!s_catalog_initialized) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	s_stop_requested = true;
+	pthread_cond_signal(&s_cond);
+	pthread_mutex_unlock(&s_mtx);
+
+	pthread_join(s_thread, NULL);
+
+	pthread_mutex_lock(&s_mtx);
+	clear_titles();
+	HASH_CLEAR(hh_cid, s_entries_by_content_id);
+	HASH_ITER(hh, s_entries_by_path, entry, tmp) {
+		HASH_DELETE(hh, s_entries_by_path, entry);
+		free(entry);
+	}
+	pthread_mutex_unlock(&s_mtx);
+
+	for (i = 0; i < s_root_count; ++i) {
+		free(s_roots[i]);
+		s_roots[i] = NULL;
+	}
+	s_root_count = 0;
+
+	s_catalog_initialized = false;
+}
+
+void catalog_rescan(void) {
+	if (!s_catalog_initialized) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	s_rescan_requested = true;
+	pthread_cond_signal(&s_cond);
+	pthread_mutex_unlock(&s_mtx);
+}
+
+size_t catalog_enumerate(const char* title_id, size_t offset, size_t limit, catalog_enum_cb* cb, void* arg, size_t* total_count) {
+	struct catalog_title* title;
+	struct catalog_entry* entry;
+	size_t total = 0;
+	size_t count = 0;
+	size_t index = 0;
+
+	assert(cb != NULL);
+
+	pthread_mutex_lock(&s_mtx);
+
+	if (title_id) {
+		HASH_FIND_STR(s_titles, title_id, title);
+		if (title) {
+			total = title->entry_count;
+			for (entry = title->entries; entry && count < limit; entry = entry->title_next, ++index) {
+				if (index < offset) {
+					continue;
+				}
+				++count;
+				if (!(*cb)(arg, &entry->info)) {
+					break;
+				}
+			}
+		}
+	} else {
+		total = HASH_CNT(hh_cid, s_entries_by_content_id);
+		for (entry = s_entries_by_content_id; entry && count < limit; entry = (struct catalog_entry*)entry->hh_cid.next, ++index) {
+			if (index < offset) {
+				continue;
+			}
+			++count;
+			if (!(*cb)(arg, &entry->info)) {
+				break;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+
+	if (total_count) {
+		*total_count = total;
+	}
+
+	return count;
+}
+
+bool catalog_find_by_content_id(const char* content_id, struct catalog_entry_info* info) {
+	struct catalog_entry* entry;
+
+	assert(content_id != NULL);
+
+	pthread_mutex_lock(&s_mtx);
+
+	HASH_FIND(hh_cid, s_entries_by_content_id, content_id, strlen(content_id), entry);
+	if (entry && info) {
+		memcpy(info, &entry->info, sizeof(*info));
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+
+	return entry != NULL;
+}
+
+static void* scan_thread(void* arg) {
+	struct timespec deadline;
+
+	UNUSED(arg);
+
+	for (;;) {
+		pthread_mutex_lock(&s_mtx);
+		if (!s_rescan_requested && !s_stop_requested) {
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_sec += CATALOG_SCAN_INTERVAL_SECS;
+			pthread_cond_timedwait(&s_cond, &s_mtx, &deadline);
+		}
+		if (s_stop_requested) {
+			pthread_mutex_unlock(&s_mtx);
+			break;
+		}
+		s_rescan_requested = false;
+		pthread_mutex_unlock(&s_mtx);
+
+		scan_all();
+	}
+
+	return NULL;
+}
+
+static void scan_all(void) {
+	struct catalog_entry* entry;
+	struct catalog_entry* tmp;
+	unsigned int generation;
+	bool changed = false;
+	size_t i;
+
+	generation = ++s_generation;
+
+	for (i = 0; i < s_root_count; ++i) {
+		scan_dir(s_roots[i], 0, generation, &changed);
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	/* Drop packages which have disappeared since last scan. */
+	HASH_ITER(hh, s_entries_by_path, entry, tmp) {
+		if (entry->generation == generation) {
+			continue;
+		}
+		if (entry->is_valid) {
+			changed = true;
+		}
+		HASH_DELETE(hh, s_entries_by_path, entry);
+		if (entry->is_valid) {
+			/* It may be referenced by content id index, so rebuild it before freeing. */
+			HASH_CLEAR(hh_cid, s_entries_by_content_id);
+			clear_titles();
+		}
+		free(entry);
+	}
+
+	if (changed) {
+		rebuild_indexes();
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+}
+
+static void scan_dir(const char* dir_path, int depth, unsigned int generation, bool* changed) {
+	char full_path[CATALOG_PATH_SIZE];
+	char buf[8192];
+	struct dirent* entry;
+	int fd = -1;
+	int ret;
+
+	fd = ret = sceKernelOpen(dir_path, O_RDONLY, 0);
+	if (ret < 0) {
+		/* Root may be missing (e.g. USB storage is not plugged in). */
+		goto err;
+	}
+
+	for (;;) {
+		memset(buf, 0, sizeof(buf));
+
+		ret = sceKernelGetdents(fd, buf, sizeof(buf));
+		if (ret < 0) {
+			EPRINTF("sceKernelGetdents failed: 0x%08X\n", ret);
+			goto err;
+		}
+		if (ret == 0) {
+			break;
+		}
+		entry = (struct dirent*)buf;
+
+		while (entry->d_fileno != 0) {
+			if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+				snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, entry->d_name);
+
+				// #define DT_DIR 4
+				// #define DT_REG 8
+				if (entry->d_type == 4) {
+					if (depth < CATALOG_MAX_DEPTH) {
+						scan_dir(full_path, depth + 1, generation, changed);
+					}
+				} else if (entry->d_type == 8 && ends_with_nocase(entry->d_name, ".pkg")) {
+					scan_file(full_path, generation, changed);
+				}
+			}
+
+			entry = (struct dirent*)((char*)entry + entry->d_reclen);
+		}
+	}
+
+err:
+	if (fd > 0) {
+		ret = sceKernelClose(fd);
+		if (ret) {
+			EPRINTF("sceKernelClose failed: 0x%08X\n", ret);
+		}
+	}
+}
+
+static void scan_file(const char* path, unsigned int generation, bool* changed) {
+	struct catalog_entry_info info;
+	struct catalog_entry* entry;
+	struct stat stbuf;
+	bool is_valid;
+	int ret;
+
+	ret = stat(path, &stbuf);
+	if (ret < 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	HASH_FIND_STR(s_entries_by_path, path, entry);
+	if (entry && entry->info.file_size == (uint64_t)stbuf.st_size && entry->info.mtime == stbuf.st_mtime) {
+		/* Unchanged since last scan, skip parsing. */
+		entry->generation = generation;
+		pthread_mutex_unlock(&s_mtx);
+		return;
+	}
+	pthread_mutex_unlock(&s_mtx);
+
+	memset(&info, 0, sizeof(info));
+	is_valid = parse_package(path, &info);
+	strlcpy(info.path, path, sizeof(info.path));
+	info.file_size = (uint64_t)stbuf.st_size;
+	info.mtime = stbuf.st_mtime;
+
+	pthread_mutex_lock(&s_mtx);
+	HASH_FIND_STR(s_entries_by_path, path, entry);
+	if (!entry) {
+		entry = (struct catalog_entry*)malloc(sizeof(*entry));
+		if (!entry) {
+			EPRINTF("No memory.\n");
+			goto done;
+		}
+		memset(entry, 0, sizeof(*entry));
+		memcpy(&entry->info, &info, sizeof(info));
+		HASH_ADD_STR(s_entries_by_path, info.path, entry);
+	} else {
+		memcpy(&entry->info, &info, sizeof(info));
+	}
+	entry->is_valid = is_valid;
+	entry->generation = generation;
+
+	*changed = true;
+
+done:
+	pthread_mutex_unlock(&s_mtx);
+}
+
+static bool read_at(int fd, uint64_t offset, void* data, size_t size) {
+	uint8_t* p = (uint8_t*)data;
+	ssize_t n;
+
+	while (size > 0) {
+		n = pread(fd, p, size, (off_t)offset);
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		offset += n;
+		size -= n;
+	}
+
+	return true;
+}
+
+static bool parse_package(const char* path, struct catalog_entry_info* info) {
+	struct pkg_header* hdr = NULL;
+	struct pkg_table_entry* entries = NULL;
+	struct pkg_content_info content_info;
+	struct sfo_view sfo_view;
+	uint8_t* param_sfo_data = NULL;
+	uint32_t param_sfo_offset = 0, param_sfo_size = 0;
+	size_t entry_count;
+	char title_entry_key[16];
+	int lang_id;
+	int fd = -1;
+	bool status = false;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		goto err;
+	}
+
+	hdr = (struct pkg_header*)malloc(sizeof(*hdr));
+	if (!hdr) {
+		EPRINTF("No memory.\n");
+		goto err;
+	}
+	if (!read_at(fd, 0, hdr, sizeof(*hdr))) {
+		goto err;
+	}
+	if (!pkg_is_valid_header(hdr)) {
+		/* Not a package or one of non-first split pieces. */
+		goto err;
+	}
+
+	entry_count = BE32(hdr->entry_count);
+	if (entry_count == 0) {
+		goto err;
+	}
+	entries = (struct pkg_table_entry*)malloc(entry_count * sizeof(*entries));
+	if (!entries) {
+		EPRINTF("No memory.\n");
+		goto err;
+	}
+	if (!read_at(fd, BE32(hdr->entry_table_offset), entries, entry_count * sizeof(*entries))) {
+		goto err;
+	}
+
+	strlcpy(info->content_id, hdr->content_id, sizeof(info->content_id));
+	if (pkg_parse_content_id(info->content_id, &content_info)) {
+		strlcpy(info->title_id, content_info.title_id, sizeof(info->title_id));
+	}
+	info->content_type = (enum pkg_content_type)BE32(hdr->content_type);
+	info->content_flags = BE32(hdr->content_flags);
+	info->package_size = BE64(hdr->package_size);
+	info->is_patch = pkg_is_patch(hdr);
+
+	pkg_find_entry(entries, entry_count, PKG_ENTRY_ID__ICON0_PNG, &info->icon0_png_offset, &info->icon0_png_size);
+
+	if (pkg_find_entry(entries, entry_count, PKG_ENTRY_ID__PARAM_SFO, &param_sfo_offset, &param_sfo_size) && param_sfo_size > 0 && param_sfo_size <= CATALOG_MAX_PARAM_SFO_SIZE) {
+		param_sfo_data = (uint8_t*)malloc(param_sfo_size);
+		if (!param_sfo_data) {
+			EPRINTF("No memory.\n");
+			goto err;
+		}
+		if (!read_at(fd, param_sfo_offset, param_sfo_data, param_sfo_size)) {
+			goto err;
+		}
+
+		if (sfo_view_init(&sfo_view, param_sfo_data, param_sfo_size)) {
+			if (!get_language_id(&lang_id)) {
+				lang_id = 1;
+			}
+
+			snprintf(title_entry_key, sizeof(title_entry_key), "TITLE_%02d", lang_id);
+			if (!sfo_view_get_string(&sfo_view, title_entry_key, info->title, sizeof(info->title))) {
+				sfo_view_get_string(&sfo_view, "TITLE", info->title, sizeof(info->title));
+			}
+		}
+	}
+
+	status = true;
+
+err:
+	if (param_sfo_data) {
+		free(param_sfo_data);
+	}
+
+	if (entries) {
+		free(entries);
+	}
+
+	if (hdr) {
+		free(hdr);
+	}
+
+	if (fd > 0) {
+		close(fd);
+	}
+
+	return status;
+}
+
+static int compare_by_content_id(void* a, void* b) {
+	return strcmp(((struct catalog_entry*)a)->info.content_id, ((struct catalog_entry*)b)->info.content_id);
+}
+
+static void rebuild_indexes(void) {
+	struct catalog_entry* entry;
+	struct catalog_entry* existing;
+	struct catalog_entry** tail;
+	struct catalog_title* title;
+
+	HASH_CLEAR(hh_cid, s_entries_by_content_id);
+	clear_titles();
+
+	for (entry = s_entries_by_path; entry; entry = (struct catalog_entry*)entry->hh.next) {
+		entry->title_next = NULL;
+
+		if (!entry->is_valid) {
+			continue;
+		}
+
+		/* The same package may be present on several roots, index the first one only. */
+		HASH_FIND(hh_cid, s_entries_by_content_id, entry->info.content_id, strlen(entry->info.content_id), existing);
+		if (existing) {
+			continue;
+		}
+		HASH_ADD(hh_cid, s_entries_by_content_id, info.content_id, strlen(entry->info.content_id), entry);
+	}
+
+	HASH_SRT(hh_cid, s_entries_by_content_id, compare_by_content_id);
+
+	/* Group entries by title id keeping content id ordering. */
+	for (entry = s_entries_by_content_id; entry; entry = (struct catalog_entry*)entry->hh_cid.next) {
+		if (entry->info.title_id[0] == '\0') {
+			continue;
+		}
+
+		HASH_FIND_STR(s_titles, entry->info.title_id, title);
+		if (!title) {
+			title = (struct catalog_title*)malloc(sizeof(*title));
+			if (!title) {
+				EPRINTF("No memory.\n");
+				continue;
+			}
+			memset(title, 0, sizeof(*title));
+			strlcpy(title->title_id, entry->info.title_id, sizeof(title->title_id));
+			HASH_ADD_STR(s_titles, title_id, title);
+		}
+
+		for (tail = &title->entries; *tail; tail = &(*tail)->title_next);
+		*tail = entry;
+		++title->entry_count;
+	}
+}
+
+static void clear_titles(void) {
+	struct catalog_title* title;
+	struct catalog_title* tmp;
+
+	HASH_ITER(hh, s_titles, title, tmp) {
+		HASH_DEL(s_titles, title);
+		free(title);
+	}
+}
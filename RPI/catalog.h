@@ -0,0 +1,35 @@
+#pragma once
+
+#include "common.h"
+#include "pkg.h"
+
+#include <time.h>
+
+#define CATALOG_PATH_SIZE 1024
+#define CATALOG_TITLE_SIZE 256
+
+struct catalog_entry_info {
+	char path[CATALOG_PATH_SIZE];
+	char content_id[PKG_CONTENT_ID_SIZE + 1];
+	char title_id[PKG_TITLE_ID_SIZE + 1];
+	char title[CATALOG_TITLE_SIZE];
+	enum pkg_content_type content_type;
+	uint32_t content_flags;
+	uint64_t package_size;
+	bool is_patch;
+	uint32_t icon0_png_offset;
+	uint32_t icon0_png_size;
+	uint64_t file_size;
+	time_t mtime;
+};
+
+/* Return false to stop enumeration. */
+typedef bool catalog_enum_cb(void* arg, const struct catalog_entry_info* info);
+
+bool catalog_init(const char* const* roots, size_t root_count);
+void catalog_fini(void);
+
+void catalog_rescan(void);
+
+size_t catalog_enumerate(const char* title_id, size_t offset, size_t limit, catalog_enum_cb* cb, void* arg, size_t* total_count);
+bool catalog_find_by_content_id(const char* content_id, struct catalog_entry_info* info);
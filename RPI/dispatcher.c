@@ -0,0 +1,330 @@
+#include "dispatcher.h"
+#include "util.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define DISPATCHER_MAX_BATCH 32
+#define DISPATCHER_MAX_OPS 32
+
+/* Lives on the stack of the calling thread until it is done. */
+struct dispatcher_cmd {
+	struct dispatcher_cmd* next;
+	size_t op;
+	void* arg;
+	uint64_t queued_usecs;
+	bool done;
+};
+
+static const struct dispatcher_op_desc* s_ops = NULL;
+static size_t s_op_count = 0;
+static struct dispatcher_op_stats s_stats[DISPATCHER_MAX_OPS];
+static pthread_mutex_t s_stats_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Intrusive multi-producer single-consumer queue. Producers only exchange the head,
+ * the dispatcher thread is the only one walking from the tail.
+ */
+static struct dispatcher_cmd s_stub;
+static struct dispatcher_cmd* s_head = &s_stub;
+static struct dispatcher_cmd* s_tail = &s_stub;
+
+/* Only used to sleep and wake up the dispatcher thread, and to report completions. */
+static pthread_mutex_t s_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t s_done_cond = PTHREAD_COND_INITIALIZER;
+static bool s_sleeping = false;
+static bool s_stop_requested = false;
+
+static pthread_t s_thread;
+
+static bool s_dispatcher_initialized = false;
+
+static void* dispatcher_thread(void* arg);
+static void run_batch(struct dispatcher_cmd** batch, size_t count);
+static void push_cmd(struct dispatcher_cmd* cmd);
+static struct dispatcher_cmd* pop_cmd(void);
+static bool is_queue_empty(void);
+static void run_inline(size_t op, void* arg);
+static void add_sample(struct dispatcher_op_stats* stats, uint64_t wait_usecs, uint64_t run_usecs, bool merged);
+static uint64_t now_usecs(void);
+
+bool dispatcher_init(const struct dispatcher_op_desc* ops, size_t op_count) {
+	size_t i;
+	int ret;
+
+	if (s_dispatcher_initialized) {
+		goto done;
+	}
+
+	if (!ops || op_count == 0 || op_count > DISPATCHER_MAX_OPS) {
+		EPRINTF("Invalid operation table.\n");
+		goto err;
+	}
+
+	s_ops = ops;
+	s_op_count = op_count;
+
+	memset(s_stats, 0, sizeof(s_stats));
+	for (i = 0; i < op_count; ++i) {
+		s_stats[i].name = ops[i].name;
+	}
+
+	memset(&s_stub, 0, sizeof(s_stub));
+	s_head = s_tail = &s_stub;
+	s_sleeping = false;
+	s_stop_requested = false;
+
+	ret = pthread_create(&s_thread, NULL, &dispatcher_thread, NULL);
+	if (ret) {
+		EPRINTF("pthread_create failed: %d\n", ret);
+		goto err;
+	}
+
+	s_dispatcher_initialized = true;
+
+done:
+	return true;
+
+err:
+	return false;
+}
+
+/* Callers must be gone by now, queued calls are still run. */
+void dispatcher_fini(void) {
+	if (!s_dispatcher_initialized) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	s_stop_requested = true;
+	pthread_cond_signal(&s_cond);
+	pthread_mutex_unlock(&s_mtx);
+
+	pthread_join(s_thread, NULL);
+
+	s_dispatcher_initialized = false;
+}
+
+bool dispatcher_call(size_t op, void* arg) {
+	struct dispatcher_cmd cmd;
+
+	if (!s_dispatcher_initialized) {
+		return false;
+	}
+
+	assert(op < s_op_count);
+
+	if (pthread_equal(pthread_self(), s_thread)) {
+		run_inline(op, arg);
+		return true;
+	}
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.op = op;
+	cmd.arg = arg;
+	cmd.queued_usecs = now_usecs();
+
+	push_cmd(&cmd);
+
+	/* Pairs with the store in the dispatcher thread, one of both sides sees the other. */
+	if (__atomic_load_n(&s_sleeping, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&s_mtx);
+		pthread_cond_signal(&s_cond);
+		pthread_mutex_unlock(&s_mtx);
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	while (!cmd.done) {
+		pthread_cond_wait(&s_done_cond, &s_mtx);
+	}
+	pthread_mutex_unlock(&s_mtx);
+
+	return true;
+}
+
+size_t dispatcher_get_stats(struct dispatcher_op_stats* stats, size_t max_count) {
+	size_t count;
+
+	assert(stats != NULL || max_count == 0);
+
+	count = s_op_count < max_count ? s_op_count : max_count;
+
+	pthread_mutex_lock(&s_stats_mtx);
+	memcpy(stats, s_stats, count * sizeof(*stats));
+	pthread_mutex_unlock(&s_stats_mtx);
+
+	return count;
+}
+
+static void* dispatcher_thread(void* arg) {
+	struct dispatcher_cmd* batch[DISPATCHER_MAX_BATCH];
+	struct dispatcher_cmd* cmd;
+	size_t count;
+	bool stop;
+
+	UNUSED(arg);
+
+	for (;;) {
+		count = 0;
+		while (count < ARRAY_SIZE(batch) && (cmd = pop_cmd()) != NULL) {
+			batch[count++] = cmd;
+		}
+
+		if (count > 0) {
+			run_batch(batch, count);
+			continue;
+		}
+
+		if (!is_queue_empty()) {
+			/* Producer is in the middle of linking its command. */
+			sched_yield();
+			continue;
+		}
+
+		pthread_mutex_lock(&s_mtx);
+		__atomic_store_n(&s_sleeping, true, __ATOMIC_SEQ_CST);
+		while (!s_stop_requested && is_queue_empty()) {
+			pthread_cond_wait(&s_cond, &s_mtx);
+		}
+		__atomic_store_n(&s_sleeping, false, __ATOMIC_SEQ_CST);
+		stop = s_stop_requested && is_queue_empty();
+		pthread_mutex_unlock(&s_mtx);
+
+		if (stop) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Runs a batch in queue order. A call directly following one of the same operation may take over
+ * its results instead, e.g. progress reads of the same task. All callers are woken at once afterwards.
+ */
+static void run_batch(struct dispatcher_cmd** batch, size_t count) {
+	const struct dispatcher_op_desc* desc;
+	struct dispatcher_cmd* cmd;
+	struct dispatcher_cmd* prev = NULL;
+	uint64_t wait_usecs[DISPATCHER_MAX_BATCH];
+	uint64_t run_usecs[DISPATCHER_MAX_BATCH];
+	bool merged[DISPATCHER_MAX_BATCH];
+	uint64_t start;
+	size_t i;
+
+	for (i = 0; i < count; ++i) {
+		cmd = batch[i];
+		desc = &s_ops[cmd->op];
+
+		start = now_usecs();
+		wait_usecs[i] = start - cmd->queued_usecs;
+
+		merged[i] = prev && prev->op == cmd->op && desc->merge && (*desc->merge)(cmd->arg, prev->arg);
+		if (!merged[i]) {
+			(*desc->cb)(cmd->arg);
+		}
+
+		run_usecs[i] = now_usecs() - start;
+		prev = cmd;
+	}
+
+	pthread_mutex_lock(&s_stats_mtx);
+	for (i = 0; i < count; ++i) {
+		add_sample(&s_stats[batch[i]->op], wait_usecs[i], run_usecs[i], merged[i]);
+	}
+	pthread_mutex_unlock(&s_stats_mtx);
+
+	/* Commands belong to their callers again once done is set. */
+	pthread_mutex_lock(&s_mtx);
+	for (i = 0; i < count; ++i) {
+		batch[i]->done = true;
+	}
+	pthread_cond_broadcast(&s_done_cond);
+	pthread_mutex_unlock(&s_mtx);
+}
+
+static void push_cmd(struct dispatcher_cmd* cmd) {
+	struct dispatcher_cmd* prev;
+
+	__atomic_store_n(&cmd->next, NULL, __ATOMIC_RELAXED);
+	prev = __atomic_exchange_n(&s_head, cmd, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&prev->next, cmd, __ATOMIC_RELEASE);
+}
+
+/* Dispatcher thread only. Returns null if empty, or if a producer has not linked its command yet. */
+static struct dispatcher_cmd* pop_cmd(void) {
+	struct dispatcher_cmd* tail = s_tail;
+	struct dispatcher_cmd* next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+	if (tail == &s_stub) {
+		if (!next) {
+			return NULL;
+		}
+		s_tail = tail = next;
+		next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+	}
+
+	if (next) {
+		s_tail = next;
+		return tail;
+	}
+
+	if (tail != __atomic_load_n(&s_head, __ATOMIC_SEQ_CST)) {
+		return NULL;
+	}
+
+	/* Last command, the stub takes its place as tail. */
+	push_cmd(&s_stub);
+
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (next) {
+		s_tail = next;
+		return tail;
+	}
+
+	return NULL;
+}
+
+/* Dispatcher thread only. */
+static bool is_queue_empty(void) {
+	return s_tail == &s_stub && __atomic_load_n(&s_head, __ATOMIC_SEQ_CST) == &s_stub;
+}
+
+static void run_inline(size_t op, void* arg) {
+	uint64_t start;
+
+	start = now_usecs();
+	(*s_ops[op].cb)(arg);
+
+	pthread_mutex_lock(&s_stats_mtx);
+	add_sample(&s_stats[op], 0, now_usecs() - start, false);
+	pthread_mutex_unlock(&s_stats_mtx);
+}
+
+/* Must be called with the stats lock held. */
+static void add_sample(struct dispatcher_op_stats* stats, uint64_t wait_usecs, uint64_t run_usecs, bool merged) {
+	++stats->calls;
+	if (merged) {
+		++stats->merged_calls;
+	}
+
+	stats->wait_usecs_total += wait_usecs;
+	if (wait_usecs > stats->wait_usecs_max) {
+		stats->wait_usecs_max = wait_usecs;
+	}
+
+	stats->run_usecs_total += run_usecs;
+	if (run_usecs > stats->run_usecs_max) {
+		stats->run_usecs_max = run_usecs;
+	}
+}
+
+static uint64_t now_usecs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "common.h"
+
+typedef void dispatcher_cb(void* arg);
+
+/* Fills results of arg from prev_arg if both ask for the same thing, returns false otherwise. */
+typedef bool dispatcher_merge_cb(void* arg, const void* prev_arg);
+
+struct dispatcher_op_desc {
+	const char* name;
+	dispatcher_cb* cb;
+	dispatcher_merge_cb* merge; /* optional, for consecutive calls of the same operation */
+};
+
+struct dispatcher_op_stats {
+	const char* name;
+	uint64_t calls;
+	uint64_t merged_calls;
+	uint64_t wait_usecs_total; /* time spent in the queue */
+	uint64_t wait_usecs_max;
+	uint64_t run_usecs_total;
+	uint64_t run_usecs_max;
+};
+
+/* Starts the thread that runs all operations of ops, table must stay valid until dispatcher_fini(). */
+bool dispatcher_init(const struct dispatcher_op_desc* ops, size_t op_count);
+void dispatcher_fini(void);
+
+/*
+ * Queues a call of ops[op] and blocks until the dispatcher thread has run it, calls from that thread itself run inline.
+ * Returns false if the dispatcher is not running, the caller should run the operation on its own then.
+ */
+bool dispatcher_call(size_t op, void* arg);
+
+/* Returns number of operations copied. */
+size_t dispatcher_get_stats(struct dispatcher_op_stats* stats, size_t max_count);
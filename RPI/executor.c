@@ -0,0 +1,263 @@
+#include "executor.h"
+#include "uri.h"
+
+#include <pthread.h>
+
+#include "utlist.h"
+
+struct executor_job {
+	executor_cb* cb;
+	void* arg;
+	struct executor_group* group;
+	char host[URI_HOST_SIZE];
+	struct executor_job* prev;
+	struct executor_job* next;
+};
+
+struct host_slot {
+	char host[URI_HOST_SIZE];
+	unsigned int active; /* slot is free if zero */
+};
+
+static pthread_t s_threads[EXECUTOR_MAX_THREADS];
+static unsigned int s_thread_count = 0;
+static unsigned int s_per_host_limit = 1;
+
+/* At most one slot per running job is needed. */
+static struct host_slot s_hosts[EXECUTOR_MAX_THREADS];
+
+static struct executor_job* s_queue = NULL;
+
+static pthread_mutex_t s_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t s_done_cond = PTHREAD_COND_INITIALIZER;
+static bool s_stop_requested = false;
+
+static bool s_executor_initialized = false;
+
+static void* worker_thread(void* arg);
+static struct executor_job* take_runnable_job(struct host_slot** slot);
+static struct host_slot* find_host_slot(const char* host);
+static void complete_job(struct executor_job* job);
+
+bool executor_init(unsigned int thread_count, unsigned int per_host_limit) {
+	unsigned int i;
+	int ret;
+
+	if (s_executor_initialized) {
+		goto done;
+	}
+
+	if (thread_count == 0 || thread_count > EXECUTOR_MAX_THREADS) {
+		EPRINTF("Invalid thread count: %u\n", thread_count);
+		goto err;
+	}
+
+	memset(s_hosts, 0, sizeof(s_hosts));
+	s_per_host_limit = per_host_limit > 0 ? per_host_limit : 1;
+	s_stop_requested = false;
+	s_thread_count = 0;
+
+	for (i = 0; i < thread_count; ++i) {
+		ret = pthread_create(&s_threads[i], NULL, &worker_thread, NULL);
+		if (ret) {
+			EPRINTF("pthread_create failed: %d\n", ret);
+			goto err_join;
+		}
+		++s_thread_count;
+	}
+
+	s_executor_initialized = true;
+
+done:
+	return true;
+
+err_join:
+	pthread_mutex_lock(&s_mtx);
+	s_stop_requested = true;
+	pthread_cond_broadcast(&s_cond);
+	pthread_mutex_unlock(&s_mtx);
+
+	for (i = 0; i < s_thread_count; ++i) {
+		pthread_join(s_threads[i], NULL);
+	}
+	s_thread_count = 0;
+
+err:
+	return false;
+}
+
+void executor_fini(void) {
+	unsigned int i;
+
+	if (!s_executor_initialized) {
+		return;
+	}
+
+	/* Workers drain the queue before they exit. */
+	pthread_mutex_lock(&s_mtx);
+	s_stop_requested = true;
+	pthread_cond_broadcast(&s_cond);
+	pthread_mutex_unlock(&s_mtx);
+
+	for (i = 0; i < s_thread_count; ++i) {
+		pthread_join(s_threads[i], NULL);
+	}
+	s_thread_count = 0;
+
+	s_executor_initialized = false;
+}
+
+void executor_group_init(struct executor_group* group) {
+	assert(group != NULL);
+
+	memset(group, 0, sizeof(*group));
+}
+
+void executor_submit(struct executor_group* group, const char* host, executor_cb* cb, void* arg) {
+	struct executor_job* job;
+
+	assert(group != NULL);
+	assert(cb != NULL);
+
+	if (!s_executor_initialized) {
+		goto run_inline;
+	}
+
+	job = (struct executor_job*)malloc(sizeof(*job));
+	if (!job) {
+		EPRINTF("No memory.\n");
+		goto run_inline;
+	}
+	memset(job, 0, sizeof(*job));
+
+	job->cb = cb;
+	job->arg = arg;
+	job->group = group;
+	if (host) {
+		strlcpy(job->host, host, sizeof(job->host));
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	if (s_stop_requested) {
+		pthread_mutex_unlock(&s_mtx);
+		free(job);
+		goto run_inline;
+	}
+
+	++group->pending;
+	DL_APPEND(s_queue, job);
+	pthread_cond_signal(&s_cond);
+
+	pthread_mutex_unlock(&s_mtx);
+
+	return;
+
+run_inline:
+	(*cb)(arg);
+}
+
+void executor_wait(struct executor_group* group) {
+	assert(group != NULL);
+
+	pthread_mutex_lock(&s_mtx);
+	while (group->pending > 0) {
+		pthread_cond_wait(&s_done_cond, &s_mtx);
+	}
+	pthread_mutex_unlock(&s_mtx);
+}
+
+static void* worker_thread(void* arg) {
+	struct executor_job* job;
+	struct host_slot* slot;
+
+	UNUSED(arg);
+
+	pthread_mutex_lock(&s_mtx);
+
+	while (!s_stop_requested || s_queue) {
+		job = take_runnable_job(&slot);
+		if (!job) {
+			pthread_cond_wait(&s_cond, &s_mtx);
+			continue;
+		}
+
+		pthread_mutex_unlock(&s_mtx);
+		(*job->cb)(job->arg);
+		pthread_mutex_lock(&s_mtx);
+
+		if (slot) {
+			--slot->active;
+		}
+		complete_job(job);
+
+		/* Freed host capacity may unblock queued jobs for other workers. */
+		pthread_cond_broadcast(&s_cond);
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+
+	return NULL;
+}
+
+/* Must be called with the lock held. Takes the oldest job whose host is below its limit. */
+static struct executor_job* take_runnable_job(struct host_slot** slot) {
+	struct executor_job* job;
+	struct host_slot* tmp_slot;
+
+	*slot = NULL;
+
+	DL_FOREACH(s_queue, job) {
+		if (job->host[0] == '\0') {
+			break;
+		}
+
+		tmp_slot = find_host_slot(job->host);
+		if (tmp_slot && tmp_slot->active >= s_per_host_limit) {
+			continue;
+		}
+		if (!tmp_slot) {
+			tmp_slot = find_host_slot(NULL);
+			strlcpy(tmp_slot->host, job->host, sizeof(tmp_slot->host));
+		}
+
+		++tmp_slot->active;
+		*slot = tmp_slot;
+		break;
+	}
+
+	if (job) {
+		DL_DELETE(s_queue, job);
+	}
+
+	return job;
+}
+
+/* Must be called with the lock held. Null host looks up a free slot. */
+static struct host_slot* find_host_slot(const char* host) {
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(s_hosts); ++i) {
+		if (!host) {
+			if (s_hosts[i].active == 0) {
+				return &s_hosts[i];
+			}
+		} else if (s_hosts[i].active > 0 && strcmp(s_hosts[i].host, host) == 0) {
+			return &s_hosts[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Must be called with the lock held. */
+static void complete_job(struct executor_job* job) {
+	assert(job->group->pending > 0);
+
+	if (--job->group->pending == 0) {
+		pthread_cond_broadcast(&s_done_cond);
+	}
+
+	free(job);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "common.h"
+
+#define EXECUTOR_MAX_THREADS 16
+
+typedef void executor_cb(void* arg);
+
+/* Tracks completion of a set of submitted jobs. */
+struct executor_group {
+	size_t pending;
+};
+
+bool executor_init(unsigned int thread_count, unsigned int per_host_limit);
+void executor_fini(void);
+
+void executor_group_init(struct executor_group* group);
+
+/*
+ * Queues a job, at most per_host_limit jobs with the same host run at once.
+ * Job is run inline if it can not be queued.
+ */
+void executor_submit(struct executor_group* group, const char* host, executor_cb* cb, void* arg);
+
+/* Blocks until all jobs of the group have completed. */
+void executor_wait(struct executor_group* group);
@@ -0,0 +1,5 @@
+#pragma once
+
+/* Types the toolchain libc headers of the tree pull from here come from glibc on the host. */
+
+#include <sys/types.h>
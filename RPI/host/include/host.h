@@ -0,0 +1,15 @@
+#pragma once
+
+/* Forced into every module of the host build, for what the toolchain libc has and glibc lacks. */
+
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+
+size_t strlcpy(char* dst, const char* src, size_t size);
+size_t strlcat(char* dst, const char* src, size_t size);
+
+/* Settings of the host stand-ins, made by the host main before anything starts. */
+void host_set_ip_address(const char* ip_address);
+void host_set_storage_path(const char* path);
@@ -0,0 +1,12 @@
+#pragma once
+
+/* Host stand-in for AppInstUtil. Calls fail, the simulated backend is used instead. */
+
+int sceAppInstUtilInitialize(void);
+int sceAppInstUtilTerminate(void);
+int sceAppInstUtilAppUnInstall(const char* title_id);
+int sceAppInstUtilAppUnInstallAddcont(const char* title_id, const char* entitlement_label);
+int sceAppInstUtilAppUnInstallPat(const char* title_id);
+int sceAppInstUtilAppUnInstallTheme(const char* content_id);
+int sceAppInstUtilAppExists(const char* title_id, int* exists);
+int sceAppInstUtilAppGetSize(const char* title_id, unsigned long* size);
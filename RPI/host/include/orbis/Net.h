@@ -0,0 +1,9 @@
+#pragma once
+
+/* Host stand-in for the net library, implemented in host/sce_net.c. Same prototypes as net.h of the tree. */
+
+#include "_types/net.h"
+
+OrbisNetId sceNetSocket(const char* name, int family, int type, int protocol);
+int sceNetSetsockopt(OrbisNetId s, int level, int optname, const void* optval, OrbisNetSocklen_t optlen);
+int sceNetBind(OrbisNetId s, const OrbisNetSockaddr* addr, OrbisNetSocklen_t addrlen);
@@ -0,0 +1,13 @@
+#pragma once
+
+/* Host stand-in for the network control library, implemented in host/sce_net.c. */
+
+#define ORBIS_NET_CTL_INFO_IP_ADDRESS 14
+
+typedef union {
+	char ip_address[16];
+} OrbisNetCtlInfo;
+
+int sceNetCtlInit(void);
+void sceNetCtlTerm(void);
+int sceNetCtlGetInfo(int code, OrbisNetCtlInfo* info);
@@ -0,0 +1,18 @@
+#pragma once
+
+/* Host stand-in for the HTTP library types, the calls are implemented in host/sce_net.c. */
+
+#include <stdint.h>
+
+#define ORBIS_METHOD_GET 0
+#define ORBIS_METHOD_POST 1
+#define ORBIS_METHOD_HEAD 2
+
+#define ORBIS_HTTP_VERSION_1_0 1
+#define ORBIS_HTTP_VERSION_1_1 2
+
+#define ORBIS_HTTP_CONTENTLEN_EXIST 0
+#define ORBIS_HTTP_CONTENTLEN_NOT_FOUND 1
+#define ORBIS_HTTP_CONTENTLEN_CHUNK_ENC 2
+
+typedef int (*OrbisHttpsCallback)(int libsslCtxId, unsigned int verifyErr, void* const sslCert[], int certNum, void* userArg);
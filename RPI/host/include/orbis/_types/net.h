@@ -0,0 +1,15 @@
+#pragma once
+
+/* Host stand-in for the net library types, sockets are the host ones. */
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+typedef int OrbisNetId;
+typedef struct sockaddr OrbisNetSockaddr;
+typedef socklen_t OrbisNetSocklen_t;
+typedef struct msghdr OrbisNetMsghdr;
+
+typedef struct {
+	int x;
+} OrbisNetDnsInfo;
@@ -0,0 +1,78 @@
+#pragma once
+
+/* Host stand-in for BGFT. Calls fail, the simulated backend is used instead. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ORBIS_BGFT_TASK_OPT_DISABLE_CDN_QUERY_PARAM 0x10000
+
+typedef int OrbisBgftTaskId;
+
+typedef enum {
+	ORBIS_BGFT_TASK_SUB_TYPE_UNKNOWN = 0,
+	ORBIS_BGFT_TASK_SUB_TYPE_PHOTO = 1,
+	ORBIS_BGFT_TASK_SUB_TYPE_MUSIC = 2,
+	ORBIS_BGFT_TASK_SUB_TYPE_VIDEO = 3,
+	ORBIS_BGFT_TASK_SUB_TYPE_MARLIN_VIDEO = 4,
+	ORBIS_BGFT_TASK_SUB_TYPE_UPDATA = 5,
+	ORBIS_BGFT_TASK_SUB_TYPE_GAME = 6,
+	ORBIS_BGFT_TASK_SUB_TYPE_GAME_AC = 7,
+	ORBIS_BGFT_TASK_SUB_TYPE_GAME_PATCH = 8,
+	ORBIS_BGFT_TASK_SUB_TYPE_GAME_LICENSE = 9,
+	ORBIS_BGFT_TASK_SUB_TYPE_SAVE_DATA = 10,
+	ORBIS_BGFT_TASK_SUB_TYPE_CRASH_REPORT = 11,
+	ORBIS_BGFT_TASK_SUB_TYPE_PACKAGE = 12,
+	ORBIS_BGFT_TASK_SUB_TYPE_MAX = 13,
+} OrbisBgftTaskSubType;
+
+typedef struct {
+	size_t heapSize;
+	void* heap;
+} OrbisBgftInitParams;
+
+typedef struct {
+	int entitlementType;
+	int userId;
+	const char* id;
+	const char* contentUrl;
+	const char* contentName;
+	const char* iconPath;
+	const char* playgoScenarioId;
+	int option;
+	const char* packageType;
+	const char* packageSubType;
+	unsigned long packageSize;
+} OrbisBgftDownloadParam;
+
+typedef struct {
+	int x;
+} OrbisBgftDownloadRegisterErrorInfo;
+
+typedef struct {
+	unsigned int bits;
+	int errorResult;
+	unsigned long length;
+	unsigned long transferred;
+	unsigned long lengthTotal;
+	unsigned long transferredTotal;
+	unsigned int numIndex;
+	unsigned int numTotal;
+	unsigned int restSec;
+	unsigned int restSecTotal;
+	int preparingPercent;
+	int localCopyPercent;
+} OrbisBgftTaskProgress;
+
+int sceBgftServiceIntInit(OrbisBgftInitParams* params);
+int sceBgftServiceIntTerm(void);
+int sceBgftServiceIntDownloadRegisterTask(OrbisBgftDownloadParam* params, OrbisBgftTaskId* task_id);
+int sceBgftServiceIntDebugDownloadRegisterPkg(OrbisBgftDownloadParam* params, OrbisBgftTaskId* task_id);
+int sceBgftServiceDownloadStartTask(OrbisBgftTaskId task_id);
+int sceBgftServiceDownloadStopTask(OrbisBgftTaskId task_id);
+int sceBgftServiceDownloadPauseTask(OrbisBgftTaskId task_id);
+int sceBgftServiceDownloadResumeTask(OrbisBgftTaskId task_id);
+int sceBgftServiceIntDownloadUnregisterTask(OrbisBgftTaskId task_id);
+int sceBgftServiceIntDownloadReregisterTaskPatch(OrbisBgftTaskId old_task_id, OrbisBgftTaskId* new_task_id);
+int sceBgftServiceDownloadGetProgress(OrbisBgftTaskId task_id, OrbisBgftTaskProgress* progress);
+int sceBgftServiceDownloadFindTaskByContentId(const char* content_id, OrbisBgftTaskSubType sub_type, OrbisBgftTaskId* task_id);
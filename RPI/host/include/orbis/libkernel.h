@@ -0,0 +1,55 @@
+#pragma once
+
+/* Host stand-in for the kernel library, implemented in host/sce_kernel.c. */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define ORBIS_KERNEL_ERROR_ENOENT 0x80020002
+#define ORBIS_KERNEL_ERROR_ENXIO 0x80020006
+#define ORBIS_KERNEL_ERROR_ENOMEM 0x8002000C
+#define ORBIS_KERNEL_ERROR_EBUSY 0x80020010
+#define ORBIS_KERNEL_ERROR_EEXIST 0x80020011
+#define ORBIS_KERNEL_ERROR_EINVAL 0x80020016
+#define ORBIS_KERNEL_ERROR_ENOSPC 0x8002001C
+#define ORBIS_KERNEL_ERROR_EAGAIN 0x80020023
+#define ORBIS_KERNEL_ERROR_ETIMEDOUT 0x8002003C
+#define ORBIS_KERNEL_ERROR_ECANCELED 0x80020055
+
+/* Layout of the SDK, with struct timespec timestamps. */
+typedef struct OrbisKernelStat {
+	uint32_t st_dev;
+	uint32_t st_ino;
+	uint16_t st_mode;
+	uint16_t st_nlink;
+	uint32_t st_uid;
+	uint32_t st_gid;
+	uint32_t st_rdev;
+	struct timespec st_atim;
+	struct timespec st_mtim;
+	struct timespec st_ctim;
+	int64_t st_size;
+	int64_t st_blocks;
+	uint32_t st_blksize;
+	uint32_t st_flags;
+	uint32_t st_gen;
+	int32_t st_lspare;
+	struct timespec st_birthtim;
+} OrbisKernelStat;
+
+typedef struct {
+	int x;
+} OrbisKernelModuleInfo;
+
+typedef struct {
+	int x;
+} OrbisKernelEventFlagOptParam;
+
+int sceKernelOpen(const char* path, int flags, int mode);
+int sceKernelClose(int fd);
+int sceKernelGetdents(int fd, char* buf, int size);
+int sceKernelStat(const char* path, OrbisKernelStat* st);
+int sceKernelGettimeofday(struct timeval* tv);
+int sceKernelUsleep(unsigned int usecs);
@@ -0,0 +1,7 @@
+#pragma once
+
+/* Host stand-in for the system service, implemented in host/sce_kernel.c. */
+
+#define ORBIS_SYSTEM_SERVICE_PARAM_ID_LANG 1
+
+int sceSystemServiceParamGetInt(int param_id, int* value);
@@ -0,0 +1,7 @@
+#pragma once
+
+/* Host stand-in for the user service, implemented in host/sce_kernel.c. */
+
+int sceUserServiceInitialize(void* params);
+int sceUserServiceTerminate(void);
+int sceUserServiceGetForegroundUser(int* user_id);
@@ -0,0 +1,159 @@
+/* Host entry point, runs the server over the simulated installer backend. Mirrors main.c of the tree. */
+
+#include "../installer.h"
+#include "../net.h"
+#include "../http.h"
+#include "../server.h"
+#include "../sim_backend.h"
+#include "../util.h"
+
+#include <orbis/userservice.h>
+
+#include "include/host.h"
+
+#include <getopt.h>
+#include <signal.h>
+#include <sys/stat.h>
+
+#define SERVER_PORT (12801)
+
+#define DEFAULT_IP_ADDRESS "127.0.0.1"
+#define DEFAULT_WORK_DIR "data"
+
+static struct sim_backend_config s_sim_backend_config = {
+	10 * 1024 * 1024, /* transfer rate */
+	2000, /* preparing time */
+	50, /* failure chance */
+	2000, /* call latency */
+	12801, /* seed */
+};
+
+static void usage(const char* name) {
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -a address   address put into URLs handed to the installer (default %s)\n"
+		"  -p port      port to listen on (default %d)\n"
+		"  -w dir       working directory, created if missing (default %s)\n"
+		"  -r rate      simulated transfer rate of each task, bytes per second (default %" PRIu64 ")\n"
+		"  -t msecs     simulated preparing time (default %u)\n"
+		"  -f permille  chance of a task to fail midway (default %u)\n"
+		"  -l usecs     latency added to every backend call (default %u)\n"
+		"  -s seed      seed of the simulation (default %u)\n",
+		name, DEFAULT_IP_ADDRESS, SERVER_PORT, DEFAULT_WORK_DIR, s_sim_backend_config.transfer_rate,
+		s_sim_backend_config.preparing_msecs, s_sim_backend_config.failure_permille,
+		s_sim_backend_config.call_latency_usecs, s_sim_backend_config.seed
+	);
+}
+
+int main(int argc, char* argv[]) {
+	const char* ip_address = DEFAULT_IP_ADDRESS;
+	const char* work_dir = DEFAULT_WORK_DIR;
+	int port = SERVER_PORT;
+	int status = 1;
+	int opt;
+	int ret;
+
+	while ((opt = getopt(argc, argv, "a:p:w:r:t:f:l:s:h")) != -1) {
+		switch (opt) {
+			case 'a': ip_address = optarg; break;
+			case 'p': port = atoi(optarg); break;
+			case 'w': work_dir = optarg; break;
+			case 'r': s_sim_backend_config.transfer_rate = strtoull(optarg, NULL, 0); break;
+			case 't': s_sim_backend_config.preparing_msecs = (unsigned int)strtoul(optarg, NULL, 0); break;
+			case 'f': s_sim_backend_config.failure_permille = (unsigned int)strtoul(optarg, NULL, 0); break;
+			case 'l': s_sim_backend_config.call_latency_usecs = (unsigned int)strtoul(optarg, NULL, 0); break;
+			case 's': s_sim_backend_config.seed = (unsigned int)strtoul(optarg, NULL, 0); break;
+			default:
+				usage(argv[0]);
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	/* Clients going away mid-response must not take the server down. */
+	signal(SIGPIPE, SIG_IGN);
+
+	if (mkdir(work_dir, 0755) < 0 && errno != EEXIST) {
+		EPRINTF("Unable to create working directory %s: %d\n", work_dir, errno);
+		goto err;
+	}
+
+	host_set_ip_address(ip_address);
+	host_set_storage_path(work_dir);
+
+	ret = sceUserServiceInitialize(NULL);
+	if (ret) {
+		EPRINTF("User service initialization failed.\n");
+		goto err;
+	}
+
+	if (!app_inst_util_init()) {
+		EPRINTF("AppInstUtil initialization failed.\n");
+		goto err_user_service_terminate;
+	}
+
+	if (!bgft_init()) {
+		EPRINTF("BGFT initialization failed.\n");
+		goto err_appinstutil_finalize;
+	}
+
+	if (!sim_backend_init(&s_sim_backend_config)) {
+		EPRINTF("Simulated installer backend initialization failed.\n");
+		goto err_bgft_finalize;
+	}
+	installer_set_backend(sim_backend_get());
+
+	if (!installer_dispatcher_init()) {
+		/* System calls are just not serialized then. */
+		EPRINTF("Installer dispatcher initialization failed.\n");
+	}
+
+	if (!net_init()) {
+		EPRINTF("Net initialization failed.\n");
+		goto err_sim_backend_finalize;
+	}
+
+	if (!http_init()) {
+		EPRINTF("HTTP initialization failed.\n");
+		goto err_net_finalize;
+	}
+
+	if (!server_start(ip_address, port, work_dir)) {
+		EPRINTF("Server start failed.\n");
+		goto err_http_finalize;
+	}
+
+	printf("Listening for incoming connections on %s:%d, working directory %s...\n", ip_address, port, work_dir);
+	fflush(stdout);
+
+	if (server_listen()) {
+		status = 0;
+	}
+
+	server_stop();
+
+err_http_finalize:
+	http_fini();
+
+err_net_finalize:
+	net_fini();
+
+err_sim_backend_finalize:
+	installer_dispatcher_fini();
+	installer_set_backend(NULL);
+	sim_backend_fini();
+
+err_bgft_finalize:
+	bgft_fini();
+
+err_appinstutil_finalize:
+	app_inst_util_fini();
+
+err_user_service_terminate:
+	ret = sceUserServiceTerminate();
+	if (ret) {
+		EPRINTF("sceUserServiceTerminate failed: 0x%08X\n", ret);
+	}
+
+err:
+	return status;
+}
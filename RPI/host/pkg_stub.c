@@ -0,0 +1,561 @@
+/*
+ * Local stand-in for the PC side HTTP server, to drive the host build without real packages.
+ *
+ * Serves:
+ *   /pkg/<n>.pkg       package number n, with a real header, entry table, param.sfo and icon0.png; the rest reads as zeros
+ *   /pkg/<n>_<k>.pkg   piece k of package n split into equal pieces, for auto_split installs
+ *   /split/<n>.pkg     first piece of package n, followed by /split/<n>.pkgpart<k> for the others
+ *   /ref/<n>.json      ref-package manifest listing the pieces of package n
+ *   /files/<name>      files of the directory given with -d, e.g. real packages
+ *
+ * Ranges are honored, as the installer reads the metadata with ranged requests.
+ */
+
+#define _GNU_SOURCE
+
+#include "../pkg.h"
+#include "../sfo.h"
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#define DEFAULT_PORT 8080
+#define DEFAULT_PACKAGE_SIZE (UINT64_C(1) << 30)
+#define DEFAULT_PIECE_COUNT 4
+
+#define MAX_REQUEST_SIZE 8192
+#define SEND_CHUNK_SIZE (64 * 1024)
+
+#define META_ENTRY_COUNT 2
+#define META_ENTRY_TABLE_OFFSET SIZEOF_PKG_HEADER
+#define META_PARAM_SFO_OFFSET (META_ENTRY_TABLE_OFFSET + 0x100)
+#define META_PARAM_SFO_AREA 0x800
+#define META_ICON0_PNG_OFFSET (META_PARAM_SFO_OFFSET + META_PARAM_SFO_AREA)
+#define META_SIZE (META_ICON0_PNG_OFFSET + 0x100)
+
+#define SFO_VALUE_AREA 0x40
+
+struct request {
+	int sock;
+	char method[8];
+	char path[1024];
+	char host[256];
+	bool has_range;
+	uint64_t range_start;
+	uint64_t range_end; /* UINT64_MAX if open-ended */
+};
+
+/* Bytes of a resource, either generated or read from a file. */
+struct resource {
+	uint64_t size;
+	uint64_t base; /* offset of the resource within the package */
+	const uint8_t* meta; /* leading bytes of a generated resource, the rest are zeros */
+	size_t meta_size;
+	int fd; /* -1 for generated packages */
+	const char* content_type;
+};
+
+/* 1x1 transparent PNG. */
+static const uint8_t s_icon0_png[] = {
+	0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A, 0x00, 0x00, 0x00, 0x0D, 0x49, 0x48, 0x44, 0x52,
+	0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x08, 0x06, 0x00, 0x00, 0x00, 0x1F, 0x15, 0xC4,
+	0x89, 0x00, 0x00, 0x00, 0x0D, 0x49, 0x44, 0x41, 0x54, 0x78, 0x9C, 0x63, 0x60, 0x00, 0x02, 0x00,
+	0x00, 0x05, 0x00, 0x01, 0xE9, 0xFA, 0xDC, 0xD8, 0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4E, 0x44,
+	0xAE, 0x42, 0x60, 0x82,
+};
+
+static uint64_t s_package_size = DEFAULT_PACKAGE_SIZE;
+static unsigned int s_piece_count = DEFAULT_PIECE_COUNT;
+static const char* s_files_dir = NULL;
+
+static void* serve_connection(void* arg);
+static bool read_request(struct request* req);
+static void route_request(struct request* req);
+static bool parse_piece_path(const char* path, unsigned int* number, unsigned int* piece);
+static void send_resource(struct request* req, const struct resource* res);
+static void send_status(struct request* req, int code, const char* text);
+static bool send_all(int sock, const void* data, size_t size);
+static void make_content_id(char* buf, size_t buf_size, unsigned int number);
+static size_t make_param_sfo(uint8_t* data, size_t data_size, unsigned int number);
+static void make_package_meta(uint8_t* meta, unsigned int number);
+
+static inline void put_be32(uint8_t* p, uint32_t value) {
+	p[0] = (uint8_t)(value >> 24);
+	p[1] = (uint8_t)(value >> 16);
+	p[2] = (uint8_t)(value >> 8);
+	p[3] = (uint8_t)value;
+}
+
+static inline void put_be64(uint8_t* p, uint64_t value) {
+	put_be32(p, (uint32_t)(value >> 32));
+	put_be32(p + 4, (uint32_t)value);
+}
+
+static inline void put_le16(uint8_t* p, uint16_t value) {
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+}
+
+static inline void put_le32(uint8_t* p, uint32_t value) {
+	put_le16(p, (uint16_t)value);
+	put_le16(p + 2, (uint16_t)(value >> 16));
+}
+
+static void usage(const char* name) {
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -p port    port to listen on (default %d)\n"
+		"  -s size    size of generated packages in bytes (default %" PRIu64 ")\n"
+		"  -n count   pieces of split packages (default %u)\n"
+		"  -d dir     directory served under /files/\n",
+		name, DEFAULT_PORT, (uint64_t)DEFAULT_PACKAGE_SIZE, DEFAULT_PIECE_COUNT
+	);
+}
+
+int main(int argc, char* argv[]) {
+	struct sockaddr_in addr;
+	pthread_t thr;
+	int port = DEFAULT_PORT;
+	int server_sock, sock;
+	int optval = 1;
+	intptr_t arg;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "p:s:n:d:h")) != -1) {
+		switch (opt) {
+			case 'p': port = atoi(optarg); break;
+			case 's': s_package_size = strtoull(optarg, NULL, 0); break;
+			case 'n': s_piece_count = (unsigned int)strtoul(optarg, NULL, 0); break;
+			case 'd': s_files_dir = optarg; break;
+			default:
+				usage(argv[0]);
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (s_package_size < META_SIZE) {
+		fprintf(stderr, "Package size must be at least %u bytes.\n", (unsigned int)META_SIZE);
+		return 1;
+	}
+	if (s_piece_count == 0 || s_package_size / s_piece_count < META_SIZE) {
+		fprintf(stderr, "Pieces must be at least %u bytes.\n", (unsigned int)META_SIZE);
+		return 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	server_sock = socket(AF_INET, SOCK_STREAM, 0);
+	if (server_sock < 0) {
+		perror("socket");
+		return 1;
+	}
+	setsockopt(server_sock, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons((uint16_t)port);
+
+	if (bind(server_sock, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(server_sock, 1024) < 0) {
+		perror("bind");
+		close(server_sock);
+		return 1;
+	}
+
+	printf("Serving packages of %" PRIu64 " bytes in %u pieces on port %d...\n", s_package_size, s_piece_count, port);
+	fflush(stdout);
+
+	for (;;) {
+		sock = accept(server_sock, NULL, NULL);
+		if (sock < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			perror("accept");
+			break;
+		}
+
+		arg = sock;
+		if (pthread_create(&thr, NULL, &serve_connection, (void*)arg) != 0) {
+			close(sock);
+			continue;
+		}
+		pthread_detach(thr);
+	}
+
+	close(server_sock);
+
+	return 1;
+}
+
+/* One request per connection, like the installer does. */
+static void* serve_connection(void* arg) {
+	struct request req;
+
+	memset(&req, 0, sizeof(req));
+	req.sock = (int)(intptr_t)arg;
+
+	if (read_request(&req)) {
+		route_request(&req);
+	}
+
+	close(req.sock);
+
+	return NULL;
+}
+
+static bool read_request(struct request* req) {
+	char buf[MAX_REQUEST_SIZE + 1];
+	char* line;
+	char* next;
+	char* value;
+	size_t len = 0;
+	ssize_t ret;
+
+	do {
+		ret = recv(req->sock, buf + len, MAX_REQUEST_SIZE - len, 0);
+		if (ret <= 0) {
+			return false;
+		}
+		len += (size_t)ret;
+		buf[len] = '\0';
+	} while (!strstr(buf, "\r\n\r\n") && len < MAX_REQUEST_SIZE);
+
+	if (sscanf(buf, "%7s %1023s", req->method, req->path) != 2) {
+		return false;
+	}
+
+	for (line = strstr(buf, "\r\n"); line; line = next) {
+		line += 2;
+		next = strstr(line, "\r\n");
+		if (next) {
+			*next = '\0';
+		}
+
+		value = strchr(line, ':');
+		if (!value) {
+			continue;
+		}
+		*value++ = '\0';
+		while (*value == ' ' || *value == '\t') {
+			++value;
+		}
+
+		if (strcasecmp(line, "Host") == 0) {
+			snprintf(req->host, sizeof(req->host), "%s", value);
+		} else if (strcasecmp(line, "Range") == 0 && strncasecmp(value, "bytes=", 6) == 0) {
+			req->range_end = UINT64_MAX;
+			if (sscanf(value + 6, "%" SCNu64 "-%" SCNu64, &req->range_start, &req->range_end) >= 1) {
+				req->has_range = true;
+			}
+		}
+	}
+
+	return true;
+}
+
+static void route_request(struct request* req) {
+	char path[PATH_MAX];
+	uint8_t meta[META_SIZE];
+	struct resource res;
+	struct stat st;
+	unsigned int number, piece;
+	uint64_t piece_size;
+	char* json;
+	size_t json_size;
+	FILE* fp;
+	int end = 0;
+	unsigned int i;
+
+	if (strcmp(req->method, "GET") != 0 && strcmp(req->method, "HEAD") != 0) {
+		send_status(req, 405, "Method Not Allowed");
+		return;
+	}
+
+	memset(&res, 0, sizeof(res));
+	res.fd = -1;
+	res.content_type = "application/octet-stream";
+
+	if (parse_piece_path(req->path, &number, &piece)) {
+		if (piece >= s_piece_count) {
+			send_status(req, 404, "Not Found");
+			return;
+		}
+
+		piece_size = s_package_size / s_piece_count;
+
+		make_package_meta(meta, number);
+		res.meta = meta;
+		res.meta_size = sizeof(meta);
+		res.base = piece * piece_size;
+		res.size = piece + 1 < s_piece_count ? piece_size : s_package_size - res.base;
+		send_resource(req, &res);
+	} else if ((end = 0, sscanf(req->path, "/pkg/%u.pkg%n", &number, &end)) == 1 && end > 0 && req->path[end] == '\0') {
+		make_package_meta(meta, number);
+		res.meta = meta;
+		res.meta_size = sizeof(meta);
+		res.size = s_package_size;
+		send_resource(req, &res);
+	} else if ((end = 0, sscanf(req->path, "/ref/%u.json%n", &number, &end)) == 1 && end > 0 && req->path[end] == '\0') {
+		fp = open_memstream(&json, &json_size);
+		if (!fp) {
+			send_status(req, 500, "Internal Server Error");
+			return;
+		}
+
+		piece_size = s_package_size / s_piece_count;
+
+		fprintf(fp, "{\"originalFileSize\":%" PRIu64 ",\"numberOfSplitFiles\":%u,\"pieces\":[", s_package_size, s_piece_count);
+		for (i = 0; i < s_piece_count; ++i) {
+			fprintf(fp, "%s{\"url\":\"http://%s/pkg/%u_%u.pkg\",\"fileOffset\":%" PRIu64 ",\"fileSize\":%" PRIu64 "}",
+				i > 0 ? "," : "", req->host, number, i, i * piece_size,
+				i + 1 < s_piece_count ? piece_size : s_package_size - i * piece_size
+			);
+		}
+		fprintf(fp, "]}");
+		fclose(fp);
+
+		res.meta = (const uint8_t*)json;
+		res.meta_size = json_size;
+		res.size = json_size;
+		res.content_type = "application/json";
+		send_resource(req, &res);
+
+		free(json);
+	} else if (s_files_dir && strncmp(req->path, "/files/", 7) == 0 && !strstr(req->path, "..")) {
+		snprintf(path, sizeof(path), "%s/%s", s_files_dir, req->path + 7);
+
+		res.fd = open(path, O_RDONLY);
+		if (res.fd < 0 || fstat(res.fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+			if (res.fd >= 0) {
+				close(res.fd);
+			}
+			send_status(req, 404, "Not Found");
+			return;
+		}
+
+		res.size = (uint64_t)st.st_size;
+		send_resource(req, &res);
+
+		close(res.fd);
+	} else {
+		send_status(req, 404, "Not Found");
+	}
+}
+
+static bool parse_piece_path(const char* path, unsigned int* number, unsigned int* piece) {
+	int end = 0;
+	int part_end = 0;
+
+	if (sscanf(path, "/pkg/%u_%u.pkg%n", number, piece, &end) == 2 && end > 0 && path[end] == '\0') {
+		return true;
+	}
+
+	end = 0;
+	if (sscanf(path, "/split/%u.pkg%n", number, &end) != 1 || end == 0) {
+		return false;
+	}
+	if (path[end] == '\0') {
+		*piece = 0;
+		return true;
+	}
+
+	return sscanf(path + end, "part%u%n", piece, &part_end) == 1 && part_end > 0 && path[end + part_end] == '\0' && *piece > 0;
+}
+
+static void send_resource(struct request* req, const struct resource* res) {
+	uint8_t* chunk;
+	char header[512];
+	uint64_t start = 0, end, offset, pkg_offset;
+	size_t chunk_size, n;
+	ssize_t ret;
+	int len;
+
+	end = res->size > 0 ? res->size - 1 : 0;
+
+	if (req->has_range) {
+		if (req->range_start >= res->size || req->range_start > req->range_end) {
+			len = snprintf(header, sizeof(header),
+				"HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%" PRIu64 "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n",
+				res->size
+			);
+			send_all(req->sock, header, (size_t)len);
+			return;
+		}
+		start = req->range_start;
+		if (req->range_end < end) {
+			end = req->range_end;
+		}
+
+		len = snprintf(header, sizeof(header),
+			"HTTP/1.1 206 Partial Content\r\nContent-Type: %s\r\nContent-Length: %" PRIu64 "\r\nContent-Range: bytes %" PRIu64 "-%" PRIu64 "/%" PRIu64 "\r\nAccept-Ranges: bytes\r\nConnection: close\r\n\r\n",
+			res->content_type, end - start + 1, start, end, res->size
+		);
+	} else {
+		len = snprintf(header, sizeof(header),
+			"HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %" PRIu64 "\r\nAccept-Ranges: bytes\r\nConnection: close\r\n\r\n",
+			res->content_type, res->size
+		);
+	}
+
+	if (!send_all(req->sock, header, (size_t)len) || strcmp(req->method, "HEAD") == 0 || res->size == 0) {
+		return;
+	}
+
+	chunk = (uint8_t*)malloc(SEND_CHUNK_SIZE);
+	if (!chunk) {
+		return;
+	}
+
+	/* Clients stop reading once they have what they asked for, sends fail then and the connection is dropped. */
+	for (offset = start; offset <= end; offset += chunk_size) {
+		chunk_size = end - offset + 1 < SEND_CHUNK_SIZE ? (size_t)(end - offset + 1) : SEND_CHUNK_SIZE;
+
+		if (res->fd >= 0) {
+			ret = pread(res->fd, chunk, chunk_size, (off_t)offset);
+			if (ret <= 0) {
+				break;
+			}
+			chunk_size = (size_t)ret;
+		} else {
+			memset(chunk, 0, chunk_size);
+
+			pkg_offset = res->base + offset;
+			if (pkg_offset < res->meta_size) {
+				n = res->meta_size - (size_t)pkg_offset < chunk_size ? res->meta_size - (size_t)pkg_offset : chunk_size;
+				memcpy(chunk, res->meta + pkg_offset, n);
+			}
+		}
+
+		if (!send_all(req->sock, chunk, chunk_size)) {
+			break;
+		}
+	}
+
+	free(chunk);
+}
+
+static void send_status(struct request* req, int code, const char* text) {
+	char header[256];
+	int len;
+
+	len = snprintf(header, sizeof(header), "HTTP/1.1 %d %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", code, text);
+	send_all(req->sock, header, (size_t)len);
+}
+
+static bool send_all(int sock, const void* data, size_t size) {
+	const uint8_t* ptr = (const uint8_t*)data;
+	ssize_t ret;
+
+	while (size > 0) {
+		ret = send(sock, ptr, size, MSG_NOSIGNAL);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret <= 0) {
+			return false;
+		}
+		ptr += ret;
+		size -= (size_t)ret;
+	}
+
+	return true;
+}
+
+/* Title ID and label come from the number, so every number is a package of its own. */
+static void make_content_id(char* buf, size_t buf_size, unsigned int number) {
+	snprintf(buf, buf_size, "UP0000-STUB%05u_00-STUBPACKAGE%05u", number % 100000, number % 100000);
+}
+
+/* Keys the installer reads, sorted like on real packages. */
+static size_t make_param_sfo(uint8_t* data, size_t data_size, unsigned int number) {
+	char values[5][SFO_VALUE_AREA];
+	static const char* const keys[] = { "APP_VER", "CATEGORY", "CONTENT_ID", "TITLE", "TITLE_ID" };
+	size_t key_table_size = 0;
+	size_t key_table_offset, value_table_offset, total_size;
+	size_t key_offset = 0;
+	uint8_t* entry;
+	size_t i;
+
+	snprintf(values[0], sizeof(values[0]), "01.00");
+	snprintf(values[1], sizeof(values[1]), "gd");
+	make_content_id(values[2], sizeof(values[2]), number);
+	snprintf(values[3], sizeof(values[3]), "Stub Package %u", number);
+	snprintf(values[4], sizeof(values[4]), "STUB%05u", number % 100000);
+
+	for (i = 0; i < ARRAY_SIZE(keys); ++i) {
+		key_table_size += strlen(keys[i]) + 1;
+	}
+
+	key_table_offset = 0x14 + ARRAY_SIZE(keys) * 0x10;
+	value_table_offset = key_table_offset + ALIGN_UP(key_table_size, 4);
+	total_size = value_table_offset + ARRAY_SIZE(keys) * SFO_VALUE_AREA;
+	if (total_size > data_size) {
+		return 0;
+	}
+
+	memset(data, 0, total_size);
+	memcpy(data, "\0PSF", 4);
+	put_le32(data + 0x04, 0x101);
+	put_le32(data + 0x08, (uint32_t)key_table_offset);
+	put_le32(data + 0x0C, (uint32_t)value_table_offset);
+	put_le32(data + 0x10, (uint32_t)ARRAY_SIZE(keys));
+
+	for (i = 0; i < ARRAY_SIZE(keys); ++i) {
+		entry = data + 0x14 + i * 0x10;
+
+		put_le16(entry + 0x00, (uint16_t)key_offset);
+		put_le16(entry + 0x02, SFO_FORMAT_STRING);
+		put_le32(entry + 0x04, (uint32_t)strlen(values[i]) + 1);
+		put_le32(entry + 0x08, SFO_VALUE_AREA);
+		put_le32(entry + 0x0C, (uint32_t)(i * SFO_VALUE_AREA));
+
+		strcpy((char*)data + key_table_offset + key_offset, keys[i]);
+		key_offset += strlen(keys[i]) + 1;
+
+		strcpy((char*)data + value_table_offset + i * SFO_VALUE_AREA, values[i]);
+	}
+
+	return total_size;
+}
+
+static void make_package_meta(uint8_t* meta, unsigned int number) {
+	char content_id[PKG_CONTENT_ID_SIZE + 1];
+	uint8_t* entry;
+	size_t sfo_size;
+	size_t i;
+
+	memset(meta, 0, META_SIZE);
+
+	sfo_size = make_param_sfo(meta + META_PARAM_SFO_OFFSET, META_PARAM_SFO_AREA, number);
+
+	memcpy(meta + offsetof(struct pkg_header, magic), PKG_MAGIC, 4);
+	put_be32(meta + offsetof(struct pkg_header, entry_count), META_ENTRY_COUNT);
+	put_be32(meta + offsetof(struct pkg_header, entry_table_offset), META_ENTRY_TABLE_OFFSET);
+	make_content_id(content_id, sizeof(content_id), number);
+	memcpy(meta + offsetof(struct pkg_header, content_id), content_id, PKG_CONTENT_ID_SIZE);
+	put_be32(meta + offsetof(struct pkg_header, content_type), PKG_CONTENT_TYPE_GD);
+	put_be64(meta + offsetof(struct pkg_header, package_size), s_package_size);
+	for (i = 0; i < PKG_DIGEST_SIZE; ++i) {
+		meta[offsetof(struct pkg_header, digest) + i] = (uint8_t)(number * 31 + i);
+	}
+
+	entry = meta + META_ENTRY_TABLE_OFFSET;
+	put_be32(entry + offsetof(struct pkg_table_entry, id), PKG_ENTRY_ID__PARAM_SFO);
+	put_be32(entry + offsetof(struct pkg_table_entry, offset), META_PARAM_SFO_OFFSET);
+	put_be32(entry + offsetof(struct pkg_table_entry, size), (uint32_t)sfo_size);
+
+	entry += SIZEOF_PKG_TABLE_ENTRY;
+	put_be32(entry + offsetof(struct pkg_table_entry, id), PKG_ENTRY_ID__ICON0_PNG);
+	put_be32(entry + offsetof(struct pkg_table_entry, offset), META_ICON0_PNG_OFFSET);
+	put_be32(entry + offsetof(struct pkg_table_entry, size), sizeof(s_icon0_png));
+
+	memcpy(meta + META_ICON0_PNG_OFFSET, s_icon0_png, sizeof(s_icon0_png));
+}
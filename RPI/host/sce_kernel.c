@@ -0,0 +1,400 @@
+/* Host stand-ins for the kernel, system and user services, BGFT and AppInstUtil. */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <orbis/libkernel.h>
+#include <orbis/systemservice.h>
+#include <orbis/userservice.h>
+#include <orbis/AppInstUtil.h>
+#include <orbis/bgft.h>
+
+#include "include/host.h"
+#include "../KPutil.h"
+
+/* Kernel error codes are errno values of FreeBSD in the 0x80020000 range, the common ones match Linux. */
+#define KERNEL_ERROR(err) ((int)(0x80020000 | ((err) & 0xFFFF)))
+
+/* Layout of struct dirent of the kernel, see dirent.h of the tree. Names differ, glibc defines d_fileno as a macro. */
+struct kernel_dirent {
+	uint32_t fileno;
+	uint32_t ino;
+	uint16_t reclen;
+	uint8_t type;
+	uint8_t namlen;
+	char name[256];
+};
+
+/* Beginning of struct statfs of the kernel, see storage.c. */
+struct kernel_statfs_head {
+	uint32_t f_version;
+	uint32_t f_type;
+	uint64_t f_flags;
+	uint64_t f_bsize;
+	uint64_t f_iosize;
+	uint64_t f_blocks;
+	uint64_t f_bfree;
+	int64_t f_bavail;
+};
+
+#define KERNEL_SYS_statfs 396
+
+/* English (United States). */
+#define HOST_LANGUAGE_ID 1
+
+#define HOST_USER_ID 0x10000000
+
+static char s_storage_path[1024] = ".";
+
+void host_set_storage_path(const char* path) {
+	snprintf(s_storage_path, sizeof(s_storage_path), "%s", path);
+}
+
+#if !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char* dst, const char* src, size_t size) {
+	size_t len = strlen(src);
+
+	if (size > 0) {
+		size = len < size - 1 ? len : size - 1;
+		memcpy(dst, src, size);
+		dst[size] = '\0';
+	}
+
+	return len;
+}
+
+size_t strlcat(char* dst, const char* src, size_t size) {
+	size_t len = strnlen(dst, size);
+
+	if (len == size) {
+		return len + strlen(src);
+	}
+
+	return len + strlcpy(dst + len, src, size - len);
+}
+#endif
+
+/*
+ * Only statfs is issued by the tree, with the kernel layout of the result.
+ * Paths of the console are missing here, so the storage path given to the host main is measured instead.
+ */
+long syscall(long number, ...) {
+	struct kernel_statfs_head* buf;
+	struct statvfs st;
+	const char* path;
+	va_list args;
+
+	if (number != KERNEL_SYS_statfs) {
+		errno = ENOSYS;
+		return -1;
+	}
+
+	va_start(args, number);
+	path = va_arg(args, const char*);
+	buf = va_arg(args, struct kernel_statfs_head*);
+	va_end(args);
+
+	if (statvfs(path, &st) < 0 && statvfs(s_storage_path, &st) < 0) {
+		return -1;
+	}
+
+	buf->f_bsize = st.f_frsize;
+	buf->f_iosize = st.f_bsize;
+	buf->f_blocks = st.f_blocks;
+	buf->f_bfree = st.f_bfree;
+	buf->f_bavail = (int64_t)st.f_bavail;
+
+	return 0;
+}
+
+int sceKernelOpen(const char* path, int flags, int mode) {
+	int fd;
+
+	fd = open(path, flags, mode);
+	if (fd < 0) {
+		return KERNEL_ERROR(errno);
+	}
+
+	return fd;
+}
+
+int sceKernelClose(int fd) {
+	if (close(fd) < 0) {
+		return KERNEL_ERROR(errno);
+	}
+
+	return 0;
+}
+
+/*
+ * Records are converted from the ones of Linux, which are never smaller. Reading into less than the whole
+ * buffer leaves zeros past the last record, callers stop there.
+ */
+int sceKernelGetdents(int fd, char* buf, int size) {
+	char tmp[8192];
+	struct dirent64* in;
+	struct kernel_dirent* out;
+	size_t name_len, rec_len;
+	ssize_t in_size;
+	size_t in_off, out_off;
+
+	if (!buf || size <= (int)(2 * sizeof(uint64_t))) {
+		return ORBIS_KERNEL_ERROR_EINVAL;
+	}
+
+	in_size = (size_t)size - 2 * sizeof(uint64_t);
+	if (in_size > (ssize_t)sizeof(tmp)) {
+		in_size = sizeof(tmp);
+	}
+
+	in_size = getdents64(fd, tmp, (size_t)in_size);
+	if (in_size < 0) {
+		return KERNEL_ERROR(errno);
+	}
+
+	for (in_off = 0, out_off = 0; in_off < (size_t)in_size; in_off += in->d_reclen) {
+		in = (struct dirent64*)(tmp + in_off);
+		out = (struct kernel_dirent*)(buf + out_off);
+
+		name_len = strnlen(in->d_name, sizeof(out->name) - 1);
+		rec_len = (offsetof(struct kernel_dirent, name) + name_len + 1 + 7) & ~(size_t)7;
+
+		memset(out, 0, rec_len);
+		out->fileno = out->ino = (uint32_t)in->d_ino ? (uint32_t)in->d_ino : 1;
+		out->reclen = (uint16_t)rec_len;
+		out->type = in->d_type;
+		out->namlen = (uint8_t)name_len;
+		memcpy(out->name, in->d_name, name_len);
+
+		out_off += rec_len;
+	}
+
+	memset(buf + out_off, 0, (size_t)size - out_off);
+
+	return (int)out_off;
+}
+
+int sceKernelStat(const char* path, OrbisKernelStat* st) {
+	struct stat host_st;
+
+	if (!st) {
+		return ORBIS_KERNEL_ERROR_EINVAL;
+	}
+
+	if (stat(path, &host_st) < 0) {
+		return KERNEL_ERROR(errno);
+	}
+
+	memset(st, 0, sizeof(*st));
+	st->st_dev = (uint32_t)host_st.st_dev;
+	st->st_ino = (uint32_t)host_st.st_ino;
+	st->st_mode = (uint16_t)host_st.st_mode;
+	st->st_nlink = (uint16_t)host_st.st_nlink;
+	st->st_uid = host_st.st_uid;
+	st->st_gid = host_st.st_gid;
+	st->st_rdev = (uint32_t)host_st.st_rdev;
+	st->st_atim = host_st.st_atim;
+	st->st_mtim = host_st.st_mtim;
+	st->st_ctim = host_st.st_ctim;
+	st->st_size = host_st.st_size;
+	st->st_blocks = host_st.st_blocks;
+	st->st_blksize = (uint32_t)host_st.st_blksize;
+
+	return 0;
+}
+
+int sceKernelGettimeofday(struct timeval* tv) {
+	if (gettimeofday(tv, NULL) < 0) {
+		return KERNEL_ERROR(errno);
+	}
+
+	return 0;
+}
+
+int sceKernelUsleep(unsigned int usecs) {
+	usleep(usecs);
+
+	return 0;
+}
+
+int sceSystemServiceParamGetInt(int param_id, int* value) {
+	if (param_id != ORBIS_SYSTEM_SERVICE_PARAM_ID_LANG || !value) {
+		return ORBIS_KERNEL_ERROR_EINVAL;
+	}
+
+	*value = HOST_LANGUAGE_ID;
+
+	return 0;
+}
+
+int sceUserServiceInitialize(void* params) {
+	(void)params;
+
+	return 0;
+}
+
+int sceUserServiceTerminate(void) {
+	return 0;
+}
+
+int sceUserServiceGetForegroundUser(int* user_id) {
+	if (!user_id) {
+		return ORBIS_KERNEL_ERROR_EINVAL;
+	}
+
+	*user_id = HOST_USER_ID;
+
+	return 0;
+}
+
+/* Libraries come up, so the regular initialization order still runs. Everything else is left to the simulated backend. */
+
+int sceAppInstUtilInitialize(void) {
+	return 0;
+}
+
+int sceAppInstUtilTerminate(void) {
+	return 0;
+}
+
+int sceAppInstUtilAppUnInstall(const char* title_id) {
+	(void)title_id;
+	return ORBIS_KERNEL_ERROR_ENXIO;
+}
+
+int sceAppInstUtilAppUnInstallAddcont(const char* title_id, const char* entitlement_label) {
+	(void)title_id;
+	(void)entitlement_label;
+	return ORBIS_KERNEL_ERROR_ENXIO;
+}
+
+int sceAppInstUtilAppUnInstallPat(const char* title_id) {
+	(void)title_id;
+	return ORBIS_KERNEL_ERROR_ENXIO;
+}
+
+int sceAppInstUtilAppUnInstallTheme(const char* content_id) {
+	(void)content_id;
+	return ORBIS_KERNEL_ERROR_ENXIO;
+}
+
+int sceAppInstUtilAppExists(const char* title_id, int* exists) {
+	(void)title_id;
+	(void)exists;
+	return ORBIS_KERNEL_ERROR_ENXIO;
+}
+
+int sceAppInstUtilAppGetSize(const char* title_id, unsigned long* size) {
+	(void)title_id;
+	(void)size;
+	return ORBIS_KERNEL_ERROR_ENXIO;
+}
+
+int sceBgftServiceIntInit(OrbisBgftInitParams* params) {
+	(void)params;
+	return 0;
+}
+
+int sceBgftServiceIntTerm(void) {
+	return 0;
+}
+
+int sceBgftServiceIntDownloadRegisterTask(OrbisBgftDownloadParam* params, OrbisBgftTaskId* task_id) {
+	(void)params;
+	(void)task_id;
+	return ORBIS_KERNEL_ERROR_ENXIO;
+}
+
+int sceBgftServiceIntDebugDownloadRegisterPkg(OrbisBgftDownloadParam* params, OrbisBgftTaskId* task_id) {
+	(void)params;
+	(void)task_id;
+	return ORBIS_KERNEL_ERROR_ENXIO;
+}
+
+int sceBgftServiceDownloadStartTask(OrbisBgftTaskId task_id) {
+	(void)task_id;
+	return ORBIS_KERNEL_ERROR_ENXIO;
+}
+
+int sceBgftServiceDownloadStopTask(OrbisBgftTaskId task_id) {
+	(void)task_id;
+	return ORBIS_KERNEL_ERROR_ENXIO;
+}
+
+int sceBgftServiceDownloadPauseTask(OrbisBgftTaskId task_id) {
+	(void)task_id;
+	return ORBIS_KERNEL_ERROR_ENXIO;
+}
+
+int sceBgftServiceDownloadResumeTask(OrbisBgftTaskId task_id) {
+	(void)task_id;
+	return ORBIS_KERNEL_ERROR_ENXIO;
+}
+
+int sceBgftServiceIntDownloadUnregisterTask(OrbisBgftTaskId task_id) {
+	(void)task_id;
+	return ORBIS_KERNEL_ERROR_ENXIO;
+}
+
+int sceBgftServiceIntDownloadReregisterTaskPatch(OrbisBgftTaskId old_task_id, OrbisBgftTaskId* new_task_id) {
+	(void)old_task_id;
+	(void)new_task_id;
+	return ORBIS_KERNEL_ERROR_ENXIO;
+}
+
+int sceBgftServiceDownloadGetProgress(OrbisBgftTaskId task_id, OrbisBgftTaskProgress* progress) {
+	(void)task_id;
+	(void)progress;
+	return ORBIS_KERNEL_ERROR_ENXIO;
+}
+
+int sceBgftServiceDownloadFindTaskByContentId(const char* content_id, OrbisBgftTaskSubType sub_type, OrbisBgftTaskId* task_id) {
+	(void)content_id;
+	(void)sub_type;
+	(void)task_id;
+	return ORBIS_KERNEL_ERROR_ENXIO;
+}
+
+/* KPutil.c talks to the system UI and the kernel log, here everything goes to stderr. */
+
+void KernelPrintOut(const char* format, ...) {
+	va_list args;
+
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+}
+
+void Notify(const char* format, ...) {
+	va_list args;
+
+	fputs("[notify] ", stderr);
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fputc('\n', stderr);
+}
+
+void SafeExit(const char* reason, ...) {
+	va_list args;
+
+	va_start(args, reason);
+	vfprintf(stderr, reason, args);
+	va_end(args);
+	fputc('\n', stderr);
+
+	exit(1);
+}
@@ -0,0 +1,626 @@
+/* Host stand-ins for the net, network control, SSL and HTTP libraries, over plain sockets. HTTPS is not supported. */
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <orbis/NetCtl.h>
+
+#include "include/host.h"
+#include "../http.h"
+#include "../net.h"
+
+#define HTTP_ERROR_INVALID_ID 0x80431100
+#define HTTP_ERROR_OUT_OF_MEMORY 0x80431022
+#define HTTP_ERROR_INVALID_URL 0x80433060
+#define HTTP_ERROR_UNKNOWN_SCHEME 0x80431061
+#define HTTP_ERROR_RESOLVER 0x804310A0
+#define HTTP_ERROR_NETWORK 0x80431063
+#define HTTP_ERROR_BEFORE_SEND 0x80431028
+#define HTTP_ERROR_AFTER_SEND 0x80431029
+#define HTTP_ERROR_PARSE_HTTP_RESPONSE 0x80431068
+#define HTTP_ERROR_TOO_LARGE_RESPONSE_HEADER 0x80431072
+
+#define HTTP_MAX_OBJECTS 1024
+#define HTTP_MAX_HOST_SIZE 256
+#define HTTP_MAX_REQUEST_HEADERS_SIZE 4096
+#define HTTP_MAX_RESPONSE_HEADER_SIZE 16384
+
+#define USER_AGENT_SIZE 64
+
+enum http_object_kind {
+	HTTP_OBJECT_TEMPLATE = 1,
+	HTTP_OBJECT_CONNECTION,
+	HTTP_OBJECT_REQUEST,
+};
+
+/* Templates, connections and requests share one id space, like on the console. */
+struct http_object {
+	enum http_object_kind kind;
+	char user_agent[USER_AGENT_SIZE];
+	char host[HTTP_MAX_HOST_SIZE];
+	char port[8];
+	char* path;
+	int method;
+	char headers[HTTP_MAX_REQUEST_HEADERS_SIZE];
+	size_t headers_len;
+	int sock;
+	int status_code;
+	int content_length_type;
+	uint64_t content_length;
+	char* response; /* body bytes which came along with the header */
+	size_t response_off;
+	size_t response_len;
+};
+
+static pthread_mutex_t s_http_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct http_object* s_http_objects[HTTP_MAX_OBJECTS];
+
+static char s_ip_address[16] = "127.0.0.1";
+
+static int http_object_new(enum http_object_kind kind, struct http_object** obj);
+static struct http_object* http_object_get(int id, enum http_object_kind kind);
+static int http_object_delete(int id, enum http_object_kind kind);
+
+static bool parse_url(const char* url, char* host, size_t host_size, char* port, size_t port_size, const char** path);
+static int read_response_header(struct http_object* req);
+
+void host_set_ip_address(const char* ip_address) {
+	snprintf(s_ip_address, sizeof(s_ip_address), "%s", ip_address);
+}
+
+int sceNetInit(void) {
+	return 0;
+}
+
+int sceNetTerm(void) {
+	return 0;
+}
+
+int sceNetPoolCreate(const char* name, int size, int flags) {
+	(void)name;
+	(void)size;
+	(void)flags;
+	return 1;
+}
+
+int sceNetPoolDestroy(int mem_id) {
+	(void)mem_id;
+	return 0;
+}
+
+int sceNetErrnoLoc(void) {
+	return errno;
+}
+
+OrbisNetId sceNetSocket(const char* name, int family, int type, int protocol) {
+	(void)name;
+	return socket(family, type, protocol);
+}
+
+int sceNetSetsockopt(OrbisNetId s, int level, int optname, const void* optval, OrbisNetSocklen_t optlen) {
+	return setsockopt(s, level, optname, optval, optlen);
+}
+
+int sceNetBind(OrbisNetId s, const OrbisNetSockaddr* addr, OrbisNetSocklen_t addrlen) {
+	return bind(s, addr, addrlen);
+}
+
+int sceNetSend(OrbisNetId s, const void* data, size_t size, int flags) {
+	return (int)send(s, data, size, flags | MSG_NOSIGNAL);
+}
+
+int sceNetRecv(OrbisNetId s, void* data, size_t size, int flags) {
+	return (int)recv(s, data, size, flags);
+}
+
+int sceNetCtlInit(void) {
+	return 0;
+}
+
+void sceNetCtlTerm(void) {
+}
+
+int sceNetCtlGetInfo(int code, OrbisNetCtlInfo* info) {
+	if (code != ORBIS_NET_CTL_INFO_IP_ADDRESS || !info) {
+		return 0x80412102;
+	}
+
+	snprintf(info->ip_address, sizeof(info->ip_address), "%s", s_ip_address);
+
+	return 0;
+}
+
+int sceSslInit(size_t pool_size) {
+	(void)pool_size;
+	return 1;
+}
+
+int sceSslTerm(int ssl_ctx_id) {
+	(void)ssl_ctx_id;
+	return 0;
+}
+
+int sceHttpInit(int mem_id, int ssl_ctx_id, size_t pool_size) {
+	(void)mem_id;
+	(void)ssl_ctx_id;
+	(void)pool_size;
+	return 1;
+}
+
+int sceHttpTerm(int http_ctx_id) {
+	(void)http_ctx_id;
+	return 0;
+}
+
+int sceHttpCreateTemplate(int http_ctx_id, const char* user_agent, int http_ver, int proxy) {
+	struct http_object* tpl;
+	int ret;
+
+	(void)http_ctx_id;
+	(void)http_ver;
+	(void)proxy;
+
+	ret = http_object_new(HTTP_OBJECT_TEMPLATE, &tpl);
+	if (ret > 0) {
+		snprintf(tpl->user_agent, sizeof(tpl->user_agent), "%s", user_agent ? user_agent : "");
+	}
+
+	return ret;
+}
+
+int sceHttpDeleteTemplate(int tpl_id) {
+	return http_object_delete(tpl_id, HTTP_OBJECT_TEMPLATE);
+}
+
+int sceHttpsDisableOption(int id, unsigned int flags) {
+	(void)id;
+	(void)flags;
+	return 0;
+}
+
+int sceHttpCreateConnectionWithURL(int tpl_id, const char* url, bool keep_alive) {
+	struct http_object* tpl;
+	struct http_object* conn;
+	char host[HTTP_MAX_HOST_SIZE];
+	char port[8];
+	const char* path;
+	int ret;
+
+	(void)keep_alive;
+
+	tpl = http_object_get(tpl_id, HTTP_OBJECT_TEMPLATE);
+	if (!tpl) {
+		return HTTP_ERROR_INVALID_ID;
+	}
+	if (!url) {
+		return HTTP_ERROR_INVALID_URL;
+	}
+	if (strncasecmp(url, "http://", 7) != 0) {
+		return HTTP_ERROR_UNKNOWN_SCHEME;
+	}
+	if (!parse_url(url, host, sizeof(host), port, sizeof(port), &path)) {
+		return HTTP_ERROR_INVALID_URL;
+	}
+
+	ret = http_object_new(HTTP_OBJECT_CONNECTION, &conn);
+	if (ret > 0) {
+		memcpy(conn->user_agent, tpl->user_agent, sizeof(conn->user_agent));
+		memcpy(conn->host, host, sizeof(conn->host));
+		memcpy(conn->port, port, sizeof(conn->port));
+	}
+
+	return ret;
+}
+
+int sceHttpDeleteConnection(int conn_id) {
+	return http_object_delete(conn_id, HTTP_OBJECT_CONNECTION);
+}
+
+int sceHttpCreateRequestWithURL(int conn_id, int method, const char* url, unsigned long long content_length) {
+	struct http_object* conn;
+	struct http_object* req;
+	char host[HTTP_MAX_HOST_SIZE];
+	char port[8];
+	const char* path;
+	int ret;
+
+	(void)content_length;
+
+	conn = http_object_get(conn_id, HTTP_OBJECT_CONNECTION);
+	if (!conn) {
+		return HTTP_ERROR_INVALID_ID;
+	}
+	if (!url || !parse_url(url, host, sizeof(host), port, sizeof(port), &path)) {
+		return HTTP_ERROR_INVALID_URL;
+	}
+
+	ret = http_object_new(HTTP_OBJECT_REQUEST, &req);
+	if (ret <= 0) {
+		return ret;
+	}
+
+	memcpy(req->user_agent, conn->user_agent, sizeof(req->user_agent));
+	memcpy(req->host, conn->host, sizeof(req->host));
+	memcpy(req->port, conn->port, sizeof(req->port));
+	req->method = method;
+	req->path = strdup(*path ? path : "/");
+	if (!req->path) {
+		http_object_delete(ret, HTTP_OBJECT_REQUEST);
+		return HTTP_ERROR_OUT_OF_MEMORY;
+	}
+
+	return ret;
+}
+
+int sceHttpDeleteRequest(int req_id) {
+	return http_object_delete(req_id, HTTP_OBJECT_REQUEST);
+}
+
+int sceHttpAddRequestHeader(int req_id, const char* name, const char* value, int mode) {
+	struct http_object* req;
+	int len;
+
+	(void)mode;
+
+	req = http_object_get(req_id, HTTP_OBJECT_REQUEST);
+	if (!req) {
+		return HTTP_ERROR_INVALID_ID;
+	}
+	if (req->sock >= 0) {
+		return HTTP_ERROR_AFTER_SEND;
+	}
+
+	len = snprintf(req->headers + req->headers_len, sizeof(req->headers) - req->headers_len, "%s: %s\r\n", name, value);
+	if (len < 0 || (size_t)len >= sizeof(req->headers) - req->headers_len) {
+		req->headers[req->headers_len] = '\0';
+		return HTTP_ERROR_OUT_OF_MEMORY;
+	}
+	req->headers_len += len;
+
+	return 0;
+}
+
+int sceHttpSendRequest(int req_id, const void* post_data, size_t size) {
+	static const char* const methods[] = { "GET", "POST", "HEAD" };
+	struct http_object* req;
+	struct addrinfo hints, *res = NULL, *ai;
+	char content_length_line[48] = "";
+	char* line = NULL;
+	int line_len;
+	ssize_t sent;
+	size_t off;
+	int ret;
+
+	req = http_object_get(req_id, HTTP_OBJECT_REQUEST);
+	if (!req) {
+		return HTTP_ERROR_INVALID_ID;
+	}
+	if (req->sock >= 0) {
+		return HTTP_ERROR_AFTER_SEND;
+	}
+	if (req->method < 0 || req->method >= (int)(sizeof(methods) / sizeof(*methods))) {
+		return HTTP_ERROR_BEFORE_SEND;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if (getaddrinfo(req->host, req->port, &hints, &res) != 0) {
+		return HTTP_ERROR_RESOLVER;
+	}
+	for (ai = res; ai; ai = ai->ai_next) {
+		req->sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (req->sock < 0) {
+			continue;
+		}
+		if (connect(req->sock, ai->ai_addr, ai->ai_addrlen) == 0) {
+			break;
+		}
+		close(req->sock);
+		req->sock = -1;
+	}
+	freeaddrinfo(res);
+
+	if (req->sock < 0) {
+		return HTTP_ERROR_NETWORK;
+	}
+
+	if (post_data) {
+		snprintf(content_length_line, sizeof(content_length_line), "Content-Length: %zu\r\n", size);
+	}
+
+	/* One request per connection keeps the response framing trivial. */
+	line_len = asprintf(&line,
+		"%s %s HTTP/1.1\r\nHost: %s:%s\r\nUser-Agent: %s\r\nConnection: close\r\n%s%s\r\n",
+		methods[req->method], req->path, req->host, req->port, req->user_agent, content_length_line, req->headers
+	);
+	if (line_len < 0) {
+		return HTTP_ERROR_OUT_OF_MEMORY;
+	}
+
+	ret = 0;
+	for (off = 0; off < (size_t)line_len; off += sent) {
+		sent = send(req->sock, line + off, (size_t)line_len - off, MSG_NOSIGNAL);
+		if (sent <= 0) {
+			ret = HTTP_ERROR_NETWORK;
+			break;
+		}
+	}
+	free(line);
+
+	for (off = 0; ret == 0 && post_data && off < size; off += sent) {
+		sent = send(req->sock, (const char*)post_data + off, size - off, MSG_NOSIGNAL);
+		if (sent <= 0) {
+			ret = HTTP_ERROR_NETWORK;
+		}
+	}
+
+	if (ret == 0) {
+		ret = read_response_header(req);
+	}
+
+	return ret;
+}
+
+int sceHttpGetStatusCode(int req_id, int* status_code) {
+	struct http_object* req;
+
+	req = http_object_get(req_id, HTTP_OBJECT_REQUEST);
+	if (!req) {
+		return HTTP_ERROR_INVALID_ID;
+	}
+	if (req->sock < 0) {
+		return HTTP_ERROR_BEFORE_SEND;
+	}
+
+	*status_code = req->status_code;
+
+	return 0;
+}
+
+int sceHttpGetResponseContentLength(int req_id, int* result, size_t* content_length) {
+	struct http_object* req;
+
+	req = http_object_get(req_id, HTTP_OBJECT_REQUEST);
+	if (!req) {
+		return HTTP_ERROR_INVALID_ID;
+	}
+	if (req->sock < 0) {
+		return HTTP_ERROR_BEFORE_SEND;
+	}
+
+	*result = req->content_length_type;
+	*content_length = req->content_length_type == ORBIS_HTTP_CONTENTLEN_EXIST ? req->content_length : 0;
+
+	return 0;
+}
+
+int sceHttpReadData(int req_id, void* data, unsigned int size) {
+	struct http_object* req;
+	size_t avail;
+	ssize_t ret;
+
+	req = http_object_get(req_id, HTTP_OBJECT_REQUEST);
+	if (!req) {
+		return HTTP_ERROR_INVALID_ID;
+	}
+	if (req->sock < 0) {
+		return HTTP_ERROR_BEFORE_SEND;
+	}
+
+	avail = req->response_len - req->response_off;
+	if (avail > 0) {
+		if (avail > size) {
+			avail = size;
+		}
+		memcpy(data, req->response + req->response_off, avail);
+		req->response_off += avail;
+		return (int)avail;
+	}
+
+	do {
+		ret = recv(req->sock, data, size, 0);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret < 0 ? (int)HTTP_ERROR_NETWORK : (int)ret;
+}
+
+/* Reads up to the end of the header, whatever body bytes come along are kept for sceHttpReadData. */
+static int read_response_header(struct http_object* req) {
+	char* buf;
+	char* end = NULL;
+	char* line;
+	char* next;
+	char* value;
+	size_t len = 0;
+	ssize_t ret;
+
+	buf = (char*)malloc(HTTP_MAX_RESPONSE_HEADER_SIZE + 1);
+	if (!buf) {
+		return HTTP_ERROR_OUT_OF_MEMORY;
+	}
+
+	while (!end) {
+		if (len == HTTP_MAX_RESPONSE_HEADER_SIZE) {
+			free(buf);
+			return HTTP_ERROR_TOO_LARGE_RESPONSE_HEADER;
+		}
+
+		ret = recv(req->sock, buf + len, HTTP_MAX_RESPONSE_HEADER_SIZE - len, 0);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret <= 0) {
+			free(buf);
+			return HTTP_ERROR_PARSE_HTTP_RESPONSE;
+		}
+		len += (size_t)ret;
+		buf[len] = '\0';
+
+		end = strstr(buf, "\r\n\r\n");
+	}
+
+	*end = '\0';
+	req->response = buf;
+	req->response_off = (size_t)(end + 4 - buf);
+	req->response_len = len;
+
+	if (sscanf(buf, "HTTP/%*u.%*u %d", &req->status_code) != 1) {
+		return HTTP_ERROR_PARSE_HTTP_RESPONSE;
+	}
+
+	req->content_length_type = ORBIS_HTTP_CONTENTLEN_NOT_FOUND;
+
+	for (line = strstr(buf, "\r\n"); line; line = next) {
+		line += 2;
+		next = strstr(line, "\r\n");
+		if (next) {
+			*next = '\0';
+		}
+
+		value = strchr(line, ':');
+		if (!value) {
+			continue;
+		}
+		*value++ = '\0';
+		while (isspace((unsigned char)*value)) {
+			++value;
+		}
+
+		if (strcasecmp(line, "Content-Length") == 0) {
+			req->content_length = strtoull(value, NULL, 10);
+			req->content_length_type = ORBIS_HTTP_CONTENTLEN_EXIST;
+		} else if (strcasecmp(line, "Transfer-Encoding") == 0 && strcasecmp(value, "chunked") == 0) {
+			req->content_length_type = ORBIS_HTTP_CONTENTLEN_CHUNK_ENC;
+		}
+	}
+
+	return 0;
+}
+
+/* Splits http://host[:port]/path, the path points into the URL. */
+static bool parse_url(const char* url, char* host, size_t host_size, char* port, size_t port_size, const char** path) {
+	const char* start;
+	const char* end;
+	const char* colon;
+	size_t len;
+
+	start = strstr(url, "://");
+	if (!start) {
+		return false;
+	}
+	start += 3;
+
+	end = start + strcspn(start, "/?#");
+	colon = memchr(start, ':', (size_t)(end - start));
+
+	len = (size_t)((colon ? colon : end) - start);
+	if (len == 0 || len >= host_size) {
+		return false;
+	}
+	memcpy(host, start, len);
+	host[len] = '\0';
+
+	if (colon) {
+		len = (size_t)(end - colon - 1);
+		if (len == 0 || len >= port_size) {
+			return false;
+		}
+		memcpy(port, colon + 1, len);
+		port[len] = '\0';
+	} else {
+		snprintf(port, port_size, "80");
+	}
+
+	*path = end;
+
+	return true;
+}
+
+static int http_object_new(enum http_object_kind kind, struct http_object** obj) {
+	struct http_object* new_obj;
+	int i;
+
+	new_obj = (struct http_object*)calloc(1, sizeof(*new_obj));
+	if (!new_obj) {
+		return HTTP_ERROR_OUT_OF_MEMORY;
+	}
+	new_obj->kind = kind;
+	new_obj->sock = -1;
+
+	pthread_mutex_lock(&s_http_mtx);
+	for (i = 0; i < HTTP_MAX_OBJECTS; ++i) {
+		if (!s_http_objects[i]) {
+			s_http_objects[i] = new_obj;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&s_http_mtx);
+
+	if (i == HTTP_MAX_OBJECTS) {
+		free(new_obj);
+		return HTTP_ERROR_OUT_OF_MEMORY;
+	}
+
+	*obj = new_obj;
+
+	return i + 1;
+}
+
+/* Objects are used by the thread which created them, only the table is shared. */
+static struct http_object* http_object_get(int id, enum http_object_kind kind) {
+	struct http_object* obj = NULL;
+
+	if (id <= 0 || id > HTTP_MAX_OBJECTS) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&s_http_mtx);
+	if (s_http_objects[id - 1] && s_http_objects[id - 1]->kind == kind) {
+		obj = s_http_objects[id - 1];
+	}
+	pthread_mutex_unlock(&s_http_mtx);
+
+	return obj;
+}
+
+static int http_object_delete(int id, enum http_object_kind kind) {
+	struct http_object* obj = NULL;
+
+	if (id <= 0 || id > HTTP_MAX_OBJECTS) {
+		return HTTP_ERROR_INVALID_ID;
+	}
+
+	pthread_mutex_lock(&s_http_mtx);
+	if (s_http_objects[id - 1] && s_http_objects[id - 1]->kind == kind) {
+		obj = s_http_objects[id - 1];
+		s_http_objects[id - 1] = NULL;
+	}
+	pthread_mutex_unlock(&s_http_mtx);
+
+	if (!obj) {
+		return HTTP_ERROR_INVALID_ID;
+	}
+
+	if (obj->sock >= 0) {
+		close(obj->sock);
+	}
+	free(obj->response);
+	free(obj->path);
+	free(obj);
+
+	return 0;
+}
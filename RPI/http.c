@@ -1,7 +1,6 @@
 #include "http.h"
 
 #include <orbis/NpCommon.h>
-#include <orbis/NpUtility.h>
 
 #include "net.h"
 #include "ssl.h"
@@ -59,7 +58,7 @@ bool http_init(void)
 	ret = sceHttpInit(net_get_mem_id(), s_libssl_ctx_id, HTTP_HEAP_SIZE);
 	if (ret < 0) {
 		EPRINTF("sceHttpInit failed: 0x%08X\n", ret);
-		goto err;
+		goto err_ssl_terminate;
 	}
 	s_libhttp_ctx_id = ret;
 
@@ -68,13 +67,6 @@ bool http_init(void)
 done:
 	return true;
 
-err_http_terminate:
-	ret = sceHttpTerm(s_libhttp_ctx_id);
-	if (ret) {
-		EPRINTF("sceHttpTerm failed: 0x%08X\n", ret);
-	}
-	s_libhttp_ctx_id = -1;
-
 err_ssl_terminate:
 	ret = sceSslTerm(s_libssl_ctx_id);
 	if (ret) {
@@ -211,128 +203,6 @@ err:
 	return status;
 }
 
-bool http_escape_uri(char** out, size_t* out_size, const char* in) {
-	char* tmp = NULL;
-	size_t tmp_size;
-	bool status = false;
-	int ret;
-
-	if (!s_http_initialized) {
-		goto err;
-	}
-
-	if (!in) {
-		goto err;
-	}
-
-	ret = sceHttpUriEscape(NULL, &tmp_size, 0, in);
-	if (ret) {
-		EPRINTF("sceHttpUriEscape failed: 0x%08X\n", ret);
-		goto err;
-	}
-
-	tmp = (char*)malloc(tmp_size);
-	if (!tmp) {
-		EPRINTF("malloc failed\n");
-		goto err;
-	}
-	memset(tmp, 0, tmp_size);
-
-	ret = sceHttpUriEscape(tmp, out_size, tmp_size, in);
-	if (ret) {
-		EPRINTF("sceHttpUriEscape failed: 0x%08X\n", ret);
-		goto err;
-	}
-
-	if (out) {
-		*out = tmp;
-		tmp = NULL;
-	}
-
-	status = true;
-
-err:
-	if (tmp) {
-		free(tmp);
-	}
-
-	return status;
-}
-
-bool http_unescape_uri(char** out, size_t* out_size, const char* in) {
-	char* tmp = NULL;
-	size_t tmp_size;
-	bool status = false;
-	int ret;
-
-	if (!s_http_initialized) {
-		goto err;
-	}
-
-	if (!in) {
-		goto err;
-	}
-
-	ret = sceHttpUriUnescape(NULL, &tmp_size, 0, in);
-	if (ret) {
-		EPRINTF("sceHttpUriUnescape failed: 0x%08X\n", ret);
-		goto err;
-	}
-
-	tmp = (char*)malloc(tmp_size);
-	if (!tmp) {
-		EPRINTF("malloc failed\n");
-		goto err;
-	}
-	memset(tmp, 0, tmp_size);
-
-	ret = sceHttpUriUnescape(tmp, out_size, tmp_size, in);
-	if (ret) {
-		EPRINTF("sceHttpUriUnescape failed: 0x%08X\n", ret);
-		goto err;
-	}
-
-	if (out) {
-		*out = tmp;
-		tmp = NULL;
-	}
-
-	status = true;
-
-err:
-	if (tmp) {
-		free(tmp);
-	}
-
-	return status;
-}
-
-bool http_escape_json_string(char* out, size_t max_out_size, const char* in) {
-	bool status = false;
-	int ret;
-
-	if (!s_http_initialized) {
-		goto err;
-	}
-
-	if (!in) {
-		goto err;
-	}
-
-	memset(out, 0, max_out_size);
-
-	ret = sceNpUtilJsonEscape(out, max_out_size, in, strlen(in));
-	if (ret) {
-		EPRINTF("sceNpUtilJsonEscape failed: 0x%08X\n", ret);
-		goto err;
-	}
-
-	status = true;
-
-err:
-	return status;
-}
-
 static int download_file_cb(void* arg, int req_id, int status_code, uint64_t content_length, int content_length_type) {
 	struct download_file_cb_args* args = (struct download_file_cb_args*)arg;
 	uint8_t* chunk;
@@ -3,6 +3,7 @@
 #include "util.h"
 #include "module.h"
 #include "KPutil.h"
+#include "dispatcher.h"
 
 #include <orbis/libkernel.h>
 #include <orbis/userservice.h>
@@ -15,7 +16,6 @@
 #define WAIT_TIME (UINT64_C(5) * 1000 * 1000) /* 5 secs */
 
 #define SCE_BGFT_INVALID_TASK_ID (-1)
-#define SCE_BGFT_ERROR_SAME_APPLICATION_ALREADY_INSTALLED (0x80990088)
 
 enum bgft_task_option_t {
 	BGFT_TASK_OPTION_NONE = 0x0,
@@ -29,13 +29,93 @@ enum bgft_task_option_t {
 	BGFT_TASK_OPTION_DISABLE_CDN_QUERY_PARAM = 0x10000,
 };
 
+/* Indexes into s_ops. */
+enum installer_op {
+	INSTALLER_OP_UNINSTALL_GAME,
+	INSTALLER_OP_UNINSTALL_AC,
+	INSTALLER_OP_UNINSTALL_PATCH,
+	INSTALLER_OP_UNINSTALL_THEME,
+	INSTALLER_OP_IS_EXISTS,
+	INSTALLER_OP_GET_SIZE,
+	INSTALLER_OP_REGISTER_PACKAGE_TASK,
+	INSTALLER_OP_START_TASK,
+	INSTALLER_OP_STOP_TASK,
+	INSTALLER_OP_PAUSE_TASK,
+	INSTALLER_OP_RESUME_TASK,
+	INSTALLER_OP_UNREGISTER_TASK,
+	INSTALLER_OP_REREGISTER_TASK_PATCH,
+	INSTALLER_OP_GET_TASK_PROGRESS,
+	INSTALLER_OP_FIND_TASK_BY_CONTENT_ID,
+};
+
+struct register_task_params {
+	const char* content_id;
+	const char* content_url;
+	const char* content_name;
+	const char* icon_path;
+	const char* package_type;
+	const char* package_sub_type;
+	unsigned long package_size;
+	bool is_patch;
+};
+
+/* Arguments and results of one call, it lives on the stack of the calling thread. */
+struct installer_call {
+	const char* id; /* title id or content id */
+	int task_id;
+	int sub_type;
+	const struct register_task_params* params;
+	bool* exists;
+	unsigned long* size;
+	int* out_task_id;
+	struct bgft_download_task_progress_info* progress_info;
+	bool status;
+	int error; /* zero unless the operation reported one */
+};
+
 static OrbisBgftInitParams s_bgft_init_params;
 
 static bool s_app_inst_util_initialized = false;
 static bool s_bgft_initialized = false;
 
-static bool modify_download_task_for_patch_internal(const char* path, int index);
-static bool modify_download_task_for_patch(OrbisBgftTaskId task_id);
+static bool do_app_inst_util_uninstall_game(const char* title_id, int* error);
+static bool do_app_inst_util_uninstall_ac(const char* content_id, int* error);
+static bool do_app_inst_util_uninstall_patch(const char* title_id, int* error);
+static bool do_app_inst_util_uninstall_theme(const char* content_id, int* error);
+static bool do_app_inst_util_is_exists(const char* title_id, bool* exists, int* error);
+static bool do_app_inst_util_get_size(const char* title_id, unsigned long* size, int* error);
+static bool do_bgft_download_register_package_task(const char* content_id, const char* content_url, const char* content_name, const char* icon_path, const char* package_type, const char* package_sub_type, unsigned long package_size, bool is_patch, int* out_task_id, int* error);
+static bool do_bgft_download_start_task(int task_id, int* error);
+static bool do_bgft_download_stop_task(int task_id, int* error);
+static bool do_bgft_download_pause_task(int task_id, int* error);
+static bool do_bgft_download_resume_task(int task_id, int* error);
+static bool do_bgft_download_unregister_task(int task_id, int* error);
+static bool do_bgft_download_reregister_task_patch(int old_task_id, int* new_task_id, int* error);
+static bool do_bgft_download_get_task_progress(int task_id, struct bgft_download_task_progress_info* progress_info, int* error);
+static bool do_bgft_download_find_task_by_content_id(const char* content_id, int sub_type, int* task_id, int* error);
+
+static bool dispatch(enum installer_op op, struct installer_call* call, int* error);
+
+static const struct installer_backend s_sce_backend = {
+	"sce",
+	&do_app_inst_util_uninstall_game,
+	&do_app_inst_util_uninstall_ac,
+	&do_app_inst_util_uninstall_patch,
+	&do_app_inst_util_uninstall_theme,
+	&do_app_inst_util_is_exists,
+	&do_app_inst_util_get_size,
+	&do_bgft_download_register_package_task,
+	&do_bgft_download_start_task,
+	&do_bgft_download_stop_task,
+	&do_bgft_download_pause_task,
+	&do_bgft_download_resume_task,
+	&do_bgft_download_unregister_task,
+	&do_bgft_download_reregister_task_patch,
+	&do_bgft_download_get_task_progress,
+	&do_bgft_download_find_task_by_content_id,
+};
+
+static const struct installer_backend* s_backend = &s_sce_backend;
 
 bool app_inst_util_init(void) {
 	int ret;
@@ -76,7 +156,7 @@ void app_inst_util_fini(void) {
 	s_app_inst_util_initialized = false;
 }
 
-bool app_inst_util_uninstall_game(const char* title_id, int* error) {
+static bool do_app_inst_util_uninstall_game(const char* title_id, int* error) {
 	int ret;
 
 	if (!s_app_inst_util_initialized) {
@@ -110,7 +190,7 @@ err:
 	return false;
 }
 
-bool app_inst_util_uninstall_ac(const char* content_id, int* error) {
+static bool do_app_inst_util_uninstall_ac(const char* content_id, int* error) {
 	struct pkg_content_info content_info;
 	int ret;
 
@@ -143,14 +223,13 @@ invalid_content_id:
 		goto err;
 	}
 
-done:
 	return true;
 
 err:
 	return false;
 }
 
-bool app_inst_util_uninstall_patch(const char* title_id, int* error) {
+static bool do_app_inst_util_uninstall_patch(const char* title_id, int* error) {
 	int ret;
 
 	if (!s_app_inst_util_initialized) {
@@ -184,7 +263,7 @@ err:
 	return false;
 }
 
-bool app_inst_util_uninstall_theme(const char* content_id, int* error) {
+static bool do_app_inst_util_uninstall_theme(const char* content_id, int* error) {
 	int ret;
 
 	if (!s_app_inst_util_initialized) {
@@ -218,7 +297,7 @@ err:
 	return false;
 }
 
-bool app_inst_util_is_exists(const char* title_id, bool* exists, int* error) {
+static bool do_app_inst_util_is_exists(const char* title_id, bool* exists, int* error) {
 	int flag;
 	int ret;
 
@@ -257,7 +336,7 @@ err:
 	return false;
 }
 
-bool app_inst_util_get_size(const char* title_id, unsigned long* size, int* error) {
+static bool do_app_inst_util_get_size(const char* title_id, unsigned long* size, int* error) {
 	int ret;
 
 	if (!s_app_inst_util_initialized) {
@@ -358,7 +437,7 @@ void bgft_fini(void) {
 	s_bgft_initialized = false;
 }
 
-bool bgft_download_register_package_task(const char* content_id, const char* content_url, const char* content_name, const char* icon_path, const char* package_type, const char* package_sub_type, unsigned long package_size, bool is_patch, int* out_task_id, int* error)
+static bool do_bgft_download_register_package_task(const char* content_id, const char* content_url, const char* content_name, const char* icon_path, const char* package_type, const char* package_sub_type, unsigned long package_size, bool is_patch, int* out_task_id, int* error)
 {
 	OrbisBgftDownloadParam params;
 	OrbisBgftDownloadRegisterErrorInfo error_info;
@@ -445,7 +524,7 @@ err:
 	return false;
 }
 
-bool bgft_download_start_task(int task_id, int* error) {
+static bool do_bgft_download_start_task(int task_id, int* error) {
 	int ret;
 
 	if (!s_bgft_initialized) {
@@ -479,7 +558,7 @@ err:
 	return false;
 }
 
-bool bgft_download_stop_task(int task_id, int* error) {
+static bool do_bgft_download_stop_task(int task_id, int* error) {
 	int ret;
 
 	if (!s_bgft_initialized) {
@@ -513,7 +592,7 @@ err:
 	return false;
 }
 
-bool bgft_download_pause_task(int task_id, int* error) {
+static bool do_bgft_download_pause_task(int task_id, int* error) {
 	int ret;
 
 	if (!s_bgft_initialized) {
@@ -547,7 +626,7 @@ err:
 	return false;
 }
 
-bool bgft_download_resume_task(int task_id, int* error) {
+static bool do_bgft_download_resume_task(int task_id, int* error) {
 	int ret;
 
 	if (!s_bgft_initialized) {
@@ -581,7 +660,7 @@ err:
 	return false;
 }
 
-bool bgft_download_unregister_task(int task_id, int* error) {
+static bool do_bgft_download_unregister_task(int task_id, int* error) {
 	int ret;
 
 	if (!s_bgft_initialized) {
@@ -615,7 +694,7 @@ err:
 	return false;
 }
 
-bool bgft_download_reregister_task_patch(int old_task_id, int* new_task_id, int* error) {
+static bool do_bgft_download_reregister_task_patch(int old_task_id, int* new_task_id, int* error) {
 	OrbisBgftTaskId tmp_id;
 	int ret;
 
@@ -655,7 +734,7 @@ err:
 	return false;
 }
 
-bool bgft_download_get_task_progress(int task_id, struct bgft_download_task_progress_info* progress_info, int* error) {
+static bool do_bgft_download_get_task_progress(int task_id, struct bgft_download_task_progress_info* progress_info, int* error) {
 	OrbisBgftTaskProgress tmp_progress_info;
 	int ret;
 
@@ -714,7 +793,7 @@ err:
 	return false;
 }
 
-bool bgft_download_find_task_by_content_id(const char* content_id, int sub_type, int* task_id, int* error) {
+static bool do_bgft_download_find_task_by_content_id(const char* content_id, int sub_type, int* task_id, int* error) {
 	OrbisBgftTaskId tmp_id;
 	int ret;
 
@@ -760,3 +839,300 @@ bool bgft_download_find_task_by_content_id(const char* content_id, int sub_type,
 err:
 	return false;
 }
+
+static void exec_uninstall_game(void* arg) {
+	struct installer_call* call = (struct installer_call*)arg;
+	call->status = (*s_backend->uninstall_game)(call->id, &call->error);
+}
+
+static void exec_uninstall_ac(void* arg) {
+	struct installer_call* call = (struct installer_call*)arg;
+	call->status = (*s_backend->uninstall_ac)(call->id, &call->error);
+}
+
+static void exec_uninstall_patch(void* arg) {
+	struct installer_call* call = (struct installer_call*)arg;
+	call->status = (*s_backend->uninstall_patch)(call->id, &call->error);
+}
+
+static void exec_uninstall_theme(void* arg) {
+	struct installer_call* call = (struct installer_call*)arg;
+	call->status = (*s_backend->uninstall_theme)(call->id, &call->error);
+}
+
+static void exec_is_exists(void* arg) {
+	struct installer_call* call = (struct installer_call*)arg;
+	call->status = (*s_backend->is_exists)(call->id, call->exists, &call->error);
+}
+
+static void exec_get_size(void* arg) {
+	struct installer_call* call = (struct installer_call*)arg;
+	call->status = (*s_backend->get_size)(call->id, call->size, &call->error);
+}
+
+static void exec_register_package_task(void* arg) {
+	struct installer_call* call = (struct installer_call*)arg;
+	const struct register_task_params* params = call->params;
+	call->status = (*s_backend->register_package_task)(params->content_id, params->content_url, params->content_name, params->icon_path, params->package_type, params->package_sub_type, params->package_size, params->is_patch, call->out_task_id, &call->error);
+}
+
+static void exec_start_task(void* arg) {
+	struct installer_call* call = (struct installer_call*)arg;
+	call->status = (*s_backend->start_task)(call->task_id, &call->error);
+}
+
+static void exec_stop_task(void* arg) {
+	struct installer_call* call = (struct installer_call*)arg;
+	call->status = (*s_backend->stop_task)(call->task_id, &call->error);
+}
+
+static void exec_pause_task(void* arg) {
+	struct installer_call* call = (struct installer_call*)arg;
+	call->status = (*s_backend->pause_task)(call->task_id, &call->error);
+}
+
+static void exec_resume_task(void* arg) {
+	struct installer_call* call = (struct installer_call*)arg;
+	call->status = (*s_backend->resume_task)(call->task_id, &call->error);
+}
+
+static void exec_unregister_task(void* arg) {
+	struct installer_call* call = (struct installer_call*)arg;
+	call->status = (*s_backend->unregister_task)(call->task_id, &call->error);
+}
+
+static void exec_reregister_task_patch(void* arg) {
+	struct installer_call* call = (struct installer_call*)arg;
+	call->status = (*s_backend->reregister_task_patch)(call->task_id, call->out_task_id, &call->error);
+}
+
+static void exec_get_task_progress(void* arg) {
+	struct installer_call* call = (struct installer_call*)arg;
+	call->status = (*s_backend->get_task_progress)(call->task_id, call->progress_info, &call->error);
+}
+
+/* Back to back reads of the same task, e.g. from several event streams, only query BGFT once. */
+static bool merge_get_task_progress(void* arg, const void* prev_arg) {
+	struct installer_call* call = (struct installer_call*)arg;
+	const struct installer_call* prev = (const struct installer_call*)prev_arg;
+
+	if (call->task_id != prev->task_id || !call->progress_info || !prev->progress_info) {
+		return false;
+	}
+
+	if (prev->status) {
+		memcpy(call->progress_info, prev->progress_info, sizeof(*call->progress_info));
+	}
+	call->status = prev->status;
+	call->error = prev->error;
+
+	return true;
+}
+
+static void exec_find_task_by_content_id(void* arg) {
+	struct installer_call* call = (struct installer_call*)arg;
+	call->status = (*s_backend->find_task_by_content_id)(call->id, call->sub_type, call->out_task_id, &call->error);
+}
+
+/* Indexed by enum installer_op. */
+static const struct dispatcher_op_desc s_ops[] = {
+	{ "uninstall_game", &exec_uninstall_game, NULL },
+	{ "uninstall_ac", &exec_uninstall_ac, NULL },
+	{ "uninstall_patch", &exec_uninstall_patch, NULL },
+	{ "uninstall_theme", &exec_uninstall_theme, NULL },
+	{ "is_exists", &exec_is_exists, NULL },
+	{ "get_size", &exec_get_size, NULL },
+	{ "register_package_task", &exec_register_package_task, NULL },
+	{ "start_task", &exec_start_task, NULL },
+	{ "stop_task", &exec_stop_task, NULL },
+	{ "pause_task", &exec_pause_task, NULL },
+	{ "resume_task", &exec_resume_task, NULL },
+	{ "unregister_task", &exec_unregister_task, NULL },
+	{ "reregister_task_patch", &exec_reregister_task_patch, NULL },
+	{ "get_task_progress", &exec_get_task_progress, &merge_get_task_progress },
+	{ "find_task_by_content_id", &exec_find_task_by_content_id, NULL },
+};
+
+void installer_set_backend(const struct installer_backend* backend) {
+	s_backend = backend ? backend : &s_sce_backend;
+}
+
+const struct installer_backend* installer_get_backend(void) {
+	return s_backend;
+}
+
+bool installer_dispatcher_init(void) {
+	return dispatcher_init(s_ops, ARRAY_SIZE(s_ops));
+}
+
+void installer_dispatcher_fini(void) {
+	dispatcher_fini();
+}
+
+bool app_inst_util_uninstall_game(const char* title_id, int* error) {
+	struct installer_call call;
+
+	memset(&call, 0, sizeof(call));
+	call.id = title_id;
+
+	return dispatch(INSTALLER_OP_UNINSTALL_GAME, &call, error);
+}
+
+bool app_inst_util_uninstall_ac(const char* content_id, int* error) {
+	struct installer_call call;
+
+	memset(&call, 0, sizeof(call));
+	call.id = content_id;
+
+	return dispatch(INSTALLER_OP_UNINSTALL_AC, &call, error);
+}
+
+bool app_inst_util_uninstall_patch(const char* title_id, int* error) {
+	struct installer_call call;
+
+	memset(&call, 0, sizeof(call));
+	call.id = title_id;
+
+	return dispatch(INSTALLER_OP_UNINSTALL_PATCH, &call, error);
+}
+
+bool app_inst_util_uninstall_theme(const char* content_id, int* error) {
+	struct installer_call call;
+
+	memset(&call, 0, sizeof(call));
+	call.id = content_id;
+
+	return dispatch(INSTALLER_OP_UNINSTALL_THEME, &call, error);
+}
+
+bool app_inst_util_is_exists(const char* title_id, bool* exists, int* error) {
+	struct installer_call call;
+
+	memset(&call, 0, sizeof(call));
+	call.id = title_id;
+	call.exists = exists;
+
+	return dispatch(INSTALLER_OP_IS_EXISTS, &call, error);
+}
+
+bool app_inst_util_get_size(const char* title_id, unsigned long* size, int* error) {
+	struct installer_call call;
+
+	memset(&call, 0, sizeof(call));
+	call.id = title_id;
+	call.size = size;
+
+	return dispatch(INSTALLER_OP_GET_SIZE, &call, error);
+}
+
+bool bgft_download_register_package_task(const char* content_id, const char* content_url, const char* content_name, const char* icon_path, const char* package_type, const char* package_sub_type, unsigned long package_size, bool is_patch, int* task_id, int* error) {
+	struct register_task_params params;
+	struct installer_call call;
+
+	memset(&params, 0, sizeof(params));
+	{
+		params.content_id = content_id;
+		params.content_url = content_url;
+		params.content_name = content_name;
+		params.icon_path = icon_path;
+		params.package_type = package_type;
+		params.package_sub_type = package_sub_type;
+		params.package_size = package_size;
+		params.is_patch = is_patch;
+	}
+
+	memset(&call, 0, sizeof(call));
+	call.params = &params;
+	call.out_task_id = task_id;
+
+	return dispatch(INSTALLER_OP_REGISTER_PACKAGE_TASK, &call, error);
+}
+
+bool bgft_download_start_task(int task_id, int* error) {
+	struct installer_call call;
+
+	memset(&call, 0, sizeof(call));
+	call.task_id = task_id;
+
+	return dispatch(INSTALLER_OP_START_TASK, &call, error);
+}
+
+bool bgft_download_stop_task(int task_id, int* error) {
+	struct installer_call call;
+
+	memset(&call, 0, sizeof(call));
+	call.task_id = task_id;
+
+	return dispatch(INSTALLER_OP_STOP_TASK, &call, error);
+}
+
+bool bgft_download_pause_task(int task_id, int* error) {
+	struct installer_call call;
+
+	memset(&call, 0, sizeof(call));
+	call.task_id = task_id;
+
+	return dispatch(INSTALLER_OP_PAUSE_TASK, &call, error);
+}
+
+bool bgft_download_resume_task(int task_id, int* error) {
+	struct installer_call call;
+
+	memset(&call, 0, sizeof(call));
+	call.task_id = task_id;
+
+	return dispatch(INSTALLER_OP_RESUME_TASK, &call, error);
+}
+
+bool bgft_download_unregister_task(int task_id, int* error) {
+	struct installer_call call;
+
+	memset(&call, 0, sizeof(call));
+	call.task_id = task_id;
+
+	return dispatch(INSTALLER_OP_UNREGISTER_TASK, &call, error);
+}
+
+bool bgft_download_reregister_task_patch(int old_task_id, int* new_task_id, int* error) {
+	struct installer_call call;
+
+	memset(&call, 0, sizeof(call));
+	call.task_id = old_task_id;
+	call.out_task_id = new_task_id;
+
+	return dispatch(INSTALLER_OP_REREGISTER_TASK_PATCH, &call, error);
+}
+
+bool bgft_download_get_task_progress(int task_id, struct bgft_download_task_progress_info* progress_info, int* error) {
+	struct installer_call call;
+
+	memset(&call, 0, sizeof(call));
+	call.task_id = task_id;
+	call.progress_info = progress_info;
+
+	return dispatch(INSTALLER_OP_GET_TASK_PROGRESS, &call, error);
+}
+
+bool bgft_download_find_task_by_content_id(const char* content_id, int sub_type, int* task_id, int* error) {
+	struct installer_call call;
+
+	memset(&call, 0, sizeof(call));
+	call.id = content_id;
+	call.sub_type = sub_type;
+	call.out_task_id = task_id;
+
+	return dispatch(INSTALLER_OP_FIND_TASK_BY_CONTENT_ID, &call, error);
+}
+
+/* Runs the call on the dispatcher thread, or right here if it is not running. */
+static bool dispatch(enum installer_op op, struct installer_call* call, int* error) {
+	if (!dispatcher_call((size_t)op, call)) {
+		(*s_ops[op].cb)(call);
+	}
+
+	if (call->error != 0 && error) {
+		*error = call->error;
+	}
+
+	return call->status;
+}
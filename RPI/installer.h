@@ -2,6 +2,8 @@
 
 #include "common.h"
 
+#include <orbis/bgft.h>
+
 bool app_inst_util_init(void);
 void app_inst_util_fini(void);
 
@@ -28,9 +30,40 @@ struct bgft_download_task_progress_info {
 	int local_copy_percent;
 };
 
+/* Registration "succeeds" with this error and no task if the application is installed already. */
+#define SCE_BGFT_ERROR_SAME_APPLICATION_ALREADY_INSTALLED (0x80990088)
+
+/* System side of all calls below. */
+struct installer_backend {
+	const char* name;
+	bool (*uninstall_game)(const char* title_id, int* error);
+	bool (*uninstall_ac)(const char* content_id, int* error);
+	bool (*uninstall_patch)(const char* title_id, int* error);
+	bool (*uninstall_theme)(const char* content_id, int* error);
+	bool (*is_exists)(const char* title_id, bool* exists, int* error);
+	bool (*get_size)(const char* title_id, unsigned long* size, int* error);
+	bool (*register_package_task)(const char* content_id, const char* content_url, const char* content_name, const char* icon_path, const char* package_type, const char* package_sub_type, unsigned long package_size, bool is_patch, int* task_id, int* error);
+	bool (*start_task)(int task_id, int* error);
+	bool (*stop_task)(int task_id, int* error);
+	bool (*pause_task)(int task_id, int* error);
+	bool (*resume_task)(int task_id, int* error);
+	bool (*unregister_task)(int task_id, int* error);
+	bool (*reregister_task_patch)(int old_task_id, int* new_task_id, int* error);
+	bool (*get_task_progress)(int task_id, struct bgft_download_task_progress_info* progress_info, int* error);
+	bool (*find_task_by_content_id)(const char* content_id, int sub_type, int* task_id, int* error);
+};
+
+/* Backend can only be switched before the dispatcher is started, null selects the system one. */
+void installer_set_backend(const struct installer_backend* backend);
+const struct installer_backend* installer_get_backend(void);
+
 bool bgft_init(void);
 void bgft_fini(void);
 
+/* Once started, all app_inst_util_* and bgft_download_* calls are run on one thread, they run on the calling thread otherwise. */
+bool installer_dispatcher_init(void);
+void installer_dispatcher_fini(void);
+
 bool bgft_download_register_package_task(const char* content_id, const char* content_url, const char* content_name, const char* icon_path, const char* package_type, const char* package_sub_type, unsigned long package_size, bool is_patch, int* task_id, int* error);
 bool bgft_download_start_task(int task_id, int* error);
 bool bgft_download_stop_task(int task_id, int* error);
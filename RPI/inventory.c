@@ -0,0 +1,293 @@
+#include "inventory.h"
+#include "installer.h"
+#include "pkg.h"
+#include "util.h"
+
+#include <pthread.h>
+#include <time.h>
+
+#include "uthash.h"
+
+#define INVENTORY_MAX_ENTRIES 2048
+#define INVENTORY_REFRESH_TICK_MSECS 5000
+#define INVENTORY_REFRESH_AGE_MSECS 60000
+#define INVENTORY_UNUSED_AGE_MSECS (10 * 60000) /* not refreshed anymore, dropped instead */
+#define INVENTORY_REFRESH_BATCH_SIZE 32
+
+struct inventory_entry {
+	char title_id[PKG_TITLE_ID_SIZE + 1];
+	struct inventory_info info;
+	uint64_t used_msecs;
+	UT_hash_handle hh;
+};
+
+static struct inventory_entry* s_entries = NULL;
+
+static pthread_mutex_t s_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t s_thread;
+static bool s_stop_requested = false;
+
+/* Bumped on invalidation, so results of checks racing with it are not stored. */
+static unsigned int s_generation = 0;
+
+static bool s_inventory_initialized = false;
+
+static void* refresh_thread(void* arg);
+static void refresh_stale_entries(void);
+static bool check_title(const char* title_id, struct inventory_info* info, int* error);
+static void store_entry(const char* title_id, const struct inventory_info* info, uint64_t used_msecs);
+static void evict_oldest_entry(void);
+static uint64_t now_msecs(void);
+
+bool inventory_init(void) {
+	int ret;
+
+	if (s_inventory_initialized) {
+		goto done;
+	}
+
+	s_stop_requested = false;
+
+	ret = pthread_create(&s_thread, NULL, &refresh_thread, NULL);
+	if (ret) {
+		EPRINTF("pthread_create failed: %d\n", ret);
+		goto err;
+	}
+
+	s_inventory_initialized = true;
+
+done:
+	return true;
+
+err:
+	return false;
+}
+
+void inventory_fini(void) {
+	struct inventory_entry* entry;
+	struct inventory_entry* tmp;
+
+	if (!s_inventory_initialized) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	s_stop_requested = true;
+	pthread_cond_signal(&s_cond);
+	pthread_mutex_unlock(&s_mtx);
+
+	pthread_join(s_thread, NULL);
+
+	pthread_mutex_lock(&s_mtx);
+	HASH_ITER(hh, s_entries, entry, tmp) {
+		HASH_DEL(s_entries, entry);
+		free(entry);
+	}
+	pthread_mutex_unlock(&s_mtx);
+
+	s_inventory_initialized = false;
+}
+
+bool inventory_query(const char* title_id, struct inventory_info* info, int* error) {
+	struct inventory_entry* entry;
+	unsigned int generation = 0;
+	uint64_t now;
+
+	assert(title_id != NULL);
+	assert(info != NULL);
+
+	if (strlen(title_id) > PKG_TITLE_ID_SIZE) {
+		return check_title(title_id, info, error);
+	}
+
+	now = now_msecs();
+
+	if (s_inventory_initialized) {
+		pthread_mutex_lock(&s_mtx);
+		HASH_FIND_STR(s_entries, title_id, entry);
+		if (entry) {
+			entry->used_msecs = now;
+			memcpy(info, &entry->info, sizeof(*info));
+		}
+		generation = s_generation;
+		pthread_mutex_unlock(&s_mtx);
+
+		if (entry) {
+			return true;
+		}
+	}
+
+	/* Failures are not cached, next query tries again. */
+	if (!check_title(title_id, info, error)) {
+		return false;
+	}
+
+	if (s_inventory_initialized) {
+		pthread_mutex_lock(&s_mtx);
+		if (generation == s_generation) {
+			store_entry(title_id, info, now);
+		}
+		pthread_mutex_unlock(&s_mtx);
+	}
+
+	return true;
+}
+
+void inventory_invalidate(const char* title_id) {
+	struct inventory_entry* entry;
+
+	if (!s_inventory_initialized || !title_id) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	HASH_FIND_STR(s_entries, title_id, entry);
+	if (entry) {
+		HASH_DEL(s_entries, entry);
+		free(entry);
+	}
+	++s_generation;
+	pthread_mutex_unlock(&s_mtx);
+}
+
+void inventory_invalidate_content(const char* content_id) {
+	struct pkg_content_info content_info;
+
+	if (!content_id || !pkg_parse_content_id(content_id, &content_info)) {
+		return;
+	}
+
+	inventory_invalidate(content_info.title_id);
+}
+
+static void* refresh_thread(void* arg) {
+	struct timespec deadline;
+
+	UNUSED(arg);
+
+	for (;;) {
+		pthread_mutex_lock(&s_mtx);
+		if (!s_stop_requested) {
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_sec += INVENTORY_REFRESH_TICK_MSECS / 1000;
+			pthread_cond_timedwait(&s_cond, &s_mtx, &deadline);
+		}
+		if (s_stop_requested) {
+			pthread_mutex_unlock(&s_mtx);
+			break;
+		}
+		pthread_mutex_unlock(&s_mtx);
+
+		refresh_stale_entries();
+	}
+
+	return NULL;
+}
+
+/* Rechecks a bounded number of stale entries per tick, system is queried without holding the lock. */
+static void refresh_stale_entries(void) {
+	char title_ids[INVENTORY_REFRESH_BATCH_SIZE][PKG_TITLE_ID_SIZE + 1];
+	struct inventory_entry* entry;
+	struct inventory_entry* tmp;
+	struct inventory_info info;
+	unsigned int generation;
+	size_t count = 0;
+	uint64_t now;
+	size_t i;
+
+	now = now_msecs();
+
+	pthread_mutex_lock(&s_mtx);
+	generation = s_generation;
+	HASH_ITER(hh, s_entries, entry, tmp) {
+		if (now - entry->used_msecs >= INVENTORY_UNUSED_AGE_MSECS) {
+			HASH_DEL(s_entries, entry);
+			free(entry);
+			continue;
+		}
+		if (count < ARRAY_SIZE(title_ids) && now - entry->info.checked_msecs >= INVENTORY_REFRESH_AGE_MSECS) {
+			strlcpy(title_ids[count++], entry->title_id, sizeof(title_ids[0]));
+		}
+	}
+	pthread_mutex_unlock(&s_mtx);
+
+	for (i = 0; i < count; ++i) {
+		if (!check_title(title_ids[i], &info, NULL)) {
+			continue;
+		}
+
+		/* Entry may have been invalidated meanwhile, then it is filled again on next query. */
+		pthread_mutex_lock(&s_mtx);
+		HASH_FIND_STR(s_entries, title_ids[i], entry);
+		if (entry && generation == s_generation) {
+			memcpy(&entry->info, &info, sizeof(entry->info));
+		}
+		pthread_mutex_unlock(&s_mtx);
+	}
+}
+
+static bool check_title(const char* title_id, struct inventory_info* info, int* error) {
+	memset(info, 0, sizeof(*info));
+
+	if (!app_inst_util_is_exists(title_id, &info->exists, error)) {
+		return false;
+	}
+	if (info->exists) {
+		info->has_size = app_inst_util_get_size(title_id, &info->size, NULL);
+	}
+	info->checked_msecs = now_msecs();
+
+	return true;
+}
+
+/* Must be called with the lock held. */
+static void store_entry(const char* title_id, const struct inventory_info* info, uint64_t used_msecs) {
+	struct inventory_entry* entry;
+
+	HASH_FIND_STR(s_entries, title_id, entry);
+	if (!entry) {
+		if (HASH_COUNT(s_entries) >= INVENTORY_MAX_ENTRIES) {
+			evict_oldest_entry();
+		}
+
+		entry = (struct inventory_entry*)malloc(sizeof(*entry));
+		if (!entry) {
+			EPRINTF("No memory.\n");
+			return;
+		}
+		memset(entry, 0, sizeof(*entry));
+
+		strlcpy(entry->title_id, title_id, sizeof(entry->title_id));
+		HASH_ADD_STR(s_entries, title_id, entry);
+	}
+
+	memcpy(&entry->info, info, sizeof(entry->info));
+	entry->used_msecs = used_msecs;
+}
+
+/* Must be called with the lock held. */
+static void evict_oldest_entry(void) {
+	struct inventory_entry* entry;
+	struct inventory_entry* tmp;
+	struct inventory_entry* oldest = NULL;
+
+	HASH_ITER(hh, s_entries, entry, tmp) {
+		if (!oldest || entry->used_msecs < oldest->used_msecs) {
+			oldest = entry;
+		}
+	}
+
+	if (oldest) {
+		HASH_DEL(s_entries, oldest);
+		free(oldest);
+	}
+}
+
+static uint64_t now_msecs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / NSEC_PER_MSEC;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "common.h"
+
+struct inventory_info {
+	bool exists;
+	bool has_size; /* size query may fail even if application exists */
+	unsigned long size;
+	uint64_t checked_msecs; /* monotonic time of last check */
+};
+
+bool inventory_init(void);
+void inventory_fini(void);
+
+/* Answers from the cache, the first query of a title id goes to the system. */
+bool inventory_query(const char* title_id, struct inventory_info* info, int* error);
+
+/* Called when this server changes installed applications. */
+void inventory_invalidate(const char* title_id);
+void inventory_invalidate_content(const char* content_id);
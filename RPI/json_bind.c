@@ -0,0 +1,100 @@
+#include "json_bind.h"
+
+static const jsonType_t s_json_types[] = {
+	[JSON_FIELD_TEXT] = JSON_TEXT,
+	[JSON_FIELD_INT] = JSON_INTEGER,
+	[JSON_FIELD_BOOL] = JSON_BOOLEAN,
+	[JSON_FIELD_ARRAY] = JSON_ARRAY,
+};
+
+static bool store_field(const struct json_field_desc* desc, const json_t* field, void* out, char* error_buf, size_t error_buf_size);
+
+bool json_bind(const json_t* obj, const struct json_field_desc* fields, size_t field_count, void* out, char* error_buf, size_t error_buf_size) {
+	const json_t* child;
+	const char* name;
+	uint32_t seen = 0;
+	size_t i;
+
+	assert(fields != NULL);
+	assert(field_count <= JSON_BIND_MAX_FIELDS);
+	assert(out != NULL);
+
+	if (obj && json_getType(obj) == JSON_OBJ) {
+		for (child = json_getChild(obj); child != NULL; child = json_getSibling(child)) {
+			name = json_getName(child);
+			if (!name) {
+				continue;
+			}
+
+			for (i = 0; i < field_count; ++i) {
+				if (*fields[i].name == *name && strcmp(fields[i].name, name) == 0) {
+					break;
+				}
+			}
+			if (i == field_count) {
+				continue;
+			}
+
+			/* First occurrence wins, as with json_getProperty(). */
+			if (seen & (UINT32_C(1) << i)) {
+				continue;
+			}
+			seen |= UINT32_C(1) << i;
+
+			if (!store_field(&fields[i], child, out, error_buf, error_buf_size)) {
+				goto err;
+			}
+		}
+	}
+
+	for (i = 0; i < field_count; ++i) {
+		if (fields[i].required && !(seen & (UINT32_C(1) << i))) {
+			snprintf(error_buf, error_buf_size, "No '%s' parameter specified.", fields[i].name);
+			goto err;
+		}
+	}
+
+	return true;
+
+err:
+	return false;
+}
+
+static bool store_field(const struct json_field_desc* desc, const json_t* field, void* out, char* error_buf, size_t error_buf_size) {
+	uint8_t* target = (uint8_t*)out + desc->offset;
+	int64_t value;
+
+	if (json_getType(field) != s_json_types[desc->type]) {
+		snprintf(error_buf, error_buf_size, "Invalid type for parameter '%s'.", desc->name);
+		goto err;
+	}
+
+	if (desc->type == JSON_FIELD_TEXT) {
+		if (desc->size > 0) {
+			strlcpy((char*)target, json_getValue(field), desc->size);
+		} else {
+			*(const char**)target = json_getValue(field);
+		}
+	} else if (desc->type == JSON_FIELD_INT) {
+		value = json_getInteger(field);
+		if (value < desc->min_value || value > desc->max_value) {
+			snprintf(error_buf, error_buf_size, "Invalid value for '%s' parameter specified.", desc->name);
+			goto err;
+		}
+		if (desc->size == sizeof(int64_t)) {
+			*(int64_t*)target = value;
+		} else {
+			assert(desc->size == sizeof(int));
+			*(int*)target = (int)value;
+		}
+	} else if (desc->type == JSON_FIELD_BOOL) {
+		*(bool*)target = json_getBoolean(field);
+	} else if (desc->type == JSON_FIELD_ARRAY) {
+		*(const json_t**)target = field;
+	}
+
+	return true;
+
+err:
+	return false;
+}
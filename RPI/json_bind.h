@@ -0,0 +1,42 @@
+#pragma once
+
+#include "common.h"
+#include "tiny-json.h"
+
+#include <stddef.h>
+
+enum json_field_type {
+	JSON_FIELD_TEXT, /* copied into char array, or pointer stored if size is zero */
+	JSON_FIELD_INT,
+	JSON_FIELD_BOOL,
+	JSON_FIELD_ARRAY, /* json_t pointer stored */
+};
+
+struct json_field_desc {
+	const char* name;
+	enum json_field_type type;
+	bool required;
+	size_t offset;
+	size_t size;
+	int64_t min_value;
+	int64_t max_value;
+};
+
+#define JSON_FIELD_TEXT_BUF(name, type, member, required) \
+	{ name, JSON_FIELD_TEXT, required, offsetof(type, member), sizeof(((type*)0)->member), 0, 0 }
+#define JSON_FIELD_TEXT_PTR(name, type, member, required) \
+	{ name, JSON_FIELD_TEXT, required, offsetof(type, member), 0, 0, 0 }
+#define JSON_FIELD_INT_RANGE(name, type, member, required, min_value, max_value) \
+	{ name, JSON_FIELD_INT, required, offsetof(type, member), sizeof(((type*)0)->member), min_value, max_value }
+#define JSON_FIELD_BOOL_VALUE(name, type, member, required) \
+	{ name, JSON_FIELD_BOOL, required, offsetof(type, member), sizeof(bool), 0, 0 }
+#define JSON_FIELD_ARRAY_PTR(name, type, member, required) \
+	{ name, JSON_FIELD_ARRAY, required, offsetof(type, member), sizeof(const json_t*), 0, 0 }
+
+#define JSON_BIND_MAX_FIELDS 32
+
+/*
+ * Fills the target struct from object properties in a single pass over its children.
+ * Optional fields that are not present keep their previous values.
+ */
+bool json_bind(const json_t* obj, const struct json_field_desc* fields, size_t field_count, void* out, char* error_buf, size_t error_buf_size);
@@ -0,0 +1,213 @@
+#include "json_pool.h"
+
+#include <pthread.h>
+
+#define JSON_POOL_MIN_CAPACITY 256
+#define JSON_POOL_MAX_CACHED 8
+
+/* Pools grown beyond this by a big request are freed instead of being kept around. */
+#define JSON_POOL_MAX_CACHED_CAPACITY 2048
+
+#define JSON_CHUNK_NODE_COUNT 256
+
+struct json_chunk {
+	struct json_chunk* next;
+	json_t nodes[JSON_CHUNK_NODE_COUNT];
+};
+
+/* Sandbird spawns a thread per connection, so pools are kept on a shared free list rather than per thread. */
+static struct json_pool* s_free_pools = NULL;
+static size_t s_free_pool_count = 0;
+
+static pthread_mutex_t s_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t estimate_node_count(const char* str);
+
+static json_t* chunk_pool_init(jsonPool_t* pool);
+static json_t* chunk_pool_alloc(jsonPool_t* pool);
+
+struct json_pool* json_pool_acquire(const char* str) {
+	struct json_pool* pool = NULL;
+	struct json_pool** pp;
+	json_t* nodes;
+	size_t capacity;
+
+	assert(str != NULL);
+
+	capacity = MIN(MAX(estimate_node_count(str), JSON_POOL_MIN_CAPACITY), JSON_POOL_MAX_CAPACITY);
+
+	pthread_mutex_lock(&s_mtx);
+
+	/* Prefer a pool that is already big enough, otherwise grow the first one. */
+	for (pp = &s_free_pools; *pp; pp = &(*pp)->next) {
+		if ((*pp)->capacity >= capacity) {
+			break;
+		}
+	}
+	if (!*pp) {
+		pp = &s_free_pools;
+	}
+	if (*pp) {
+		pool = *pp;
+		*pp = pool->next;
+		--s_free_pool_count;
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+
+	if (!pool) {
+		pool = (struct json_pool*)malloc(sizeof(*pool));
+		if (!pool) {
+			goto err;
+		}
+		memset(pool, 0, sizeof(*pool));
+	}
+
+	if (pool->capacity < capacity) {
+		nodes = (json_t*)realloc(pool->nodes, capacity * sizeof(*nodes));
+		if (!nodes) {
+			goto err;
+		}
+		pool->nodes = nodes;
+		pool->capacity = capacity;
+	}
+
+	pool->next = NULL;
+
+	return pool;
+
+err:
+	if (pool) {
+		if (pool->nodes) {
+			free(pool->nodes);
+		}
+		free(pool);
+	}
+
+	return NULL;
+}
+
+void json_pool_release(struct json_pool* pool) {
+	if (!pool) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	if (s_free_pool_count < JSON_POOL_MAX_CACHED && pool->capacity <= JSON_POOL_MAX_CACHED_CAPACITY) {
+		pool->next = s_free_pools;
+		s_free_pools = pool;
+		++s_free_pool_count;
+		pool = NULL;
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+
+	if (pool) {
+		free(pool->nodes);
+		free(pool);
+	}
+}
+
+void json_pool_fini(void) {
+	struct json_pool* pool;
+
+	pthread_mutex_lock(&s_mtx);
+
+	while (s_free_pools) {
+		pool = s_free_pools;
+		s_free_pools = pool->next;
+
+		free(pool->nodes);
+		free(pool);
+	}
+	s_free_pool_count = 0;
+
+	pthread_mutex_unlock(&s_mtx);
+}
+
+void json_chunk_pool_init(struct json_chunk_pool* pool, size_t max_node_count) {
+	assert(pool != NULL);
+
+	memset(pool, 0, sizeof(*pool));
+
+	pool->pool.init = &chunk_pool_init;
+	pool->pool.alloc = &chunk_pool_alloc;
+	pool->max_node_count = max_node_count;
+}
+
+void json_chunk_pool_fini(struct json_chunk_pool* pool) {
+	struct json_chunk* chunk;
+
+	if (!pool) {
+		return;
+	}
+
+	while (pool->chunks) {
+		chunk = pool->chunks;
+		pool->chunks = chunk->next;
+
+		free(chunk);
+	}
+
+	pool->current = NULL;
+	pool->next_free = 0;
+	pool->node_count = 0;
+}
+
+static json_t* chunk_pool_init(jsonPool_t* pool) {
+	struct json_chunk_pool* cpool = (struct json_chunk_pool*)pool;
+
+	/* Reuse already allocated chunks when parsing again. */
+	cpool->current = NULL;
+	cpool->next_free = JSON_CHUNK_NODE_COUNT;
+	cpool->node_count = 0;
+
+	return chunk_pool_alloc(pool);
+}
+
+static json_t* chunk_pool_alloc(jsonPool_t* pool) {
+	struct json_chunk_pool* cpool = (struct json_chunk_pool*)pool;
+	struct json_chunk* chunk;
+
+	if (cpool->max_node_count > 0 && cpool->node_count >= cpool->max_node_count) {
+		return NULL;
+	}
+
+	if (cpool->next_free >= JSON_CHUNK_NODE_COUNT) {
+		chunk = cpool->current ? cpool->current->next : cpool->chunks;
+		if (!chunk) {
+			chunk = (struct json_chunk*)malloc(sizeof(*chunk));
+			if (!chunk) {
+				return NULL;
+			}
+			chunk->next = NULL;
+
+			if (cpool->current) {
+				cpool->current->next = chunk;
+			} else {
+				cpool->chunks = chunk;
+			}
+		}
+
+		cpool->current = chunk;
+		cpool->next_free = 0;
+	}
+
+	++cpool->node_count;
+
+	return &cpool->current->nodes[cpool->next_free++];
+}
+
+/* Every value except the first one in a container is preceded by a comma, so this is an upper bound. */
+static size_t estimate_node_count(const char* str) {
+	size_t count = 1;
+
+	for (; *str != '\0' && count <= JSON_POOL_MAX_CAPACITY; ++str) {
+		if (*str == ',' || *str == '{' || *str == '[') {
+			++count;
+		}
+	}
+
+	return count;
+}
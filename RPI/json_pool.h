@@ -0,0 +1,34 @@
+#pragma once
+
+#include "common.h"
+#include "tiny-json.h"
+
+struct json_pool {
+	json_t* nodes;
+	size_t capacity;
+	struct json_pool* next;
+};
+
+/* Upper bound of pool capacity, documents with more nodes fail to parse. */
+#define JSON_POOL_MAX_CAPACITY 16384
+
+/* Returns a pool big enough to parse the given string, up to the upper bound. */
+struct json_pool* json_pool_acquire(const char* str);
+void json_pool_release(struct json_pool* pool);
+
+void json_pool_fini(void);
+
+struct json_chunk;
+
+/* Grows in fixed-size chunks so nodes never move, for documents of unknown size. */
+struct json_chunk_pool {
+	jsonPool_t pool;
+	struct json_chunk* chunks;
+	struct json_chunk* current;
+	size_t next_free;
+	size_t node_count;
+	size_t max_node_count; /* 0 means unlimited */
+};
+
+void json_chunk_pool_init(struct json_chunk_pool* pool, size_t max_node_count);
+void json_chunk_pool_fini(struct json_chunk_pool* pool);
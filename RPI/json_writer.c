@@ -0,0 +1,324 @@
+#include "json_writer.h"
+
+/* Longest separator written in front of a value. */
+#define SEPARATOR_MAX_SIZE 2
+
+/* Zero means the byte is copied as is, 'u' means \u00XX form, anything else follows a backslash. */
+static const char s_escape_table[256] = {
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	['"'] = '"',
+	['\\'] = '\\',
+};
+
+static const char s_hex_digits[] = "0123456789ABCDEF";
+
+static char* reserve(struct json_writer* w, size_t size);
+static char* put_separator(struct json_writer* w, char* p);
+static void begin_block(struct json_writer* w, char ch);
+static void end_block(struct json_writer* w, char ch);
+static void write_literal(struct json_writer* w, const char* str, size_t len);
+static char* format_uint(char* end, uintmax_t value);
+
+void json_writer_init(struct json_writer* w, sb_Stream* s) {
+	assert(w != NULL);
+	assert(s != NULL);
+
+	memset(w, 0, sizeof(*w));
+	w->s = s;
+}
+
+bool json_writer_finish(struct json_writer* w) {
+	char* p;
+
+	assert(w != NULL);
+
+	if (w->depth != 0 || w->after_key) {
+		w->failed = true;
+	}
+
+	p = reserve(w, 1);
+	if (p) {
+		*p = '\n';
+		sb_commit(w->s, 1);
+	}
+
+	return !w->failed;
+}
+
+void json_write_begin_object(struct json_writer* w) {
+	begin_block(w, '{');
+}
+
+void json_write_end_object(struct json_writer* w) {
+	end_block(w, '}');
+}
+
+void json_write_begin_array(struct json_writer* w) {
+	begin_block(w, '[');
+}
+
+void json_write_end_array(struct json_writer* w) {
+	end_block(w, ']');
+}
+
+void json_write_key(struct json_writer* w, const char* key) {
+	size_t len;
+	char* start;
+	char* p;
+
+	assert(key != NULL);
+
+	len = strlen(key);
+
+	start = p = reserve(w, SEPARATOR_MAX_SIZE + len + 4);
+	if (!p) {
+		return;
+	}
+
+	p = put_separator(w, p);
+	*p++ = '"';
+	memcpy(p, key, len);
+	p += len;
+	*p++ = '"';
+	*p++ = ':';
+	*p++ = ' ';
+
+	sb_commit(w->s, p - start);
+
+	w->after_key = true;
+}
+
+void json_write_string(struct json_writer* w, const char* value) {
+	const unsigned char* in;
+	const unsigned char* run;
+	unsigned char ch;
+	size_t len;
+	char* start;
+	char* p;
+	char esc;
+
+	if (!value) {
+		value = "";
+	}
+
+	len = strlen(value);
+
+	/* Worst case every byte turns into \u00XX. */
+	start = p = reserve(w, SEPARATOR_MAX_SIZE + len * 6 + 2);
+	if (!p) {
+		return;
+	}
+
+	p = put_separator(w, p);
+	*p++ = '"';
+
+	in = (const unsigned char*)value;
+	for (;;) {
+		run = in;
+		while ((ch = *in) != '\0' && !s_escape_table[ch]) {
+			++in;
+		}
+		if (in > run) {
+			memcpy(p, run, in - run);
+			p += in - run;
+		}
+		if (ch == '\0') {
+			break;
+		}
+
+		esc = s_escape_table[ch];
+		*p++ = '\\';
+		*p++ = esc;
+		if (esc == 'u') {
+			*p++ = '0';
+			*p++ = '0';
+			*p++ = s_hex_digits[ch >> 4];
+			*p++ = s_hex_digits[ch & 0xF];
+		}
+		++in;
+	}
+
+	*p++ = '"';
+
+	sb_commit(w->s, p - start);
+}
+
+void json_write_int(struct json_writer* w, intmax_t value) {
+	char buf[24];
+	char* end = buf + sizeof(buf);
+	char* p;
+
+	if (value < 0) {
+		p = format_uint(end, -(uintmax_t)value);
+		*--p = '-';
+	} else {
+		p = format_uint(end, (uintmax_t)value);
+	}
+
+	write_literal(w, p, end - p);
+}
+
+void json_write_uint(struct json_writer* w, uintmax_t value) {
+	char buf[24];
+	char* end = buf + sizeof(buf);
+	char* p;
+
+	p = format_uint(end, value);
+
+	write_literal(w, p, end - p);
+}
+
+void json_write_hex(struct json_writer* w, uintmax_t value) {
+	char buf[24];
+	char* end = buf + sizeof(buf);
+	char* p = end;
+
+	do {
+		*--p = s_hex_digits[value & 0xF];
+		value >>= 4;
+	} while (value);
+	*--p = 'x';
+	*--p = '0';
+
+	write_literal(w, p, end - p);
+}
+
+void json_write_hex32(struct json_writer* w, uint32_t value) {
+	char buf[10];
+	int i;
+
+	buf[0] = '0';
+	buf[1] = 'x';
+	for (i = 0; i < 8; ++i) {
+		buf[2 + i] = s_hex_digits[(value >> (28 - i * 4)) & 0xF];
+	}
+
+	write_literal(w, buf, sizeof(buf));
+}
+
+void json_write_bool(struct json_writer* w, bool value) {
+	if (value) {
+		write_literal(w, "true", 4);
+	} else {
+		write_literal(w, "false", 5);
+	}
+}
+
+static char* reserve(struct json_writer* w, size_t size) {
+	char* p;
+
+	assert(w != NULL);
+
+	if (w->failed) {
+		return NULL;
+	}
+
+	p = sb_reserve(w->s, size);
+	if (!p) {
+		w->failed = true;
+	}
+
+	return p;
+}
+
+/* Writes a separator required in front of a new value, if any. */
+static char* put_separator(struct json_writer* w, char* p) {
+	uint64_t bit;
+
+	if (w->after_key) {
+		w->after_key = false;
+		return p;
+	}
+	if (w->depth == 0) {
+		return p;
+	}
+
+	bit = UINT64_C(1) << w->depth;
+	if (w->has_items & bit) {
+		*p++ = ',';
+	} else {
+		w->has_items |= bit;
+	}
+	*p++ = ' ';
+
+	return p;
+}
+
+static void begin_block(struct json_writer* w, char ch) {
+	char* start;
+	char* p;
+
+	if (w->depth >= JSON_WRITER_MAX_DEPTH) {
+		w->failed = true;
+		return;
+	}
+
+	start = p = reserve(w, SEPARATOR_MAX_SIZE + 1);
+	if (!p) {
+		return;
+	}
+
+	p = put_separator(w, p);
+	*p++ = ch;
+
+	sb_commit(w->s, p - start);
+
+	++w->depth;
+	w->has_items &= ~(UINT64_C(1) << w->depth);
+}
+
+static void end_block(struct json_writer* w, char ch) {
+	uint64_t bit;
+	char* start;
+	char* p;
+
+	if (w->depth == 0) {
+		w->failed = true;
+		return;
+	}
+
+	start = p = reserve(w, 2);
+	if (!p) {
+		return;
+	}
+
+	bit = UINT64_C(1) << w->depth;
+	if (w->has_items & bit) {
+		*p++ = ' ';
+	}
+	*p++ = ch;
+
+	sb_commit(w->s, p - start);
+
+	w->has_items &= ~bit;
+	--w->depth;
+}
+
+static void write_literal(struct json_writer* w, const char* str, size_t len) {
+	char* start;
+	char* p;
+
+	start = p = reserve(w, SEPARATOR_MAX_SIZE + len);
+	if (!p) {
+		return;
+	}
+
+	p = put_separator(w, p);
+	memcpy(p, str, len);
+	p += len;
+
+	sb_commit(w->s, p - start);
+}
+
+/* Formats backwards from the end of the buffer. */
+static char* format_uint(char* end, uintmax_t value) {
+	char* p = end;
+
+	do {
+		*--p = (char)('0' + value % 10);
+		value /= 10;
+	} while (value);
+
+	return p;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "common.h"
+#include "sandbird.h"
+
+#define JSON_WRITER_MAX_DEPTH 63
+
+/* Writes JSON directly into the stream's send buffer, no intermediate formatting. */
+struct json_writer {
+	sb_Stream* s;
+	uint64_t has_items; /* one bit per nesting level */
+	unsigned int depth;
+	bool after_key;
+	bool failed;
+};
+
+void json_writer_init(struct json_writer* w, sb_Stream* s);
+
+/* Terminates response with a newline. Returns false if any write failed. */
+bool json_writer_finish(struct json_writer* w);
+
+void json_write_begin_object(struct json_writer* w);
+void json_write_end_object(struct json_writer* w);
+void json_write_begin_array(struct json_writer* w);
+void json_write_end_array(struct json_writer* w);
+
+/* Key is written as is, so it should not need escaping. */
+void json_write_key(struct json_writer* w, const char* key);
+
+void json_write_string(struct json_writer* w, const char* value);
+void json_write_int(struct json_writer* w, intmax_t value);
+void json_write_uint(struct json_writer* w, uintmax_t value);
+void json_write_hex(struct json_writer* w, uintmax_t value);
+void json_write_hex32(struct json_writer* w, uint32_t value); /* zero padded, used for error codes */
+void json_write_bool(struct json_writer* w, bool value);
+
+static inline void json_write_string_field(struct json_writer* w, const char* key, const char* value) {
+	json_write_key(w, key);
+	json_write_string(w, value);
+}
+
+static inline void json_write_int_field(struct json_writer* w, const char* key, intmax_t value) {
+	json_write_key(w, key);
+	json_write_int(w, value);
+}
+
+static inline void json_write_uint_field(struct json_writer* w, const char* key, uintmax_t value) {
+	json_write_key(w, key);
+	json_write_uint(w, value);
+}
+
+static inline void json_write_hex_field(struct json_writer* w, const char* key, uintmax_t value) {
+	json_write_key(w, key);
+	json_write_hex(w, value);
+}
+
+static inline void json_write_bool_field(struct json_writer* w, const char* key, bool value) {
+	json_write_key(w, key);
+	json_write_bool(w, value);
+}
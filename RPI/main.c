@@ -4,6 +4,9 @@
 #include "server.h"
 #include "util.h"
 #include "KPutil.h"
+#ifdef SIMULATED_BACKEND
+#include "sim_backend.h"
+#endif
 
 #include <orbis/libkernel.h>
 #include <orbis/Sysmodule.h>
@@ -13,6 +16,16 @@
 
 #define SERVER_PORT (12801)
 
+#ifdef SIMULATED_BACKEND
+static const struct sim_backend_config s_sim_backend_config = {
+	10 * 1024 * 1024, /* transfer rate */
+	2000, /* preparing time */
+	50, /* failure chance */
+	2000, /* call latency */
+	12801, /* seed */
+};
+#endif
+
 int sceUserMainThreadPriority = 700;
 
 size_t sceUserMainThreadStackSize = 512 * 1024;
@@ -131,6 +144,20 @@ int main(int argc, const char* const argv[])
 		goto err_appinstutil_finalize;
 	}
 
+#ifdef SIMULATED_BACKEND
+	if (sim_backend_init(&s_sim_backend_config)) {
+		printf("Using simulated installer backend.\n");
+		installer_set_backend(sim_backend_get());
+	} else {
+		EPRINTF("Simulated installer backend initialization failed.\n");
+	}
+#endif
+
+	if (!installer_dispatcher_init()) {
+		/* System calls are just not serialized then. */
+		EPRINTF("Installer dispatcher initialization failed.\n");
+	}
+
 	//printf("Initializing net...\n");
 	if (!net_init()) {
 		EPRINTF("Net initialization failed.\n");
@@ -174,6 +201,13 @@ err_net_finalize:
 	net_fini();
 
 err_bgft_finalize:
+	installer_dispatcher_fini();
+
+#ifdef SIMULATED_BACKEND
+	installer_set_backend(NULL);
+	sim_backend_fini();
+#endif
+
 	//printf("Finalizing BGFT...\n");
 	bgft_fini();
 
@@ -40,13 +40,6 @@ bool net_init(void) {
 done:
 	return true;
 
-err_pool_destroy:
-	ret = sceNetPoolDestroy(s_libnet_mem_id);
-	if (ret < 0) {
-		EPRINTF("sceNetPoolDestroy failed: 0x%08X\n", sceNetErrnoLoc());
-	}
-	s_libnet_mem_id = -1;
-
 err_net_terminate:
 	ret = sceNetTerm();
 	if (ret) {
@@ -1,9 +1,18 @@
 #include "pkg.h"
 #include "http.h"
+#include "uri.h"
 #include "util.h"
 
 #include <orbis/libkernel.h>
+#include <ctype.h>
+#include <pthread.h>
 #include "tiny-json.h"
+#include "json_pool.h"
+#include "utstring.h"
+
+#define PKG_PROBE_WINDOW_SIZE 4
+#define PKG_MAX_PIECE_COUNT 256
+#define PKG_MAX_REF_JSON_NODE_COUNT (256 * 1024)
 
 union json_value_t {
 	const json_t* jval;
@@ -11,8 +20,20 @@ union json_value_t {
 	int64_t ival;
 };
 
+struct probe_args {
+	const char* url;
+	uint64_t size;
+	bool found;
+};
+
 static uint8_t s_zero_mini_digest[PKG_MINI_DIGEST_SIZE] = { 0 };
 
+static void* probe_thread(void* arg);
+static void probe_window(struct probe_args* args, size_t count);
+static bool probe_piece_sizes(char** piece_urls, size_t piece_count, uint64_t* piece_sizes);
+static bool probe_next_pieces(const char* first_url, size_t digits_offset, size_t digits_length, const char* prefix, uintmax_t first_number, uint64_t package_size, char** urls, uint64_t* sizes, size_t* count, uint64_t* sum);
+static char* make_piece_url(const char* first_url, size_t digits_offset, size_t digits_length, const char* prefix, uintmax_t number);
+
 bool pkg_parse_content_id(const char* content_id, struct pkg_content_info* info) {
 	struct pkg_content_info tmp;
 	char* p1;
@@ -75,10 +96,10 @@ err:
 }
 
 char** pkg_extract_piece_urls_from_ref_pkg_json(const char* url, size_t* piece_count) {
-	static json_t* pool = NULL;
-	const size_t pool_size = 256;
+	struct json_chunk_pool pool;
 	const json_t* root;
 	const json_t* field;
+	const json_t* prop;
 	union json_value_t val;
 	const char* prop_val;
 	char* data = NULL;
@@ -87,9 +108,10 @@ char** pkg_extract_piece_urls_from_ref_pkg_json(const char* url, size_t* piece_c
 	char** piece_urls = NULL;
 	size_t count;
 	char* unescaped_url = NULL;
-	size_t unescaped_url_size;
 	size_t i;
 
+	json_chunk_pool_init(&pool, PKG_MAX_REF_JSON_NODE_COUNT);
+
 	if (!url) {
 		EPRINTF("No URL specified.\n");
 		goto err;
@@ -106,14 +128,8 @@ char** pkg_extract_piece_urls_from_ref_pkg_json(const char* url, size_t* piece_c
 		goto err;
 	}
 
-	pool = (json_t*)malloc(sizeof(*pool) * pool_size);
-	if (!pool) {
-		EPRINTF("No memory.\n");
-		goto err;
-	}
-	memset(pool, 0, sizeof(*pool) * pool_size);
-
-	root = json_create(data, pool, pool_size);
+	/* Manifests may list thousands of pieces, so let the node pool grow. */
+	root = json_createWithPool(data, &pool.pool);
 	if (!root) {
 		EPRINTF("Invalid JSON format.\n");
 		goto err;
@@ -129,22 +145,40 @@ char** pkg_extract_piece_urls_from_ref_pkg_json(const char* url, size_t* piece_c
 		goto err;
 	}
 	for (val.jval = json_getChild(field), count = 0; val.jval != NULL; val.jval = json_getSibling(val.jval)) {
+		++count;
+	}
+	if (count == 0) {
+		EPRINTF("No pieces.\n");
+		goto err;
+	}
+
+	piece_urls = (char**)malloc(count * sizeof(*piece_urls));
+	if (!piece_urls) {
+		EPRINTF("No memory.\n");
+		goto err;
+	}
+	memset(piece_urls, 0, count * sizeof(*piece_urls));
+
+	/* Validate and collect in a single pass, each url is looked up and unescaped once. */
+	for (val.jval = json_getChild(field), i = 0; val.jval != NULL; val.jval = json_getSibling(val.jval)) {
 		if (json_getType(val.jval) != JSON_OBJ) {
 			EPRINTF("Invalid type for element of parameter '%s'.\n", "pieces");
 			goto err;
 		}
 
-		prop_val = json_getPropertyValue(val.jval, "url");
-		if (!prop_val) {
+		prop = json_getProperty(val.jval, "url");
+		if (!prop || json_getType(prop) == JSON_OBJ || json_getType(prop) == JSON_ARRAY) {
 			EPRINTF("No '%s' property found in element of parameter '%s'.\n", "url", "pieces");
 			goto err;
 		}
-		if (strlen(prop_val) == 0) {
+		prop_val = json_getValue(prop);
+		if (*prop_val == '\0') {
 			EPRINTF("Empty value of property '%s' in element of parameter '%s'.\n", "url", "pieces");
 			goto err;
 		}
 
-		if (!http_unescape_uri(&unescaped_url, &unescaped_url_size, prop_val)) {
+		unescaped_url = uri_decode(prop_val, NULL);
+		if (!unescaped_url) {
 			EPRINTF("Unable to unescape value of property '%s' in element of parameter '%s'.\n", "url", "pieces");
 			goto err;
 		}
@@ -154,31 +188,6 @@ char** pkg_extract_piece_urls_from_ref_pkg_json(const char* url, size_t* piece_c
 			goto err;
 		}
 
-		free(unescaped_url);
-		unescaped_url = NULL;
-
-		++count;
-	}
-	if (count == 0) {
-		EPRINTF("No pieces.\n");
-		goto err;
-	}
-
-	piece_urls = (char**)malloc(count * sizeof(*piece_urls));
-	if (!piece_urls) {
-		EPRINTF("No memory.\n");
-		goto err;
-	}
-	memset(piece_urls, 0, count * sizeof(*piece_urls));
-
-	for (val.jval = json_getChild(field), i = 0; val.jval != NULL; val.jval = json_getSibling(val.jval)) {
-		prop_val = json_getPropertyValue(val.jval, "url");
-
-		if (!http_unescape_uri(&unescaped_url, &unescaped_url_size, prop_val)) {
-			EPRINTF("Unable to unescape value of property '%s' in element of parameter '%s'.\n", "url", "pieces");
-			goto err;
-		}
-
 		piece_urls[i++] = unescaped_url;
 		unescaped_url = NULL;
 	}
@@ -191,6 +200,8 @@ char** pkg_extract_piece_urls_from_ref_pkg_json(const char* url, size_t* piece_c
 		free(unescaped_url);
 	}
 
+	json_chunk_pool_fini(&pool);
+
 	if (data) {
 		free(data);
 	}
@@ -213,6 +224,8 @@ err:
 		free(unescaped_url);
 	}
 
+	json_chunk_pool_fini(&pool);
+
 	if (data) {
 		free(data);
 	}
@@ -227,9 +240,8 @@ err:
 		EPRINTF(format, ##__VA_ARGS__); \
 	} while (0)
 
-bool pkg_setup_prerequisites(char** piece_urls, size_t piece_count, const char* ref_pkg_json_path, const char* param_sfo_path, const char* icon0_png_path, enum pkg_content_type* content_type, uint64_t* package_size, bool* is_patch, bool* has_icon, char* error_buf, size_t error_buf_size) {
-	static const uint8_t magic[] = { '\x7F', 'C', 'N', 'T' };
-	struct pkg_header* hdr;
+bool pkg_setup_prerequisites(char** piece_urls, const uint64_t* piece_sizes, size_t piece_count, const struct pkg_header* header, struct pkg_prerequisites* prereq, char* error_buf, size_t error_buf_size) {
+	const struct pkg_header* hdr;
 	struct pkg_table_entry* entries;
 	uint8_t* hdr_data = NULL;
 	uint64_t hdr_size = sizeof(*hdr);
@@ -245,17 +257,22 @@ bool pkg_setup_prerequisites(char** piece_urls, size_t piece_count, const char*
 	uint32_t icon0_png_size = 0;
 	uint64_t icon0_png_dl_size;
 	uint64_t offset, total_size;
+	uint64_t* sizes = NULL;
 	size_t entry_count;
 	char pkg_digest_str[PKG_DIGEST_SIZE * 2 + 1];
 	char piece_digest_str[PKG_MINI_DIGEST_SIZE * 2 + 1];
 #ifdef ESCAPE_URL
 	char* escaped_url = NULL;
-	size_t escaped_url_size;
 #endif
-	FILE* fp = NULL;
+	UT_string json;
+	bool has_json = false;
 	size_t i;
 	bool status = false;
 
+	assert(prereq != NULL);
+
+	memset(prereq, 0, sizeof(*prereq));
+
 	if (!piece_urls) {
 		PKG_THROW_ERROR("No pieces URLs specified.\n");
 		goto err;
@@ -264,46 +281,36 @@ bool pkg_setup_prerequisites(char** piece_urls, size_t piece_count, const char*
 		PKG_THROW_ERROR("No pieces.\n");
 		goto err;
 	}
-	if (!ref_pkg_json_path || strlen(ref_pkg_json_path) == 0) {
-		PKG_THROW_ERROR("Empty reference package json file path specified.\n");
-		goto err;
-	}
-	if (!param_sfo_path || strlen(param_sfo_path) == 0) {
-		PKG_THROW_ERROR("Empty param.sfo file path specified.\n");
-		goto err;
-	}
-	if (!icon0_png_path || strlen(icon0_png_path) == 0) {
-		PKG_THROW_ERROR("Empty icon0.png file path specified.\n");
-		goto err;
-	}
 
-	unlink(ref_pkg_json_path);
-	unlink(param_sfo_path);
-	unlink(icon0_png_path);
+	if (header) {
+		/* Already fetched while discovering the pieces. */
+		if (!piece_sizes) {
+			PKG_THROW_ERROR("No piece sizes for '%s'.\n", piece_urls[0]);
+			goto err;
+		}
+		hdr = header;
+		total_size = piece_sizes[0];
+	} else {
+		//printf("Downloading package header: %s\n", piece_urls[0]);
+		if (!http_download_file(piece_urls[0], &hdr_data, &hdr_size, &total_size, 0)) {
+			PKG_THROW_ERROR("Unable to download package header for '%s'.\n", piece_urls[0]);
+			goto err;
+		}
+		//printf("Package header size: 0x%" PRIX64 "\n", hdr_size);
+		if (hdr_size != sizeof(*hdr)) {
+			PKG_THROW_ERROR("Package header size mismatch for '%s'.\n", piece_urls[0]);
+			goto err;
+		}
+		//printf("Package total size: 0x%" PRIX64 "\n", total_size);
 
-	//printf("Downloading package header: %s\n", piece_urls[0]);
-	if (!http_download_file(piece_urls[0], &hdr_data, &hdr_size, &total_size, 0)) {
-		PKG_THROW_ERROR("Unable to download package header for '%s'.\n", piece_urls[0]);
-		goto err;
+		hdr = (const struct pkg_header*)hdr_data;
 	}
-	//printf("Package header size: 0x%" PRIX64 "\n", hdr_size);
-	if (hdr_size != sizeof(*hdr)) {
-		PKG_THROW_ERROR("Package header size mismatch for '%s'.\n", piece_urls[0]);
-		goto err;
-	}
-	//printf("Package total size: 0x%" PRIX64 "\n", total_size);
-
-	hdr = (struct pkg_header*)hdr_data;
 
-	if (memcmp(hdr->magic, magic, sizeof(magic)) != 0) {
+	if (!pkg_is_valid_header(hdr)) {
 		PKG_THROW_ERROR("Invalid package format for '%s'.\n", piece_urls[0]);
 		goto err;
 	}
 
-	if (is_patch) {
-		*is_patch = pkg_is_patch(hdr);
-	}
-
 	if (piece_count == 1 && BE64(hdr->package_size) > 0 && total_size != BE64(hdr->package_size)) {
 		PKG_THROW_ERROR("Unexpected file size for '%s'.\n", piece_urls[0]);
 		goto err;
@@ -329,21 +336,8 @@ bool pkg_setup_prerequisites(char** piece_urls, size_t piece_count, const char*
 	}
 
 	entries = (struct pkg_table_entry*)entry_table_data;
-	for (i = 0; i < entry_count; ++i) {
-		switch (BE32(entries[i].id)) {
-			case PKG_ENTRY_ID__PARAM_SFO:
-				param_sfo_offset = BE32(entries[i].offset);
-				param_sfo_size = BE32(entries[i].size);
-				break;
-			case PKG_ENTRY_ID__ICON0_PNG:
-				icon0_png_offset = BE32(entries[i].offset);
-				icon0_png_size = BE32(entries[i].size);
-				break;
-			default:
-				goto next;
-		}
-next:;
-	}
+	pkg_find_entry(entries, entry_count, PKG_ENTRY_ID__PARAM_SFO, &param_sfo_offset, &param_sfo_size);
+	pkg_find_entry(entries, entry_count, PKG_ENTRY_ID__ICON0_PNG, &icon0_png_offset, &icon0_png_size);
 
 	if (param_sfo_offset > 0 && param_sfo_size > 0) {
 		//printf("Downloading %s: %s\n", "param.sfo", piece_urls[0]);
@@ -382,35 +376,41 @@ next:;
 		goto err;
 	}
 
-	fp = fopen(ref_pkg_json_path, "wb");
-	if (!fp) {
-		PKG_THROW_ERROR("fopen(%s) failed: %d\n", ref_pkg_json_path, errno);
+	sizes = (uint64_t*)malloc(piece_count * sizeof(*sizes));
+	if (!sizes) {
+		PKG_THROW_ERROR("No memory.\n");
 		goto err;
 	}
+	if (piece_sizes) {
+		memcpy(sizes, piece_sizes, piece_count * sizeof(*sizes));
+	} else {
+		sizes[0] = total_size;
+		if (piece_count > 1 && !probe_piece_sizes(piece_urls + 1, piece_count - 1, sizes + 1)) {
+			PKG_THROW_ERROR("Unable to get file size for pieces of '%s'.\n", piece_urls[0]);
+			goto err;
+		}
+	}
+
+	utstring_init(&json);
+	has_json = true;
 
-	fprintf(fp,
+	utstring_printf(&json,
 		"{\"originalFileSize\":%" PRIu64 ",\"packageDigest\":\"%s\",\"numberOfSplitFiles\":%" PRIuMAX ",\"pieces\":[",
 		BE64(hdr->package_size), pkg_digest_str, (uintmax_t)piece_count
 	);
 
 	for (i = 0, offset = 0; i < piece_count; ++i) {
-		if (i > 0) {
-			//printf("Getting piece information: %s\n", piece_urls[i]);
-			if (!http_get_file_size(piece_urls[i], &total_size)) {
-				PKG_THROW_ERROR("Unable to get file size for piece '%s'.\n", piece_urls[i]);
-				goto err_file_close;
-			}
-			//printf("Piece size: 0x%" PRIX64 "\n", total_size);
-		}
+		total_size = sizes[i];
 
 #ifdef ESCAPE_URL
-		if (!http_escape_uri(&escaped_url, &escaped_url_size, piece_urls[i])) {
+		escaped_url = uri_encode(piece_urls[i], NULL);
+		if (!escaped_url) {
 			PKG_THROW_ERROR("Unable to escape URL for piece '%s'.\n", piece_urls[i]);
-			goto err_file_close;
+			goto err;
 		}
 #endif
 
-		fprintf(fp,
+		utstring_printf(&json,
 			"{\"url\":\"%s\",\"fileOffset\":%" PRIu64 ",\"fileSize\":%" PRIu64 ",\"hashValue\":\"%s\"}",
 #ifdef ESCAPE_URL
 			escaped_url, offset, total_size, piece_digest_str
@@ -419,7 +419,7 @@ next:;
 #endif
 		);
 		if (i + 1 < piece_count) {
-			fputs(",", fp);
+			utstring_bincpy(&json, ",", 1);
 		}
 
 		offset += total_size;
@@ -430,61 +430,50 @@ next:;
 #endif
 	}
 
-	fputs("]}", fp);
+	utstring_bincpy(&json, "]}", 2);
 
 	if (BE64(hdr->package_size) > 0 && offset != BE64(hdr->package_size)) {
 		PKG_THROW_ERROR("Unexpected total file size for '%s'.\n", piece_urls[0]);
-		goto err_file_close;
+		goto err;
 	}
 
-	if (param_sfo_offset > 0 && param_sfo_size > 0) {
-		if (!write_file_trunc(param_sfo_path, param_sfo_data, param_sfo_size, NULL, S_IRUSR | S_IWUSR)) {
-			PKG_THROW_ERROR("Unable to write %s file for '%s'.\n", "param.sfo", piece_urls[0]);
-			goto err_file_close;
-		}
-	}
-	if (icon0_png_offset > 0 && icon0_png_size > 0) {
-		if (!write_file_trunc(icon0_png_path, icon0_png_data, icon0_png_size, NULL, S_IRUSR | S_IWUSR)) {
-			PKG_THROW_ERROR("Unable to write %s file for '%s'.\n", "icon0.png", piece_urls[0]);
-			goto err_file_close;
-		}
-		if (has_icon) {
-			*has_icon = true;
-		}
-	} else {
-		if (has_icon) {
-			*has_icon = false;
-		}
-	}
+	prereq->content_type = (enum pkg_content_type)BE32(hdr->content_type);
+	prereq->package_size = BE64(hdr->package_size);
+	prereq->is_patch = pkg_is_patch(hdr);
+
+	/* Hand buffers over to the caller. */
+	prereq->ref_pkg_json = utstring_body(&json);
+	prereq->ref_pkg_json_size = utstring_len(&json);
+	has_json = false;
 
-	if (content_type) {
-		*content_type = BE32(hdr->content_type);
+	if (param_sfo_data) {
+		prereq->param_sfo_data = param_sfo_data;
+		prereq->param_sfo_size = param_sfo_size;
+		param_sfo_data = NULL;
 	}
-	if (package_size) {
-		*package_size = BE64(hdr->package_size);
+	if (icon0_png_data) {
+		prereq->icon0_png_data = icon0_png_data;
+		prereq->icon0_png_size = icon0_png_size;
+		icon0_png_data = NULL;
 	}
 
 	status = true;
 
-err_file_close:
-	if (fp) {
-		fclose(fp);
-	}
-
-err_file_unlink:
-	if (!status) {
-		unlink(icon0_png_path);
-		unlink(param_sfo_path);
-		unlink(ref_pkg_json_path);
+err:
+	if (has_json) {
+		utstring_done(&json);
 	}
 
-err:
 #ifdef ESCAPE_URL
 	if (escaped_url) {
 		free(escaped_url);
 	}
 #endif
 
+	if (sizes) {
+		free(sizes);
+	}
+
 	if (icon0_png_data) {
 		free(icon0_png_data);
 	}
@@ -503,9 +492,191 @@ err:
 	return status;
 }
 
+void pkg_free_prerequisites(struct pkg_prerequisites* prereq) {
+	if (!prereq) {
+		return;
+	}
+
+	if (prereq->ref_pkg_json) {
+		free(prereq->ref_pkg_json);
+	}
+	if (prereq->param_sfo_data) {
+		free(prereq->param_sfo_data);
+	}
+	if (prereq->icon0_png_data) {
+		free(prereq->icon0_png_data);
+	}
+
+	memset(prereq, 0, sizeof(*prereq));
+}
+
+char** pkg_discover_piece_urls(const char* first_url, uint64_t** piece_sizes, size_t* piece_count, struct pkg_header** header, char* error_buf, size_t error_buf_size) {
+	struct pkg_header* hdr;
+	uint8_t* hdr_data = NULL;
+	uint64_t hdr_size = sizeof(*hdr);
+	uint64_t package_size, total_size, sum;
+	char** urls = NULL;
+	uint64_t* sizes = NULL;
+	size_t count = 0;
+	size_t name_start, name_end;
+	size_t digits_offset, digits_end, digits_length;
+	uintmax_t first_number;
+	size_t i;
+
+	if (!first_url) {
+		PKG_THROW_ERROR("No URL specified.\n");
+		goto err;
+	}
+
+	if (!http_download_file(first_url, &hdr_data, &hdr_size, &total_size, 0)) {
+		PKG_THROW_ERROR("Unable to download package header for '%s'.\n", first_url);
+		goto err;
+	}
+	if (hdr_size != sizeof(*hdr)) {
+		PKG_THROW_ERROR("Package header size mismatch for '%s'.\n", first_url);
+		goto err;
+	}
+
+	hdr = (struct pkg_header*)hdr_data;
+
+	if (!pkg_is_valid_header(hdr)) {
+		PKG_THROW_ERROR("Invalid package format for '%s'.\n", first_url);
+		goto err;
+	}
+
+	package_size = BE64(hdr->package_size);
+
+	urls = (char**)malloc(PKG_MAX_PIECE_COUNT * sizeof(*urls));
+	sizes = (uint64_t*)malloc(PKG_MAX_PIECE_COUNT * sizeof(*sizes));
+	if (!urls || !sizes) {
+		PKG_THROW_ERROR("No memory.\n");
+		goto err;
+	}
+	memset(urls, 0, PKG_MAX_PIECE_COUNT * sizeof(*urls));
+
+	urls[0] = strdup(first_url);
+	if (!urls[0]) {
+		PKG_THROW_ERROR("No memory.\n");
+		goto err;
+	}
+	sizes[0] = total_size;
+	count = 1;
+	sum = total_size;
+
+	if (package_size == 0 || sum >= package_size) {
+		goto done;
+	}
+
+	/* First piece may have no number at all, e.g. foo.pkg followed by foo.pkgpart1. */
+	name_end = strcspn(first_url, "?#");
+	if (!probe_next_pieces(first_url, name_end, 0, "part", 0, package_size, urls, sizes, &count, &sum)) {
+		PKG_THROW_ERROR("No memory.\n");
+		goto err;
+	}
+
+	/* Otherwise split scheme is inferred from the last run of digits in the file name, e.g. foo_0.pkg or foo.pkgpart0. */
+	if (count == 1) {
+		name_start = name_end;
+		while (name_start > 0 && first_url[name_start - 1] != '/') {
+			--name_start;
+		}
+		digits_end = name_end;
+		while (digits_end > name_start && !isdigit((unsigned char)first_url[digits_end - 1])) {
+			--digits_end;
+		}
+		digits_offset = digits_end;
+		while (digits_offset > name_start && isdigit((unsigned char)first_url[digits_offset - 1])) {
+			--digits_offset;
+		}
+		digits_length = digits_end - digits_offset;
+		if (digits_length == 0) {
+			PKG_THROW_ERROR("Unable to infer split naming scheme for '%s'.\n", first_url);
+			goto err;
+		}
+		first_number = strtoumax(first_url + digits_offset, NULL, 10);
+		if (!probe_next_pieces(first_url, digits_offset, digits_length, "", first_number, package_size, urls, sizes, &count, &sum)) {
+			PKG_THROW_ERROR("No memory.\n");
+			goto err;
+		}
+	}
+
+	if (sum != package_size) {
+		PKG_THROW_ERROR("Unable to find all pieces for '%s' (%" PRIuMAX " found).\n", first_url, (uintmax_t)count);
+		goto err;
+	}
+
+done:
+	if (piece_count) {
+		*piece_count = count;
+	}
+	if (piece_sizes) {
+		*piece_sizes = sizes;
+	} else {
+		free(sizes);
+	}
+	if (header) {
+		*header = hdr;
+	} else {
+		free(hdr_data);
+	}
+
+	return urls;
+
+err:
+	if (piece_count) {
+		*piece_count = 0;
+	}
+
+	if (urls) {
+		for (i = 0; i < count; ++i) {
+			free(urls[i]);
+		}
+		free(urls);
+	}
+
+	if (sizes) {
+		free(sizes);
+	}
+
+	if (hdr_data) {
+		free(hdr_data);
+	}
+
+	return NULL;
+}
+
 #undef PKG_THROW_ERROR
 
-bool pkg_is_patch(struct pkg_header* hdr) {
+bool pkg_is_valid_header(const struct pkg_header* hdr) {
+	assert(hdr != NULL);
+
+	return memcmp(hdr->magic, PKG_MAGIC, sizeof(hdr->magic)) == 0;
+}
+
+bool pkg_find_entry(const struct pkg_table_entry* entries, size_t entry_count, enum pkg_entry_id id, uint32_t* offset, uint32_t* size) {
+	size_t i;
+
+	assert(entries != NULL);
+
+	for (i = 0; i < entry_count; ++i) {
+		if (BE32(entries[i].id) != (uint32_t)id) {
+			continue;
+		}
+
+		if (offset) {
+			*offset = BE32(entries[i].offset);
+		}
+		if (size) {
+			*size = BE32(entries[i].size);
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+bool pkg_is_patch(const struct pkg_header* hdr) {
 	unsigned int flags;
 
 	assert(hdr != NULL);
@@ -527,3 +698,151 @@ bool pkg_is_patch(struct pkg_header* hdr) {
 
 	return false;
 }
+
+static void* probe_thread(void* arg) {
+	struct probe_args* args = (struct probe_args*)arg;
+
+	args->found = http_get_file_size(args->url, &args->size);
+
+	return NULL;
+}
+
+static void probe_window(struct probe_args* args, size_t count) {
+	pthread_t threads[PKG_PROBE_WINDOW_SIZE];
+	bool started[PKG_PROBE_WINDOW_SIZE];
+	size_t i;
+
+	assert(args != NULL);
+	assert(count <= PKG_PROBE_WINDOW_SIZE);
+
+	for (i = 0; i < count; ++i) {
+		args[i].size = 0;
+		args[i].found = false;
+
+		/* Fall back to probing inline if we are out of threads. */
+		started[i] = pthread_create(&threads[i], NULL, &probe_thread, &args[i]) == 0;
+		if (!started[i]) {
+			probe_thread(&args[i]);
+		}
+	}
+
+	for (i = 0; i < count; ++i) {
+		if (started[i]) {
+			pthread_join(threads[i], NULL);
+		}
+	}
+}
+
+static bool probe_piece_sizes(char** piece_urls, size_t piece_count, uint64_t* piece_sizes) {
+	struct probe_args args[PKG_PROBE_WINDOW_SIZE];
+	size_t window;
+	size_t i, j;
+
+	assert(piece_urls != NULL);
+	assert(piece_sizes != NULL);
+
+	for (i = 0; i < piece_count; i += window) {
+		window = MIN(PKG_PROBE_WINDOW_SIZE, piece_count - i);
+
+		for (j = 0; j < window; ++j) {
+			args[j].url = piece_urls[i + j];
+		}
+
+		probe_window(args, window);
+
+		for (j = 0; j < window; ++j) {
+			if (!args[j].found) {
+				EPRINTF("Unable to get file size for piece '%s'.\n", piece_urls[i + j]);
+				return false;
+			}
+			piece_sizes[i + j] = args[j].size;
+		}
+	}
+
+	return true;
+}
+
+/* Probes the pieces following the ones found so far, until one is missing or the package is complete. Fails only if out of memory. */
+static bool probe_next_pieces(const char* first_url, size_t digits_offset, size_t digits_length, const char* prefix, uintmax_t first_number, uint64_t package_size, char** urls, uint64_t* sizes, size_t* count, uint64_t* sum) {
+	struct probe_args args[PKG_PROBE_WINDOW_SIZE];
+	char* candidates[PKG_PROBE_WINDOW_SIZE];
+	size_t window, i;
+	bool finished;
+	bool status = false;
+
+	memset(candidates, 0, sizeof(candidates));
+
+	for (finished = false; !finished && *count < PKG_MAX_PIECE_COUNT; ) {
+		window = MIN(PKG_PROBE_WINDOW_SIZE, PKG_MAX_PIECE_COUNT - *count);
+
+		for (i = 0; i < window; ++i) {
+			candidates[i] = make_piece_url(first_url, digits_offset, digits_length, prefix, first_number + *count + i);
+			if (!candidates[i]) {
+				goto err;
+			}
+			args[i].url = candidates[i];
+		}
+
+		probe_window(args, window);
+
+		for (i = 0; i < window; ++i) {
+			if (!finished && args[i].found && args[i].size > 0) {
+				urls[*count] = candidates[i];
+				sizes[*count] = args[i].size;
+				candidates[i] = NULL;
+				*sum += sizes[(*count)++];
+				if (*sum >= package_size) {
+					finished = true;
+				}
+			} else {
+				finished = true;
+			}
+
+			if (candidates[i]) {
+				free(candidates[i]);
+				candidates[i] = NULL;
+			}
+		}
+	}
+
+	status = true;
+
+err:
+	for (i = 0; i < PKG_PROBE_WINDOW_SIZE; ++i) {
+		if (candidates[i]) {
+			free(candidates[i]);
+		}
+	}
+
+	return status;
+}
+
+static char* make_piece_url(const char* first_url, size_t digits_offset, size_t digits_length, const char* prefix, uintmax_t number) {
+	char digits[32];
+	char* url;
+	size_t prefix_length;
+	size_t length;
+	int n;
+
+	assert(first_url != NULL);
+	assert(prefix != NULL);
+
+	n = snprintf(digits, sizeof(digits), "%0*" PRIuMAX, (int)digits_length, number);
+	if (n < 0 || (size_t)n >= sizeof(digits)) {
+		return NULL;
+	}
+
+	prefix_length = strlen(prefix);
+	length = strlen(first_url) - digits_length + prefix_length + (size_t)n;
+	url = (char*)malloc(length + 1);
+	if (!url) {
+		return NULL;
+	}
+
+	memcpy(url, first_url, digits_offset);
+	memcpy(url + digits_offset, prefix, prefix_length);
+	memcpy(url + digits_offset + prefix_length, digits, (size_t)n);
+	strcpy(url + digits_offset + prefix_length + (size_t)n, first_url + digits_offset + digits_length);
+
+	return url;
+}
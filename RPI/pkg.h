@@ -21,6 +21,8 @@ enum pkg_content_type {
 #define PKG_DIGEST_SIZE 0x20
 #define PKG_MINI_DIGEST_SIZE 0x14
 
+#define PKG_MAGIC "\x7F" "CNT"
+
 #define SIZEOF_PKG_HEADER 0x2000
 
 TYPE_BEGIN(struct pkg_header, SIZEOF_PKG_HEADER);
@@ -65,7 +67,26 @@ struct pkg_content_info {
 bool pkg_parse_content_id(const char* content_id, struct pkg_content_info* info);
 
 char** pkg_extract_piece_urls_from_ref_pkg_json(const char* url, size_t* piece_count);
+/* Header of the first piece is handed over to the caller if requested, to be passed to pkg_setup_prerequisites(). */
+char** pkg_discover_piece_urls(const char* first_url, uint64_t** piece_sizes, size_t* piece_count, struct pkg_header** header, char* error_buf, size_t error_buf_size);
+
+struct pkg_prerequisites {
+	enum pkg_content_type content_type;
+	uint64_t package_size;
+	bool is_patch;
+	char* ref_pkg_json;
+	size_t ref_pkg_json_size;
+	uint8_t* param_sfo_data; /* null if package has no param.sfo */
+	size_t param_sfo_size;
+	uint8_t* icon0_png_data; /* null if package has no icon0.png */
+	size_t icon0_png_size;
+};
+
+/* Header of the first piece is downloaded unless given, piece sizes are required with it. */
+bool pkg_setup_prerequisites(char** piece_urls, const uint64_t* piece_sizes, size_t piece_count, const struct pkg_header* header, struct pkg_prerequisites* prereq, char* error_buf, size_t error_buf_size);
+void pkg_free_prerequisites(struct pkg_prerequisites* prereq);
 
-bool pkg_setup_prerequisites(char** piece_urls, size_t piece_count, const char* ref_pkg_json_path, const char* param_sfo_path, const char* icon0_png_path, enum pkg_content_type* content_type, uint64_t* package_size, bool* is_patch, bool* has_icon, char* error_buf, size_t error_buf_size);
+bool pkg_is_valid_header(const struct pkg_header* hdr);
+bool pkg_find_entry(const struct pkg_table_entry* entries, size_t entry_count, enum pkg_entry_id id, uint32_t* offset, uint32_t* size);
 
-bool pkg_is_patch(struct pkg_header* hdr);
+bool pkg_is_patch(const struct pkg_header* hdr);
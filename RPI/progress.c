@@ -0,0 +1,469 @@
+#include "progress.h"
+#include "throughput.h"
+#include "util.h"
+
+#include <pthread.h>
+#include <time.h>
+
+#define PROGRESS_TICK_MSECS 250
+#define PROGRESS_ACTIVE_INTERVAL_MSECS 500
+#define PROGRESS_IDLE_MAX_INTERVAL_MSECS 5000
+#define PROGRESS_DONE_INTERVAL_MSECS 10000
+
+/* Reads may fail now and then, only a run of failed ones counts as a failed task. */
+#define PROGRESS_MAX_FAILED_READS 5
+
+struct progress_slot {
+	/* Read without lock, guarded by sequence counter. */
+	unsigned int seq; /* odd while being updated */
+	int task_id; /* -1 if slot is free */
+	bool has_snapshot;
+	struct progress_snapshot snapshot;
+
+	/* Poller state, guarded by mutex. */
+	uint64_t next_poll_msecs;
+	unsigned int interval_msecs;
+	unsigned int failed_reads; /* in a row */
+	bool finished;
+	uint64_t finished_msecs;
+	bool failed;
+};
+
+static struct progress_slot s_slots[PROGRESS_MAX_TASKS];
+
+static progress_finish_cb* s_finish_cb = NULL;
+
+static pthread_mutex_t s_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t s_change_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t s_thread;
+static bool s_stop_requested = false;
+
+static unsigned int s_generation = 0;
+
+static bool s_progress_initialized = false;
+
+static void* poll_thread(void* arg);
+static void poll_due_tasks(void);
+static void publish_snapshot(struct progress_slot* slot, int task_id, const struct progress_snapshot* snapshot);
+static struct progress_slot* find_slot(int task_id);
+static struct progress_slot* find_oldest_finished_slot(void);
+static void notify_change(void);
+static uint64_t now_msecs(void);
+
+bool progress_init(progress_finish_cb* finish_cb) {
+	size_t i;
+	int ret;
+
+	if (s_progress_initialized) {
+		goto done;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(s_slots); ++i) {
+		memset(&s_slots[i], 0, sizeof(s_slots[i]));
+		s_slots[i].task_id = -1;
+	}
+
+	s_finish_cb = finish_cb;
+	s_stop_requested = false;
+
+	ret = pthread_create(&s_thread, NULL, &poll_thread, NULL);
+	if (ret) {
+		EPRINTF("pthread_create failed: %d\n", ret);
+		goto err;
+	}
+
+	s_progress_initialized = true;
+
+done:
+	return true;
+
+err:
+	return false;
+}
+
+void progress_fini(void) {
+	if (!s_progress_initialized) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	s_stop_requested = true;
+	pthread_cond_signal(&s_cond);
+	pthread_cond_broadcast(&s_change_cond);
+	pthread_mutex_unlock(&s_mtx);
+
+	pthread_join(s_thread, NULL);
+
+	s_finish_cb = NULL;
+
+	s_progress_initialized = false;
+}
+
+bool progress_track(int task_id) {
+	struct progress_slot* slot;
+	int evicted_task_id = -1;
+
+	if (!s_progress_initialized || task_id < 0) {
+		return false;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	slot = find_slot(task_id);
+	if (!slot) {
+		slot = find_slot(-1);
+		if (!slot) {
+			/* Finished tasks are kept only for clients to see their final state. */
+			slot = find_oldest_finished_slot();
+			if (slot) {
+				evicted_task_id = slot->task_id;
+			}
+		}
+		if (slot) {
+			publish_snapshot(slot, task_id, NULL);
+			notify_change();
+			slot->next_poll_msecs = 0;
+			slot->interval_msecs = PROGRESS_ACTIVE_INTERVAL_MSECS;
+			slot->failed_reads = 0;
+			slot->finished = false;
+			slot->finished_msecs = 0;
+			slot->failed = false;
+
+			/* Poll it right away. */
+			pthread_cond_signal(&s_cond);
+		} else {
+			EPRINTF("Too many tracked tasks.\n");
+		}
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+
+	if (evicted_task_id >= 0) {
+		throughput_remove(evicted_task_id);
+	}
+
+	return slot != NULL;
+}
+
+void progress_untrack(int task_id) {
+	struct progress_slot* slot;
+
+	if (!s_progress_initialized || task_id < 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	slot = find_slot(task_id);
+	if (slot) {
+		publish_snapshot(slot, -1, NULL);
+		notify_change();
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+
+	throughput_remove(task_id);
+}
+
+size_t progress_get_tracked_tasks(int* task_ids, size_t max_count) {
+	size_t count = 0;
+	size_t i;
+
+	assert(task_ids != NULL);
+
+	if (!s_progress_initialized) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	for (i = 0; i < ARRAY_SIZE(s_slots) && count < max_count; ++i) {
+		if (s_slots[i].task_id >= 0) {
+			task_ids[count++] = s_slots[i].task_id;
+		}
+	}
+	pthread_mutex_unlock(&s_mtx);
+
+	return count;
+}
+
+bool progress_wait_for_change(unsigned int* generation, unsigned int timeout_msecs, bool* changed) {
+	struct timespec deadline;
+	bool running;
+	int ret = 0;
+
+	assert(generation != NULL);
+	assert(changed != NULL);
+
+	*changed = false;
+
+	if (!s_progress_initialized) {
+		return false;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout_msecs / 1000;
+	deadline.tv_nsec += (timeout_msecs % 1000) * NSEC_PER_MSEC;
+	if (deadline.tv_nsec >= NSEC_PER_SEC) {
+		deadline.tv_nsec -= NSEC_PER_SEC;
+		++deadline.tv_sec;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	while (*generation == s_generation && !s_stop_requested && ret == 0) {
+		ret = pthread_cond_timedwait(&s_change_cond, &s_mtx, &deadline);
+	}
+	*changed = *generation != s_generation;
+	*generation = s_generation;
+	running = !s_stop_requested;
+	pthread_mutex_unlock(&s_mtx);
+
+	return running;
+}
+
+bool progress_get_snapshot(int task_id, struct progress_snapshot* snapshot) {
+	struct progress_slot* slot;
+	unsigned int seq;
+	bool found = false;
+	size_t i;
+
+	assert(snapshot != NULL);
+
+	if (!s_progress_initialized || task_id < 0) {
+		return false;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(s_slots); ++i) {
+		slot = &s_slots[i];
+
+		if (__atomic_load_n(&slot->task_id, __ATOMIC_RELAXED) != task_id) {
+			continue;
+		}
+
+		do {
+			seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+			if (seq & 1) {
+				continue;
+			}
+
+			found = slot->task_id == task_id && slot->has_snapshot;
+			if (found) {
+				memcpy(snapshot, &slot->snapshot, sizeof(*snapshot));
+			}
+
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		} while ((seq & 1) || seq != __atomic_load_n(&slot->seq, __ATOMIC_RELAXED));
+
+		if (found) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void progress_get_snapshots(const int* task_ids, size_t count, struct progress_snapshot* snapshots, bool* found) {
+	struct progress_slot* slot;
+	size_t i;
+
+	assert(task_ids != NULL || count == 0);
+	assert(snapshots != NULL || count == 0);
+	assert(found != NULL || count == 0);
+
+	if (count == 0) {
+		return;
+	}
+
+	memset(found, 0, count * sizeof(*found));
+
+	if (!s_progress_initialized) {
+		return;
+	}
+
+	/* Publishers hold the lock, so nothing changes while we copy. */
+	pthread_mutex_lock(&s_mtx);
+	for (i = 0; i < count; ++i) {
+		slot = task_ids[i] >= 0 ? find_slot(task_ids[i]) : NULL;
+		if (slot && slot->has_snapshot) {
+			memcpy(&snapshots[i], &slot->snapshot, sizeof(snapshots[i]));
+			found[i] = true;
+		}
+	}
+	pthread_mutex_unlock(&s_mtx);
+}
+
+static void* poll_thread(void* arg) {
+	struct timespec deadline;
+
+	UNUSED(arg);
+
+	for (;;) {
+		pthread_mutex_lock(&s_mtx);
+		if (!s_stop_requested) {
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_nsec += PROGRESS_TICK_MSECS * NSEC_PER_MSEC;
+			if (deadline.tv_nsec >= NSEC_PER_SEC) {
+				deadline.tv_nsec -= NSEC_PER_SEC;
+				++deadline.tv_sec;
+			}
+			pthread_cond_timedwait(&s_cond, &s_mtx, &deadline);
+		}
+		if (s_stop_requested) {
+			pthread_mutex_unlock(&s_mtx);
+			break;
+		}
+		pthread_mutex_unlock(&s_mtx);
+
+		poll_due_tasks();
+	}
+
+	return NULL;
+}
+
+static void poll_due_tasks(void) {
+	int task_ids[PROGRESS_MAX_TASKS];
+	int finished_task_ids[PROGRESS_MAX_TASKS];
+	enum progress_outcome finished_outcomes[PROGRESS_MAX_TASKS];
+	struct progress_snapshot snapshot;
+	struct progress_snapshot* prev;
+	struct progress_slot* slot;
+	size_t task_count = 0;
+	size_t finished_count = 0;
+	uint64_t now;
+	bool done;
+	bool failed;
+	size_t i;
+
+	now = now_msecs();
+
+	pthread_mutex_lock(&s_mtx);
+	for (i = 0; i < ARRAY_SIZE(s_slots); ++i) {
+		slot = &s_slots[i];
+		if (slot->task_id >= 0 && slot->next_poll_msecs <= now) {
+			task_ids[task_count++] = slot->task_id;
+		}
+	}
+	pthread_mutex_unlock(&s_mtx);
+
+	/* BGFT is queried without holding the lock. */
+	for (i = 0; i < task_count; ++i) {
+		memset(&snapshot, 0, sizeof(snapshot));
+		snapshot.valid = bgft_download_get_task_progress(task_ids[i], &snapshot.info, &snapshot.error);
+
+		pthread_mutex_lock(&s_mtx);
+
+		slot = find_slot(task_ids[i]);
+		if (slot) {
+			/* Only while tracked, so untracked tasks do not come back. */
+			if (snapshot.valid) {
+				throughput_add_sample(task_ids[i], snapshot.info.transferred_total, snapshot.info.length_total);
+			}
+
+			prev = slot->has_snapshot ? &slot->snapshot : NULL;
+			done = snapshot.valid && snapshot.info.length_total > 0 && snapshot.info.transferred_total >= snapshot.info.length_total;
+			slot->failed_reads = snapshot.valid ? 0 : slot->failed_reads + 1;
+			failed = snapshot.valid ? snapshot.info.error_result != 0 : slot->failed_reads >= PROGRESS_MAX_FAILED_READS;
+
+			/* Poll fast while bytes are moving, back off while idle. */
+			if (done) {
+				slot->interval_msecs = PROGRESS_DONE_INTERVAL_MSECS;
+			} else if (snapshot.valid && (!prev || !prev->valid || prev->info.transferred_total != snapshot.info.transferred_total || prev->info.preparing_percent != snapshot.info.preparing_percent)) {
+				slot->interval_msecs = PROGRESS_ACTIVE_INTERVAL_MSECS;
+			} else {
+				slot->interval_msecs = MIN(slot->interval_msecs * 2, PROGRESS_IDLE_MAX_INTERVAL_MSECS);
+			}
+			slot->next_poll_msecs = now + slot->interval_msecs;
+
+			if (!prev || memcmp(prev, &snapshot, sizeof(snapshot)) != 0) {
+				publish_snapshot(slot, task_ids[i], &snapshot);
+				notify_change();
+			}
+
+			if (done && !slot->finished) {
+				slot->finished = true;
+				slot->finished_msecs = now;
+				finished_outcomes[finished_count] = PROGRESS_OUTCOME_FINISHED;
+				finished_task_ids[finished_count++] = task_ids[i];
+			} else if (!done && failed && !slot->failed) {
+				/* Reported once until the task recovers. */
+				slot->failed = true;
+				finished_outcomes[finished_count] = PROGRESS_OUTCOME_FAILED;
+				finished_task_ids[finished_count++] = task_ids[i];
+			} else if (!failed && slot->failed) {
+				slot->failed = false;
+				if (!done) {
+					finished_outcomes[finished_count] = PROGRESS_OUTCOME_RECOVERED;
+					finished_task_ids[finished_count++] = task_ids[i];
+				}
+			}
+		}
+
+		pthread_mutex_unlock(&s_mtx);
+	}
+
+	if (s_finish_cb) {
+		for (i = 0; i < finished_count; ++i) {
+			(*s_finish_cb)(finished_task_ids[i], finished_outcomes[i]);
+		}
+	}
+}
+
+/* Must be called with the lock held. Snapshot may be null to clear it. */
+static void publish_snapshot(struct progress_slot* slot, int task_id, const struct progress_snapshot* snapshot) {
+	unsigned int seq = slot->seq;
+
+	__atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	__atomic_store_n(&slot->task_id, task_id, __ATOMIC_RELAXED);
+	if (snapshot) {
+		memcpy(&slot->snapshot, snapshot, sizeof(slot->snapshot));
+		slot->has_snapshot = true;
+	} else {
+		memset(&slot->snapshot, 0, sizeof(slot->snapshot));
+		slot->has_snapshot = false;
+	}
+
+	__atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Must be called with the lock held. */
+static void notify_change(void) {
+	++s_generation;
+	pthread_cond_broadcast(&s_change_cond);
+}
+
+/* Must be called with the lock held. */
+static struct progress_slot* find_slot(int task_id) {
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(s_slots); ++i) {
+		if (s_slots[i].task_id == task_id) {
+			return &s_slots[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Must be called with the lock held. */
+static struct progress_slot* find_oldest_finished_slot(void) {
+	struct progress_slot* oldest = NULL;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(s_slots); ++i) {
+		if (s_slots[i].task_id >= 0 && s_slots[i].finished && (!oldest || s_slots[i].finished_msecs < oldest->finished_msecs)) {
+			oldest = &s_slots[i];
+		}
+	}
+
+	return oldest;
+}
+
+static uint64_t now_msecs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / NSEC_PER_MSEC;
+}
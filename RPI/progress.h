@@ -0,0 +1,42 @@
+#pragma once
+
+#include "common.h"
+#include "installer.h"
+
+#define PROGRESS_MAX_TASKS 64
+
+struct progress_snapshot {
+	bool valid; /* false if last poll failed, see error */
+	int error;
+	struct bgft_download_task_progress_info info;
+};
+
+enum progress_outcome {
+	PROGRESS_OUTCOME_FINISHED, /* transferred everything */
+	PROGRESS_OUTCOME_FAILED, /* started failing */
+	PROGRESS_OUTCOME_RECOVERED, /* no longer failing */
+};
+
+/* Called from the poller thread once for each change of outcome of a tracked task. */
+typedef void progress_finish_cb(int task_id, enum progress_outcome outcome);
+
+bool progress_init(progress_finish_cb* finish_cb);
+void progress_fini(void);
+
+/* Takes over the slot of the longest finished task if all are in use. */
+bool progress_track(int task_id);
+void progress_untrack(int task_id);
+
+size_t progress_get_tracked_tasks(int* task_ids, size_t max_count);
+
+/*
+ * Blocks until any snapshot changes after the given generation, or until timeout expires.
+ * Returns false once the poller is shutting down.
+ */
+bool progress_wait_for_change(unsigned int* generation, unsigned int timeout_msecs, bool* changed);
+
+/* Lock-free read of the latest polled state. Returns false if the task is not tracked or was not polled yet. */
+bool progress_get_snapshot(int task_id, struct progress_snapshot* snapshot);
+
+/* Reads several snapshots at once, consistent with each other. Sets found[i] for each polled task. */
+void progress_get_snapshots(const int* task_ids, size_t count, struct progress_snapshot* snapshots, bool* found);
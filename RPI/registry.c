@@ -0,0 +1,624 @@
+#include "registry.h"
+#include "installer.h"
+#include "uri.h"
+#include "util.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "uthash.h"
+#include "utstring.h"
+
+#define REGISTRY_JOURNAL_MAX_SIZE (16 * 1024 * 1024)
+#define REGISTRY_COMPACT_MIN_RECORDS 256
+#define REGISTRY_MAX_FIELDS 512
+
+struct content_key {
+	char content_id[PKG_CONTENT_ID_SIZE + 1];
+	int sub_type;
+};
+
+struct registry_entry {
+	struct registry_task_info info; /* url pointers refer to fields below */
+	char* ref_pkg_url;
+	char** piece_urls;
+	struct content_key key;
+	bool in_content_index;
+	UT_hash_handle hh; /* by task id */
+	UT_hash_handle hh_content; /* by content id and sub type */
+};
+
+static struct registry_entry* s_entries = NULL;
+static struct registry_entry* s_content_index = NULL;
+
+static char* s_journal_path = NULL;
+static size_t s_record_count = 0; /* records in journal, including stale ones */
+
+static pthread_mutex_t s_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static bool s_registry_initialized = false;
+
+static struct registry_entry* create_entry(const struct registry_task_info* info);
+static void insert_entry(struct registry_entry* entry);
+static void delete_entry(struct registry_entry* entry);
+static void load_journal(void);
+static void replay_record(char** fields, size_t field_count);
+static void drop_missing_tasks(void);
+static void append_record(UT_string* record);
+static void format_add_record(UT_string* record, const struct registry_entry* entry);
+static void format_field(UT_string* record, const char* value);
+static void maybe_compact(void);
+
+bool registry_init(const char* journal_path) {
+	if (s_registry_initialized) {
+		goto done;
+	}
+
+	if (!journal_path) {
+		EPRINTF("No journal path specified.\n");
+		goto err;
+	}
+
+	s_journal_path = strdup(journal_path);
+	if (!s_journal_path) {
+		EPRINTF("No memory.\n");
+		goto err;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	s_record_count = 0;
+	load_journal();
+
+	s_registry_initialized = true;
+
+	drop_missing_tasks();
+	maybe_compact();
+
+	pthread_mutex_unlock(&s_mtx);
+
+done:
+	return true;
+
+err:
+	return false;
+}
+
+void registry_fini(void) {
+	struct registry_entry* entry;
+	struct registry_entry* tmp;
+
+	if (!s_registry_initialized) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	HASH_ITER(hh, s_entries, entry, tmp) {
+		delete_entry(entry);
+	}
+
+	s_registry_initialized = false;
+
+	pthread_mutex_unlock(&s_mtx);
+
+	free(s_journal_path);
+	s_journal_path = NULL;
+}
+
+bool registry_add(const struct registry_task_info* info) {
+	struct registry_entry* entry;
+	struct registry_entry* old_entry;
+	UT_string record;
+
+	assert(info != NULL);
+
+	if (!s_registry_initialized || info->task_id < 0) {
+		return false;
+	}
+
+	entry = create_entry(info);
+	if (!entry) {
+		return false;
+	}
+
+	utstring_init(&record);
+
+	pthread_mutex_lock(&s_mtx);
+
+	HASH_FIND(hh, s_entries, &info->task_id, sizeof(info->task_id), old_entry);
+	if (old_entry) {
+		delete_entry(old_entry);
+	}
+	insert_entry(entry);
+
+	format_add_record(&record, entry);
+	append_record(&record);
+
+	pthread_mutex_unlock(&s_mtx);
+
+	utstring_done(&record);
+
+	return true;
+}
+
+void registry_remove(int task_id) {
+	struct registry_entry* entry;
+	UT_string record;
+
+	if (!s_registry_initialized) {
+		return;
+	}
+
+	utstring_init(&record);
+
+	pthread_mutex_lock(&s_mtx);
+
+	HASH_FIND(hh, s_entries, &task_id, sizeof(task_id), entry);
+	if (entry) {
+		delete_entry(entry);
+
+		utstring_printf(&record, "del\t%d\n", task_id);
+		append_record(&record);
+		maybe_compact();
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+
+	utstring_done(&record);
+}
+
+void registry_mark_finished(int task_id) {
+	struct registry_entry* entry;
+	UT_string record;
+
+	if (!s_registry_initialized) {
+		return;
+	}
+
+	utstring_init(&record);
+
+	pthread_mutex_lock(&s_mtx);
+
+	HASH_FIND(hh, s_entries, &task_id, sizeof(task_id), entry);
+	if (entry && entry->info.finished_time == 0) {
+		entry->info.finished_time = time(NULL);
+
+		utstring_printf(&record, "fin\t%d\t%" PRId64 "\n", task_id, (int64_t)entry->info.finished_time);
+		append_record(&record);
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+
+	utstring_done(&record);
+}
+
+bool registry_find_by_content_id(const char* content_id, int sub_type, int* task_id) {
+	struct registry_entry* entry;
+	struct content_key key;
+
+	assert(content_id != NULL);
+	assert(task_id != NULL);
+
+	if (!s_registry_initialized) {
+		return false;
+	}
+
+	memset(&key, 0, sizeof(key));
+	strlcpy(key.content_id, content_id, sizeof(key.content_id));
+	key.sub_type = sub_type;
+
+	pthread_mutex_lock(&s_mtx);
+
+	HASH_FIND(hh_content, s_content_index, &key, sizeof(key), entry);
+	if (entry) {
+		*task_id = entry->info.task_id;
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+
+	return entry != NULL;
+}
+
+bool registry_get_content_id(int task_id, char* content_id, size_t content_id_size) {
+	struct registry_entry* entry;
+
+	assert(content_id != NULL);
+
+	if (!s_registry_initialized) {
+		return false;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	HASH_FIND(hh, s_entries, &task_id, sizeof(task_id), entry);
+	if (entry) {
+		strlcpy(content_id, entry->info.content_id, content_id_size);
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+
+	return entry != NULL;
+}
+
+/* Both buffers must hold ARTIFACT_NAME_SIZE bytes, names are empty if not set. */
+bool registry_get_artifact_names(int task_id, char* ref_pkg_json_name, char* icon0_png_name) {
+	struct registry_entry* entry;
+
+	assert(ref_pkg_json_name != NULL);
+	assert(icon0_png_name != NULL);
+
+	if (!s_registry_initialized) {
+		return false;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	HASH_FIND(hh, s_entries, &task_id, sizeof(task_id), entry);
+	if (entry) {
+		strlcpy(ref_pkg_json_name, entry->info.ref_pkg_json_name, ARTIFACT_NAME_SIZE);
+		strlcpy(icon0_png_name, entry->info.icon0_png_name, ARTIFACT_NAME_SIZE);
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+
+	return entry != NULL;
+}
+
+size_t registry_enumerate(registry_enum_cb* cb, void* arg) {
+	struct registry_entry* entry;
+	struct registry_entry* tmp;
+	size_t count = 0;
+
+	assert(cb != NULL);
+
+	if (!s_registry_initialized) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	HASH_ITER(hh, s_entries, entry, tmp) {
+		++count;
+		if (!(*cb)(arg, &entry->info)) {
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+
+	return count;
+}
+
+static struct registry_entry* create_entry(const struct registry_task_info* info) {
+	struct registry_entry* entry;
+	size_t i;
+
+	entry = (struct registry_entry*)malloc(sizeof(*entry));
+	if (!entry) {
+		goto err_no_memory;
+	}
+	memset(entry, 0, sizeof(*entry));
+
+	memcpy(&entry->info, info, sizeof(entry->info));
+
+	if (info->ref_pkg_url) {
+		entry->ref_pkg_url = strdup(info->ref_pkg_url);
+		if (!entry->ref_pkg_url) {
+			goto err_no_memory;
+		}
+	}
+
+	if (info->piece_count > 0) {
+		entry->piece_urls = (char**)calloc(info->piece_count, sizeof(*entry->piece_urls));
+		if (!entry->piece_urls) {
+			goto err_no_memory;
+		}
+		for (i = 0; i < info->piece_count; ++i) {
+			entry->piece_urls[i] = strdup(info->piece_urls[i] ? info->piece_urls[i] : "");
+			if (!entry->piece_urls[i]) {
+				goto err_no_memory;
+			}
+		}
+	}
+
+	entry->info.ref_pkg_url = entry->ref_pkg_url;
+	entry->info.piece_urls = (const char* const*)entry->piece_urls;
+
+	if (entry->info.created_time == 0) {
+		entry->info.created_time = time(NULL);
+	}
+
+	strlcpy(entry->key.content_id, entry->info.content_id, sizeof(entry->key.content_id));
+	entry->key.sub_type = entry->info.sub_type;
+
+	return entry;
+
+err_no_memory:
+	EPRINTF("No memory.\n");
+
+	if (entry) {
+		if (entry->piece_urls) {
+			for (i = 0; i < info->piece_count; ++i) {
+				free(entry->piece_urls[i]);
+			}
+			free(entry->piece_urls);
+		}
+		free(entry->ref_pkg_url);
+		free(entry);
+	}
+
+	return NULL;
+}
+
+/* Must be called with the lock held. Newest task wins the content id slot. */
+static void insert_entry(struct registry_entry* entry) {
+	struct registry_entry* old_entry;
+
+	HASH_ADD(hh, s_entries, info.task_id, sizeof(entry->info.task_id), entry);
+
+	HASH_FIND(hh_content, s_content_index, &entry->key, sizeof(entry->key), old_entry);
+	if (old_entry) {
+		HASH_DELETE(hh_content, s_content_index, old_entry);
+		old_entry->in_content_index = false;
+	}
+	HASH_ADD(hh_content, s_content_index, key, sizeof(entry->key), entry);
+	entry->in_content_index = true;
+}
+
+/* Must be called with the lock held. */
+static void delete_entry(struct registry_entry* entry) {
+	size_t i;
+
+	HASH_DELETE(hh, s_entries, entry);
+	if (entry->in_content_index) {
+		HASH_DELETE(hh_content, s_content_index, entry);
+	}
+
+	if (entry->piece_urls) {
+		for (i = 0; i < entry->info.piece_count; ++i) {
+			free(entry->piece_urls[i]);
+		}
+		free(entry->piece_urls);
+	}
+	free(entry->ref_pkg_url);
+	free(entry);
+}
+
+/*
+ * Must be called with the lock held. Journal is a text file with one tab separated record per line:
+ *   add <task id> <created> <finished> <sub type> <content id> <package type> <size> <patch> <title> <json name> <png name> <ref url> <piece url>...
+ *   fin <task id> <finished>
+ *   del <task id>
+ * Text fields are percent encoded. A torn last line is ignored.
+ */
+static void load_journal(void) {
+	void* data = NULL;
+	uint64_t size = (uint64_t)-1;
+	uint64_t nread = 0;
+	char* text = NULL;
+	char* fields[REGISTRY_MAX_FIELDS];
+	size_t field_count;
+	char* line;
+	char* next;
+	char* p;
+
+	if (!is_file_exists(s_journal_path)) {
+		goto done;
+	}
+
+	if (!read_file(s_journal_path, &data, &size, REGISTRY_JOURNAL_MAX_SIZE, &nread)) {
+		EPRINTF("Unable to read task journal: %s\n", s_journal_path);
+		goto done;
+	}
+
+	text = (char*)malloc(nread + 1);
+	if (!text) {
+		EPRINTF("No memory.\n");
+		goto done;
+	}
+	memcpy(text, data, nread);
+	text[nread] = '\0';
+
+	for (line = text; line && *line != '\0'; line = next) {
+		next = strchr(line, '\n');
+		if (!next) {
+			break;
+		}
+		*next++ = '\0';
+
+		field_count = 0;
+		for (p = line; p && field_count < ARRAY_SIZE(fields); ) {
+			fields[field_count++] = p;
+			p = strchr(p, '\t');
+			if (p) {
+				*p++ = '\0';
+			}
+		}
+
+		replay_record(fields, field_count);
+		++s_record_count;
+	}
+
+done:
+	if (text) {
+		free(text);
+	}
+	if (data) {
+		free(data);
+	}
+}
+
+/* Must be called with the lock held. */
+static void replay_record(char** fields, size_t field_count) {
+	struct registry_task_info info;
+	struct registry_entry* entry;
+	struct registry_entry* old_entry;
+	int task_id;
+	size_t i;
+
+	if (field_count < 2) {
+		return;
+	}
+
+	task_id = atoi(fields[1]);
+	if (task_id < 0) {
+		/* Registrations without a task are never journaled. */
+		return;
+	}
+
+	if (strcmp(fields[0], "add") == 0 && field_count >= 13) {
+		for (i = 5; i < field_count; ++i) {
+			uri_decode_in_place(fields[i]);
+		}
+
+		memset(&info, 0, sizeof(info));
+		info.task_id = task_id;
+		info.created_time = (time_t)strtoll(fields[2], NULL, 10);
+		info.finished_time = (time_t)strtoll(fields[3], NULL, 10);
+		info.sub_type = atoi(fields[4]);
+		strlcpy(info.content_id, fields[5], sizeof(info.content_id));
+		strlcpy(info.package_type, fields[6], sizeof(info.package_type));
+		info.package_size = strtoull(fields[7], NULL, 10);
+		info.is_patch = atoi(fields[8]) != 0;
+		strlcpy(info.title, fields[9], sizeof(info.title));
+		strlcpy(info.ref_pkg_json_name, fields[10], sizeof(info.ref_pkg_json_name));
+		strlcpy(info.icon0_png_name, fields[11], sizeof(info.icon0_png_name));
+		info.ref_pkg_url = *fields[12] != '\0' ? fields[12] : NULL;
+		info.piece_urls = (const char* const*)&fields[13];
+		info.piece_count = field_count - 13;
+
+		entry = create_entry(&info);
+		if (!entry) {
+			return;
+		}
+
+		HASH_FIND(hh, s_entries, &task_id, sizeof(task_id), old_entry);
+		if (old_entry) {
+			delete_entry(old_entry);
+		}
+		insert_entry(entry);
+	} else if (strcmp(fields[0], "fin") == 0 && field_count >= 3) {
+		HASH_FIND(hh, s_entries, &task_id, sizeof(task_id), entry);
+		if (entry) {
+			entry->info.finished_time = (time_t)strtoll(fields[2], NULL, 10);
+		}
+	} else if (strcmp(fields[0], "del") == 0) {
+		HASH_FIND(hh, s_entries, &task_id, sizeof(task_id), entry);
+		if (entry) {
+			delete_entry(entry);
+		}
+	}
+}
+
+/* Must be called with the lock held. Task may have been removed while we were not running. */
+static void drop_missing_tasks(void) {
+	struct bgft_download_task_progress_info progress_info;
+	struct registry_entry* entry;
+	struct registry_entry* tmp;
+	UT_string record;
+	int ret;
+
+	utstring_init(&record);
+
+	HASH_ITER(hh, s_entries, entry, tmp) {
+		if (bgft_download_get_task_progress(entry->info.task_id, &progress_info, &ret)) {
+			continue;
+		}
+
+		utstring_printf(&record, "del\t%d\n", entry->info.task_id);
+		delete_entry(entry);
+	}
+
+	if (utstring_len(&record) > 0) {
+		append_record(&record);
+	}
+
+	utstring_done(&record);
+}
+
+/* Must be called with the lock held. Record is written in one call, so readers never see a partial line unless we crash. */
+static void append_record(UT_string* record) {
+	const char* p;
+
+	if (!write_file(s_journal_path, utstring_body(record), utstring_len(record), NULL, S_IRUSR | S_IWUSR, O_APPEND)) {
+		EPRINTF("Unable to append to task journal: %s\n", s_journal_path);
+		return;
+	}
+
+	for (p = utstring_body(record); (p = strchr(p, '\n')) != NULL; ++p) {
+		++s_record_count;
+	}
+}
+
+static void format_add_record(UT_string* record, const struct registry_entry* entry) {
+	const struct registry_task_info* info = &entry->info;
+	size_t i;
+
+	utstring_printf(record, "add\t%d\t%" PRId64 "\t%" PRId64 "\t%d", info->task_id, (int64_t)info->created_time, (int64_t)info->finished_time, info->sub_type);
+
+	format_field(record, info->content_id);
+	format_field(record, info->package_type);
+	utstring_printf(record, "\t%" PRIu64 "\t%d", info->package_size, info->is_patch ? 1 : 0);
+	format_field(record, info->title);
+	format_field(record, info->ref_pkg_json_name);
+	format_field(record, info->icon0_png_name);
+	format_field(record, info->ref_pkg_url ? info->ref_pkg_url : "");
+	for (i = 0; i < info->piece_count; ++i) {
+		format_field(record, info->piece_urls[i]);
+	}
+
+	utstring_bincpy(record, "\n", 1);
+}
+
+/* Tabs, newlines and percent signs are always escaped. */
+static void format_field(UT_string* record, const char* value) {
+	size_t len;
+	char* tmp;
+
+	utstring_bincpy(record, "\t", 1);
+
+	tmp = uri_encode(value, &len);
+	if (tmp) {
+		utstring_bincpy(record, tmp, len);
+		free(tmp);
+	}
+}
+
+/* Must be called with the lock held. Journal is rewritten once most of its records are stale. */
+static void maybe_compact(void) {
+	struct registry_entry* entry;
+	struct registry_entry* tmp;
+	UT_string record;
+	char tmp_path[1024];
+	size_t count;
+
+	count = HASH_COUNT(s_entries);
+	if (s_record_count < REGISTRY_COMPACT_MIN_RECORDS || s_record_count <= count * 2) {
+		return;
+	}
+
+	utstring_init(&record);
+
+	HASH_ITER(hh, s_entries, entry, tmp) {
+		format_add_record(&record, entry);
+	}
+
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", s_journal_path);
+
+	if (!write_file_trunc(tmp_path, utstring_body(&record), utstring_len(&record), NULL, S_IRUSR | S_IWUSR)) {
+		EPRINTF("Unable to write task journal: %s\n", tmp_path);
+		goto done;
+	}
+	if (rename(tmp_path, s_journal_path) != 0) {
+		EPRINTF("Unable to replace task journal: %s\n", s_journal_path);
+		unlink(tmp_path);
+		goto done;
+	}
+
+	s_record_count = count;
+
+done:
+	utstring_done(&record);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "common.h"
+#include "pkg.h"
+#include "artifact.h"
+
+#include <time.h>
+
+#define REGISTRY_TITLE_SIZE 256
+#define REGISTRY_PACKAGE_TYPE_SIZE 8
+
+/* Everything the server knows about a task it has registered. */
+struct registry_task_info {
+	int task_id;
+	int sub_type;
+	char content_id[PKG_CONTENT_ID_SIZE + 1];
+	char title[REGISTRY_TITLE_SIZE];
+	char package_type[REGISTRY_PACKAGE_TYPE_SIZE];
+	uint64_t package_size;
+	bool is_patch;
+	const char* ref_pkg_url; /* null for direct installs */
+	const char* const* piece_urls;
+	size_t piece_count;
+	char ref_pkg_json_name[ARTIFACT_NAME_SIZE];
+	char icon0_png_name[ARTIFACT_NAME_SIZE];
+	time_t created_time;
+	time_t finished_time; /* zero until download is complete */
+};
+
+/* Return false to stop enumeration. Pointers inside info are only valid during the call. */
+typedef bool registry_enum_cb(void* arg, const struct registry_task_info* info);
+
+/* Replays the journal, tasks which no longer exist are dropped. */
+bool registry_init(const char* journal_path);
+void registry_fini(void);
+
+/* Copies everything from info, a previous task with the same content id and sub type is shadowed. */
+bool registry_add(const struct registry_task_info* info);
+void registry_remove(int task_id);
+void registry_mark_finished(int task_id);
+
+bool registry_find_by_content_id(const char* content_id, int sub_type, int* task_id);
+bool registry_get_content_id(int task_id, char* content_id, size_t content_id_size);
+bool registry_get_artifact_names(int task_id, char* ref_pkg_json_name, char* icon0_png_name);
+
+/* Tasks are enumerated in registration order. */
+size_t registry_enumerate(registry_enum_cb* cb, void* arg);
@@ -217,17 +217,19 @@ static int sb_buffer_push_char(sb_Buffer *buf, char chr) {
 }
 
 
+static int sb_buffer_grow(sb_Buffer *buf, size_t n) {
+  size_t cap = buf->cap ? buf->cap : 64;
+  if (buf->len + n <= buf->cap) return SB_ESUCCESS;
+  while (cap < buf->len + n) cap <<= 1;
+  return sb_buffer_reserve(buf, cap);
+}
+
+
 static int sb_buffer_push_str(sb_Buffer *buf, const char *p, size_t len) {
-  int err;
-  size_t orig_len = buf->len;
-  while (len) {
-    err = sb_buffer_push_char(buf, *p);
-    if (err) {
-      buf->len = orig_len;
-      return err;
-    }
-    p++, len--;
-  }
+  int err = sb_buffer_grow(buf, len);
+  if (err) return err;
+  memcpy(buf->s + buf->len, p, len);
+  buf->len += len;
   return SB_ESUCCESS;
 }
 
@@ -450,7 +452,6 @@ static void sb_stream_destroy(sb_Stream *st) {
 static int sb_stream_recv(sb_Stream *st) {
   for (;;) {
     char buf[4096];
-    size_t n;
     int err, i, sz;
 
     /* Receive data */
@@ -660,6 +661,46 @@ int sb_write(sb_Stream *st, const void *data, size_t len) {
 }
 
 
+char *sb_reserve(sb_Stream *st, size_t len) {
+  if (st->state < STATE_SENDING_DATA) {
+    if (sb_stream_finalize_header(st)) return NULL;
+  }
+  if (st->state != STATE_SENDING_DATA) return NULL;
+  if (sb_buffer_grow(&st->send_buf, len)) return NULL;
+  return st->send_buf.s + st->send_buf.len;
+}
+
+
+void sb_commit(sb_Stream *st, size_t len) {
+  st->send_buf.len += len;
+}
+
+
+int sb_flush(sb_Stream *st) {
+  int flags = 0;
+  int sz;
+#ifdef MSG_NOSIGNAL
+  flags |= MSG_NOSIGNAL;
+#endif
+  if (st->state < STATE_SENDING_DATA) {
+    int err = sb_stream_finalize_header(st);
+    if (err) return err;
+  }
+  if (st->state != STATE_SENDING_DATA) return SB_EBADSTATE;
+  while (st->send_buf.len > 0) {
+    sz = send(st->sockfd, st->send_buf.s, st->send_buf.len, flags);
+    if (sz <= 0) {
+      if (sz < 0 && (errno == EWOULDBLOCK || errno == EINTR)) continue;
+      sb_stream_close(st);
+      return SB_EFAILURE;
+    }
+    sb_buffer_shift(&st->send_buf, sz);
+    st->last_activity = st->server->now;
+  }
+  return SB_ESUCCESS;
+}
+
+
 int sb_vwritef(sb_Stream *st, const char *fmt, va_list args) {
   if (st->state < STATE_SENDING_DATA) {
     int err = sb_stream_finalize_header(st);
@@ -113,6 +113,9 @@ int sb_send_status(sb_Stream *st, int code, const char *msg);
 int sb_send_header(sb_Stream *st, const char *field, const char *val);
 int sb_send_file(sb_Stream *st, const char *filename);
 int sb_write(sb_Stream *st, const void *data, size_t len);
+char *sb_reserve(sb_Stream *st, size_t len);
+void sb_commit(sb_Stream *st, size_t len);
+int sb_flush(sb_Stream *st);
 int sb_vwritef(sb_Stream *st, const char *fmt, va_list args);
 int sb_writef(sb_Stream *st, const char *fmt, ...);
 int sb_get_header(sb_Stream *st, const char *field, char *dst, size_t len);
@@ -0,0 +1,637 @@
+#include "scheduler.h"
+#include "installer.h"
+#include "util.h"
+
+#include <sys/stat.h>
+#include <pthread.h>
+
+#define SCHEDULER_STATE_FILE_MAX_SIZE (64 * 1024)
+
+struct scheduler_entry {
+	int task_id; /* -1 if entry is free */
+	int priority;
+	unsigned int seq; /* keeps FIFO order among equal priorities */
+	enum scheduler_state state;
+	bool failed; /* held because it failed, not by the user */
+};
+
+static struct scheduler_entry s_entries[SCHEDULER_MAX_TASKS];
+static unsigned int s_next_seq = 0;
+static unsigned int s_max_active = 1;
+
+static char* s_state_path = NULL;
+
+static pthread_mutex_t s_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static bool s_scheduler_initialized = false;
+
+typedef bool bgft_task_op(int task_id, int* error);
+
+static void dispatch(void);
+static bool start_entry(struct scheduler_entry* entry, int* error);
+static bool release_task(int task_id, bool add, bgft_task_op* fallback, int* error);
+static bool hold_task(int task_id, bgft_task_op* op, int* error);
+static struct scheduler_entry* add_entry(int task_id);
+static struct scheduler_entry* find_entry(int task_id);
+static struct scheduler_entry* find_next_waiting(void);
+static struct scheduler_entry* find_last_active(void);
+static unsigned int count_active(void);
+static bool is_before(const struct scheduler_entry* a, const struct scheduler_entry* b);
+static size_t sort_entries(const struct scheduler_entry** sorted);
+static void load_state(void);
+static void save_state(void);
+
+bool scheduler_init(const char* state_path, unsigned int max_active) {
+	size_t i;
+
+	if (s_scheduler_initialized) {
+		goto done;
+	}
+
+	if (!state_path) {
+		EPRINTF("No state path specified.\n");
+		goto err;
+	}
+
+	s_state_path = strdup(state_path);
+	if (!s_state_path) {
+		EPRINTF("No memory.\n");
+		goto err;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(s_entries); ++i) {
+		memset(&s_entries[i], 0, sizeof(s_entries[i]));
+		s_entries[i].task_id = -1;
+	}
+	s_next_seq = 0;
+	s_max_active = max_active > 0 ? max_active : 1;
+
+	pthread_mutex_lock(&s_mtx);
+
+	load_state();
+
+	s_scheduler_initialized = true;
+
+	dispatch();
+	save_state();
+
+	pthread_mutex_unlock(&s_mtx);
+
+done:
+	return true;
+
+err:
+	return false;
+}
+
+void scheduler_fini(void) {
+	if (!s_scheduler_initialized) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	save_state();
+	s_scheduler_initialized = false;
+	pthread_mutex_unlock(&s_mtx);
+
+	free(s_state_path);
+	s_state_path = NULL;
+}
+
+bool scheduler_enqueue(int task_id, int priority) {
+	struct scheduler_entry* entry;
+
+	if (!s_scheduler_initialized || task_id < 0) {
+		return false;
+	}
+
+	priority = MAX(MIN(priority, SCHEDULER_MAX_PRIORITY), SCHEDULER_MIN_PRIORITY);
+
+	pthread_mutex_lock(&s_mtx);
+
+	entry = find_entry(task_id);
+	if (!entry) {
+		entry = add_entry(task_id);
+		if (!entry) {
+			pthread_mutex_unlock(&s_mtx);
+			return false;
+		}
+	}
+	entry->priority = priority;
+
+	dispatch();
+	save_state();
+
+	pthread_mutex_unlock(&s_mtx);
+
+	return true;
+}
+
+void scheduler_remove(int task_id) {
+	struct scheduler_entry* entry;
+
+	if (!s_scheduler_initialized || task_id < 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	entry = find_entry(task_id);
+	if (entry) {
+		entry->task_id = -1;
+
+		dispatch();
+		save_state();
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+}
+
+void scheduler_task_done(int task_id) {
+	scheduler_remove(task_id);
+}
+
+void scheduler_task_failed(int task_id) {
+	struct scheduler_entry* entry;
+
+	if (!s_scheduler_initialized || task_id < 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	entry = find_entry(task_id);
+	if (entry && entry->state != SCHEDULER_STATE_HELD) {
+		entry->state = SCHEDULER_STATE_HELD;
+		entry->failed = true;
+
+		dispatch();
+		save_state();
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+}
+
+void scheduler_task_recovered(int task_id) {
+	struct scheduler_entry* entry;
+	int ret;
+
+	if (!s_scheduler_initialized || task_id < 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	entry = find_entry(task_id);
+	if (entry && entry->failed) {
+		entry->failed = false;
+
+		if (entry->state == SCHEDULER_STATE_HELD) {
+			/* BGFT retried on its own, so the task runs again. Paused if that takes it over the limit. */
+			entry->state = SCHEDULER_STATE_ACTIVE;
+			if (count_active() > s_max_active) {
+				if (bgft_download_pause_task(task_id, &ret)) {
+					entry->state = SCHEDULER_STATE_PAUSED;
+				} else {
+					EPRINTF("Unable to pause recovered task %d: 0x%08X\n", task_id, ret);
+				}
+			}
+
+			dispatch();
+			save_state();
+		}
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+}
+
+bool scheduler_start_task(int task_id, int* error) {
+	return release_task(task_id, true, &bgft_download_start_task, error);
+}
+
+bool scheduler_stop_task(int task_id, int* error) {
+	return hold_task(task_id, &bgft_download_stop_task, error);
+}
+
+bool scheduler_pause_task(int task_id, int* error) {
+	return hold_task(task_id, &bgft_download_pause_task, error);
+}
+
+bool scheduler_resume_task(int task_id, int* error) {
+	return release_task(task_id, false, &bgft_download_resume_task, error);
+}
+
+void scheduler_set_max_active(unsigned int max_active) {
+	if (!s_scheduler_initialized) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	s_max_active = max_active > 0 ? max_active : 1;
+
+	dispatch();
+	save_state();
+
+	pthread_mutex_unlock(&s_mtx);
+}
+
+unsigned int scheduler_get_max_active(void) {
+	unsigned int max_active;
+
+	pthread_mutex_lock(&s_mtx);
+	max_active = s_max_active;
+	pthread_mutex_unlock(&s_mtx);
+
+	return max_active;
+}
+
+size_t scheduler_get_entries(struct scheduler_entry_info* entries, size_t max_count) {
+	const struct scheduler_entry* sorted[SCHEDULER_MAX_TASKS];
+	const struct scheduler_entry* tmp;
+	size_t count;
+	size_t i;
+
+	assert(entries != NULL);
+
+	if (!s_scheduler_initialized) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	count = MIN(sort_entries(sorted), max_count);
+	for (i = 0; i < count; ++i) {
+		tmp = sorted[i];
+		entries[i].task_id = tmp->task_id;
+		entries[i].priority = tmp->priority;
+		entries[i].state = tmp->state;
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+
+	return count;
+}
+
+const char* scheduler_state_name(enum scheduler_state state) {
+	if (state == SCHEDULER_STATE_ACTIVE) {
+		return "active";
+	} else if (state == SCHEDULER_STATE_PAUSED) {
+		return "paused";
+	} else if (state == SCHEDULER_STATE_HELD) {
+		return "held";
+	} else {
+		return "queued";
+	}
+}
+
+/*
+ * Must be called with the lock held. Starts waiting tasks while there are free slots,
+ * and pauses the lowest priority active task if a higher priority one is waiting.
+ */
+static void dispatch(void) {
+	struct scheduler_entry* next;
+	struct scheduler_entry* last;
+	int ret;
+
+	while ((next = find_next_waiting()) != NULL) {
+		if (count_active() < s_max_active) {
+			start_entry(next, NULL);
+			continue;
+		}
+
+		last = find_last_active();
+		if (!last || last->priority >= next->priority) {
+			break;
+		}
+
+		if (!bgft_download_pause_task(last->task_id, &ret)) {
+			EPRINTF("Unable to preempt task %d: 0x%08X\n", last->task_id, ret);
+			break;
+		}
+		last->state = SCHEDULER_STATE_PAUSED;
+	}
+}
+
+/* Must be called with the lock held. Tasks which can not be started are dropped from the queue. */
+static bool start_entry(struct scheduler_entry* entry, int* error) {
+	bool started = false;
+	int ret = 0;
+
+	if (entry->state == SCHEDULER_STATE_PAUSED) {
+		started = bgft_download_resume_task(entry->task_id, &ret);
+	}
+	if (!started) {
+		started = bgft_download_start_task(entry->task_id, &ret);
+	}
+
+	if (!started) {
+		EPRINTF("Unable to start task %d: 0x%08X\n", entry->task_id, ret);
+		entry->task_id = -1;
+		if (error) {
+			*error = ret;
+		}
+		return false;
+	}
+
+	entry->state = SCHEDULER_STATE_ACTIVE;
+
+	return true;
+}
+
+/* Makes a held or waiting task eligible again, and starts it right away if a slot is free. */
+static bool release_task(int task_id, bool add, bgft_task_op* fallback, int* error) {
+	struct scheduler_entry* entry;
+	bool status = true;
+
+	if (!s_scheduler_initialized || task_id < 0) {
+		return (*fallback)(task_id, error);
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	entry = find_entry(task_id);
+	if (!entry && add) {
+		entry = add_entry(task_id);
+	}
+	if (!entry) {
+		pthread_mutex_unlock(&s_mtx);
+		return (*fallback)(task_id, error);
+	}
+
+	if (entry->state == SCHEDULER_STATE_HELD) {
+		/* Resumed first, started if that fails. Failed tasks are only retried by a start. */
+		entry->state = entry->failed ? SCHEDULER_STATE_QUEUED : SCHEDULER_STATE_PAUSED;
+		entry->failed = false;
+	}
+
+	if (entry->state != SCHEDULER_STATE_ACTIVE && count_active() < s_max_active) {
+		status = start_entry(entry, error);
+	}
+
+	dispatch();
+	save_state();
+
+	pthread_mutex_unlock(&s_mtx);
+
+	return status;
+}
+
+/* Pauses or stops an active task and gives its slot to the next one. Waiting tasks are just held back. */
+static bool hold_task(int task_id, bgft_task_op* op, int* error) {
+	struct scheduler_entry* entry;
+
+	if (!s_scheduler_initialized || task_id < 0) {
+		return (*op)(task_id, error);
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	entry = find_entry(task_id);
+	if (!entry) {
+		pthread_mutex_unlock(&s_mtx);
+		return (*op)(task_id, error);
+	}
+
+	if (entry->state == SCHEDULER_STATE_ACTIVE && !(*op)(task_id, error)) {
+		pthread_mutex_unlock(&s_mtx);
+		return false;
+	}
+	entry->state = SCHEDULER_STATE_HELD;
+	entry->failed = false;
+
+	dispatch();
+	save_state();
+
+	pthread_mutex_unlock(&s_mtx);
+
+	return true;
+}
+
+/* Must be called with the lock held. */
+static struct scheduler_entry* add_entry(int task_id) {
+	struct scheduler_entry* entry;
+
+	entry = find_entry(-1);
+	if (!entry) {
+		EPRINTF("Too many scheduled tasks.\n");
+		return NULL;
+	}
+
+	entry->task_id = task_id;
+	entry->priority = 0;
+	entry->seq = s_next_seq++;
+	entry->state = SCHEDULER_STATE_QUEUED;
+	entry->failed = false;
+
+	/* Completion is detected by the progress poller. */
+	progress_track(task_id);
+
+	return entry;
+}
+
+/* Must be called with the lock held. */
+static struct scheduler_entry* find_entry(int task_id) {
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(s_entries); ++i) {
+		if (s_entries[i].task_id == task_id) {
+			return &s_entries[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Must be called with the lock held. */
+static struct scheduler_entry* find_next_waiting(void) {
+	struct scheduler_entry* best = NULL;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(s_entries); ++i) {
+		if (s_entries[i].task_id < 0 || s_entries[i].state == SCHEDULER_STATE_ACTIVE || s_entries[i].state == SCHEDULER_STATE_HELD) {
+			continue;
+		}
+		if (!best || is_before(&s_entries[i], best)) {
+			best = &s_entries[i];
+		}
+	}
+
+	return best;
+}
+
+/* Must be called with the lock held. */
+static struct scheduler_entry* find_last_active(void) {
+	struct scheduler_entry* worst = NULL;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(s_entries); ++i) {
+		if (s_entries[i].task_id < 0 || s_entries[i].state != SCHEDULER_STATE_ACTIVE) {
+			continue;
+		}
+		if (!worst || is_before(worst, &s_entries[i])) {
+			worst = &s_entries[i];
+		}
+	}
+
+	return worst;
+}
+
+/* Must be called with the lock held. */
+static unsigned int count_active(void) {
+	unsigned int count = 0;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(s_entries); ++i) {
+		if (s_entries[i].task_id >= 0 && s_entries[i].state == SCHEDULER_STATE_ACTIVE) {
+			++count;
+		}
+	}
+
+	return count;
+}
+
+static bool is_before(const struct scheduler_entry* a, const struct scheduler_entry* b) {
+	if (a->priority != b->priority) {
+		return a->priority > b->priority;
+	}
+
+	return a->seq < b->seq;
+}
+
+/* Must be called with the lock held. Insertion sort, there are only a few entries. */
+static size_t sort_entries(const struct scheduler_entry** sorted) {
+	size_t count = 0;
+	size_t i, j;
+
+	for (i = 0; i < ARRAY_SIZE(s_entries); ++i) {
+		if (s_entries[i].task_id < 0) {
+			continue;
+		}
+
+		for (j = count++; j > 0 && is_before(&s_entries[i], sorted[j - 1]); --j) {
+			sorted[j] = sorted[j - 1];
+		}
+		sorted[j] = &s_entries[i];
+	}
+
+	return count;
+}
+
+/*
+ * Must be called with the lock held. State file is plain text:
+ *   max_active <count>
+ *   task <task id> <priority> <state>
+ * with tasks listed in queue order.
+ */
+static void load_state(void) {
+	struct bgft_download_task_progress_info info;
+	struct scheduler_entry* entry;
+	void* data = NULL;
+	uint64_t size = (uint64_t)-1;
+	uint64_t nread = 0;
+	char* text = NULL;
+	char* line;
+	char* next;
+	int task_id, priority, state;
+	unsigned int max_active;
+	int ret;
+
+	if (!is_file_exists(s_state_path)) {
+		goto done;
+	}
+
+	if (!read_file(s_state_path, &data, &size, SCHEDULER_STATE_FILE_MAX_SIZE, &nread)) {
+		EPRINTF("Unable to read scheduler state file: %s\n", s_state_path);
+		goto done;
+	}
+
+	text = (char*)malloc(nread + 1);
+	if (!text) {
+		EPRINTF("No memory.\n");
+		goto done;
+	}
+	memcpy(text, data, nread);
+	text[nread] = '\0';
+
+	for (line = text; line && *line != '\0'; line = next) {
+		next = strchr(line, '\n');
+		if (next) {
+			*next++ = '\0';
+		}
+
+		if (sscanf(line, "max_active %u", &max_active) == 1) {
+			if (max_active > 0) {
+				s_max_active = max_active;
+			}
+			continue;
+		}
+		if (sscanf(line, "task %d %d %d", &task_id, &priority, &state) != 3) {
+			continue;
+		}
+		if (task_id < 0 || state < SCHEDULER_STATE_QUEUED || state > SCHEDULER_STATE_HELD || find_entry(task_id)) {
+			continue;
+		}
+
+		/* Task may have been removed while we were not running. */
+		if (!bgft_download_get_task_progress(task_id, &info, &ret)) {
+			continue;
+		}
+		if (info.length_total > 0 && info.transferred_total >= info.length_total) {
+			continue;
+		}
+
+		entry = find_entry(-1);
+		if (!entry) {
+			break;
+		}
+
+		entry->task_id = task_id;
+		entry->priority = MAX(MIN(priority, SCHEDULER_MAX_PRIORITY), SCHEDULER_MIN_PRIORITY);
+		entry->seq = s_next_seq++;
+		entry->state = (enum scheduler_state)state;
+		entry->failed = false;
+
+		progress_track(task_id);
+	}
+
+done:
+	if (text) {
+		free(text);
+	}
+	if (data) {
+		free(data);
+	}
+}
+
+/* Must be called with the lock held. Written to a temporary file first, so a crash never leaves it truncated. */
+static void save_state(void) {
+	const struct scheduler_entry* sorted[SCHEDULER_MAX_TASKS];
+	char buf[64 + SCHEDULER_MAX_TASKS * 48];
+	char tmp_path[1024];
+	size_t count;
+	size_t len;
+	size_t i;
+
+	if (!s_scheduler_initialized || !s_state_path) {
+		return;
+	}
+
+	count = sort_entries(sorted);
+
+	len = (size_t)snprintf(buf, sizeof(buf), "max_active %u\n", s_max_active);
+	for (i = 0; i < count; ++i) {
+		len += (size_t)snprintf(buf + len, sizeof(buf) - len, "task %d %d %d\n", sorted[i]->task_id, sorted[i]->priority, (int)sorted[i]->state);
+	}
+
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", s_state_path);
+
+	if (!write_file_trunc(tmp_path, buf, len, NULL, S_IRUSR | S_IWUSR)) {
+		EPRINTF("Unable to write scheduler state file: %s\n", tmp_path);
+		return;
+	}
+	if (rename(tmp_path, s_state_path) != 0) {
+		EPRINTF("Unable to replace scheduler state file: %s\n", s_state_path);
+		unlink(tmp_path);
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "common.h"
+#include "progress.h"
+
+#define SCHEDULER_MAX_TASKS PROGRESS_MAX_TASKS
+
+#define SCHEDULER_MIN_PRIORITY (-100)
+#define SCHEDULER_MAX_PRIORITY 100
+
+enum scheduler_state {
+	SCHEDULER_STATE_QUEUED, /* never started */
+	SCHEDULER_STATE_ACTIVE,
+	SCHEDULER_STATE_PAUSED, /* preempted by a higher priority task */
+	SCHEDULER_STATE_HELD, /* paused or stopped by the user, or failing, not started again until asked to or recovered */
+};
+
+struct scheduler_entry_info {
+	int task_id;
+	int priority;
+	enum scheduler_state state;
+};
+
+/* Queue is restored from the state file, tasks which no longer exist are dropped. */
+bool scheduler_init(const char* state_path, unsigned int max_active);
+void scheduler_fini(void);
+
+/* Adds a task, or changes its priority if already queued. */
+bool scheduler_enqueue(int task_id, int priority);
+void scheduler_remove(int task_id);
+
+/* Removes a task which has finished and starts the next one. */
+void scheduler_task_done(int task_id);
+
+/* Holds a task which started failing and gives its slot to the next one. It stays queued until it is unregistered. */
+void scheduler_task_failed(int task_id);
+
+/* Takes a failed task back into the slots once it transfers again, or lets it wait for one. */
+void scheduler_task_recovered(int task_id);
+
+/*
+ * User requests, same signatures as the BGFT calls they stand in for. Start and resume run the task
+ * if a slot is free and queue it otherwise, pause and stop hold it until it is started again.
+ * Tasks the scheduler does not know are passed to BGFT as is, except start which queues them.
+ */
+bool scheduler_start_task(int task_id, int* error);
+bool scheduler_stop_task(int task_id, int* error);
+bool scheduler_pause_task(int task_id, int* error);
+bool scheduler_resume_task(int task_id, int* error);
+
+void scheduler_set_max_active(unsigned int max_active);
+unsigned int scheduler_get_max_active(void);
+
+/* Entries are returned in dispatch order. */
+size_t scheduler_get_entries(struct scheduler_entry_info* entries, size_t max_count);
+
+const char* scheduler_state_name(enum scheduler_state state);
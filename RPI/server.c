@@ -1,21 +1,72 @@
 #include <ctype.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <time.h>
 #include <orbis/libkernel.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 
 #include "server.h"
 #include "installer.h"
+#include "catalog.h"
+#include "artifact.h"
+#include "progress.h"
+#include "throughput.h"
+#include "executor.h"
+#include "scheduler.h"
+#include "registry.h"
+#include "inventory.h"
+#include "uninstaller.h"
+#include "storage.h"
+#include "singleflight.h"
+#include "dispatcher.h"
 #include "pkg.h"
 #include "sfo.h"
 #include "http.h"
+#include "uri.h"
 #include "util.h"
 #include "dirent.h"
 #include "sandbird.h"
 #include "tiny-json.h"
+#include "json_pool.h"
+#include "json_writer.h"
+#include "json_bind.h"
 
 #define CLEANUP_DAY_COUNT 3
 
+#define CATALOG_DEFAULT_PAGE_SIZE 50
+#define CATALOG_MAX_PAGE_SIZE 500
+
+#define ARTIFACT_MEMORY_CAP (8 * 1024 * 1024)
+
+#define EVENTS_DEFAULT_INTERVAL_MSECS 500
+#define EVENTS_MIN_INTERVAL_MSECS 100
+#define EVENTS_MAX_INTERVAL_MSECS 60000
+#define EVENTS_HEARTBEAT_MSECS 15000
+
+#define TASKS_BATCH_MAX_ITEMS 256
+
+#define INSTALL_BATCH_MAX_ITEMS 64
+#define INSTALL_RESOLVE_THREAD_COUNT 4
+#define INSTALL_RESOLVE_PER_HOST_LIMIT 2
+
+#define SCHEDULER_DEFAULT_MAX_ACTIVE 2
+#define SCHEDULER_STATE_FILE_NAME "scheduler.txt"
+
+#define REGISTRY_JOURNAL_FILE_NAME "tasks.journal"
+
+#define IS_EXISTS_BATCH_MAX_ITEMS 512
+
+#define DISPATCHER_STATS_MAX_OPS 32
+
+#define THROUGHPUT_STATS_MAX_TASKS THROUGHPUT_MAX_TASKS
+
+/* BGFT installs applications to this file system, some space is always left for the system. */
+#define STORAGE_PATH "/user"
+#define STORAGE_MARGIN_SIZE (256 * 1024 * 1024)
+
+#define UNINSTALL_EVENTS_HEARTBEAT_MSECS 15000
+
 typedef bool handler_cb(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
 
 struct handler_desc {
@@ -24,12 +75,218 @@ struct handler_desc {
 	bool need_partial_match;
 };
 
+typedef bool task_op_cb(int task_id, int* error);
+
+struct task_op_desc {
+	const char* name;
+	task_op_cb* op; /* null for progress reads */
+};
+
 union json_value_t {
 	const json_t* jval;
 	const char* sval;
 	int64_t ival;
 };
 
+struct install_request {
+	const char* type;
+};
+
+struct install_direct_request {
+	const json_t* packages;
+	bool auto_split;
+	int priority;
+};
+
+struct install_ref_pkg_url_request {
+	const char* url;
+	int priority;
+};
+
+struct install_batch_request {
+	const json_t* packages;
+	const json_t* order;
+};
+
+struct install_job {
+	/* Set up on the request thread. */
+	const char* ref_pkg_url; /* null for direct installs */
+	char** piece_urls;
+	uint64_t* piece_sizes;
+	size_t piece_count;
+	bool auto_split;
+	struct pkg_header* header; /* first piece, kept from discovery until prerequisites are set up */
+	int priority;
+	int lang_id;
+	char host[URI_HOST_SIZE];
+
+	/* Filled in by resolve_install_job(). */
+	bool resolved;
+	struct pkg_prerequisites prereq;
+	const char* package_type;
+	char title_name[256];
+	char content_id[PKG_CONTENT_ID_SIZE + 1];
+
+	/* Outcome, error_code is set if BGFT refused the task. Registered tasks have no id if the application is installed already. */
+	bool registered;
+	int task_id;
+	int error_code;
+	char error[256];
+};
+
+/* Shared with identical install requests that arrived while the job was in flight. */
+struct install_outcome {
+	bool registered;
+	int task_id;
+	int error_code;
+	char error[256];
+	char title_name[256];
+};
+
+struct title_id_request {
+	char title_id[PKG_TITLE_ID_SIZE + 1];
+};
+
+struct title_ids_request {
+	const json_t* title_ids;
+};
+
+struct content_id_request {
+	char content_id[PKG_CONTENT_ID_SIZE + 1];
+};
+
+struct uninstall_batch_request {
+	const json_t* items;
+};
+
+struct uninstall_item_request {
+	const char* type;
+};
+
+struct uninstall_job_request {
+	int job_id;
+};
+
+struct task_id_request {
+	int task_id;
+};
+
+struct find_task_request {
+	char content_id[PKG_CONTENT_ID_SIZE + 1];
+	int sub_type;
+};
+
+struct tasks_batch_request {
+	const json_t* items;
+};
+
+struct tasks_batch_item_request {
+	const char* op;
+	int task_id;
+};
+
+struct queue_priority_request {
+	int task_id;
+	int priority;
+};
+
+struct queue_max_active_request {
+	int max_active;
+};
+
+struct events_request {
+	const json_t* task_ids;
+	int interval_ms;
+};
+
+struct catalog_request {
+	int64_t offset;
+	int64_t limit;
+	char title_id[PKG_TITLE_ID_SIZE + 1];
+};
+
+static const struct json_field_desc s_install_fields[] = {
+	JSON_FIELD_TEXT_PTR("type", struct install_request, type, true),
+};
+
+static const struct json_field_desc s_install_direct_fields[] = {
+	JSON_FIELD_ARRAY_PTR("packages", struct install_direct_request, packages, true),
+	JSON_FIELD_BOOL_VALUE("auto_split", struct install_direct_request, auto_split, false),
+	JSON_FIELD_INT_RANGE("priority", struct install_direct_request, priority, false, SCHEDULER_MIN_PRIORITY, SCHEDULER_MAX_PRIORITY),
+};
+
+static const struct json_field_desc s_install_ref_pkg_url_fields[] = {
+	JSON_FIELD_TEXT_PTR("url", struct install_ref_pkg_url_request, url, true),
+	JSON_FIELD_INT_RANGE("priority", struct install_ref_pkg_url_request, priority, false, SCHEDULER_MIN_PRIORITY, SCHEDULER_MAX_PRIORITY),
+};
+
+static const struct json_field_desc s_install_batch_fields[] = {
+	JSON_FIELD_ARRAY_PTR("packages", struct install_batch_request, packages, true),
+	JSON_FIELD_ARRAY_PTR("order", struct install_batch_request, order, false),
+};
+
+static const struct json_field_desc s_title_id_fields[] = {
+	JSON_FIELD_TEXT_BUF("title_id", struct title_id_request, title_id, true),
+};
+
+static const struct json_field_desc s_title_ids_fields[] = {
+	JSON_FIELD_ARRAY_PTR("title_ids", struct title_ids_request, title_ids, true),
+};
+
+static const struct json_field_desc s_content_id_fields[] = {
+	JSON_FIELD_TEXT_BUF("content_id", struct content_id_request, content_id, true),
+};
+
+static const struct json_field_desc s_uninstall_batch_fields[] = {
+	JSON_FIELD_ARRAY_PTR("items", struct uninstall_batch_request, items, true),
+};
+
+static const struct json_field_desc s_uninstall_item_fields[] = {
+	JSON_FIELD_TEXT_PTR("type", struct uninstall_item_request, type, true),
+};
+
+static const struct json_field_desc s_uninstall_job_fields[] = {
+	JSON_FIELD_INT_RANGE("job_id", struct uninstall_job_request, job_id, true, 1, INT_MAX),
+};
+
+static const struct json_field_desc s_task_id_fields[] = {
+	JSON_FIELD_INT_RANGE("task_id", struct task_id_request, task_id, true, 0, INT_MAX),
+};
+
+static const struct json_field_desc s_find_task_fields[] = {
+	JSON_FIELD_TEXT_BUF("content_id", struct find_task_request, content_id, true),
+	JSON_FIELD_INT_RANGE("sub_type", struct find_task_request, sub_type, true, INT_MIN, INT_MAX),
+};
+
+static const struct json_field_desc s_tasks_batch_fields[] = {
+	JSON_FIELD_ARRAY_PTR("items", struct tasks_batch_request, items, true),
+};
+
+static const struct json_field_desc s_tasks_batch_item_fields[] = {
+	JSON_FIELD_TEXT_PTR("op", struct tasks_batch_item_request, op, true),
+	JSON_FIELD_INT_RANGE("task_id", struct tasks_batch_item_request, task_id, true, 0, INT_MAX),
+};
+
+static const struct json_field_desc s_queue_priority_fields[] = {
+	JSON_FIELD_INT_RANGE("task_id", struct queue_priority_request, task_id, true, 0, INT_MAX),
+	JSON_FIELD_INT_RANGE("priority", struct queue_priority_request, priority, true, SCHEDULER_MIN_PRIORITY, SCHEDULER_MAX_PRIORITY),
+};
+
+static const struct json_field_desc s_queue_max_active_fields[] = {
+	JSON_FIELD_INT_RANGE("max_active", struct queue_max_active_request, max_active, true, 1, SCHEDULER_MAX_TASKS),
+};
+
+static const struct json_field_desc s_events_fields[] = {
+	JSON_FIELD_ARRAY_PTR("task_ids", struct events_request, task_ids, false),
+	JSON_FIELD_INT_RANGE("interval_ms", struct events_request, interval_ms, false, EVENTS_MIN_INTERVAL_MSECS, EVENTS_MAX_INTERVAL_MSECS),
+};
+
+static const struct json_field_desc s_catalog_fields[] = {
+	JSON_FIELD_INT_RANGE("offset", struct catalog_request, offset, false, 0, INT64_MAX),
+	JSON_FIELD_INT_RANGE("limit", struct catalog_request, limit, false, 1, CATALOG_MAX_PAGE_SIZE),
+	JSON_FIELD_TEXT_BUF("title_id", struct catalog_request, title_id, false),
+};
+
 #define THROW_ERROR(format, ...) \
 	do { \
 		char tmp_buf[256]; \
@@ -43,16 +300,29 @@ static char* s_ip_address = NULL;
 static int s_port = 0;
 static char* s_work_dir = NULL;
 
+static const char* const s_catalog_roots[] = {
+	"/mnt/usb0",
+	"/mnt/usb1",
+	NULL, /* working directory */
+};
+
 static bool s_server_started = false;
 
+static unsigned int s_install_seq = 0;
+
 static int event_handler(sb_Event* e);
 
 static bool handle_api_install(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
+static bool handle_api_install_batch(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
 static bool handle_api_uninstall_game(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
 static bool handle_api_uninstall_ac(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
 static bool handle_api_uninstall_patch(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
 static bool handle_api_uninstall_theme(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
+static bool handle_api_uninstall_batch(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
+static bool handle_api_uninstall_status(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
+static bool handle_api_uninstall_events(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
 static bool handle_api_is_exists(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
+static bool handle_api_is_exists_batch(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
 static bool handle_api_start_task(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
 static bool handle_api_stop_task(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
 static bool handle_api_pause_task(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
@@ -60,6 +330,17 @@ static bool handle_api_resume_task(sb_Stream* s, const char* method, const char*
 static bool handle_api_unregister_task(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
 static bool handle_api_get_task_progress(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
 static bool handle_api_find_task(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
+static bool handle_api_list_tasks(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
+static bool handle_api_tasks_batch(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
+static bool handle_api_queue(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
+static bool handle_api_dispatcher_stats(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
+static bool handle_api_throughput(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
+static bool handle_api_queue_set_priority(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
+static bool handle_api_queue_set_max_active(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
+static bool handle_api_events(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
+static bool handle_api_catalog(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
+static bool handle_api_catalog_find(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
+static bool handle_api_catalog_rescan(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
 
 static bool handle_static(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size);
 
@@ -68,19 +349,49 @@ static void kick_error(sb_Stream* s, int code, const char* title, const char* er
 static void kick_result_header_json(sb_Stream* s);
 static void kick_error_json(sb_Stream* s, int code);
 static void kick_success_json(sb_Stream* s);
+static void kick_task_result_json(sb_Stream* s, int task_id, const char* title);
+
+static void write_task_progress(struct json_writer* w, const struct bgft_download_task_progress_info* info);
+static void write_task_progress_delta(struct json_writer* w, const struct bgft_download_task_progress_info* prev, const struct bgft_download_task_progress_info* info);
+static void write_task_throughput(struct json_writer* w, int task_id);
+static void write_throughput_info(struct json_writer* w, const struct throughput_info* info);
+
+static bool parse_request(sb_Stream* s, char* in_data, const struct json_field_desc* fields, size_t field_count, void* out, struct json_pool** pool, const json_t** root);
+static bool bind_request(sb_Stream* s, const json_t* root, const struct json_field_desc* fields, size_t field_count, void* out);
 
 static void cleanup_temp_files(void);
 
-static char* encodeURI(char *src);
+static void sse_begin(sb_Stream* s);
+static void sse_keepalive(sb_Stream* s);
+static uint64_t now_msecs(void);
+
+static void remove_task_artifacts(int task_id);
+static bool unregister_task(int task_id, int* error);
+static void on_task_finished(int task_id, enum progress_outcome outcome);
+static bool restore_storage_reservation(void* arg, const struct registry_task_info* info);
+
+static const struct task_op_desc s_task_ops[] = {
+	{ "start", &scheduler_start_task },
+	{ "stop", &scheduler_stop_task },
+	{ "pause", &scheduler_pause_task },
+	{ "resume", &scheduler_resume_task },
+	{ "unregister", &unregister_task },
+	{ "progress", NULL },
+};
 
 static const struct handler_desc s_get_handlers[] = {
 	{ "/static/", &handle_static, true },
 	{ "/api/install", &handle_api_install, false },
+	{ "/api/install_batch", &handle_api_install_batch, false },
 	{ "/api/uninstall_game", &handle_api_uninstall_game, false },
 	{ "/api/uninstall_ac", &handle_api_uninstall_ac, false },
 	{ "/api/uninstall_patch", &handle_api_uninstall_patch, false },
 	{ "/api/uninstall_theme", &handle_api_uninstall_theme, false },
+	{ "/api/uninstall_batch", &handle_api_uninstall_batch, false },
+	{ "/api/uninstall_status", &handle_api_uninstall_status, false },
+	{ "/api/uninstall_events", &handle_api_uninstall_events, false },
 	{ "/api/is_exists", &handle_api_is_exists, false },
+	{ "/api/is_exists_batch", &handle_api_is_exists_batch, false },
 	{ "/api/start_task", &handle_api_start_task, false },
 	{ "/api/stop_task", &handle_api_stop_task, false },
 	{ "/api/pause_task", &handle_api_pause_task, false },
@@ -88,14 +399,30 @@ static const struct handler_desc s_get_handlers[] = {
 	{ "/api/unregister_task", &handle_api_unregister_task, false },
 	{ "/api/get_task_progress", &handle_api_get_task_progress, false },
 	{ "/api/find_task", &handle_api_find_task, false },
+	{ "/api/list_tasks", &handle_api_list_tasks, false },
+	{ "/api/tasks/batch", &handle_api_tasks_batch, false },
+	{ "/api/queue", &handle_api_queue, false },
+	{ "/api/dispatcher_stats", &handle_api_dispatcher_stats, false },
+	{ "/api/throughput", &handle_api_throughput, false },
+	{ "/api/queue/set_priority", &handle_api_queue_set_priority, false },
+	{ "/api/queue/set_max_active", &handle_api_queue_set_max_active, false },
+	{ "/api/events", &handle_api_events, false },
+	{ "/api/catalog", &handle_api_catalog, false },
+	{ "/api/catalog/find", &handle_api_catalog_find, false },
+	{ "/api/catalog/rescan", &handle_api_catalog_rescan, false },
 };
 static const struct handler_desc s_post_handlers[] = {
 	{ "/api/install", &handle_api_install, false },
+	{ "/api/install_batch", &handle_api_install_batch, false },
 	{ "/api/uninstall_game", &handle_api_uninstall_game, false },
 	{ "/api/uninstall_ac", &handle_api_uninstall_ac, false },
 	{ "/api/uninstall_patch", &handle_api_uninstall_patch, false },
 	{ "/api/uninstall_theme", &handle_api_uninstall_theme, false },
+	{ "/api/uninstall_batch", &handle_api_uninstall_batch, false },
+	{ "/api/uninstall_status", &handle_api_uninstall_status, false },
+	{ "/api/uninstall_events", &handle_api_uninstall_events, false },
 	{ "/api/is_exists", &handle_api_is_exists, false },
+	{ "/api/is_exists_batch", &handle_api_is_exists_batch, false },
 	{ "/api/start_task", &handle_api_start_task, false },
 	{ "/api/stop_task", &handle_api_stop_task, false },
 	{ "/api/pause_task", &handle_api_pause_task, false },
@@ -103,6 +430,17 @@ static const struct handler_desc s_post_handlers[] = {
 	{ "/api/unregister_task", &handle_api_unregister_task, false },
 	{ "/api/get_task_progress", &handle_api_get_task_progress, false },
 	{ "/api/find_task", &handle_api_find_task, false },
+	{ "/api/list_tasks", &handle_api_list_tasks, false },
+	{ "/api/tasks/batch", &handle_api_tasks_batch, false },
+	{ "/api/queue", &handle_api_queue, false },
+	{ "/api/dispatcher_stats", &handle_api_dispatcher_stats, false },
+	{ "/api/throughput", &handle_api_throughput, false },
+	{ "/api/queue/set_priority", &handle_api_queue_set_priority, false },
+	{ "/api/queue/set_max_active", &handle_api_queue_set_max_active, false },
+	{ "/api/events", &handle_api_events, false },
+	{ "/api/catalog", &handle_api_catalog, false },
+	{ "/api/catalog/find", &handle_api_catalog_find, false },
+	{ "/api/catalog/rescan", &handle_api_catalog_rescan, false },
 };
 
 bool server_start(const char* ip_address, int port, const char* work_dir) {
@@ -128,6 +466,74 @@ bool server_start(const char* ip_address, int port, const char* work_dir) {
 
 	cleanup_temp_files();
 
+	{
+		const char* roots[ARRAY_SIZE(s_catalog_roots)];
+		size_t i;
+
+		for (i = 0; i < ARRAY_SIZE(s_catalog_roots); ++i) {
+			roots[i] = s_catalog_roots[i] ? s_catalog_roots[i] : s_work_dir;
+		}
+
+		if (!catalog_init(roots, ARRAY_SIZE(roots))) {
+			EPRINTF("Unable to initialize package catalog.\n");
+		}
+	}
+
+	if (!artifact_init(s_work_dir, ARTIFACT_MEMORY_CAP)) {
+		EPRINTF("Unable to initialize artifact store.\n");
+		goto err_catalog_fini;
+	}
+
+	if (!throughput_init()) {
+		/* Progress responses just come without throughput then. */
+		EPRINTF("Unable to initialize throughput tracker.\n");
+	}
+
+	if (!progress_init(&on_task_finished)) {
+		EPRINTF("Unable to initialize progress poller.\n");
+		throughput_fini();
+		goto err_artifact_fini;
+	}
+
+	{
+		char state_path[1024];
+
+		snprintf(state_path, sizeof(state_path), "%s/%s", s_work_dir, REGISTRY_JOURNAL_FILE_NAME);
+
+		if (!registry_init(state_path)) {
+			EPRINTF("Unable to initialize task registry.\n");
+		}
+
+		if (storage_init(STORAGE_PATH, STORAGE_MARGIN_SIZE)) {
+			/* Downloads still in flight keep their space. */
+			registry_enumerate(&restore_storage_reservation, NULL);
+		} else {
+			EPRINTF("Unable to initialize storage ledger.\n");
+		}
+
+		snprintf(state_path, sizeof(state_path), "%s/%s", s_work_dir, SCHEDULER_STATE_FILE_NAME);
+
+		if (!scheduler_init(state_path, SCHEDULER_DEFAULT_MAX_ACTIVE)) {
+			/* Tasks are left for the client to start then. */
+			EPRINTF("Unable to initialize install scheduler.\n");
+		}
+	}
+
+	if (!executor_init(INSTALL_RESOLVE_THREAD_COUNT, INSTALL_RESOLVE_PER_HOST_LIMIT)) {
+		/* Batches still work, just resolved serially. */
+		EPRINTF("Unable to initialize install executor.\n");
+	}
+
+	if (!inventory_init()) {
+		/* Queries go straight to the system then. */
+		EPRINTF("Unable to initialize application inventory.\n");
+	}
+
+	if (!uninstaller_init()) {
+		/* Single uninstall endpoints do not need it. */
+		EPRINTF("Unable to initialize uninstaller.\n");
+	}
+
 	memset(&opts, 0, sizeof(opts));
 	{
 		snprintf(port_str, sizeof(port_str), "%d", port);
@@ -142,7 +548,7 @@ bool server_start(const char* ip_address, int port, const char* work_dir) {
 	s_server = sb_new_server(&opts);
 	if (!s_server) {
 		EPRINTF("Unable to initialize server.\n");
-		goto err_work_dir_free;
+		goto err_progress_fini;
 	}
 
 	s_server_started = true;
@@ -150,7 +556,22 @@ bool server_start(const char* ip_address, int port, const char* work_dir) {
 done:
 	return true;
 
-err_work_dir_free:
+err_progress_fini:
+	uninstaller_fini();
+	inventory_fini();
+	executor_fini();
+	scheduler_fini();
+	storage_fini();
+	registry_fini();
+	progress_fini();
+	throughput_fini();
+
+err_artifact_fini:
+	artifact_fini();
+
+err_catalog_fini:
+	catalog_fini();
+
 	free(s_work_dir);
 	s_work_dir = NULL;
 
@@ -185,6 +606,18 @@ void server_stop(void) {
 	sb_close_server(s_server);
 	s_server = NULL;
 
+	uninstaller_fini();
+	inventory_fini();
+	executor_fini();
+	scheduler_fini();
+	storage_fini();
+	registry_fini();
+	progress_fini();
+	throughput_fini();
+	artifact_fini();
+	catalog_fini();
+	json_pool_fini();
+
 	free(s_work_dir);
 	s_work_dir = NULL;
 
@@ -197,7 +630,6 @@ void server_stop(void) {
 
 char *sb_get_query_data(sb_Stream *st, const char *name) {
   char *data;
-  size_t len = st->recv_buf.len;
 
   data = (char *)malloc(sizeof(char) * 512);
   sb_get_var(st, name, data, 512);
@@ -274,410 +706,478 @@ done:
 	return ret;
 }
 
-static inline bool handle_api_install_direct(sb_Stream* s, const json_t* root) {
-	const json_t* field;
-	union json_value_t val, child_val;
-	char** piece_urls = NULL;
-	char* unescaped_url = NULL;
-	size_t unescaped_url_size;
-	size_t piece_count;
-	char tmp_name[32];
-	char ref_pkg_json_path[1024];
-	char param_sfo_path[1024];
-	char icon0_png_path[1024];
-	struct sfo* sfo = NULL;
-	struct sfo_entry* sfo_entry;
+static bool get_package_sfo_info(const struct sfo_view* view, int lang_id, char* title_name, size_t title_name_size, char* content_id, size_t content_id_size, char* error_buf, size_t error_buf_size) {
+	struct sfo_view_entry entry;
 	char title_entry_key[16];
-	char title_name[256];
-	char escaped_title_name[256 * 2 + 1];
-	char content_id[PKG_CONTENT_ID_SIZE + 1];
-	char content_url[256];
-	char icon_path[1024];
-	enum pkg_content_type content_type;
-	const char* package_type;
-	const char* package_sub_type = NULL;
-	char error_buf[256];
-	uint64_t package_size;
-	bool is_patch;
-	bool has_icon = false;
-	int lang_id;
-	int task_id = -1;
+
+	assert(view != NULL);
+	assert(title_name != NULL);
+	assert(content_id != NULL);
+	assert(error_buf != NULL);
+
+	snprintf(title_entry_key, sizeof(title_entry_key), "TITLE_%02d", lang_id);
+	if (!sfo_view_find(view, title_entry_key, NULL)) {
+		strlcpy(title_entry_key, "TITLE", sizeof(title_entry_key));
+		if (!sfo_view_find(view, title_entry_key, NULL)) {
+			snprintf(error_buf, error_buf_size, "Unable to get title");
+			return false;
+		}
+	}
+	if (!sfo_view_get_string(view, title_entry_key, title_name, title_name_size)) {
+		snprintf(error_buf, error_buf_size, "Invalid format of '%s' entry in system file object", title_entry_key);
+		return false;
+	}
+
+	if (!sfo_view_find(view, "CONTENT_ID", &entry)) {
+		snprintf(error_buf, error_buf_size, "Unable to get content id");
+		return false;
+	}
+	if (entry.format != SFO_FORMAT_STRING || entry.size != content_id_size || !sfo_view_get_string(view, "CONTENT_ID", content_id, content_id_size)) {
+		snprintf(error_buf, error_buf_size, "Invalid format of '%s' entry in system file object", "CONTENT_ID");
+		return false;
+	}
+
+	return true;
+}
+
+/* Errors of the steps are cut to leave room for the package URL. */
+#define FAIL_JOB(job, format, ...) \
+	do { \
+		snprintf((job)->error, sizeof((job)->error), format, ##__VA_ARGS__); \
+		goto err; \
+	} while (0)
+
+static void init_install_job(struct install_job* job) {
+	memset(job, 0, sizeof(*job));
+	job->task_id = -1;
+}
+
+static void free_install_job(struct install_job* job) {
 	size_t i;
-	int ret;
 
-	memset(ref_pkg_json_path, 0, sizeof(ref_pkg_json_path));
-	memset(param_sfo_path, 0, sizeof(param_sfo_path));
-	memset(icon0_png_path, 0, sizeof(icon0_png_path));
+	pkg_free_prerequisites(&job->prereq);
 
-	if (!get_language_id(&lang_id)) {
-		THROW_ERROR("Unable to get language id.");
+	if (job->header) {
+		free(job->header);
+		job->header = NULL;
+	}
+
+	if (job->piece_sizes) {
+		free(job->piece_sizes);
+		job->piece_sizes = NULL;
 	}
 
-	field = json_getProperty(root, "packages");
-	if (!field) {
-		THROW_ERROR("No '%s' parameter specified.", "packages");
+	if (job->piece_urls) {
+		for (i = 0; i < job->piece_count; ++i) {
+			free(job->piece_urls[i]);
+		}
+		free(job->piece_urls);
+		job->piece_urls = NULL;
+	}
+}
+
+static bool prepare_direct_install_job(struct install_job* job, const json_t* packages, bool auto_split) {
+	union json_value_t val, child_val;
+	size_t i;
+
+	for (val.jval = json_getChild(packages), job->piece_count = 0; val.jval != NULL; val.jval = json_getSibling(val.jval)) {
+		++job->piece_count;
+	}
+	if (job->piece_count == 0) {
+		FAIL_JOB(job, "No packages.");
 	}
-	if (json_getType(field) != JSON_ARRAY) {
-		THROW_ERROR("Invalid type for parameter '%s'.", "packages");
+
+	job->piece_urls = (char**)malloc(job->piece_count * sizeof(*job->piece_urls));
+	if (!job->piece_urls) {
+		FAIL_JOB(job, "No memory.");
 	}
-	for (val.jval = json_getChild(field), piece_count = 0; val.jval != NULL; val.jval = json_getSibling(val.jval)) {
+	memset(job->piece_urls, 0, job->piece_count * sizeof(*job->piece_urls));
+
+	for (val.jval = json_getChild(packages), i = 0; val.jval != NULL; val.jval = json_getSibling(val.jval)) {
 		if (json_getType(val.jval) != JSON_TEXT) {
-			THROW_ERROR("Invalid type for element of parameter '%s'.", "packages");
+			FAIL_JOB(job, "Invalid type for element of parameter '%s'.", "packages");
 		}
+
+		/* Values live in our own request buffer, so they are decoded in place. */
 		child_val.sval = json_getValue(val.jval);
-		if (strlen(child_val.sval) == 0) {
-			THROW_ERROR("Empty element value of parameter '%s'.", "packages");
+		if (uri_decode_in_place((char*)child_val.sval) == 0) {
+			FAIL_JOB(job, "Empty element value of parameter '%s'.", "packages");
 		}
 
-		if (!http_unescape_uri(&unescaped_url, &unescaped_url_size, child_val.sval)) {
-			THROW_ERROR("Unable to unescape element value of parameter '%s'.", "packages");
+		if (!starts_with(child_val.sval, "http://") && !starts_with(child_val.sval, "https://")) {
+			FAIL_JOB(job, "Unexpected element value of parameter '%s'.", "packages");
 		}
 
-		if (!starts_with(unescaped_url, "http://") && !starts_with(unescaped_url, "https://")) {
-			free(unescaped_url);
-			unescaped_url = NULL;
-			THROW_ERROR("Unexpected element value of parameter '%s'.", "packages");
+		job->piece_urls[i] = uri_encode(child_val.sval, NULL);
+		if (!job->piece_urls[i]) {
+			FAIL_JOB(job, "No memory.");
 		}
+		++i;
+	}
 
-		free(unescaped_url);
-		unescaped_url = NULL;
-
-		++piece_count;
+	if (auto_split && job->piece_count != 1) {
+		FAIL_JOB(job, "Only the first piece must be specified with '%s'.", "auto_split");
 	}
-	if (piece_count == 0) {
-		THROW_ERROR("No packages.");
+	job->auto_split = auto_split;
+
+	uri_get_host(job->piece_urls[0], job->host, sizeof(job->host));
+
+	return true;
+
+err:
+	return false;
+}
+
+static bool prepare_ref_pkg_url_install_job(struct install_job* job, const char* url) {
+	/* Value lives in our own request buffer, so it is decoded in place. */
+	if (uri_decode_in_place((char*)url) == 0) {
+		FAIL_JOB(job, "Empty element value of parameter '%s'.", "url");
 	}
 
-	piece_urls = (char**)malloc(piece_count * sizeof(*piece_urls));
-	if (!piece_urls) {
-		THROW_ERROR("No memory.");
+	if (!starts_with(url, "http://") && !starts_with(url, "https://")) {
+		FAIL_JOB(job, "Unexpected element value of parameter '%s'.", "url");
 	}
-	memset(piece_urls, 0, piece_count * sizeof(*piece_urls));
 
-	for (val.jval = json_getChild(field), i = 0; val.jval != NULL; val.jval = json_getSibling(val.jval)) {
-		child_val.sval = json_getValue(val.jval);
+	job->ref_pkg_url = url;
 
-		if (!http_unescape_uri(&unescaped_url, &unescaped_url_size, child_val.sval)) {
-			THROW_ERROR("Unable to unescape element value of parameter '%s'.", "packages");
-		}
+	uri_get_host(url, job->host, sizeof(job->host));
 
-		char *dst = encodeURI(unescaped_url);
+	return true;
 
-		piece_urls[i++] = dst;
-		unescaped_url = NULL;
-		dst = NULL;
-	}
+err:
+	return false;
+}
+
+/* Does all network round trips of an install, safe to run on a worker thread. */
+static void resolve_install_job(void* arg) {
+	struct install_job* job = (struct install_job*)arg;
+	char** discovered_urls;
+	struct sfo_view sfo_view;
+	char error_buf[256];
 
-	snprintf(tmp_name, sizeof(tmp_name), "tmp_%" PRIxMAX, (uintmax_t)(s->init_time) ^ (uint32_t)(uintptr_t)s);
+	if (job->ref_pkg_url) {
+		job->piece_urls = pkg_extract_piece_urls_from_ref_pkg_json(job->ref_pkg_url, &job->piece_count);
+		if (!job->piece_urls) {
+			job->piece_count = 0;
+			FAIL_JOB(job, "Unable to extract pieces URLs for %s'.", job->ref_pkg_url);
+		}
+	} else if (job->auto_split) {
+		memset(error_buf, 0, sizeof(error_buf));
+		discovered_urls = pkg_discover_piece_urls(job->piece_urls[0], &job->piece_sizes, &job->piece_count, &job->header, error_buf, sizeof(error_buf));
+		if (!discovered_urls) {
+			job->piece_count = 1;
+			rtrim(error_buf);
+			if (*error_buf != '\0')
+				FAIL_JOB(job, "Unable to discover pieces for package '%s': %.128s", job->piece_urls[0], error_buf);
+			else
+				FAIL_JOB(job, "Unable to discover pieces for package '%s'.", job->piece_urls[0]);
+		}
 
-	snprintf(ref_pkg_json_path, sizeof(ref_pkg_json_path), "%s/%s.json", s_work_dir, tmp_name);
-	snprintf(param_sfo_path, sizeof(param_sfo_path), "%s/%s.sfo", s_work_dir, tmp_name);
-	snprintf(icon0_png_path, sizeof(icon0_png_path), "%s/%s.png", s_work_dir, tmp_name);
+		free(job->piece_urls[0]);
+		free(job->piece_urls);
+		job->piece_urls = discovered_urls;
+	}
 
 	memset(error_buf, 0, sizeof(error_buf));
-	if (!pkg_setup_prerequisites(piece_urls, piece_count, ref_pkg_json_path, param_sfo_path, icon0_png_path, &content_type, &package_size, &is_patch, &has_icon, error_buf, sizeof(error_buf))) {
+	if (!pkg_setup_prerequisites(job->piece_urls, job->piece_sizes, job->piece_count, job->header, &job->prereq, error_buf, sizeof(error_buf))) {
 		rtrim(error_buf);
 		if (*error_buf != '\0')
-			THROW_ERROR("Unable to set up prerequisites for package '%s': %s", piece_urls[0], error_buf);
+			FAIL_JOB(job, "Unable to set up prerequisites for package '%s': %.128s", job->piece_urls[0], error_buf);
 		else
-			THROW_ERROR("Unable to set up prerequisites for package '%s'.", piece_urls[0]);
+			FAIL_JOB(job, "Unable to set up prerequisites for package '%s'.", job->piece_urls[0]);
 	}
 
-	switch (content_type) {
-		case PKG_CONTENT_TYPE_GD: package_type = "PS4GD"; break;
-		case PKG_CONTENT_TYPE_AC: package_type = "PS4AC"; break;
-		case PKG_CONTENT_TYPE_AL: package_type = "PS4AL"; break;
-		case PKG_CONTENT_TYPE_DP: package_type = "PS4DP"; break;
-		default:
-			package_type = NULL;
-			THROW_ERROR("Unsupported content type for package '%s'.", piece_urls[0]);
-			break;
+	if (job->header) {
+		free(job->header);
+		job->header = NULL;
 	}
 
-	sfo = sfo_alloc();
-	if (!sfo) {
-		THROW_ERROR("Unable to allocate system file object for package '%s'.", piece_urls[0]);
-	}
-	if (!sfo_load_from_file(sfo, param_sfo_path)) {
-		THROW_ERROR("Unable to load system file object for package '%s'.", piece_urls[0]);
+	switch (job->prereq.content_type) {
+		case PKG_CONTENT_TYPE_GD: job->package_type = "PS4GD"; break;
+		case PKG_CONTENT_TYPE_AC: job->package_type = "PS4AC"; break;
+		case PKG_CONTENT_TYPE_AL: job->package_type = "PS4AL"; break;
+		case PKG_CONTENT_TYPE_DP: job->package_type = "PS4DP"; break;
+		default:
+			job->package_type = NULL;
+			FAIL_JOB(job, "Unsupported content type for package '%s'.", job->piece_urls[0]);
+			break;
 	}
 
-	snprintf(title_entry_key, sizeof(title_entry_key), "TITLE_%02d", lang_id);
-	sfo_entry = sfo_find_entry(sfo, title_entry_key);
-	if (!sfo_entry) {
-		strlcpy(title_entry_key, "TITLE", sizeof(title_entry_key));
-		sfo_entry = sfo_find_entry(sfo, title_entry_key);
-		if (!sfo_entry) {
-			THROW_ERROR("Unable to get title for package '%s'.", piece_urls[0]);
-		}
-	}
-	if (sfo_entry->format != SFO_FORMAT_STRING || sfo_entry->size < 1) {
-		THROW_ERROR("Invalid format of '%s' entry in system file object for package '%s'.", title_entry_key, piece_urls[0]);
+	if (!job->prereq.param_sfo_data || !sfo_view_init(&sfo_view, job->prereq.param_sfo_data, job->prereq.param_sfo_size)) {
+		FAIL_JOB(job, "Unable to load system file object for package '%s'.", job->piece_urls[0]);
 	}
-	strlcpy(title_name, (const char*)sfo_entry->value, sizeof(title_name));
 
-	if (!http_escape_json_string(escaped_title_name, sizeof(escaped_title_name), title_name)) {
-		THROW_ERROR("Unable to escape title name.");
+	memset(error_buf, 0, sizeof(error_buf));
+	if (!get_package_sfo_info(&sfo_view, job->lang_id, job->title_name, sizeof(job->title_name), job->content_id, sizeof(job->content_id), error_buf, sizeof(error_buf))) {
+		FAIL_JOB(job, "%.128s for package '%s'.", error_buf, job->piece_urls[0]);
 	}
 
-	sfo_entry = sfo_find_entry(sfo, "CONTENT_ID");
-	if (!sfo_entry) {
-		THROW_ERROR("Unable to get content id for package '%s'.", piece_urls[0]);
-	}
-	if (sfo_entry->format != SFO_FORMAT_STRING || sfo_entry->size != sizeof(content_id)) {
-		THROW_ERROR("Invalid format of '%s' entry in system file object for package '%s'.", "CONTENT_ID", piece_urls[0]);
-	}
-	strlcpy(content_id, (const char*)sfo_entry->value, sizeof(content_id));
+	job->resolved = true;
 
-	snprintf(content_url, sizeof(content_url), "http://%s:%d/static/%s.json", s_ip_address, s_port, tmp_name);
-	snprintf(icon_path, sizeof(icon_path), "/user%s/%s.png", s_work_dir, tmp_name);
+err:
+	return;
+}
 
-	if (bgft_download_register_package_task(content_id, content_url, title_name, has_icon ? icon_path : NULL, package_type, package_sub_type, package_size, is_patch, &task_id, &ret)) {
-		kick_result_header_json(s);
-		sb_writef(s, "{ \"status\": \"success\", \"task_id\": %d, \"title\": \"%s\" }\n", task_id, escaped_title_name);
+/* Sub type BGFT assigns to the task, used to look it up by content id later. */
+static int get_package_sub_type(const struct install_job* job) {
+	if (job->prereq.is_patch || job->prereq.content_type == PKG_CONTENT_TYPE_DP) {
+		return ORBIS_BGFT_TASK_SUB_TYPE_GAME_PATCH;
+	} else if (job->prereq.content_type == PKG_CONTENT_TYPE_AC || job->prereq.content_type == PKG_CONTENT_TYPE_AL) {
+		return ORBIS_BGFT_TASK_SUB_TYPE_GAME_AC;
 	} else {
-		kick_error_json(s, ret);
+		return ORBIS_BGFT_TASK_SUB_TYPE_GAME;
 	}
+}
+
+/* Stores artifacts of a resolved job and registers its BGFT task. */
+static bool register_install_job(struct install_job* job, const char* tmp_name) {
+	struct registry_task_info info;
+	char ref_pkg_json_name[ARTIFACT_NAME_SIZE];
+	char icon0_png_name[ARTIFACT_NAME_SIZE];
+	char content_url[256];
+	char icon_path[1024];
+	const char* package_sub_type = NULL;
+	struct storage_usage usage;
+	bool has_icon = false;
+	int reservation_id = 0;
+	int task_id = -1;
+	int ret;
 
-	unlink(param_sfo_path);
+	assert(job->resolved);
 
-	if (sfo) {
-		sfo_free(sfo);
-	}
+	snprintf(ref_pkg_json_name, sizeof(ref_pkg_json_name), "%s.json", tmp_name);
+	snprintf(icon0_png_name, sizeof(icon0_png_name), "%s.png", tmp_name);
 
-	if (piece_urls) {
-		for (i = 0; i < piece_count; ++i) {
-			free(piece_urls[i]);
+	/* Fail before anything is stored or registered if the package would not fit. */
+	memset(&usage, 0, sizeof(usage));
+	if (!storage_reserve(job->prereq.package_size, &reservation_id, &usage, &ret)) {
+		if (ret == ENOSPC) {
+			FAIL_JOB(job, "Not enough free space for package '%s': %" PRIu64 " bytes needed, %" PRIu64 " bytes free, %" PRIu64 " bytes reserved by other tasks.",
+				job->piece_urls[0], (uint64_t)job->prereq.package_size, usage.free_size, usage.reserved_size);
 		}
-		free(piece_urls);
+		/* Free space is unknown, leave it to BGFT. */
+		EPRINTF("Unable to reserve space for package '%s'.\n", job->piece_urls[0]);
 	}
 
-	if (unescaped_url) {
-		free(unescaped_url);
+	/* Reference json is served from memory, but also written through to survive restarts. Icon is read by BGFT from disk. */
+	if (!artifact_put(ref_pkg_json_name, "application/json", (uint8_t*)job->prereq.ref_pkg_json, job->prereq.ref_pkg_json_size, true)) {
+		job->prereq.ref_pkg_json = NULL;
+		FAIL_JOB(job, "Unable to store reference package json for package '%s'.", job->piece_urls[0]);
+	}
+	job->prereq.ref_pkg_json = NULL;
+	if (job->prereq.icon0_png_data) {
+		if (!artifact_put(icon0_png_name, "image/png", job->prereq.icon0_png_data, job->prereq.icon0_png_size, true)) {
+			job->prereq.icon0_png_data = NULL;
+			FAIL_JOB(job, "Unable to store icon for package '%s'.", job->piece_urls[0]);
+		}
+		job->prereq.icon0_png_data = NULL;
+		has_icon = true;
 	}
 
-	return true;
+	snprintf(content_url, sizeof(content_url), "http://%s:%d/static/%s.json", s_ip_address, s_port, tmp_name);
+	snprintf(icon_path, sizeof(icon_path), "/user%s/%s.png", s_work_dir, tmp_name);
 
-err:
-	if (strlen(ref_pkg_json_path) > 0) {
-		unlink(ref_pkg_json_path);
-	}
-	if (strlen(param_sfo_path) > 0) {
-		unlink(param_sfo_path);
-	}
-	if (strlen(icon0_png_path) > 0) {
-		unlink(icon0_png_path);
+	if (!bgft_download_register_package_task(job->content_id, content_url, job->title_name, has_icon ? icon_path : NULL, job->package_type, package_sub_type, job->prereq.package_size, job->prereq.is_patch, &task_id, &ret)) {
+		job->error_code = ret;
+		goto err;
 	}
 
-	if (sfo) {
-		sfo_free(sfo);
-	}
+	job->registered = true;
+	job->task_id = task_id;
 
-	if (piece_urls) {
-		for (i = 0; i < piece_count; ++i) {
-			free(piece_urls[i]);
-		}
-		free(piece_urls);
-	}
+	if (task_id < 0) {
+		/* Installed already, there is no task to track or schedule. */
+		artifact_remove(ref_pkg_json_name);
+		artifact_remove(icon0_png_name);
+		storage_release(reservation_id);
+		return true;
+	}
+
+	artifact_bind_task(ref_pkg_json_name, task_id);
+	artifact_bind_task(icon0_png_name, task_id);
+	storage_bind_task(reservation_id, task_id);
+	progress_track(task_id);
+
+	memset(&info, 0, sizeof(info));
+	info.task_id = task_id;
+	info.sub_type = get_package_sub_type(job);
+	strlcpy(info.content_id, job->content_id, sizeof(info.content_id));
+	strlcpy(info.title, job->title_name, sizeof(info.title));
+	strlcpy(info.package_type, job->package_type, sizeof(info.package_type));
+	info.package_size = job->prereq.package_size;
+	info.is_patch = job->prereq.is_patch;
+	info.ref_pkg_url = job->ref_pkg_url;
+	info.piece_urls = (const char* const*)job->piece_urls;
+	info.piece_count = job->piece_count;
+	strlcpy(info.ref_pkg_json_name, ref_pkg_json_name, sizeof(info.ref_pkg_json_name));
+	if (has_icon) {
+		strlcpy(info.icon0_png_name, icon0_png_name, sizeof(info.icon0_png_name));
+	}
+	registry_add(&info);
+
+	/* Application may already show up as installed once BGFT accepted the task. */
+	inventory_invalidate_content(job->content_id);
+
+	/* Scheduler starts it once a slot is free. */
+	scheduler_enqueue(task_id, job->priority);
 
-	if (unescaped_url) {
-		free(unescaped_url);
-	}
+	return true;
+
+err:
+	artifact_remove(ref_pkg_json_name);
+	artifact_remove(icon0_png_name);
+	storage_release(reservation_id);
 
 	return false;
 }
 
-static inline bool handle_api_install_ref_pkg_url(sb_Stream* s, const json_t* root) {
-	const json_t* field;
-	union json_value_t val;
-	char* unescaped_url = NULL;
-	size_t unescaped_url_size;
-	char** piece_urls = NULL;
-	size_t piece_count;
-	char tmp_name[32];
-	char ref_pkg_json_path[1024];
-	char param_sfo_path[1024];
-	char icon0_png_path[1024];
-	struct sfo* sfo = NULL;
-	struct sfo_entry* sfo_entry;
-	char title_entry_key[16];
-	char title_name[256];
-	char escaped_title_name[256 * 2 + 1];
-	char content_id[PKG_CONTENT_ID_SIZE + 1];
-	char content_url[256];
-	char icon_path[256];
-	char error_buf[256];
-	enum pkg_content_type content_type;
-	const char* package_type;
-	const char* package_sub_type = NULL;
-	uint64_t package_size;
-	bool is_patch;
-	bool has_icon = false;
-	int lang_id;
-	int task_id = -1;
-	size_t i;
-	int ret;
+#undef FAIL_JOB
 
-	memset(ref_pkg_json_path, 0, sizeof(ref_pkg_json_path));
-	memset(param_sfo_path, 0, sizeof(param_sfo_path));
-	memset(icon0_png_path, 0, sizeof(icon0_png_path));
+/* Artifacts are removed by name when their task is done, so names must not repeat for streams reusing an address. */
+static void make_install_tmp_name(sb_Stream* s, size_t index, char* buf, size_t buf_size) {
+	unsigned int seq = __atomic_add_fetch(&s_install_seq, 1, __ATOMIC_RELAXED);
 
-	if (!get_language_id(&lang_id)) {
-		THROW_ERROR("Unable to get language id.");
+	if (index == 0) {
+		snprintf(buf, buf_size, "tmp_%" PRIxMAX "_%u", (uintmax_t)(s->init_time) ^ (uint32_t)(uintptr_t)s, seq);
+	} else {
+		snprintf(buf, buf_size, "tmp_%" PRIxMAX "_%u_%" PRIuMAX, (uintmax_t)(s->init_time) ^ (uint32_t)(uintptr_t)s, seq, (uintmax_t)index);
 	}
+}
 
-	field = json_getProperty(root, "url");
-	if (!field) {
-		THROW_ERROR("No '%s' parameter specified.", "url");
-	}
-	if (json_getType(field) != JSON_TEXT) {
-		THROW_ERROR("Invalid type for parameter '%s'.", "url");
-	}
-	val.sval = json_getValue(field);
-	if (strlen(val.sval) == 0) {
-		THROW_ERROR("Empty element value of parameter '%s'.", "url");
+/*
+ * Identical requests for the same package URL that arrive while one is still resolving or registering
+ * wait for it and report its outcome, instead of fetching everything again and registering another task.
+ */
+static bool run_install_job(sb_Stream* s, struct install_job* job) {
+	struct singleflight_call* call = NULL;
+	struct install_outcome outcome;
+	char tmp_name[48];
+	bool leader = true;
+	char* key;
+
+	key = uri_normalize(job->ref_pkg_url ? job->ref_pkg_url : job->piece_urls[0]);
+	if (key) {
+		if (!singleflight_begin(key, &call, &leader)) {
+			call = NULL;
+		}
+		free(key);
 	}
 
-	if (!http_unescape_uri(&unescaped_url, &unescaped_url_size, val.sval)) {
-		THROW_ERROR("Unable to unescape element value of parameter '%s'.", "url");
+	if (call && !leader) {
+		if (singleflight_wait(call, &outcome, sizeof(outcome))) {
+			job->registered = outcome.registered;
+			job->task_id = outcome.task_id;
+			job->error_code = outcome.error_code;
+			strlcpy(job->error, outcome.error, sizeof(job->error));
+			strlcpy(job->title_name, outcome.title_name, sizeof(job->title_name));
+			goto report;
+		}
+
+		/* Nothing to share, do it all again. */
+		call = NULL;
 	}
 
-	if (!starts_with(unescaped_url, "http://") && !starts_with(unescaped_url, "https://")) {
-		free(unescaped_url);
-		unescaped_url = NULL;
-		THROW_ERROR("Unexpected element value of parameter '%s'.", "url");
+	resolve_install_job(job);
+	if (job->resolved) {
+		make_install_tmp_name(s, 0, tmp_name, sizeof(tmp_name));
+		register_install_job(job, tmp_name);
 	}
 
-	piece_urls = pkg_extract_piece_urls_from_ref_pkg_json(unescaped_url, &piece_count);
-	if (!piece_urls) {
-		THROW_ERROR("Unable to extract pieces URLs for %s'.", unescaped_url);
+	if (call) {
+		memset(&outcome, 0, sizeof(outcome));
+		outcome.registered = job->registered;
+		outcome.task_id = job->task_id;
+		outcome.error_code = job->error_code;
+		strlcpy(outcome.error, job->error, sizeof(outcome.error));
+		strlcpy(outcome.title_name, job->title_name, sizeof(outcome.title_name));
+		singleflight_finish(call, &outcome, sizeof(outcome));
 	}
 
-	snprintf(tmp_name, sizeof(tmp_name), "tmp_%" PRIxMAX, (uintmax_t)(s->init_time) ^ (uint32_t)(uintptr_t)s);
+report:
+	if (job->registered) {
+		kick_task_result_json(s, job->task_id, job->title_name);
+	} else if (job->error[0] != '\0') {
+		THROW_ERROR("%s", job->error);
+	} else {
+		kick_error_json(s, job->error_code);
+	}
 
-	snprintf(ref_pkg_json_path, sizeof(ref_pkg_json_path), "%s/%s.json", s_work_dir, tmp_name);
-	snprintf(param_sfo_path, sizeof(param_sfo_path), "%s/%s.sfo", s_work_dir, tmp_name);
-	snprintf(icon0_png_path, sizeof(icon0_png_path), "%s/%s.png", s_work_dir, tmp_name);
+	return true;
 
-	memset(error_buf, 0, sizeof(error_buf));
-	if (!pkg_setup_prerequisites(piece_urls, piece_count, ref_pkg_json_path, param_sfo_path, icon0_png_path, &content_type, &package_size, &is_patch, &has_icon, error_buf, sizeof(error_buf))) {
-		rtrim(error_buf);
-		if (*error_buf != '\0')
-			THROW_ERROR("Unable to set up prerequisites for package '%s': %s", piece_urls[0], error_buf);
-		else
-			THROW_ERROR("Unable to set up prerequisites for package '%s'.", piece_urls[0]);
-	}
+err:
+	return false;
+}
 
-	switch (content_type) {
-		case PKG_CONTENT_TYPE_GD: package_type = "PS4GD"; break;
-		case PKG_CONTENT_TYPE_AC: package_type = "PS4AC"; break;
-		case PKG_CONTENT_TYPE_AL: package_type = "PS4AL"; break;
-		case PKG_CONTENT_TYPE_DP: package_type = "PS4DP"; break;
-		default:
-			package_type = NULL;
-			THROW_ERROR("Unsupported content type for package '%s'.", piece_urls[0]);
-			break;
-	}
+static inline bool handle_api_install_direct(sb_Stream* s, const json_t* root) {
+	struct install_direct_request req;
+	struct install_job job;
+	bool status;
 
-	sfo = sfo_alloc();
-	if (!sfo) {
-		THROW_ERROR("Unable to allocate system file object for package '%s'.", piece_urls[0]);
-	}
-	if (!sfo_load_from_file(sfo, param_sfo_path)) {
-		THROW_ERROR("Unable to load system file object for package '%s'.", piece_urls[0]);
-	}
+	init_install_job(&job);
 
-	snprintf(title_entry_key, sizeof(title_entry_key), "TITLE_%02d", lang_id);
-	sfo_entry = sfo_find_entry(sfo, title_entry_key);
-	if (!sfo_entry) {
-		strlcpy(title_entry_key, "TITLE", sizeof(title_entry_key));
-		sfo_entry = sfo_find_entry(sfo, title_entry_key);
-		if (!sfo_entry) {
-			THROW_ERROR("Unable to get title for package '%s'.", piece_urls[0]);
-		}
-	}
-	if (sfo_entry->format != SFO_FORMAT_STRING || sfo_entry->size < 1) {
-		THROW_ERROR("Invalid format of '%s' entry in system file object for package '%s'.", title_entry_key, piece_urls[0]);
+	if (!get_language_id(&job.lang_id)) {
+		THROW_ERROR("Unable to get language id.");
 	}
-	strlcpy(title_name, (const char*)sfo_entry->value, sizeof(title_name));
 
-	if (!http_escape_json_string(escaped_title_name, sizeof(escaped_title_name), title_name)) {
-		THROW_ERROR("Unable to escape title name.");
+	memset(&req, 0, sizeof(req));
+	if (!bind_request(s, root, s_install_direct_fields, ARRAY_SIZE(s_install_direct_fields), &req)) {
+		goto err;
 	}
 
-	sfo_entry = sfo_find_entry(sfo, "CONTENT_ID");
-	if (!sfo_entry) {
-		THROW_ERROR("Unable to get content id for package '%s'.", piece_urls[0]);
-	}
-	if (sfo_entry->format != SFO_FORMAT_STRING || sfo_entry->size != sizeof(content_id)) {
-		THROW_ERROR("Invalid format of '%s' entry in system file object for package '%s'.", "CONTENT_ID", piece_urls[0]);
+	if (!prepare_direct_install_job(&job, req.packages, req.auto_split)) {
+		THROW_ERROR("%s", job.error);
 	}
-	strlcpy(content_id, (const char*)sfo_entry->value, sizeof(content_id));
+	job.priority = req.priority;
 
-	snprintf(content_url, sizeof(content_url), "http://%s:%d/static/%s.json", s_ip_address, s_port, tmp_name);
-	snprintf(icon_path, sizeof(icon_path), "/user%s/%s.png", s_work_dir, tmp_name);
+	status = run_install_job(s, &job);
 
-	if (bgft_download_register_package_task(content_id, content_url, title_name, has_icon ? icon_path : NULL, package_type, package_sub_type, package_size, is_patch, &task_id, &ret)) {
-		kick_result_header_json(s);
-		sb_writef(s, "{ \"status\": \"success\", \"task_id\": %d, \"title\": \"%s\" }\n", task_id, escaped_title_name);
-	} else {
-		kick_error_json(s, ret);
-	}
+	free_install_job(&job);
 
-	unlink(param_sfo_path);
+	return status;
 
-	if (sfo) {
-		sfo_free(sfo);
-	}
+err:
+	free_install_job(&job);
 
-	if (unescaped_url) {
-		free(unescaped_url);
-	}
+	return false;
+}
 
-	if (piece_urls) {
-		for (i = 0; i < piece_count; ++i) {
-			free(piece_urls[i]);
-		}
-		free(piece_urls);
-	}
+static inline bool handle_api_install_ref_pkg_url(sb_Stream* s, const json_t* root) {
+	struct install_ref_pkg_url_request req;
+	struct install_job job;
+	bool status;
 
-	return true;
+	init_install_job(&job);
 
-err:
-	if (strlen(ref_pkg_json_path) > 0) {
-		unlink(ref_pkg_json_path);
-	}
-	if (strlen(param_sfo_path) > 0) {
-		unlink(param_sfo_path);
-	}
-	if (strlen(icon0_png_path) > 0) {
-		unlink(icon0_png_path);
+	if (!get_language_id(&job.lang_id)) {
+		THROW_ERROR("Unable to get language id.");
 	}
 
-	if (sfo) {
-		sfo_free(sfo);
+	memset(&req, 0, sizeof(req));
+	if (!bind_request(s, root, s_install_ref_pkg_url_fields, ARRAY_SIZE(s_install_ref_pkg_url_fields), &req)) {
+		goto err;
 	}
 
-	if (unescaped_url) {
-		free(unescaped_url);
+	if (!prepare_ref_pkg_url_install_job(&job, req.url)) {
+		THROW_ERROR("%s", job.error);
 	}
+	job.priority = req.priority;
 
-	if (piece_urls) {
-		for (i = 0; i < piece_count; ++i) {
-			free(piece_urls[i]);
-		}
-		free(piece_urls);
-	}
+	status = run_install_job(s, &job);
+
+	free_install_job(&job);
+
+	return status;
+
+err:
+	free_install_job(&job);
 
 	return false;
 }
 
 static bool handle_api_install(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
-	static json_t* pool = NULL;
-	const size_t pool_size = 256;
+	struct json_pool* pool = NULL;
+	struct install_request req;
 	const json_t* root;
-	const json_t* field;
-	union json_value_t val;
 	bool status;
 
 	assert(s != NULL);
@@ -685,111 +1185,229 @@ static bool handle_api_install(sb_Stream* s, const char* method, const char* pat
 	assert(path != NULL);
 	assert(in_data != NULL);
 
-	pool = (json_t*)malloc(sizeof(*pool) * pool_size);
-	if (!pool) {
-		THROW_ERROR("No memory.");
-	}
-	memset(pool, 0, sizeof(*pool) * pool_size);
-
-	root = json_create(in_data, pool, pool_size);
-	if (!root) {
-		THROW_ERROR("Invalid JSON format.");
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_install_fields, ARRAY_SIZE(s_install_fields), &req, &pool, &root)) {
+		goto err;
 	}
 
-	field = json_getProperty(root, "type");
-	if (!field) {
-		THROW_ERROR("No '%s' parameter specified.", "type");
-	}
-	if (json_getType(field) != JSON_TEXT) {
-		THROW_ERROR("Invalid type for parameter '%s'.", "type");
-	}
-	val.sval = json_getValue(field);
-	if (strcasecmp(val.sval, "direct") == 0) {
+	if (strcasecmp(req.type, "direct") == 0) {
 		status = handle_api_install_direct(s, root);
-	} else if (strcasecmp(val.sval, "ref_pkg_url") == 0) {
+	} else if (strcasecmp(req.type, "ref_pkg_url") == 0) {
 		status = handle_api_install_ref_pkg_url(s, root);
 	} else {
-		THROW_ERROR("Invalid type '%s'.", val.sval);
+		THROW_ERROR("Invalid type '%s'.", req.type);
 	}
 
 	if (pool) {
-		free(pool);
+		json_pool_release(pool);
 	}
 
 	return status;
 
 err:
 	if (pool) {
-		free(pool);
+		json_pool_release(pool);
 	}
 
 	return false;
 }
 
-static bool handle_api_uninstall_game(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
-	static json_t* pool = NULL;
-	const size_t pool_size = 256;
-	const json_t* root;
-	const json_t* field;
-	char title_id[PKG_TITLE_ID_SIZE + 1];
+/* Binds one spec of a batch, malformed specs fail on their own. */
+static bool prepare_batch_install_job(const json_t* node, struct install_job* job) {
+	struct install_request req;
+	struct install_direct_request direct_req;
+	struct install_ref_pkg_url_request ref_req;
+
+	if (json_getType(node) != JSON_OBJ) {
+		snprintf(job->error, sizeof(job->error), "Invalid element of parameter '%s'.", "packages");
+		return false;
+	}
+
+	memset(&req, 0, sizeof(req));
+	if (!json_bind(node, s_install_fields, ARRAY_SIZE(s_install_fields), &req, job->error, sizeof(job->error))) {
+		return false;
+	}
+
+	if (strcasecmp(req.type, "direct") == 0) {
+		memset(&direct_req, 0, sizeof(direct_req));
+		if (!json_bind(node, s_install_direct_fields, ARRAY_SIZE(s_install_direct_fields), &direct_req, job->error, sizeof(job->error))) {
+			return false;
+		}
+		job->priority = direct_req.priority;
+		return prepare_direct_install_job(job, direct_req.packages, direct_req.auto_split);
+	} else if (strcasecmp(req.type, "ref_pkg_url") == 0) {
+		memset(&ref_req, 0, sizeof(ref_req));
+		if (!json_bind(node, s_install_ref_pkg_url_fields, ARRAY_SIZE(s_install_ref_pkg_url_fields), &ref_req, job->error, sizeof(job->error))) {
+			return false;
+		}
+		job->priority = ref_req.priority;
+		return prepare_ref_pkg_url_install_job(job, ref_req.url);
+	}
+
+	snprintf(job->error, sizeof(job->error), "Invalid type '%s'.", req.type);
+
+	return false;
+}
+
+/*
+ * Prerequisites of all packages are resolved concurrently, then tasks are registered one by one
+ * in the requested order. Results are reported in the order of the packages array.
+ */
+static bool handle_api_install_batch(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct install_batch_request req;
+	struct install_job* jobs = NULL;
+	struct install_job* job;
+	struct executor_group group;
+	size_t* order = NULL;
+	bool* ordered = NULL;
+	struct json_writer w;
 	union json_value_t val;
-	int ret;
+	char tmp_name[48];
+	size_t job_count = 0;
+	size_t order_count = 0;
+	size_t i;
+	int lang_id;
 
 	assert(s != NULL);
 	assert(method != NULL);
 	assert(path != NULL);
 	assert(in_data != NULL);
 
-	pool = (json_t*)malloc(sizeof(*pool) * pool_size);
-	if (!pool) {
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_install_batch_fields, ARRAY_SIZE(s_install_batch_fields), &req, &pool, NULL)) {
+		goto err;
+	}
+
+	if (!get_language_id(&lang_id)) {
+		THROW_ERROR("Unable to get language id.");
+	}
+
+	for (val.jval = json_getChild(req.packages); val.jval != NULL; val.jval = json_getSibling(val.jval)) {
+		if (++job_count > INSTALL_BATCH_MAX_ITEMS) {
+			THROW_ERROR("Too many elements in parameter '%s'.", "packages");
+		}
+	}
+	if (job_count == 0) {
+		THROW_ERROR("No packages.");
+	}
+
+	jobs = (struct install_job*)calloc(job_count, sizeof(*jobs));
+	order = (size_t*)calloc(job_count, sizeof(*order));
+	ordered = (bool*)calloc(job_count, sizeof(*ordered));
+	if (!jobs || !order || !ordered) {
 		THROW_ERROR("No memory.");
 	}
-	memset(pool, 0, sizeof(*pool) * pool_size);
+	for (i = 0; i < job_count; ++i) {
+		init_install_job(&jobs[i]);
+		jobs[i].lang_id = lang_id;
+	}
 
-	root = json_create(in_data, pool, pool_size);
-	if (!root) {
-		THROW_ERROR("Invalid JSON format.");
+	/* Explicitly ordered packages go first, the rest follow in array order. */
+	if (req.order) {
+		for (val.jval = json_getChild(req.order); val.jval != NULL; val.jval = json_getSibling(val.jval)) {
+			if (json_getType(val.jval) != JSON_INTEGER || json_getInteger(val.jval) < 0 || (uint64_t)json_getInteger(val.jval) >= job_count) {
+				THROW_ERROR("Invalid element of parameter '%s'.", "order");
+			}
+			i = (size_t)json_getInteger(val.jval);
+			if (ordered[i]) {
+				THROW_ERROR("Duplicate element of parameter '%s'.", "order");
+			}
+			ordered[i] = true;
+			order[order_count++] = i;
+		}
+	}
+	for (i = 0; i < job_count; ++i) {
+		if (!ordered[i]) {
+			order[order_count++] = i;
+		}
 	}
 
-	field = json_getProperty(root, "title_id");
-	if (!field) {
-		THROW_ERROR("No '%s' parameter specified.", "title_id");
+	executor_group_init(&group);
+
+	for (i = 0, val.jval = json_getChild(req.packages); val.jval != NULL; ++i, val.jval = json_getSibling(val.jval)) {
+		job = &jobs[i];
+		if (prepare_batch_install_job(val.jval, job)) {
+			executor_submit(&group, job->host, &resolve_install_job, job);
+		}
 	}
-	if (json_getType(field) != JSON_TEXT) {
-		THROW_ERROR("Invalid type for parameter '%s'.", "title_id");
+
+	executor_wait(&group);
+
+	for (i = 0; i < order_count; ++i) {
+		job = &jobs[order[i]];
+		if (!job->resolved) {
+			continue;
+		}
+
+		make_install_tmp_name(s, order[i] + 1, tmp_name, sizeof(tmp_name));
+		register_install_job(job, tmp_name);
 	}
-	val.sval = json_getValue(field);
 
-	strlcpy(title_id, val.sval, sizeof(title_id));
+	kick_result_header_json(s);
 
-	if (app_inst_util_uninstall_game(title_id, &ret)) {
-		kick_result_header_json(s);
-		sb_writef(s, "{ \"status\": \"success\" }\n");
-	} else {
-		kick_error_json(s, ret);
+	json_writer_init(&w, s);
+	json_write_begin_object(&w);
+	json_write_string_field(&w, "status", "success");
+	json_write_key(&w, "results");
+	json_write_begin_array(&w);
+	for (i = 0; i < job_count; ++i) {
+		job = &jobs[i];
+
+		json_write_begin_object(&w);
+		if (job->registered) {
+			json_write_string_field(&w, "status", "success");
+			json_write_int_field(&w, "task_id", job->task_id);
+			json_write_string_field(&w, "title", job->title_name);
+		} else if (job->error[0] != '\0') {
+			json_write_string_field(&w, "status", "fail");
+			json_write_string_field(&w, "error", job->error);
+		} else {
+			json_write_string_field(&w, "status", "fail");
+			json_write_key(&w, "error_code");
+			json_write_hex32(&w, (uint32_t)job->error_code);
+		}
+		json_write_end_object(&w);
 	}
+	json_write_end_array(&w);
+	json_write_end_object(&w);
+	json_writer_finish(&w);
 
-	if (pool) {
-		free(pool);
+	for (i = 0; i < job_count; ++i) {
+		free_install_job(&jobs[i]);
 	}
+	free(jobs);
+	free(ordered);
+	free(order);
+
+	json_pool_release(pool);
 
 	return true;
 
 err:
+	if (jobs) {
+		for (i = 0; i < job_count; ++i) {
+			free_install_job(&jobs[i]);
+		}
+		free(jobs);
+	}
+	if (ordered) {
+		free(ordered);
+	}
+	if (order) {
+		free(order);
+	}
+
 	if (pool) {
-		free(pool);
+		json_pool_release(pool);
 	}
 
 	return false;
 }
 
-static bool handle_api_uninstall_ac(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
-	static json_t* pool = NULL;
-	const size_t pool_size = 256;
-	const json_t* root;
-	const json_t* field;
-	char content_id[PKG_CONTENT_ID_SIZE + 1];
-	union json_value_t val;
+static bool handle_api_uninstall_game(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct title_id_request req;
 	int ret;
 
 	assert(s != NULL);
@@ -797,56 +1415,35 @@ static bool handle_api_uninstall_ac(sb_Stream* s, const char* method, const char
 	assert(path != NULL);
 	assert(in_data != NULL);
 
-	pool = (json_t*)malloc(sizeof(*pool) * pool_size);
-	if (!pool) {
-		THROW_ERROR("No memory.");
-	}
-	memset(pool, 0, sizeof(*pool) * pool_size);
-
-	root = json_create(in_data, pool, pool_size);
-	if (!root) {
-		THROW_ERROR("Invalid JSON format.");
-	}
-
-	field = json_getProperty(root, "content_id");
-	if (!field) {
-		THROW_ERROR("No '%s' parameter specified.", "content_id");
-	}
-	if (json_getType(field) != JSON_TEXT) {
-		THROW_ERROR("Invalid type for parameter '%s'.", "content_id");
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_title_id_fields, ARRAY_SIZE(s_title_id_fields), &req, &pool, NULL)) {
+		goto err;
 	}
-	val.sval = json_getValue(field);
-
-	strlcpy(content_id, val.sval, sizeof(content_id));
 
-	if (app_inst_util_uninstall_ac(content_id, &ret)) {
-		kick_result_header_json(s);
-		sb_writef(s, "{ \"status\": \"success\" }\n");
+	if (app_inst_util_uninstall_game(req.title_id, &ret)) {
+		inventory_invalidate(req.title_id);
+		kick_success_json(s);
 	} else {
 		kick_error_json(s, ret);
 	}
 
 	if (pool) {
-		free(pool);
+		json_pool_release(pool);
 	}
 
 	return true;
 
 err:
 	if (pool) {
-		free(pool);
+		json_pool_release(pool);
 	}
 
 	return false;
 }
 
-static bool handle_api_uninstall_patch(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
-	static json_t* pool = NULL;
-	const size_t pool_size = 256;
-	const json_t* root;
-	const json_t* field;
-	char title_id[PKG_TITLE_ID_SIZE + 1];
-	union json_value_t val;
+static bool handle_api_uninstall_ac(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct content_id_request req;
 	int ret;
 
 	assert(s != NULL);
@@ -854,56 +1451,35 @@ static bool handle_api_uninstall_patch(sb_Stream* s, const char* method, const c
 	assert(path != NULL);
 	assert(in_data != NULL);
 
-	pool = (json_t*)malloc(sizeof(*pool) * pool_size);
-	if (!pool) {
-		THROW_ERROR("No memory.");
-	}
-	memset(pool, 0, sizeof(*pool) * pool_size);
-
-	root = json_create(in_data, pool, pool_size);
-	if (!root) {
-		THROW_ERROR("Invalid JSON format.");
-	}
-
-	field = json_getProperty(root, "title_id");
-	if (!field) {
-		THROW_ERROR("No '%s' parameter specified.", "title_id");
-	}
-	if (json_getType(field) != JSON_TEXT) {
-		THROW_ERROR("Invalid type for parameter '%s'.", "title_id");
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_content_id_fields, ARRAY_SIZE(s_content_id_fields), &req, &pool, NULL)) {
+		goto err;
 	}
-	val.sval = json_getValue(field);
 
-	strlcpy(title_id, val.sval, sizeof(title_id));
-
-	if (app_inst_util_uninstall_patch(title_id, &ret)) {
-		kick_result_header_json(s);
-		sb_writef(s, "{ \"status\": \"success\" }\n");
+	if (app_inst_util_uninstall_ac(req.content_id, &ret)) {
+		inventory_invalidate_content(req.content_id);
+		kick_success_json(s);
 	} else {
 		kick_error_json(s, ret);
 	}
 
 	if (pool) {
-		free(pool);
+		json_pool_release(pool);
 	}
 
 	return true;
 
 err:
 	if (pool) {
-		free(pool);
+		json_pool_release(pool);
 	}
 
 	return false;
 }
 
-static bool handle_api_uninstall_theme(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
-	static json_t* pool = NULL;
-	const size_t pool_size = 256;
-	const json_t* root;
-	const json_t* field;
-	char content_id[PKG_CONTENT_ID_SIZE + 1];
-	union json_value_t val;
+static bool handle_api_uninstall_patch(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct title_id_request req;
 	int ret;
 
 	assert(s != NULL);
@@ -911,58 +1487,35 @@ static bool handle_api_uninstall_theme(sb_Stream* s, const char* method, const c
 	assert(path != NULL);
 	assert(in_data != NULL);
 
-	pool = (json_t*)malloc(sizeof(*pool) * pool_size);
-	if (!pool) {
-		THROW_ERROR("No memory.");
-	}
-	memset(pool, 0, sizeof(*pool) * pool_size);
-
-	root = json_create(in_data, pool, pool_size);
-	if (!root) {
-		THROW_ERROR("Invalid JSON format.");
-	}
-
-	field = json_getProperty(root, "content_id");
-	if (!field) {
-		THROW_ERROR("No '%s' parameter specified.", "content_id");
-	}
-	if (json_getType(field) != JSON_TEXT) {
-		THROW_ERROR("Invalid type for parameter '%s'.", "content_id");
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_title_id_fields, ARRAY_SIZE(s_title_id_fields), &req, &pool, NULL)) {
+		goto err;
 	}
-	val.sval = json_getValue(field);
-
-	strlcpy(content_id, val.sval, sizeof(content_id));
 
-	if (app_inst_util_uninstall_theme(content_id, &ret)) {
-		kick_result_header_json(s);
-		sb_writef(s, "{ \"status\": \"success\" }\n");
+	if (app_inst_util_uninstall_patch(req.title_id, &ret)) {
+		inventory_invalidate(req.title_id);
+		kick_success_json(s);
 	} else {
 		kick_error_json(s, ret);
 	}
 
 	if (pool) {
-		free(pool);
+		json_pool_release(pool);
 	}
 
 	return true;
 
 err:
 	if (pool) {
-		free(pool);
+		json_pool_release(pool);
 	}
 
 	return false;
 }
 
-static bool handle_api_is_exists(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
-	static json_t* pool = NULL;
-	const size_t pool_size = 256;
-	const json_t* root;
-	const json_t* field;
-	char title_id[PKG_TITLE_ID_SIZE + 1];
-	union json_value_t val;
-	unsigned long size;
-	bool exists;
+static bool handle_api_uninstall_theme(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct content_id_request req;
 	int ret;
 
 	assert(s != NULL);
@@ -970,493 +1523,1576 @@ static bool handle_api_is_exists(sb_Stream* s, const char* method, const char* p
 	assert(path != NULL);
 	assert(in_data != NULL);
 
-	pool = (json_t*)malloc(sizeof(*pool) * pool_size);
-	if (!pool) {
-		THROW_ERROR("No memory.");
-	}
-	memset(pool, 0, sizeof(*pool) * pool_size);
-
-	root = json_create(in_data, pool, pool_size);
-	if (!root) {
-		THROW_ERROR("Invalid JSON format.");
-	}
-
-	field = json_getProperty(root, "title_id");
-	if (!field) {
-		THROW_ERROR("No '%s' parameter specified.", "title_id");
-	}
-	if (json_getType(field) != JSON_TEXT) {
-		THROW_ERROR("Invalid type for parameter '%s'.", "title_id");
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_content_id_fields, ARRAY_SIZE(s_content_id_fields), &req, &pool, NULL)) {
+		goto err;
 	}
-	val.sval = json_getValue(field);
 
-	strlcpy(title_id, val.sval, sizeof(title_id));
-
-	if (app_inst_util_is_exists(title_id, &exists, &ret)) {
-		kick_result_header_json(s);
-		if (exists) {
-			if (!app_inst_util_get_size(title_id, &size, &ret)) {
-				size = (unsigned long)-1;
-			}
-			sb_writef(s, "{ \"status\": \"success\", \"exists\": \"%s\", \"size\": 0x%" PRIXMAX " }\n", exists ? "true" : "false", (uintmax_t)size);
-		} else {
-			sb_writef(s, "{ \"status\": \"success\", \"exists\": \"%s\" }\n", exists ? "true" : "false");
-		}
+	if (app_inst_util_uninstall_theme(req.content_id, &ret)) {
+		inventory_invalidate_content(req.content_id);
+		kick_success_json(s);
 	} else {
 		kick_error_json(s, ret);
 	}
 
 	if (pool) {
-		free(pool);
+		json_pool_release(pool);
 	}
 
 	return true;
 
 err:
 	if (pool) {
-		free(pool);
+		json_pool_release(pool);
 	}
 
 	return false;
 }
 
-static bool handle_api_start_task(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
-	static json_t* pool = NULL;
-	const size_t pool_size = 256;
-	const json_t* root;
-	const json_t* field;
-	int task_id;
-	union json_value_t val;
-	int ret;
-
-	assert(s != NULL);
-	assert(method != NULL);
-	assert(path != NULL);
-	assert(in_data != NULL);
-
-	pool = (json_t*)malloc(sizeof(*pool) * pool_size);
-	if (!pool) {
-		THROW_ERROR("No memory.");
-	}
-	memset(pool, 0, sizeof(*pool) * pool_size);
+static bool bind_uninstall_item(const json_t* node, struct uninstall_item* item, char* error_buf, size_t error_buf_size) {
+	struct uninstall_item_request req;
+	struct title_id_request title_req;
+	struct content_id_request content_req;
 
-	root = json_create(in_data, pool, pool_size);
-	if (!root) {
-		THROW_ERROR("Invalid JSON format.");
+	if (json_getType(node) != JSON_OBJ) {
+		snprintf(error_buf, error_buf_size, "Invalid element of parameter '%s'.", "items");
+		return false;
 	}
 
-	field = json_getProperty(root, "task_id");
-	if (!field) {
-		THROW_ERROR("No '%s' parameter specified.", "task_id");
-	}
-	if (json_getType(field) != JSON_INTEGER) {
-		THROW_ERROR("Invalid type for parameter '%s'.", "task_id");
+	memset(&req, 0, sizeof(req));
+	if (!json_bind(node, s_uninstall_item_fields, ARRAY_SIZE(s_uninstall_item_fields), &req, error_buf, error_buf_size)) {
+		return false;
 	}
-	val.ival = (int)json_getInteger(field);
 
-	task_id = val.ival;
-	if (task_id < 0) {
-		THROW_ERROR("Invalid value for '%s' parameter specified.", "task_id");
+	memset(item, 0, sizeof(*item));
+	if (!uninstall_type_from_name(req.type, &item->type)) {
+		snprintf(error_buf, error_buf_size, "Invalid type '%s'.", req.type);
+		return false;
 	}
 
-	if (bgft_download_start_task(task_id, &ret)) {
-		kick_result_header_json(s);
-		sb_writef(s, "{ \"status\": \"success\" }\n");
+	if (uninstall_type_uses_content_id(item->type)) {
+		memset(&content_req, 0, sizeof(content_req));
+		if (!json_bind(node, s_content_id_fields, ARRAY_SIZE(s_content_id_fields), &content_req, error_buf, error_buf_size)) {
+			return false;
+		}
+		strlcpy(item->id, content_req.content_id, sizeof(item->id));
 	} else {
-		kick_error_json(s, ret);
-	}
-
-	if (pool) {
-		free(pool);
+		memset(&title_req, 0, sizeof(title_req));
+		if (!json_bind(node, s_title_id_fields, ARRAY_SIZE(s_title_id_fields), &title_req, error_buf, error_buf_size)) {
+			return false;
+		}
+		strlcpy(item->id, title_req.title_id, sizeof(item->id));
 	}
 
 	return true;
+}
 
-err:
-	if (pool) {
-		free(pool);
+static void write_uninstall_item(struct json_writer* w, const struct uninstall_item* item) {
+	json_write_string_field(w, "type", uninstall_type_name(item->type));
+	json_write_string_field(w, uninstall_type_uses_content_id(item->type) ? "content_id" : "title_id", item->id);
+	json_write_string_field(w, "state", uninstall_state_name(item->state));
+	if (item->state == UNINSTALL_STATE_FAILED) {
+		json_write_key(w, "error_code");
+		json_write_hex32(w, (uint32_t)item->error);
 	}
-
-	return false;
 }
 
-static bool handle_api_stop_task(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
-	static json_t* pool = NULL;
-	const size_t pool_size = 256;
-	const json_t* root;
-	const json_t* field;
-	int task_id;
-	union json_value_t val;
-	int ret;
+/* Queues uninstalls for the worker thread and returns right away, use the job id to follow them. */
+static bool handle_api_uninstall_batch(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct uninstall_batch_request req;
+	struct uninstall_item* items = NULL;
+	struct json_writer w;
+	char error_buf[256];
+	const json_t* node;
+	size_t count = 0;
+	int job_id;
 
 	assert(s != NULL);
 	assert(method != NULL);
 	assert(path != NULL);
 	assert(in_data != NULL);
 
-	pool = (json_t*)malloc(sizeof(*pool) * pool_size);
-	if (!pool) {
-		THROW_ERROR("No memory.");
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_uninstall_batch_fields, ARRAY_SIZE(s_uninstall_batch_fields), &req, &pool, NULL)) {
+		goto err;
 	}
-	memset(pool, 0, sizeof(*pool) * pool_size);
 
-	root = json_create(in_data, pool, pool_size);
-	if (!root) {
-		THROW_ERROR("Invalid JSON format.");
+	items = (struct uninstall_item*)calloc(UNINSTALLER_MAX_ITEMS, sizeof(*items));
+	if (!items) {
+		THROW_ERROR("No memory.");
 	}
 
-	field = json_getProperty(root, "task_id");
-	if (!field) {
-		THROW_ERROR("No '%s' parameter specified.", "task_id");
-	}
-	if (json_getType(field) != JSON_INTEGER) {
-		THROW_ERROR("Invalid type for parameter '%s'.", "task_id");
+	/* Items are queued together, so any invalid one rejects the whole batch. */
+	for (node = json_getChild(req.items); node != NULL; node = json_getSibling(node)) {
+		if (count >= UNINSTALLER_MAX_ITEMS) {
+			THROW_ERROR("Too many elements in parameter '%s'.", "items");
+		}
+		if (!bind_uninstall_item(node, &items[count], error_buf, sizeof(error_buf))) {
+			THROW_ERROR("%s", error_buf);
+		}
+		++count;
+	}
+
+	if (!uninstaller_submit(items, count, &job_id)) {
+		THROW_ERROR("Unable to queue uninstall job.");
+	}
+
+	kick_result_header_json(s);
+
+	json_writer_init(&w, s);
+	json_write_begin_object(&w);
+	json_write_string_field(&w, "status", "success");
+	json_write_int_field(&w, "job_id", job_id);
+	json_write_end_object(&w);
+	json_writer_finish(&w);
+
+	free(items);
+
+	json_pool_release(pool);
+
+	return true;
+
+err:
+	if (items) {
+		free(items);
+	}
+
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return false;
+}
+
+static bool handle_api_uninstall_status(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct uninstall_job_request req;
+	struct uninstall_item* items = NULL;
+	struct json_writer w;
+	size_t count;
+	bool finished;
+	size_t i;
+
+	assert(s != NULL);
+	assert(method != NULL);
+	assert(path != NULL);
+	assert(in_data != NULL);
+
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_uninstall_job_fields, ARRAY_SIZE(s_uninstall_job_fields), &req, &pool, NULL)) {
+		goto err;
+	}
+
+	items = (struct uninstall_item*)calloc(UNINSTALLER_MAX_ITEMS, sizeof(*items));
+	if (!items) {
+		THROW_ERROR("No memory.");
+	}
+
+	if (!uninstaller_get_job(req.job_id, items, &count, &finished)) {
+		THROW_ERROR("Unknown job id %d.", req.job_id);
+	}
+
+	kick_result_header_json(s);
+
+	json_writer_init(&w, s);
+	json_write_begin_object(&w);
+	json_write_string_field(&w, "status", "success");
+	json_write_int_field(&w, "job_id", req.job_id);
+	json_write_bool_field(&w, "finished", finished);
+	json_write_key(&w, "items");
+	json_write_begin_array(&w);
+	for (i = 0; i < count; ++i) {
+		json_write_begin_object(&w);
+		write_uninstall_item(&w, &items[i]);
+		json_write_end_object(&w);
+	}
+	json_write_end_array(&w);
+	json_write_end_object(&w);
+	json_writer_finish(&w);
+
+	free(items);
+
+	json_pool_release(pool);
+
+	return true;
+
+err:
+	if (items) {
+		free(items);
+	}
+
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return false;
+}
+
+static void write_uninstall_event(sb_Stream* s, const char* name, int job_id, size_t index, const struct uninstall_item* item) {
+	struct json_writer w;
+
+	sb_writef(s, "event: %s\ndata: ", name);
+
+	json_writer_init(&w, s);
+	json_write_begin_object(&w);
+	json_write_int_field(&w, "job_id", job_id);
+	if (item) {
+		json_write_int_field(&w, "index", (int)index);
+		write_uninstall_item(&w, item);
+	}
+	json_write_end_object(&w);
+	json_writer_finish(&w);
+
+	sb_write(s, "\n", 1);
+}
+
+/* Streams item state changes of one job, the stream ends once the job is finished. */
+static bool handle_api_uninstall_events(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct uninstall_job_request req;
+	struct uninstall_item* items = NULL;
+	enum uninstall_state sent_states[UNINSTALLER_MAX_ITEMS];
+	unsigned int generation = 0;
+	size_t count;
+	bool finished;
+	bool changed;
+	size_t i;
+
+	assert(s != NULL);
+	assert(method != NULL);
+	assert(path != NULL);
+	assert(in_data != NULL);
+
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_uninstall_job_fields, ARRAY_SIZE(s_uninstall_job_fields), &req, &pool, NULL)) {
+		goto err;
+	}
+
+	json_pool_release(pool);
+	pool = NULL;
+
+	items = (struct uninstall_item*)calloc(UNINSTALLER_MAX_ITEMS, sizeof(*items));
+	if (!items) {
+		THROW_ERROR("No memory.");
+	}
+
+	if (!uninstaller_get_job(req.job_id, items, &count, &finished)) {
+		THROW_ERROR("Unknown job id %d.", req.job_id);
+	}
+
+	sse_begin(s);
+
+	/* Current state of every item goes out first. */
+	for (i = 0; i < count; ++i) {
+		write_uninstall_event(s, "item", req.job_id, i, &items[i]);
+		sent_states[i] = items[i].state;
+	}
+
+	while (!finished) {
+		if (sb_flush(s) != SB_ESUCCESS) {
+			break;
+		}
+
+		if (!uninstaller_wait_for_change(&generation, UNINSTALL_EVENTS_HEARTBEAT_MSECS, &changed)) {
+			break;
+		}
+
+		if (!changed) {
+			sse_keepalive(s);
+			continue;
+		}
+
+		if (!uninstaller_get_job(req.job_id, items, &count, &finished)) {
+			break;
+		}
+
+		for (i = 0; i < count; ++i) {
+			if (items[i].state == sent_states[i]) {
+				continue;
+			}
+			write_uninstall_event(s, "item", req.job_id, i, &items[i]);
+			sent_states[i] = items[i].state;
+		}
+	}
+
+	if (finished) {
+		write_uninstall_event(s, "finished", req.job_id, 0, NULL);
+		sb_flush(s);
+	}
+
+	free(items);
+
+	return true;
+
+err:
+	if (items) {
+		free(items);
+	}
+
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return false;
+}
+
+static void write_inventory_info(struct json_writer* w, const struct inventory_info* info) {
+	json_write_string_field(w, "exists", info->exists ? "true" : "false");
+	if (info->exists) {
+		json_write_hex_field(w, "size", info->has_size ? (uintmax_t)info->size : (uintmax_t)(unsigned long)-1);
+	}
+}
+
+static bool handle_api_is_exists(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct title_id_request req;
+	struct json_writer w;
+	struct inventory_info info;
+	int ret;
+
+	assert(s != NULL);
+	assert(method != NULL);
+	assert(path != NULL);
+	assert(in_data != NULL);
+
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_title_id_fields, ARRAY_SIZE(s_title_id_fields), &req, &pool, NULL)) {
+		goto err;
+	}
+
+	if (inventory_query(req.title_id, &info, &ret)) {
+		kick_result_header_json(s);
+
+		json_writer_init(&w, s);
+		json_write_begin_object(&w);
+		json_write_string_field(&w, "status", "success");
+		write_inventory_info(&w, &info);
+		json_write_end_object(&w);
+		json_writer_finish(&w);
+	} else {
+		kick_error_json(s, ret);
+	}
+
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return true;
+
+err:
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return false;
+}
+
+static bool handle_api_is_exists_batch(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct title_ids_request req;
+	struct json_writer w;
+	struct inventory_info info;
+	union json_value_t val;
+	size_t count = 0;
+	int ret;
+
+	assert(s != NULL);
+	assert(method != NULL);
+	assert(path != NULL);
+	assert(in_data != NULL);
+
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_title_ids_fields, ARRAY_SIZE(s_title_ids_fields), &req, &pool, NULL)) {
+		goto err;
+	}
+
+	for (val.jval = json_getChild(req.title_ids); val.jval != NULL; val.jval = json_getSibling(val.jval)) {
+		if (json_getType(val.jval) != JSON_TEXT || *json_getValue(val.jval) == '\0') {
+			THROW_ERROR("Invalid element of parameter '%s'.", "title_ids");
+		}
+		if (++count > IS_EXISTS_BATCH_MAX_ITEMS) {
+			THROW_ERROR("Too many elements in parameter '%s'.", "title_ids");
+		}
+	}
+
+	kick_result_header_json(s);
+
+	json_writer_init(&w, s);
+	json_write_begin_object(&w);
+	json_write_string_field(&w, "status", "success");
+	json_write_key(&w, "results");
+	json_write_begin_array(&w);
+	for (val.jval = json_getChild(req.title_ids); val.jval != NULL; val.jval = json_getSibling(val.jval)) {
+		val.sval = json_getValue(val.jval);
+
+		json_write_begin_object(&w);
+		json_write_string_field(&w, "title_id", val.sval);
+		if (inventory_query(val.sval, &info, &ret)) {
+			json_write_string_field(&w, "status", "success");
+			write_inventory_info(&w, &info);
+		} else {
+			json_write_string_field(&w, "status", "fail");
+			json_write_key(&w, "error_code");
+			json_write_hex32(&w, (uint32_t)ret);
+		}
+		json_write_end_object(&w);
+	}
+	json_write_end_array(&w);
+	json_write_end_object(&w);
+	json_writer_finish(&w);
+
+	json_pool_release(pool);
+
+	return true;
+
+err:
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return false;
+}
+
+static bool handle_api_start_task(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct task_id_request req;
+	int ret;
+
+	assert(s != NULL);
+	assert(method != NULL);
+	assert(path != NULL);
+	assert(in_data != NULL);
+
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_task_id_fields, ARRAY_SIZE(s_task_id_fields), &req, &pool, NULL)) {
+		goto err;
+	}
+
+	if (scheduler_start_task(req.task_id, &ret)) {
+		kick_success_json(s);
+	} else {
+		kick_error_json(s, ret);
+	}
+
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return true;
+
+err:
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return false;
+}
+
+static bool handle_api_stop_task(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct task_id_request req;
+	int ret;
+
+	assert(s != NULL);
+	assert(method != NULL);
+	assert(path != NULL);
+	assert(in_data != NULL);
+
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_task_id_fields, ARRAY_SIZE(s_task_id_fields), &req, &pool, NULL)) {
+		goto err;
+	}
+
+	if (scheduler_stop_task(req.task_id, &ret)) {
+		kick_success_json(s);
+	} else {
+		kick_error_json(s, ret);
+	}
+
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return true;
+
+err:
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return false;
+}
+
+static bool handle_api_pause_task(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct task_id_request req;
+	int ret;
+
+	assert(s != NULL);
+	assert(method != NULL);
+	assert(path != NULL);
+	assert(in_data != NULL);
+
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_task_id_fields, ARRAY_SIZE(s_task_id_fields), &req, &pool, NULL)) {
+		goto err;
+	}
+
+	if (scheduler_pause_task(req.task_id, &ret)) {
+		kick_success_json(s);
+	} else {
+		kick_error_json(s, ret);
+	}
+
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return true;
+
+err:
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return false;
+}
+
+static bool handle_api_resume_task(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct task_id_request req;
+	int ret;
+
+	assert(s != NULL);
+	assert(method != NULL);
+	assert(path != NULL);
+	assert(in_data != NULL);
+
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_task_id_fields, ARRAY_SIZE(s_task_id_fields), &req, &pool, NULL)) {
+		goto err;
+	}
+
+	if (scheduler_resume_task(req.task_id, &ret)) {
+		kick_success_json(s);
+	} else {
+		kick_error_json(s, ret);
+	}
+
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return true;
+
+err:
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return false;
+}
+
+static bool handle_api_unregister_task(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct task_id_request req;
+	int ret;
+
+	assert(s != NULL);
+	assert(method != NULL);
+	assert(path != NULL);
+	assert(in_data != NULL);
+
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_task_id_fields, ARRAY_SIZE(s_task_id_fields), &req, &pool, NULL)) {
+		goto err;
+	}
+
+	if (unregister_task(req.task_id, &ret)) {
+		kick_success_json(s);
+	} else {
+		kick_error_json(s, ret);
+	}
+
+	if (pool) {
+		json_pool_release(pool);
 	}
-	val.ival = (int)json_getInteger(field);
 
-	task_id = val.ival;
-	if (task_id < 0) {
-		THROW_ERROR("Invalid value for '%s' parameter specified.", "task_id");
+	return true;
+
+err:
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return false;
+}
+
+static bool handle_api_get_task_progress(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct task_id_request req;
+	struct json_writer w;
+	struct progress_snapshot snapshot;
+
+	assert(s != NULL);
+	assert(method != NULL);
+	assert(path != NULL);
+	assert(in_data != NULL);
+
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_task_id_fields, ARRAY_SIZE(s_task_id_fields), &req, &pool, NULL)) {
+		goto err;
+	}
+
+	if (!progress_get_snapshot(req.task_id, &snapshot)) {
+		/* Not polled in background yet, ask BGFT directly and let the poller take over. */
+		memset(&snapshot, 0, sizeof(snapshot));
+		snapshot.valid = bgft_download_get_task_progress(req.task_id, &snapshot.info, &snapshot.error);
+		if (snapshot.valid) {
+			progress_track(req.task_id);
+		}
+	}
+
+	if (snapshot.valid) {
+		kick_result_header_json(s);
+
+		json_writer_init(&w, s);
+		json_write_begin_object(&w);
+		json_write_string_field(&w, "status", "success");
+		write_task_progress(&w, &snapshot.info);
+		write_task_throughput(&w, req.task_id);
+		json_write_end_object(&w);
+		json_writer_finish(&w);
+	} else {
+		kick_error_json(s, snapshot.error);
+	}
+
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return true;
+
+err:
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return false;
+}
+
+static bool handle_api_find_task(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct find_task_request req;
+	struct json_writer w;
+	int task_id = -1;
+	int ret;
+
+	assert(s != NULL);
+	assert(method != NULL);
+	assert(path != NULL);
+	assert(in_data != NULL);
+
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_find_task_fields, ARRAY_SIZE(s_find_task_fields), &req, &pool, NULL)) {
+		goto err;
 	}
 
-	if (bgft_download_stop_task(task_id, &ret)) {
+	/* Tasks registered by someone else are only known to BGFT. */
+	if (registry_find_by_content_id(req.content_id, req.sub_type, &task_id) || bgft_download_find_task_by_content_id(req.content_id, req.sub_type, &task_id, &ret)) {
 		kick_result_header_json(s);
-		sb_writef(s, "{ \"status\": \"success\" }\n");
+
+		json_writer_init(&w, s);
+		json_write_begin_object(&w);
+		json_write_string_field(&w, "status", "success");
+		json_write_int_field(&w, "task_id", task_id);
+		json_write_end_object(&w);
+		json_writer_finish(&w);
 	} else {
 		kick_error_json(s, ret);
 	}
 
 	if (pool) {
-		free(pool);
+		json_pool_release(pool);
+	}
+
+	return true;
+
+err:
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return false;
+}
+
+struct tasks_batch_item {
+	const struct task_op_desc* desc; /* null if item is malformed */
+	int task_id;
+	bool ok;
+	int error;
+	size_t progress_index;
+	char error_buf[128];
+};
+
+static const struct task_op_desc* find_task_op(const char* name) {
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(s_task_ops); ++i) {
+		if (strcmp(s_task_ops[i].name, name) == 0) {
+			return &s_task_ops[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Malformed items are reported in their result entry instead of failing the whole batch. */
+static void bind_tasks_batch_item(const json_t* node, struct tasks_batch_item* item) {
+	struct tasks_batch_item_request req;
+
+	memset(&req, 0, sizeof(req));
+
+	if (json_getType(node) != JSON_OBJ) {
+		snprintf(item->error_buf, sizeof(item->error_buf), "Invalid element of parameter '%s'.", "items");
+		return;
+	}
+	if (!json_bind(node, s_tasks_batch_item_fields, ARRAY_SIZE(s_tasks_batch_item_fields), &req, item->error_buf, sizeof(item->error_buf))) {
+		return;
+	}
+
+	item->desc = find_task_op(req.op);
+	if (!item->desc) {
+		snprintf(item->error_buf, sizeof(item->error_buf), "Unknown operation '%s'.", req.op);
+		return;
+	}
+
+	item->task_id = req.task_id;
+}
+
+/* Progress items reflect the state before any control operation of the batch was run. */
+static bool handle_api_tasks_batch(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct tasks_batch_request req;
+	struct tasks_batch_item* items = NULL;
+	struct tasks_batch_item* item;
+	struct progress_snapshot* snapshots = NULL;
+	struct progress_snapshot* snapshot;
+	int* progress_ids = NULL;
+	bool* found = NULL;
+	struct json_writer w;
+	union json_value_t val;
+	size_t item_count = 0;
+	size_t progress_count = 0;
+	size_t i;
+
+	assert(s != NULL);
+	assert(method != NULL);
+	assert(path != NULL);
+	assert(in_data != NULL);
+
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_tasks_batch_fields, ARRAY_SIZE(s_tasks_batch_fields), &req, &pool, NULL)) {
+		goto err;
+	}
+
+	for (val.jval = json_getChild(req.items); val.jval != NULL; val.jval = json_getSibling(val.jval)) {
+		if (++item_count > TASKS_BATCH_MAX_ITEMS) {
+			THROW_ERROR("Too many elements in parameter '%s'.", "items");
+		}
+	}
+
+	if (item_count > 0) {
+		items = (struct tasks_batch_item*)calloc(item_count, sizeof(*items));
+		progress_ids = (int*)calloc(item_count, sizeof(*progress_ids));
+		snapshots = (struct progress_snapshot*)calloc(item_count, sizeof(*snapshots));
+		found = (bool*)calloc(item_count, sizeof(*found));
+		if (!items || !progress_ids || !snapshots || !found) {
+			THROW_ERROR("No memory.");
+		}
+	}
+
+	for (i = 0, val.jval = json_getChild(req.items); val.jval != NULL; ++i, val.jval = json_getSibling(val.jval)) {
+		item = &items[i];
+		bind_tasks_batch_item(val.jval, item);
+		if (item->desc && !item->desc->op) {
+			item->progress_index = progress_count;
+			progress_ids[progress_count++] = item->task_id;
+		}
+	}
+
+	/* One pass over the poller state for all progress items. */
+	progress_get_snapshots(progress_ids, progress_count, snapshots, found);
+
+	for (i = 0; i < progress_count; ++i) {
+		if (found[i]) {
+			continue;
+		}
+
+		/* Not polled in background yet, ask BGFT directly and let the poller take over. */
+		snapshot = &snapshots[i];
+		memset(snapshot, 0, sizeof(*snapshot));
+		snapshot->valid = bgft_download_get_task_progress(progress_ids[i], &snapshot->info, &snapshot->error);
+		if (snapshot->valid) {
+			progress_track(progress_ids[i]);
+		}
+	}
+
+	for (i = 0; i < item_count; ++i) {
+		item = &items[i];
+		if (item->desc && item->desc->op) {
+			item->ok = item->desc->op(item->task_id, &item->error);
+		}
+	}
+
+	kick_result_header_json(s);
+
+	json_writer_init(&w, s);
+	json_write_begin_object(&w);
+	json_write_string_field(&w, "status", "success");
+	json_write_key(&w, "results");
+	json_write_begin_array(&w);
+	for (i = 0; i < item_count; ++i) {
+		item = &items[i];
+
+		json_write_begin_object(&w);
+		if (!item->desc) {
+			json_write_string_field(&w, "status", "fail");
+			json_write_string_field(&w, "error", item->error_buf);
+		} else if (!item->desc->op) {
+			snapshot = &snapshots[item->progress_index];
+			json_write_int_field(&w, "task_id", item->task_id);
+			json_write_string_field(&w, "op", item->desc->name);
+			if (snapshot->valid) {
+				json_write_string_field(&w, "status", "success");
+				write_task_progress(&w, &snapshot->info);
+				write_task_throughput(&w, item->task_id);
+			} else {
+				json_write_string_field(&w, "status", "fail");
+				json_write_key(&w, "error_code");
+				json_write_hex32(&w, (uint32_t)snapshot->error);
+			}
+		} else {
+			json_write_int_field(&w, "task_id", item->task_id);
+			json_write_string_field(&w, "op", item->desc->name);
+			if (item->ok) {
+				json_write_string_field(&w, "status", "success");
+			} else {
+				json_write_string_field(&w, "status", "fail");
+				json_write_key(&w, "error_code");
+				json_write_hex32(&w, (uint32_t)item->error);
+			}
+		}
+		json_write_end_object(&w);
+	}
+	json_write_end_array(&w);
+	json_write_end_object(&w);
+	json_writer_finish(&w);
+
+	free(found);
+	free(snapshots);
+	free(progress_ids);
+	free(items);
+
+	json_pool_release(pool);
+
+	return true;
+
+err:
+	if (found) {
+		free(found);
+	}
+	if (snapshots) {
+		free(snapshots);
+	}
+	if (progress_ids) {
+		free(progress_ids);
+	}
+	if (items) {
+		free(items);
+	}
+
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return false;
+}
+
+static bool handle_api_queue(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct scheduler_entry_info entries[SCHEDULER_MAX_TASKS];
+	struct json_writer w;
+	size_t count;
+	size_t i;
+
+	assert(s != NULL);
+	assert(method != NULL);
+	assert(path != NULL);
+	assert(in_data != NULL);
+
+	count = scheduler_get_entries(entries, ARRAY_SIZE(entries));
+
+	kick_result_header_json(s);
+
+	json_writer_init(&w, s);
+	json_write_begin_object(&w);
+	json_write_string_field(&w, "status", "success");
+	json_write_uint_field(&w, "max_active", scheduler_get_max_active());
+	json_write_key(&w, "tasks");
+	json_write_begin_array(&w);
+	for (i = 0; i < count; ++i) {
+		json_write_begin_object(&w);
+		json_write_int_field(&w, "task_id", entries[i].task_id);
+		json_write_int_field(&w, "priority", entries[i].priority);
+		json_write_string_field(&w, "state", scheduler_state_name(entries[i].state));
+		json_write_end_object(&w);
+	}
+	json_write_end_array(&w);
+	json_write_end_object(&w);
+	json_writer_finish(&w);
+
+	return true;
+}
+
+/* Call counts and latencies of system service calls, as seen by the installer dispatcher. */
+static bool handle_api_dispatcher_stats(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct dispatcher_op_stats stats[DISPATCHER_STATS_MAX_OPS];
+	struct json_writer w;
+	size_t count;
+	size_t i;
+
+	assert(s != NULL);
+	assert(method != NULL);
+	assert(path != NULL);
+	assert(in_data != NULL);
+
+	count = dispatcher_get_stats(stats, ARRAY_SIZE(stats));
+
+	kick_result_header_json(s);
+
+	json_writer_init(&w, s);
+	json_write_begin_object(&w);
+	json_write_string_field(&w, "status", "success");
+	json_write_key(&w, "operations");
+	json_write_begin_array(&w);
+	for (i = 0; i < count; ++i) {
+		json_write_begin_object(&w);
+		json_write_string_field(&w, "name", stats[i].name);
+		json_write_uint_field(&w, "calls", stats[i].calls);
+		json_write_uint_field(&w, "merged_calls", stats[i].merged_calls);
+		json_write_uint_field(&w, "wait_usecs_total", stats[i].wait_usecs_total);
+		json_write_uint_field(&w, "wait_usecs_max", stats[i].wait_usecs_max);
+		json_write_uint_field(&w, "run_usecs_total", stats[i].run_usecs_total);
+		json_write_uint_field(&w, "run_usecs_max", stats[i].run_usecs_max);
+		json_write_end_object(&w);
+	}
+	json_write_end_array(&w);
+	json_write_end_object(&w);
+	json_writer_finish(&w);
+
+	return true;
+}
+
+/* Smoothed transfer rates and ETAs of polled tasks, and their sum. */
+static bool handle_api_throughput(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	int task_ids[THROUGHPUT_STATS_MAX_TASKS];
+	struct throughput_info infos[THROUGHPUT_STATS_MAX_TASKS];
+	struct throughput_totals totals;
+	struct json_writer w;
+	size_t count;
+	size_t i;
+
+	assert(s != NULL);
+	assert(method != NULL);
+	assert(path != NULL);
+	assert(in_data != NULL);
+
+	count = throughput_get_all(task_ids, infos, ARRAY_SIZE(infos), &totals);
+
+	kick_result_header_json(s);
+
+	json_writer_init(&w, s);
+	json_write_begin_object(&w);
+	json_write_string_field(&w, "status", "success");
+	json_write_uint_field(&w, "task_count", totals.task_count);
+	json_write_uint_field(&w, "active_count", totals.active_count);
+	json_write_uint_field(&w, "stalled_count", totals.stalled_count);
+	json_write_uint_field(&w, "rate", totals.rate);
+	json_write_uint_field(&w, "peak_rate", totals.peak_rate);
+	json_write_hex_field(&w, "remaining", totals.remaining);
+	if (totals.has_eta) {
+		json_write_uint_field(&w, "eta_sec", totals.eta_secs);
+	}
+	json_write_key(&w, "tasks");
+	json_write_begin_array(&w);
+	for (i = 0; i < count; ++i) {
+		json_write_begin_object(&w);
+		json_write_int_field(&w, "task_id", task_ids[i]);
+		json_write_hex_field(&w, "transferred_total", infos[i].transferred);
+		json_write_hex_field(&w, "length_total", infos[i].length);
+		write_throughput_info(&w, &infos[i]);
+		json_write_end_object(&w);
+	}
+	json_write_end_array(&w);
+	json_write_end_object(&w);
+	json_writer_finish(&w);
+
+	return true;
+}
+
+/* Also queues a registered task which is not scheduled yet. */
+static bool handle_api_queue_set_priority(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct queue_priority_request req;
+
+	assert(s != NULL);
+	assert(method != NULL);
+	assert(path != NULL);
+	assert(in_data != NULL);
+
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_queue_priority_fields, ARRAY_SIZE(s_queue_priority_fields), &req, &pool, NULL)) {
+		goto err;
+	}
+
+	if (!scheduler_enqueue(req.task_id, req.priority)) {
+		THROW_ERROR("Unable to schedule task %d.", req.task_id);
+	}
+
+	kick_success_json(s);
+
+	json_pool_release(pool);
+
+	return true;
+
+err:
+	if (pool) {
+		json_pool_release(pool);
+	}
+
+	return false;
+}
+
+static bool handle_api_queue_set_max_active(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct queue_max_active_request req;
+
+	assert(s != NULL);
+	assert(method != NULL);
+	assert(path != NULL);
+	assert(in_data != NULL);
+
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_queue_max_active_fields, ARRAY_SIZE(s_queue_max_active_fields), &req, &pool, NULL)) {
+		goto err;
 	}
 
+	scheduler_set_max_active((unsigned int)req.max_active);
+
+	kick_success_json(s);
+
+	json_pool_release(pool);
+
 	return true;
 
 err:
 	if (pool) {
-		free(pool);
+		json_pool_release(pool);
+	}
+
+	return false;
+}
+
+static bool write_registry_task(void* arg, const struct registry_task_info* info) {
+	struct json_writer* w = (struct json_writer*)arg;
+	size_t i;
+
+	json_write_begin_object(w);
+	json_write_int_field(w, "task_id", info->task_id);
+	json_write_string_field(w, "content_id", info->content_id);
+	json_write_int_field(w, "sub_type", info->sub_type);
+	json_write_string_field(w, "title", info->title);
+	json_write_string_field(w, "package_type", info->package_type);
+	json_write_uint_field(w, "package_size", info->package_size);
+	json_write_bool_field(w, "is_patch", info->is_patch);
+	if (info->ref_pkg_url) {
+		json_write_string_field(w, "ref_pkg_url", info->ref_pkg_url);
+	}
+	json_write_key(w, "piece_urls");
+	json_write_begin_array(w);
+	for (i = 0; i < info->piece_count; ++i) {
+		json_write_string(w, info->piece_urls[i]);
+	}
+	json_write_end_array(w);
+	json_write_int_field(w, "created_time", (intmax_t)info->created_time);
+	if (info->finished_time != 0) {
+		json_write_int_field(w, "finished_time", (intmax_t)info->finished_time);
+	}
+	json_write_end_object(w);
+
+	return true;
+}
+
+static bool handle_api_list_tasks(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_writer w;
+
+	assert(s != NULL);
+	assert(method != NULL);
+	assert(path != NULL);
+	assert(in_data != NULL);
+
+	kick_result_header_json(s);
+
+	json_writer_init(&w, s);
+	json_write_begin_object(&w);
+	json_write_string_field(&w, "status", "success");
+	json_write_key(&w, "tasks");
+	json_write_begin_array(&w);
+	registry_enumerate(&write_registry_task, &w);
+	json_write_end_array(&w);
+	json_write_end_object(&w);
+	json_writer_finish(&w);
+
+	return true;
+}
+
+struct event_task_state {
+	int task_id;
+	bool sent;
+	struct progress_snapshot last;
+};
+
+struct event_stream {
+	sb_Stream* s;
+	bool follow_all; /* no explicit subscription, follow tracked tasks */
+	struct event_task_state tasks[PROGRESS_MAX_TASKS];
+	size_t task_count;
+};
+
+static void write_event(sb_Stream* s, const char* name, int task_id, const struct progress_snapshot* prev, const struct progress_snapshot* snapshot) {
+	struct json_writer w;
+
+	sb_writef(s, "event: %s\ndata: ", name);
+
+	json_writer_init(&w, s);
+	json_write_begin_object(&w);
+	json_write_int_field(&w, "task_id", task_id);
+	if (snapshot && snapshot->valid) {
+		write_task_progress_delta(&w, prev && prev->valid ? &prev->info : NULL, &snapshot->info);
+	} else if (snapshot) {
+		json_write_key(&w, "error_code");
+		json_write_hex32(&w, (uint32_t)snapshot->error);
+	}
+	json_write_end_object(&w);
+	json_writer_finish(&w);
+
+	sb_write(s, "\n", 1);
+}
+
+static bool contains_task_id(const int* task_ids, size_t count, int task_id) {
+	size_t i;
+
+	for (i = 0; i < count; ++i) {
+		if (task_ids[i] == task_id) {
+			return true;
+		}
 	}
 
 	return false;
 }
 
-static bool handle_api_pause_task(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
-	static json_t* pool = NULL;
-	const size_t pool_size = 256;
-	const json_t* root;
-	const json_t* field;
-	int task_id;
-	union json_value_t val;
-	int ret;
+static void sync_followed_tasks(struct event_stream* es) {
+	int task_ids[PROGRESS_MAX_TASKS];
+	int known_task_ids[PROGRESS_MAX_TASKS];
+	size_t task_count, known_count;
+	size_t i;
 
-	assert(s != NULL);
-	assert(method != NULL);
-	assert(path != NULL);
-	assert(in_data != NULL);
+	task_count = progress_get_tracked_tasks(task_ids, ARRAY_SIZE(task_ids));
 
-	pool = (json_t*)malloc(sizeof(*pool) * pool_size);
-	if (!pool) {
-		THROW_ERROR("No memory.");
-	}
-	memset(pool, 0, sizeof(*pool) * pool_size);
+	for (i = 0; i < es->task_count; ) {
+		if (contains_task_id(task_ids, task_count, es->tasks[i].task_id)) {
+			known_task_ids[i] = es->tasks[i].task_id;
+			++i;
+			continue;
+		}
 
-	root = json_create(in_data, pool, pool_size);
-	if (!root) {
-		THROW_ERROR("Invalid JSON format.");
+		write_event(es->s, "removed", es->tasks[i].task_id, NULL, NULL);
+		es->tasks[i] = es->tasks[--es->task_count];
 	}
 
-	field = json_getProperty(root, "task_id");
-	if (!field) {
-		THROW_ERROR("No '%s' parameter specified.", "task_id");
-	}
-	if (json_getType(field) != JSON_INTEGER) {
-		THROW_ERROR("Invalid type for parameter '%s'.", "task_id");
-	}
-	val.ival = (int)json_getInteger(field);
+	known_count = es->task_count;
 
-	task_id = val.ival;
-	if (task_id < 0) {
-		THROW_ERROR("Invalid value for '%s' parameter specified.", "task_id");
-	}
+	for (i = 0; i < task_count && es->task_count < ARRAY_SIZE(es->tasks); ++i) {
+		if (contains_task_id(known_task_ids, known_count, task_ids[i])) {
+			continue;
+		}
 
-	if (bgft_download_pause_task(task_id, &ret)) {
-		kick_result_header_json(s);
-		sb_writef(s, "{ \"status\": \"success\" }\n");
-	} else {
-		kick_error_json(s, ret);
+		memset(&es->tasks[es->task_count], 0, sizeof(es->tasks[es->task_count]));
+		es->tasks[es->task_count++].task_id = task_ids[i];
 	}
+}
 
-	if (pool) {
-		free(pool);
+/* Returns number of events written. */
+static size_t write_pending_events(struct event_stream* es) {
+	struct event_task_state* state;
+	struct progress_snapshot snapshot;
+	size_t count = 0;
+	size_t i;
+
+	if (es->follow_all) {
+		sync_followed_tasks(es);
 	}
 
-	return true;
+	for (i = 0; i < es->task_count; ++i) {
+		state = &es->tasks[i];
 
-err:
-	if (pool) {
-		free(pool);
+		if (!progress_get_snapshot(state->task_id, &snapshot)) {
+			continue;
+		}
+		if (state->sent && memcmp(&state->last, &snapshot, sizeof(snapshot)) == 0) {
+			continue;
+		}
+
+		write_event(es->s, snapshot.valid ? "progress" : "error", state->task_id, state->sent ? &state->last : NULL, &snapshot);
+
+		memcpy(&state->last, &snapshot, sizeof(state->last));
+		state->sent = true;
+		++count;
 	}
 
-	return false;
+	return count;
 }
 
-static bool handle_api_resume_task(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
-	static json_t* pool = NULL;
-	const size_t pool_size = 256;
-	const json_t* root;
-	const json_t* field;
-	int task_id;
+static bool handle_api_events(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct events_request req;
+	struct event_stream* es = NULL;
+	struct progress_snapshot snapshot;
 	union json_value_t val;
-	int ret;
+	unsigned int generation = 0;
+	unsigned int timeout_msecs;
+	uint64_t next_send_msecs, now;
+	bool changed;
+	bool pending = false;
+	int task_id;
+	size_t i;
 
 	assert(s != NULL);
 	assert(method != NULL);
 	assert(path != NULL);
 	assert(in_data != NULL);
 
-	pool = (json_t*)malloc(sizeof(*pool) * pool_size);
-	if (!pool) {
-		THROW_ERROR("No memory.");
-	}
-	memset(pool, 0, sizeof(*pool) * pool_size);
+	memset(&req, 0, sizeof(req));
+	req.interval_ms = EVENTS_DEFAULT_INTERVAL_MSECS;
 
-	root = json_create(in_data, pool, pool_size);
-	if (!root) {
-		THROW_ERROR("Invalid JSON format.");
+	/* All parameters are optional. */
+	if (*in_data != '\0') {
+		if (!parse_request(s, in_data, s_events_fields, ARRAY_SIZE(s_events_fields), &req, &pool, NULL)) {
+			goto err;
+		}
 	}
 
-	field = json_getProperty(root, "task_id");
-	if (!field) {
-		THROW_ERROR("No '%s' parameter specified.", "task_id");
+	es = (struct event_stream*)malloc(sizeof(*es));
+	if (!es) {
+		THROW_ERROR("No memory.");
 	}
-	if (json_getType(field) != JSON_INTEGER) {
-		THROW_ERROR("Invalid type for parameter '%s'.", "task_id");
+	memset(es, 0, sizeof(*es));
+	es->s = s;
+	es->follow_all = req.task_ids == NULL;
+
+	if (req.task_ids) {
+		for (val.jval = json_getChild(req.task_ids); val.jval != NULL; val.jval = json_getSibling(val.jval)) {
+			if (json_getType(val.jval) != JSON_INTEGER || json_getInteger(val.jval) < 0 || json_getInteger(val.jval) > INT_MAX) {
+				THROW_ERROR("Invalid element of parameter '%s'.", "task_ids");
+			}
+			if (es->task_count >= ARRAY_SIZE(es->tasks)) {
+				THROW_ERROR("Too many elements in parameter '%s'.", "task_ids");
+			}
+			es->tasks[es->task_count++].task_id = (int)json_getInteger(val.jval);
+		}
 	}
-	val.ival = (int)json_getInteger(field);
 
-	task_id = val.ival;
-	if (task_id < 0) {
-		THROW_ERROR("Invalid value for '%s' parameter specified.", "task_id");
+	if (pool) {
+		json_pool_release(pool);
+		pool = NULL;
 	}
 
-	if (bgft_download_resume_task(task_id, &ret)) {
-		kick_result_header_json(s);
-		sb_writef(s, "{ \"status\": \"success\" }\n");
-	} else {
-		kick_error_json(s, ret);
+	sse_begin(s);
+
+	/* Make sure subscribed tasks are polled, report unknown ones right away. */
+	for (i = 0; i < es->task_count; ++i) {
+		task_id = es->tasks[i].task_id;
+		if (progress_get_snapshot(task_id, &snapshot)) {
+			continue;
+		}
+
+		memset(&snapshot, 0, sizeof(snapshot));
+		snapshot.valid = bgft_download_get_task_progress(task_id, &snapshot.info, &snapshot.error);
+		if (snapshot.valid) {
+			progress_track(task_id);
+		}
+
+		write_event(s, snapshot.valid ? "progress" : "error", task_id, NULL, &snapshot);
+		memcpy(&es->tasks[i].last, &snapshot, sizeof(snapshot));
+		es->tasks[i].sent = true;
 	}
 
-	if (pool) {
-		free(pool);
+	write_pending_events(es);
+
+	next_send_msecs = now_msecs() + (unsigned int)req.interval_ms;
+
+	for (;;) {
+		if (sb_flush(s) != SB_ESUCCESS) {
+			break;
+		}
+
+		/* Changes within the interval after a send are held back and go out together. */
+		now = now_msecs();
+		if (pending) {
+			timeout_msecs = next_send_msecs > now ? (unsigned int)(next_send_msecs - now) : 0;
+		} else {
+			timeout_msecs = EVENTS_HEARTBEAT_MSECS;
+		}
+
+		if (!progress_wait_for_change(&generation, timeout_msecs, &changed)) {
+			break;
+		}
+		pending = pending || changed;
+
+		now = now_msecs();
+		if (pending && now >= next_send_msecs) {
+			if (write_pending_events(es) > 0) {
+				next_send_msecs = now + (unsigned int)req.interval_ms;
+			}
+			pending = false;
+		} else if (!pending) {
+			sse_keepalive(s);
+		}
 	}
 
+	free(es);
+
 	return true;
 
 err:
+	if (es) {
+		free(es);
+	}
+
 	if (pool) {
-		free(pool);
+		json_pool_release(pool);
 	}
 
 	return false;
 }
 
-static bool handle_api_unregister_task(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
-	static json_t* pool = NULL;
-	const size_t pool_size = 256;
-	const json_t* root;
-	const json_t* field;
-	int task_id;
-	union json_value_t val;
-	int ret;
-
-	assert(s != NULL);
-	assert(method != NULL);
-	assert(path != NULL);
-	assert(in_data != NULL);
+static void write_task_progress(struct json_writer* w, const struct bgft_download_task_progress_info* info) {
+	write_task_progress_delta(w, NULL, info);
+}
 
-	pool = (json_t*)malloc(sizeof(*pool) * pool_size);
-	if (!pool) {
-		THROW_ERROR("No memory.");
-	}
-	memset(pool, 0, sizeof(*pool) * pool_size);
+/* Writes only fields that differ from previous state, or all of them if there is none. */
+static void write_task_progress_delta(struct json_writer* w, const struct bgft_download_task_progress_info* prev, const struct bgft_download_task_progress_info* info) {
+#define CHANGED(field) (!prev || prev->field != info->field)
+	/* TODO: make bits field more user-friendly */
+	if (CHANGED(bits)) json_write_hex_field(w, "bits", info->bits);
+	if (CHANGED(error_result)) json_write_int_field(w, "error", info->error_result);
+	if (CHANGED(length)) json_write_hex_field(w, "length", info->length);
+	if (CHANGED(transferred)) json_write_hex_field(w, "transferred", info->transferred);
+	if (CHANGED(length_total)) json_write_hex_field(w, "length_total", info->length_total);
+	if (CHANGED(transferred_total)) json_write_hex_field(w, "transferred_total", info->transferred_total);
+	if (CHANGED(num_index)) json_write_uint_field(w, "num_index", info->num_index);
+	if (CHANGED(num_total)) json_write_uint_field(w, "num_total", info->num_total);
+	if (CHANGED(rest_sec)) json_write_uint_field(w, "rest_sec", info->rest_sec);
+	if (CHANGED(rest_sec_total)) json_write_uint_field(w, "rest_sec_total", info->rest_sec_total);
+	if (CHANGED(preparing_percent)) json_write_int_field(w, "preparing_percent", info->preparing_percent);
+	if (CHANGED(local_copy_percent)) json_write_int_field(w, "local_copy_percent", info->local_copy_percent);
+#undef CHANGED
+}
 
-	root = json_create(in_data, pool, pool_size);
-	if (!root) {
-		THROW_ERROR("Invalid JSON format.");
-	}
+/* Nothing is written until the poller has sampled the task. */
+static void write_task_throughput(struct json_writer* w, int task_id) {
+	struct throughput_info info;
 
-	field = json_getProperty(root, "task_id");
-	if (!field) {
-		THROW_ERROR("No '%s' parameter specified.", "task_id");
-	}
-	if (json_getType(field) != JSON_INTEGER) {
-		THROW_ERROR("Invalid type for parameter '%s'.", "task_id");
+	if (!throughput_get(task_id, &info)) {
+		return;
 	}
-	val.ival = (int)json_getInteger(field);
 
-	task_id = val.ival;
-	if (task_id < 0) {
-		THROW_ERROR("Invalid value for '%s' parameter specified.", "task_id");
-	}
+	json_write_key(w, "throughput");
+	json_write_begin_object(w);
+	write_throughput_info(w, &info);
+	json_write_end_object(w);
+}
 
-	if (bgft_download_unregister_task(task_id, &ret)) {
-		kick_result_header_json(s);
-		sb_writef(s, "{ \"status\": \"success\" }\n");
-	} else {
-		kick_error_json(s, ret);
+/* Rates are in bytes per second. */
+static void write_throughput_info(struct json_writer* w, const struct throughput_info* info) {
+	if (info->has_rate) {
+		json_write_uint_field(w, "rate", info->rate);
+		json_write_uint_field(w, "window_rate", info->window_rate);
+		json_write_uint_field(w, "peak_rate", info->peak_rate);
 	}
-
-	if (pool) {
-		free(pool);
+	if (info->has_eta) {
+		json_write_uint_field(w, "eta_sec", info->eta_secs);
 	}
+	json_write_bool_field(w, "finished", info->finished);
+	json_write_bool_field(w, "stalled", info->stalled);
+	json_write_uint_field(w, "idle_sec", info->idle_secs);
+}
 
-	return true;
+struct catalog_write_args {
+	struct json_writer* w;
+	size_t count;
+};
 
-err:
-	if (pool) {
-		free(pool);
-	}
+static bool write_catalog_entry(void* arg, const struct catalog_entry_info* info) {
+	struct catalog_write_args* args = (struct catalog_write_args*)arg;
+	struct json_writer* w = args->w;
+
+	json_write_begin_object(w);
+	json_write_string_field(w, "content_id", info->content_id);
+	json_write_string_field(w, "title_id", info->title_id);
+	json_write_string_field(w, "title", info->title);
+	json_write_int_field(w, "content_type", (int)info->content_type);
+	json_write_bool_field(w, "is_patch", info->is_patch);
+	json_write_hex_field(w, "package_size", info->package_size);
+	json_write_string_field(w, "path", info->path);
+	json_write_hex_field(w, "file_size", info->file_size);
+	json_write_hex_field(w, "icon_offset", info->icon0_png_offset);
+	json_write_hex_field(w, "icon_size", info->icon0_png_size);
+	json_write_end_object(w);
+	++args->count;
 
-	return false;
+	return true;
 }
 
-static bool handle_api_get_task_progress(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
-	static json_t* pool = NULL;
-	const size_t pool_size = 256;
-	const json_t* root;
-	const json_t* field;
-	int task_id;
-	struct bgft_download_task_progress_info progress_info;
-	union json_value_t val;
-	int ret;
+static bool handle_api_catalog(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct json_writer w;
+	struct catalog_request req;
+	struct catalog_write_args args;
+	size_t total_count;
 
 	assert(s != NULL);
 	assert(method != NULL);
 	assert(path != NULL);
 	assert(in_data != NULL);
 
-	pool = (json_t*)malloc(sizeof(*pool) * pool_size);
-	if (!pool) {
-		THROW_ERROR("No memory.");
-	}
-	memset(pool, 0, sizeof(*pool) * pool_size);
+	memset(&req, 0, sizeof(req));
+	req.offset = 0;
+	req.limit = CATALOG_DEFAULT_PAGE_SIZE;
 
-	root = json_create(in_data, pool, pool_size);
-	if (!root) {
-		THROW_ERROR("Invalid JSON format.");
+	/* All parameters are optional. */
+	if (*in_data != '\0') {
+		if (!parse_request(s, in_data, s_catalog_fields, ARRAY_SIZE(s_catalog_fields), &req, &pool, NULL)) {
+			goto err;
+		}
 	}
 
-	field = json_getProperty(root, "task_id");
-	if (!field) {
-		THROW_ERROR("No '%s' parameter specified.", "task_id");
-	}
-	if (json_getType(field) != JSON_INTEGER) {
-		THROW_ERROR("Invalid type for parameter '%s'.", "task_id");
-	}
-	val.ival = (int)json_getInteger(field);
+	kick_result_header_json(s);
 
-	task_id = val.ival;
-	if (task_id < 0) {
-		THROW_ERROR("Invalid value for '%s' parameter specified.", "task_id");
-	}
+	json_writer_init(&w, s);
+	json_write_begin_object(&w);
+	json_write_string_field(&w, "status", "success");
+	json_write_int_field(&w, "offset", req.offset);
+	json_write_key(&w, "items");
+	json_write_begin_array(&w);
 
-	if (bgft_download_get_task_progress(task_id, &progress_info, &ret)) {
-		kick_result_header_json(s);
+	memset(&args, 0, sizeof(args));
+	args.w = &w;
+	catalog_enumerate(*req.title_id != '\0' ? req.title_id : NULL, (size_t)req.offset, (size_t)req.limit, &write_catalog_entry, &args, &total_count);
 
-		/* TODO: make bits field more user-friendly */
-		sb_writef(s,
-			"{ \"status\": \"success\", \"bits\": 0x%" PRIX32 ", \"error\": %d, \"length\": 0x%" PRIXMAX ", \"transferred\": 0x%" PRIXMAX ", \"length_total\": 0x%" PRIXMAX ", \"transferred_total\": 0x%" PRIXMAX ", \"num_index\": %" PRIu32 ", \"num_total\": %" PRIu32 ", \"rest_sec\": %" PRIu32 ", \"rest_sec_total\": %" PRIu32 ", \"preparing_percent\": %" PRId32 ", \"local_copy_percent\": %" PRId32 " }\n",
-			progress_info.bits, progress_info.error_result, (uintmax_t)progress_info.length, (uintmax_t)progress_info.transferred, (uintmax_t)progress_info.length_total, (uintmax_t)progress_info.transferred_total, progress_info.num_index, progress_info.num_total, progress_info.rest_sec, progress_info.rest_sec_total, progress_info.preparing_percent, progress_info.local_copy_percent
-		);
-	} else {
-		kick_error_json(s, ret);
-	}
+	json_write_end_array(&w);
+	json_write_uint_field(&w, "count", args.count);
+	json_write_uint_field(&w, "total", total_count);
+	json_write_end_object(&w);
+	json_writer_finish(&w);
 
 	if (pool) {
-		free(pool);
+		json_pool_release(pool);
 	}
 
 	return true;
 
 err:
 	if (pool) {
-		free(pool);
+		json_pool_release(pool);
 	}
 
 	return false;
 }
 
-static bool handle_api_find_task(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
-	static json_t* pool = NULL;
-	const size_t pool_size = 256;
-	const json_t* root;
-	const json_t* field;
-	union json_value_t val;
-	char content_id[PKG_CONTENT_ID_SIZE + 1];
-	int sub_type;
-	int task_id = -1;
-	int ret;
+static bool handle_api_catalog_find(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct json_pool* pool = NULL;
+	struct content_id_request req;
+	struct json_writer w;
+	struct catalog_entry_info* info = NULL;
+	struct catalog_write_args args;
 
 	assert(s != NULL);
 	assert(method != NULL);
 	assert(path != NULL);
 	assert(in_data != NULL);
 
-	pool = (json_t*)malloc(sizeof(*pool) * pool_size);
-	if (!pool) {
-		THROW_ERROR("No memory.");
+	memset(&req, 0, sizeof(req));
+	if (!parse_request(s, in_data, s_content_id_fields, ARRAY_SIZE(s_content_id_fields), &req, &pool, NULL)) {
+		goto err;
 	}
-	memset(pool, 0, sizeof(*pool) * pool_size);
 
-	root = json_create(in_data, pool, pool_size);
-	if (!root) {
-		THROW_ERROR("Invalid JSON format.");
+	info = (struct catalog_entry_info*)malloc(sizeof(*info));
+	if (!info) {
+		THROW_ERROR("No memory.");
 	}
 
-	field = json_getProperty(root, "content_id");
-	if (!field) {
-		THROW_ERROR("No '%s' parameter specified.", "content_id");
-	}
-	if (json_getType(field) != JSON_TEXT) {
-		THROW_ERROR("Invalid type for parameter '%s'.", "content_id");
+	if (!catalog_find_by_content_id(req.content_id, info)) {
+		THROW_ERROR("Package '%s' not found in catalog.", req.content_id);
 	}
-	val.sval = json_getValue(field);
 
-	strlcpy(content_id, val.sval, sizeof(content_id));
+	kick_result_header_json(s);
 
-	field = json_getProperty(root, "sub_type");
-	if (!field) {
-		THROW_ERROR("No '%s' parameter specified.", "sub_type");
-	}
-	if (json_getType(field) != JSON_INTEGER) {
-		THROW_ERROR("Invalid type for parameter '%s'.", "sub_type");
-	}
-	val.ival = (int)json_getInteger(field);
+	json_writer_init(&w, s);
+	json_write_begin_object(&w);
+	json_write_string_field(&w, "status", "success");
+	json_write_key(&w, "item");
 
-	sub_type = val.ival;
+	memset(&args, 0, sizeof(args));
+	args.w = &w;
+	write_catalog_entry(&args, info);
 
-	if (bgft_download_find_task_by_content_id(content_id, sub_type, &task_id, &ret)) {
-		kick_result_header_json(s);
-		sb_writef(s, "{ \"status\": \"success\", \"task_id\": %d }\n", task_id);
-	} else {
-		kick_error_json(s, ret);
-	}
+	json_write_end_object(&w);
+	json_writer_finish(&w);
+
+	free(info);
 
 	if (pool) {
-		free(pool);
+		json_pool_release(pool);
 	}
 
 	return true;
 
 err:
+	if (info) {
+		free(info);
+	}
+
 	if (pool) {
-		free(pool);
+		json_pool_release(pool);
 	}
 
 	return false;
 }
 
+static bool handle_api_catalog_rescan(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	assert(s != NULL);
+
+	catalog_rescan();
+
+	kick_success_json(s);
+
+	return true;
+}
+
 static bool handle_static(sb_Stream* s, const char* method, const char* path, char* in_data, size_t in_size) {
+	struct artifact* artifact;
 	struct stat stbuf;
 	const char* content_type;
 	char real_path[1024];
@@ -1473,6 +3109,23 @@ static bool handle_static(sb_Stream* s, const char* method, const char* path, ch
 	}
 	path += strlen("/static/");
 
+	artifact = artifact_acquire(path);
+	if (artifact) {
+		sb_send_status(s, 200, "OK");
+		sb_send_header(s, "Connection", "close");
+		sb_send_header(s, "Content-Type", artifact->content_type);
+		sb_send_header(s, "Content-Length", artifact->content_length);
+
+		ret = sb_write(s, artifact->data, artifact->size);
+
+		artifact_release(artifact);
+
+		if (ret) {
+			kick_error(s, 500, "Internal server error", sb_error_str(ret));
+		}
+		goto done;
+	}
+
 	snprintf(real_path, sizeof(real_path), "%s/%s", s_work_dir, path);
 
 	ret = stat(real_path, &stbuf);
@@ -1510,6 +3163,54 @@ done:
 	return (ret == SB_RES_OK);
 }
 
+static bool parse_request(sb_Stream* s, char* in_data, const struct json_field_desc* fields, size_t field_count, void* out, struct json_pool** pool, const json_t** root) {
+	const json_t* tmp_root;
+
+	assert(pool != NULL);
+
+	*pool = json_pool_acquire(in_data);
+	if (!*pool) {
+		THROW_ERROR("No memory.");
+	}
+
+	tmp_root = json_create(in_data, (*pool)->nodes, (unsigned int)(*pool)->capacity);
+	if (!tmp_root) {
+		if ((*pool)->capacity >= JSON_POOL_MAX_CAPACITY) {
+			THROW_ERROR("Request is too large.");
+		}
+		THROW_ERROR("Invalid JSON format.");
+	}
+
+	if (!bind_request(s, tmp_root, fields, field_count, out)) {
+		goto err;
+	}
+
+	if (root) {
+		*root = tmp_root;
+	}
+
+	return true;
+
+err:
+	if (*pool) {
+		json_pool_release(*pool);
+		*pool = NULL;
+	}
+
+	return false;
+}
+
+static bool bind_request(sb_Stream* s, const json_t* root, const struct json_field_desc* fields, size_t field_count, void* out) {
+	char error_buf[256];
+
+	if (!json_bind(root, fields, field_count, out, error_buf, sizeof(error_buf))) {
+		kick_error(s, 500, "Internal server error", error_buf);
+		return false;
+	}
+
+	return true;
+}
+
 static void set_cors_header(sb_Stream* s) {
 	sb_send_header(s, "Content-Type", "application/json");
 	sb_send_header(s, "Access-Control-Allow-Origin", "*");
@@ -1518,7 +3219,7 @@ static void set_cors_header(sb_Stream* s) {
 }
 
 static void kick_error(sb_Stream* s, int code, const char* title, const char* error) {
-	char escaped_error[1024];
+	struct json_writer w;
 
 	if (!error) {
 		error = "Unknown";
@@ -1528,11 +3229,12 @@ static void kick_error(sb_Stream* s, int code, const char* title, const char* er
 	set_cors_header(s);
 	sb_send_header(s, "Connection", "close");
 
-	if (!http_escape_json_string(escaped_error, sizeof(escaped_error), error)) {
-		strlcpy(escaped_error, "Unable to escape error string.", sizeof(escaped_error));
-	}
-
-	sb_writef(s, "{ \"status\": \"fail\", \"error\": \"%s\" }\n", escaped_error);
+	json_writer_init(&w, s);
+	json_write_begin_object(&w);
+	json_write_string_field(&w, "status", "fail");
+	json_write_string_field(&w, "error", error);
+	json_write_end_object(&w);
+	json_writer_finish(&w);
 }
 
 static void kick_result_header_json(sb_Stream* s) {
@@ -1542,13 +3244,130 @@ static void kick_result_header_json(sb_Stream* s) {
 }
 
 static void kick_error_json(sb_Stream* s, int code) {
+	struct json_writer w;
+
 	kick_result_header_json(s);
-	sb_writef(s, "{ \"status\": \"fail\", \"error_code\": 0x%08X }\n", code);
+
+	json_writer_init(&w, s);
+	json_write_begin_object(&w);
+	json_write_string_field(&w, "status", "fail");
+	json_write_key(&w, "error_code");
+	json_write_hex32(&w, (uint32_t)code);
+	json_write_end_object(&w);
+	json_writer_finish(&w);
 }
 
 static void kick_success_json(sb_Stream* s) {
+	struct json_writer w;
+
+	kick_result_header_json(s);
+
+	json_writer_init(&w, s);
+	json_write_begin_object(&w);
+	json_write_string_field(&w, "status", "success");
+	json_write_end_object(&w);
+	json_writer_finish(&w);
+}
+
+static void kick_task_result_json(sb_Stream* s, int task_id, const char* title) {
+	struct json_writer w;
+
 	kick_result_header_json(s);
-	sb_writef(s, "{ \"status\": \"success\" }\n");
+
+	json_writer_init(&w, s);
+	json_write_begin_object(&w);
+	json_write_string_field(&w, "status", "success");
+	json_write_int_field(&w, "task_id", task_id);
+	json_write_string_field(&w, "title", title);
+	json_write_end_object(&w);
+	json_writer_finish(&w);
+}
+
+static void sse_begin(sb_Stream* s) {
+	sb_send_status(s, 200, "OK");
+	sb_send_header(s, "Content-Type", "text/event-stream");
+	sb_send_header(s, "Cache-Control", "no-cache");
+	sb_send_header(s, "Access-Control-Allow-Origin", "*");
+	sb_send_header(s, "Connection", "close");
+}
+
+/* Comment line, also detects disconnected clients. */
+static void sse_keepalive(sb_Stream* s) {
+	sb_write(s, ": keep-alive\n\n", 14);
+}
+
+static uint64_t now_msecs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / NSEC_PER_MSEC;
+}
+
+/* Must be called before the task leaves the registry. */
+static void remove_task_artifacts(int task_id) {
+	char ref_pkg_json_name[ARTIFACT_NAME_SIZE];
+	char icon0_png_name[ARTIFACT_NAME_SIZE];
+
+	artifact_evict_task(task_id);
+
+	/* Artifacts evicted from memory lost their task, but their files are still there. */
+	if (registry_get_artifact_names(task_id, ref_pkg_json_name, icon0_png_name)) {
+		if (*ref_pkg_json_name) {
+			artifact_remove(ref_pkg_json_name);
+		}
+		if (*icon0_png_name) {
+			artifact_remove(icon0_png_name);
+		}
+	}
+}
+
+static bool unregister_task(int task_id, int* error) {
+	if (!bgft_download_unregister_task(task_id, error)) {
+		return false;
+	}
+
+	scheduler_remove(task_id);
+	storage_release_task(task_id);
+	remove_task_artifacts(task_id);
+	registry_remove(task_id);
+	progress_untrack(task_id);
+
+	return true;
+}
+
+static void on_task_finished(int task_id, enum progress_outcome outcome) {
+	char content_id[PKG_CONTENT_ID_SIZE + 1];
+
+	if (outcome == PROGRESS_OUTCOME_FAILED) {
+		/* Failures may be transient, the task keeps its place in the queue but not its slot. */
+		scheduler_task_failed(task_id);
+		return;
+	} else if (outcome == PROGRESS_OUTCOME_RECOVERED) {
+		scheduler_task_recovered(task_id);
+		return;
+	}
+
+	/* Download is complete, BGFT does not need its artifacts anymore. */
+	remove_task_artifacts(task_id);
+	storage_release_task(task_id);
+	registry_mark_finished(task_id);
+
+	if (registry_get_content_id(task_id, content_id, sizeof(content_id))) {
+		inventory_invalidate_content(content_id);
+	}
+
+	scheduler_task_done(task_id);
+}
+
+static bool restore_storage_reservation(void* arg, const struct registry_task_info* info) {
+	UNUSED(arg);
+
+	if (info->finished_time == 0) {
+		storage_reserve_task(info->task_id, info->package_size);
+	}
+
+	return true;
 }
 
 static void cleanup_temp_files(void) {
@@ -1597,8 +3416,8 @@ static void cleanup_temp_files(void) {
 						goto err;
 					}
 
-					if (timespec_compare(&now, &stat_buf.st_atime) >= 0) {
-						timespec_sub(&diff, &now, &stat_buf.st_atime);
+					if (timespec_compare(&now, &stat_buf.st_atim) >= 0) {
+						timespec_sub(&diff, &now, &stat_buf.st_atim);
 
 						if (diff.tv_sec >= (long)CLEANUP_DAY_COUNT * 24 * 60 * 60) {
 							unlink(full_path);
@@ -1619,22 +3438,3 @@ err:
 		}
 	}
 }
-
-/* Converts an integer value to its hex character*/
-char to_hex(char code) {
-  static char hex[] = "0123456789abcdef";
-  return hex[code & 15];
-}
-
-char *encodeURI(char *str) {
-  char *pstr = str, *buf = malloc(strlen(str) * 3 + 1), *pbuf = buf;
-  while (*pstr) {
-    if (isalnum(*pstr) || *pstr == '-' || *pstr == '_' || *pstr == '.' || *pstr == '~' || *pstr == '+' || *pstr == ':' || *pstr == '/' || *pstr == '@') 
-      *pbuf++ = *pstr;
-    else 
-      *pbuf++ = '%', *pbuf++ = to_hex(*pstr >> 4), *pbuf++ = to_hex(*pstr & 15);
-    pstr++;
-  }
-  *pbuf = '\0';
-  return buf;
-}
\ No newline at end of file
@@ -238,3 +238,152 @@ struct sfo_entry* sfo_find_entry(struct sfo* sfo, const char* key) {
 
 	return NULL;
 }
+
+static inline const struct sfo_table_entry* view_table_entry(const struct sfo_view* view, size_t index) {
+	return (const struct sfo_table_entry*)(view->data + sizeof(struct sfo_header)) + index;
+}
+
+static inline const char* view_key(const struct sfo_view* view, size_t index) {
+	return view->key_table + LE16(view_table_entry(view, index)->key_offset);
+}
+
+bool sfo_view_init(struct sfo_view* view, const void* data, size_t data_size) {
+	const struct sfo_header* hdr;
+	const struct sfo_table_entry* entry;
+	size_t key_table_offset, value_table_offset;
+	size_t key_offset, value_offset;
+	size_t entry_count, i, j;
+	uint16_t index;
+
+	assert(view != NULL);
+	assert(data != NULL);
+
+	memset(view, 0, sizeof(*view));
+
+	if (data_size < sizeof(*hdr)) {
+		EPRINTF("Insufficient data.\n");
+		return false;
+	}
+
+	hdr = (const struct sfo_header*)data;
+	if (memcmp(hdr->magic, SFO_MAGIC, sizeof(hdr->magic)) != 0) {
+		EPRINTF("Invalid system file object format.\n");
+		return false;
+	}
+
+	entry_count = LE32(hdr->entry_count);
+	if (entry_count > SFO_VIEW_MAX_ENTRIES) {
+		EPRINTF("Too many entries.\n");
+		return false;
+	}
+	if (data_size < sizeof(*hdr) + entry_count * sizeof(*entry)) {
+		EPRINTF("Insufficient data.\n");
+		return false;
+	}
+
+	key_table_offset = LE32(hdr->key_table_offset);
+	value_table_offset = LE32(hdr->value_table_offset);
+	if (key_table_offset >= data_size || value_table_offset > data_size) {
+		EPRINTF("Invalid table offsets.\n");
+		return false;
+	}
+
+	view->data = (const uint8_t*)data;
+	view->data_size = data_size;
+	view->key_table = (const char*)data + key_table_offset;
+	view->value_table = (const uint8_t*)data + value_table_offset;
+
+	/* Validate all entries once so lookups do not need to. */
+	for (i = 0; i < entry_count; ++i) {
+		entry = view_table_entry(view, i);
+
+		key_offset = key_table_offset + LE16(entry->key_offset);
+		if (key_offset >= data_size || !memchr(view->data + key_offset, '\0', data_size - key_offset)) {
+			EPRINTF("Invalid entry key.\n");
+			return false;
+		}
+
+		if (LE32(entry->max_size) < LE32(entry->size)) {
+			EPRINTF("Unexpected entry sizes.\n");
+			return false;
+		}
+
+		value_offset = value_table_offset + LE32(entry->value_offset);
+		if (value_offset > data_size || data_size - value_offset < LE32(entry->size)) {
+			EPRINTF("Invalid entry value.\n");
+			return false;
+		}
+
+		/* Insertion sort, tables are small and usually sorted already. */
+		index = (uint16_t)i;
+		for (j = i; j > 0 && strcmp(view_key(view, view->sorted[j - 1]), view_key(view, index)) > 0; --j) {
+			view->sorted[j] = view->sorted[j - 1];
+		}
+		view->sorted[j] = index;
+	}
+
+	view->entry_count = entry_count;
+
+	return true;
+}
+
+bool sfo_view_find(const struct sfo_view* view, const char* key, struct sfo_view_entry* entry) {
+	const struct sfo_table_entry* table_entry;
+	size_t lo, hi, mid;
+	int cmp;
+
+	assert(view != NULL);
+	assert(key != NULL);
+
+	for (lo = 0, hi = view->entry_count; lo < hi;) {
+		mid = lo + (hi - lo) / 2;
+
+		cmp = strcmp(view_key(view, view->sorted[mid]), key);
+		if (cmp < 0) {
+			lo = mid + 1;
+		} else if (cmp > 0) {
+			hi = mid;
+		} else {
+			if (entry) {
+				table_entry = view_table_entry(view, view->sorted[mid]);
+
+				entry->key = view_key(view, view->sorted[mid]);
+				entry->value = view->value_table + LE32(table_entry->value_offset);
+				entry->size = LE32(table_entry->size);
+				entry->area = LE32(table_entry->max_size);
+				entry->format = (enum sfo_value_format)LE16(table_entry->format);
+			}
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool sfo_view_get_string(const struct sfo_view* view, const char* key, char* buf, size_t buf_size) {
+	struct sfo_view_entry entry;
+	size_t length;
+
+	assert(view != NULL);
+	assert(key != NULL);
+	assert(buf != NULL);
+	assert(buf_size > 0);
+
+	if (!sfo_view_find(view, key, &entry)) {
+		return false;
+	}
+	if (entry.format != SFO_FORMAT_STRING || entry.size < 1) {
+		return false;
+	}
+
+	/* Value is not guaranteed to be null-terminated inside the buffer. */
+	length = strnlen((const char*)entry.value, entry.size);
+	if (length >= buf_size) {
+		length = buf_size - 1;
+	}
+	memcpy(buf, entry.value, length);
+	buf[length] = '\0';
+
+	return true;
+}
@@ -22,6 +22,26 @@ struct sfo {
 	struct sfo_entry* entries;
 };
 
+#define SFO_VIEW_MAX_ENTRIES 128
+
+/* Read-only view over SFO data, the data must outlive the view. */
+struct sfo_view {
+	const uint8_t* data;
+	size_t data_size;
+	const char* key_table;
+	const uint8_t* value_table;
+	size_t entry_count;
+	uint16_t sorted[SFO_VIEW_MAX_ENTRIES]; /* entry indices ordered by key */
+};
+
+struct sfo_view_entry {
+	const char* key;
+	const void* value;
+	size_t size;
+	size_t area;
+	enum sfo_value_format format;
+};
+
 struct sfo* sfo_alloc(void);
 void sfo_free(struct sfo* sfo);
 
@@ -29,3 +49,7 @@ bool sfo_load_from_file(struct sfo* sfo, const char* file_path);
 bool sfo_load_from_memory(struct sfo* sfo, const void* data, size_t data_size);
 
 struct sfo_entry* sfo_find_entry(struct sfo* sfo, const char* key);
+
+bool sfo_view_init(struct sfo_view* view, const void* data, size_t data_size);
+bool sfo_view_find(const struct sfo_view* view, const char* key, struct sfo_view_entry* entry);
+bool sfo_view_get_string(const struct sfo_view* view, const char* key, char* buf, size_t buf_size);
@@ -0,0 +1,675 @@
+#include "sim_backend.h"
+#include "pkg.h"
+#include "util.h"
+
+#include <orbis/libkernel.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "uthash.h"
+
+#define SIM_MAX_TASKS 256
+
+/* Reported by tasks that fail midway. */
+#define SIM_TRANSFER_ERROR ORBIS_KERNEL_ERROR_ETIMEDOUT
+
+enum sim_task_state {
+	SIM_TASK_REGISTERED,
+	SIM_TASK_RUNNING,
+	SIM_TASK_PAUSED,
+	SIM_TASK_FINISHED,
+	SIM_TASK_FAILED,
+};
+
+struct sim_content_key {
+	char content_id[PKG_CONTENT_ID_SIZE + 1];
+	int sub_type;
+};
+
+struct sim_task {
+	int task_id; /* zero if slot is free */
+	struct sim_content_key key;
+	enum sim_task_state state;
+	uint64_t size;
+	uint64_t transferred;
+	uint64_t fail_at; /* zero if it does not fail */
+	uint64_t started_usecs; /* zero until first start */
+	uint64_t updated_usecs;
+};
+
+/* Installed application, patch or add-on. */
+struct sim_content {
+	struct sim_content_key key;
+	char title_id[PKG_TITLE_ID_SIZE + 1];
+	uint64_t size;
+	UT_hash_handle hh;
+};
+
+static struct sim_backend_config s_config;
+static unsigned int s_seed;
+
+static struct sim_task s_tasks[SIM_MAX_TASKS];
+static int s_next_task_id = 1;
+
+static struct sim_content* s_contents = NULL;
+
+static pthread_mutex_t s_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static bool s_sim_backend_initialized = false;
+
+static bool sim_uninstall_game(const char* title_id, int* error);
+static bool sim_uninstall_ac(const char* content_id, int* error);
+static bool sim_uninstall_patch(const char* title_id, int* error);
+static bool sim_uninstall_theme(const char* content_id, int* error);
+static bool sim_is_exists(const char* title_id, bool* exists, int* error);
+static bool sim_get_size(const char* title_id, unsigned long* size, int* error);
+static bool sim_register_package_task(const char* content_id, const char* content_url, const char* content_name, const char* icon_path, const char* package_type, const char* package_sub_type, unsigned long package_size, bool is_patch, int* task_id, int* error);
+static bool sim_start_task(int task_id, int* error);
+static bool sim_stop_task(int task_id, int* error);
+static bool sim_pause_task(int task_id, int* error);
+static bool sim_resume_task(int task_id, int* error);
+static bool sim_unregister_task(int task_id, int* error);
+static bool sim_reregister_task_patch(int old_task_id, int* new_task_id, int* error);
+static bool sim_get_task_progress(int task_id, struct bgft_download_task_progress_info* progress_info, int* error);
+static bool sim_find_task_by_content_id(const char* content_id, int sub_type, int* task_id, int* error);
+
+static void begin_call(void);
+static void end_call(void);
+static bool fail(int* error, int code);
+static struct sim_task* find_task(int task_id);
+static struct sim_task* add_task(const struct sim_content_key* key, uint64_t size);
+static void advance_task(struct sim_task* task, uint64_t now);
+static bool pause_task(int task_id, int* error);
+static size_t remove_contents(const char* title_id, const char* content_id, int sub_type, bool skip_base);
+static uint64_t now_usecs(void);
+
+static const struct installer_backend s_backend = {
+	"sim",
+	&sim_uninstall_game,
+	&sim_uninstall_ac,
+	&sim_uninstall_patch,
+	&sim_uninstall_theme,
+	&sim_is_exists,
+	&sim_get_size,
+	&sim_register_package_task,
+	&sim_start_task,
+	&sim_stop_task,
+	&sim_pause_task,
+	&sim_resume_task,
+	&sim_unregister_task,
+	&sim_reregister_task_patch,
+	&sim_get_task_progress,
+	&sim_find_task_by_content_id,
+};
+
+bool sim_backend_init(const struct sim_backend_config* config) {
+	if (s_sim_backend_initialized) {
+		goto done;
+	}
+
+	if (!config || config->transfer_rate == 0) {
+		EPRINTF("Invalid configuration.\n");
+		goto err;
+	}
+
+	memcpy(&s_config, config, sizeof(s_config));
+	s_seed = config->seed;
+
+	memset(s_tasks, 0, sizeof(s_tasks));
+	s_next_task_id = 1;
+
+	s_sim_backend_initialized = true;
+
+done:
+	return true;
+
+err:
+	return false;
+}
+
+void sim_backend_fini(void) {
+	struct sim_content* content;
+	struct sim_content* tmp;
+
+	if (!s_sim_backend_initialized) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	HASH_ITER(hh, s_contents, content, tmp) {
+		HASH_DEL(s_contents, content);
+		free(content);
+	}
+	pthread_mutex_unlock(&s_mtx);
+
+	s_sim_backend_initialized = false;
+}
+
+const struct installer_backend* sim_backend_get(void) {
+	return &s_backend;
+}
+
+static bool sim_uninstall_game(const char* title_id, int* error) {
+	bool status;
+
+	if (!title_id) {
+		return fail(error, ORBIS_KERNEL_ERROR_EINVAL);
+	}
+
+	begin_call();
+	/* Patches and add-ons go along with the game. */
+	status = remove_contents(title_id, NULL, -1, false) > 0;
+	end_call();
+
+	return status ? true : fail(error, ORBIS_KERNEL_ERROR_ENOENT);
+}
+
+static bool sim_uninstall_ac(const char* content_id, int* error) {
+	bool status;
+
+	if (!content_id) {
+		return fail(error, ORBIS_KERNEL_ERROR_EINVAL);
+	}
+
+	begin_call();
+	status = remove_contents(NULL, content_id, ORBIS_BGFT_TASK_SUB_TYPE_GAME_AC, false) > 0;
+	end_call();
+
+	return status ? true : fail(error, ORBIS_KERNEL_ERROR_ENOENT);
+}
+
+static bool sim_uninstall_patch(const char* title_id, int* error) {
+	bool status;
+
+	if (!title_id) {
+		return fail(error, ORBIS_KERNEL_ERROR_EINVAL);
+	}
+
+	begin_call();
+	status = remove_contents(title_id, NULL, ORBIS_BGFT_TASK_SUB_TYPE_GAME_PATCH, false) > 0;
+	end_call();
+
+	return status ? true : fail(error, ORBIS_KERNEL_ERROR_ENOENT);
+}
+
+static bool sim_uninstall_theme(const char* content_id, int* error) {
+	bool status;
+
+	if (!content_id) {
+		return fail(error, ORBIS_KERNEL_ERROR_EINVAL);
+	}
+
+	/* Themes are not told apart from other contents here. */
+	begin_call();
+	status = remove_contents(NULL, content_id, -1, true) > 0;
+	end_call();
+
+	return status ? true : fail(error, ORBIS_KERNEL_ERROR_ENOENT);
+}
+
+static bool sim_is_exists(const char* title_id, bool* exists, int* error) {
+	struct sim_content* content;
+	struct sim_content* tmp;
+	bool found = false;
+
+	if (!title_id || !exists) {
+		return fail(error, ORBIS_KERNEL_ERROR_EINVAL);
+	}
+
+	begin_call();
+	HASH_ITER(hh, s_contents, content, tmp) {
+		if (content->key.sub_type == ORBIS_BGFT_TASK_SUB_TYPE_GAME && strcmp(content->title_id, title_id) == 0) {
+			found = true;
+			break;
+		}
+	}
+	end_call();
+
+	*exists = found;
+
+	return true;
+}
+
+static bool sim_get_size(const char* title_id, unsigned long* size, int* error) {
+	struct sim_content* content;
+	struct sim_content* tmp;
+	uint64_t total = 0;
+	bool found = false;
+
+	if (!title_id || !size) {
+		return fail(error, ORBIS_KERNEL_ERROR_EINVAL);
+	}
+
+	begin_call();
+	HASH_ITER(hh, s_contents, content, tmp) {
+		if (strcmp(content->title_id, title_id) == 0) {
+			total += content->size;
+			found = true;
+		}
+	}
+	end_call();
+
+	if (!found) {
+		return fail(error, ORBIS_KERNEL_ERROR_ENOENT);
+	}
+
+	*size = (unsigned long)total;
+
+	return true;
+}
+
+static bool sim_register_package_task(const char* content_id, const char* content_url, const char* content_name, const char* icon_path, const char* package_type, const char* package_sub_type, unsigned long package_size, bool is_patch, int* task_id, int* error) {
+	struct pkg_content_info content_info;
+	struct sim_content_key key;
+	struct sim_content* content;
+	struct sim_task* task;
+	size_t i;
+
+	UNUSED(content_url);
+	UNUSED(content_name);
+	UNUSED(icon_path);
+	UNUSED(package_sub_type);
+
+	if (!content_id || !pkg_parse_content_id(content_id, &content_info)) {
+		return fail(error, ORBIS_KERNEL_ERROR_EINVAL);
+	}
+
+	memset(&key, 0, sizeof(key));
+	strlcpy(key.content_id, content_id, sizeof(key.content_id));
+	if (is_patch) {
+		key.sub_type = ORBIS_BGFT_TASK_SUB_TYPE_GAME_PATCH;
+	} else if (package_type && (strcmp(package_type, "PS4AC") == 0 || strcmp(package_type, "PS4AL") == 0)) {
+		key.sub_type = ORBIS_BGFT_TASK_SUB_TYPE_GAME_AC;
+	} else {
+		key.sub_type = ORBIS_BGFT_TASK_SUB_TYPE_GAME;
+	}
+
+	begin_call();
+
+	HASH_FIND(hh, s_contents, &key, sizeof(key), content);
+	if (content && !is_patch) {
+		end_call();
+		if (task_id) {
+			*task_id = -1;
+		}
+		if (error) {
+			*error = SCE_BGFT_ERROR_SAME_APPLICATION_ALREADY_INSTALLED;
+		}
+		return true;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(s_tasks); ++i) {
+		if (s_tasks[i].task_id != 0 && memcmp(&s_tasks[i].key, &key, sizeof(key)) == 0) {
+			end_call();
+			return fail(error, ORBIS_KERNEL_ERROR_EEXIST);
+		}
+	}
+
+	task = add_task(&key, package_size);
+	if (task && task_id) {
+		*task_id = task->task_id;
+	}
+
+	end_call();
+
+	return task ? true : fail(error, ORBIS_KERNEL_ERROR_ENOMEM);
+}
+
+static bool sim_start_task(int task_id, int* error) {
+	struct sim_task* task;
+	uint64_t now;
+
+	begin_call();
+
+	task = find_task(task_id);
+	if (!task) {
+		end_call();
+		return fail(error, ORBIS_KERNEL_ERROR_ENOENT);
+	}
+
+	now = now_usecs();
+	advance_task(task, now);
+
+	if (task->state == SIM_TASK_REGISTERED || task->state == SIM_TASK_PAUSED || task->state == SIM_TASK_FAILED) {
+		if (task->started_usecs == 0) {
+			task->started_usecs = now;
+		}
+		if (task->state == SIM_TASK_FAILED) {
+			/* Retried tasks go through. */
+			task->fail_at = 0;
+		}
+		task->state = SIM_TASK_RUNNING;
+		task->updated_usecs = now;
+	}
+
+	end_call();
+
+	return true;
+}
+
+static bool sim_stop_task(int task_id, int* error) {
+	/* Transferred data is kept, like with a pause. */
+	return pause_task(task_id, error);
+}
+
+static bool sim_pause_task(int task_id, int* error) {
+	return pause_task(task_id, error);
+}
+
+static bool sim_resume_task(int task_id, int* error) {
+	struct sim_task* task;
+
+	begin_call();
+
+	task = find_task(task_id);
+	if (!task) {
+		end_call();
+		return fail(error, ORBIS_KERNEL_ERROR_ENOENT);
+	}
+
+	if (task->state == SIM_TASK_PAUSED) {
+		task->state = SIM_TASK_RUNNING;
+		task->updated_usecs = now_usecs();
+	}
+
+	end_call();
+
+	return true;
+}
+
+static bool sim_unregister_task(int task_id, int* error) {
+	struct sim_task* task;
+
+	begin_call();
+
+	task = find_task(task_id);
+	if (task) {
+		memset(task, 0, sizeof(*task));
+	}
+
+	end_call();
+
+	return task ? true : fail(error, ORBIS_KERNEL_ERROR_ENOENT);
+}
+
+static bool sim_reregister_task_patch(int old_task_id, int* new_task_id, int* error) {
+	struct sim_task* task;
+	struct sim_task* new_task;
+	struct sim_content_key key;
+	uint64_t size;
+
+	begin_call();
+
+	task = find_task(old_task_id);
+	if (!task) {
+		end_call();
+		return fail(error, ORBIS_KERNEL_ERROR_ENOENT);
+	}
+
+	memcpy(&key, &task->key, sizeof(key));
+	size = task->size;
+	memset(task, 0, sizeof(*task));
+
+	new_task = add_task(&key, size);
+	if (new_task && new_task_id) {
+		*new_task_id = new_task->task_id;
+	}
+
+	end_call();
+
+	return new_task ? true : fail(error, ORBIS_KERNEL_ERROR_ENOMEM);
+}
+
+static bool sim_get_task_progress(int task_id, struct bgft_download_task_progress_info* progress_info, int* error) {
+	struct sim_task* task;
+	uint64_t now, prepared_usecs;
+
+	if (!progress_info) {
+		return fail(error, ORBIS_KERNEL_ERROR_EINVAL);
+	}
+
+	begin_call();
+
+	task = find_task(task_id);
+	if (!task) {
+		end_call();
+		return fail(error, ORBIS_KERNEL_ERROR_ENOENT);
+	}
+
+	now = now_usecs();
+	advance_task(task, now);
+
+	memset(progress_info, 0, sizeof(*progress_info));
+	progress_info->error_result = task->state == SIM_TASK_FAILED ? SIM_TRANSFER_ERROR : 0;
+	progress_info->length = progress_info->length_total = (unsigned long)task->size;
+	progress_info->transferred = progress_info->transferred_total = (unsigned long)task->transferred;
+	progress_info->num_index = 1;
+	progress_info->num_total = 1;
+	progress_info->rest_sec = progress_info->rest_sec_total = (unsigned int)((task->size - task->transferred) / s_config.transfer_rate);
+
+	prepared_usecs = task->started_usecs + (uint64_t)s_config.preparing_msecs * 1000;
+	if (task->started_usecs == 0) {
+		progress_info->preparing_percent = 0;
+	} else if (now < prepared_usecs) {
+		progress_info->preparing_percent = (int)((now - task->started_usecs) * 100 / ((uint64_t)s_config.preparing_msecs * 1000));
+	} else {
+		progress_info->preparing_percent = 100;
+	}
+
+	end_call();
+
+	return true;
+}
+
+static bool sim_find_task_by_content_id(const char* content_id, int sub_type, int* task_id, int* error) {
+	int found_task_id = -1;
+	size_t i;
+
+	if (!content_id) {
+		return fail(error, ORBIS_KERNEL_ERROR_EINVAL);
+	}
+
+	begin_call();
+
+	for (i = 0; i < ARRAY_SIZE(s_tasks); ++i) {
+		if (s_tasks[i].task_id != 0 && s_tasks[i].key.sub_type == sub_type && strcmp(s_tasks[i].key.content_id, content_id) == 0) {
+			found_task_id = s_tasks[i].task_id;
+			break;
+		}
+	}
+
+	end_call();
+
+	if (found_task_id < 0) {
+		return fail(error, ORBIS_KERNEL_ERROR_ENOENT);
+	}
+
+	if (task_id) {
+		*task_id = found_task_id;
+	}
+
+	return true;
+}
+
+/* Latency is spent outside the lock, like a system call that blocks. */
+static void begin_call(void) {
+	if (s_config.call_latency_usecs > 0) {
+		sceKernelUsleep(s_config.call_latency_usecs);
+	}
+
+	pthread_mutex_lock(&s_mtx);
+}
+
+static void end_call(void) {
+	pthread_mutex_unlock(&s_mtx);
+}
+
+static bool fail(int* error, int code) {
+	if (error) {
+		*error = code;
+	}
+
+	return false;
+}
+
+/* Must be called with the lock held. */
+static struct sim_task* find_task(int task_id) {
+	size_t i;
+
+	if (task_id <= 0) {
+		return NULL;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(s_tasks); ++i) {
+		if (s_tasks[i].task_id == task_id) {
+			return &s_tasks[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Must be called with the lock held. */
+static struct sim_task* add_task(const struct sim_content_key* key, uint64_t size) {
+	struct sim_task* task = NULL;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(s_tasks); ++i) {
+		if (s_tasks[i].task_id == 0) {
+			task = &s_tasks[i];
+			break;
+		}
+	}
+	if (!task) {
+		return NULL;
+	}
+
+	memset(task, 0, sizeof(*task));
+	task->task_id = s_next_task_id++;
+	if (s_next_task_id <= 0) {
+		s_next_task_id = 1;
+	}
+	memcpy(&task->key, key, sizeof(task->key));
+	task->state = SIM_TASK_REGISTERED;
+	task->size = size;
+
+	/* Failing tasks stop somewhere between 10% and 90%. */
+	if (size > 0 && (unsigned int)(rand_r(&s_seed) % 1000) < s_config.failure_permille) {
+		task->fail_at = size / 10 + (uint64_t)(rand_r(&s_seed) % 801) * size / 1000;
+		if (task->fail_at == 0) {
+			task->fail_at = 1;
+		}
+	}
+
+	return task;
+}
+
+/* Must be called with the lock held. Moves a running task forward to now. */
+static void advance_task(struct sim_task* task, uint64_t now) {
+	struct sim_content* content;
+	struct pkg_content_info content_info;
+	uint64_t from;
+
+	if (task->state != SIM_TASK_RUNNING) {
+		return;
+	}
+
+	from = task->started_usecs + (uint64_t)s_config.preparing_msecs * 1000;
+	if (from < task->updated_usecs) {
+		from = task->updated_usecs;
+	}
+
+	if (now > from) {
+		task->transferred += (now - from) * s_config.transfer_rate / 1000000;
+		if (task->transferred > task->size) {
+			task->transferred = task->size;
+		}
+		task->updated_usecs = now;
+	}
+
+	if (task->fail_at > 0 && task->transferred >= task->fail_at) {
+		task->transferred = task->fail_at;
+		task->state = SIM_TASK_FAILED;
+		return;
+	}
+
+	if (task->transferred < task->size) {
+		return;
+	}
+
+	task->state = SIM_TASK_FINISHED;
+
+	HASH_FIND(hh, s_contents, &task->key, sizeof(task->key), content);
+	if (!content) {
+		content = (struct sim_content*)malloc(sizeof(*content));
+		if (!content) {
+			EPRINTF("No memory.\n");
+			return;
+		}
+		memset(content, 0, sizeof(*content));
+
+		memcpy(&content->key, &task->key, sizeof(content->key));
+		if (pkg_parse_content_id(task->key.content_id, &content_info)) {
+			strlcpy(content->title_id, content_info.title_id, sizeof(content->title_id));
+		}
+		HASH_ADD(hh, s_contents, key, sizeof(content->key), content);
+	}
+	content->size = task->size;
+}
+
+static bool pause_task(int task_id, int* error) {
+	struct sim_task* task;
+
+	begin_call();
+
+	task = find_task(task_id);
+	if (!task) {
+		end_call();
+		return fail(error, ORBIS_KERNEL_ERROR_ENOENT);
+	}
+
+	advance_task(task, now_usecs());
+	if (task->state == SIM_TASK_RUNNING) {
+		task->state = SIM_TASK_PAUSED;
+	}
+
+	end_call();
+
+	return true;
+}
+
+/* Must be called with the lock held. Null and negative arguments match everything. */
+static size_t remove_contents(const char* title_id, const char* content_id, int sub_type, bool skip_base) {
+	struct sim_content* content;
+	struct sim_content* tmp;
+	size_t count = 0;
+
+	HASH_ITER(hh, s_contents, content, tmp) {
+		if (title_id && strcmp(content->title_id, title_id) != 0) {
+			continue;
+		}
+		if (content_id && strcmp(content->key.content_id, content_id) != 0) {
+			continue;
+		}
+		if (sub_type >= 0 && content->key.sub_type != sub_type) {
+			continue;
+		}
+		if (skip_base && (content->key.sub_type == ORBIS_BGFT_TASK_SUB_TYPE_GAME || content->key.sub_type == ORBIS_BGFT_TASK_SUB_TYPE_GAME_PATCH)) {
+			continue;
+		}
+
+		HASH_DEL(s_contents, content);
+		free(content);
+		++count;
+	}
+
+	return count;
+}
+
+static uint64_t now_usecs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "common.h"
+#include "installer.h"
+
+struct sim_backend_config {
+	uint64_t transfer_rate; /* bytes per second of each running task */
+	unsigned int preparing_msecs; /* after start, before data is transferred */
+	unsigned int failure_permille; /* chance of a started task to fail midway */
+	unsigned int call_latency_usecs; /* added to every call */
+	unsigned int seed;
+};
+
+/*
+ * In-memory stand-in for BGFT and AppInstUtil, to exercise the server without touching the real system.
+ * Tasks progress with wall time, completed ones show up as installed applications.
+ */
+bool sim_backend_init(const struct sim_backend_config* config);
+void sim_backend_fini(void);
+
+const struct installer_backend* sim_backend_get(void);
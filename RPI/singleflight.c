@@ -0,0 +1,132 @@
+#include "singleflight.h"
+#include "util.h"
+
+#include <pthread.h>
+
+#include "uthash.h"
+
+struct singleflight_call {
+	char* key;
+	unsigned int ref_count; /* leader and waiters */
+	bool finished;
+	void* result; /* null if it could not be copied */
+	size_t result_size;
+	UT_hash_handle hh;
+};
+
+/* Only calls in flight, finished ones are removed right away. */
+static struct singleflight_call* s_calls = NULL;
+
+static pthread_mutex_t s_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+
+static void release_call(struct singleflight_call* call);
+
+bool singleflight_begin(const char* key, struct singleflight_call** call, bool* leader) {
+	struct singleflight_call* c;
+
+	assert(key != NULL);
+	assert(call != NULL);
+	assert(leader != NULL);
+
+	pthread_mutex_lock(&s_mtx);
+
+	HASH_FIND_STR(s_calls, key, c);
+	if (c) {
+		++c->ref_count;
+		*leader = false;
+		goto done;
+	}
+
+	c = (struct singleflight_call*)malloc(sizeof(*c));
+	if (!c) {
+		goto no_memory;
+	}
+	memset(c, 0, sizeof(*c));
+
+	c->key = strdup(key);
+	if (!c->key) {
+		free(c);
+		goto no_memory;
+	}
+	c->ref_count = 1;
+
+	HASH_ADD_KEYPTR(hh, s_calls, c->key, strlen(c->key), c);
+	*leader = true;
+
+done:
+	pthread_mutex_unlock(&s_mtx);
+
+	*call = c;
+
+	return true;
+
+no_memory:
+	pthread_mutex_unlock(&s_mtx);
+
+	EPRINTF("No memory.\n");
+
+	return false;
+}
+
+void singleflight_finish(struct singleflight_call* call, const void* result, size_t result_size) {
+	assert(call != NULL);
+	assert(result != NULL);
+
+	pthread_mutex_lock(&s_mtx);
+
+	if (call->ref_count > 1) {
+		call->result = malloc(result_size);
+		if (call->result) {
+			memcpy(call->result, result, result_size);
+			call->result_size = result_size;
+		} else {
+			EPRINTF("No memory.\n");
+		}
+	}
+
+	call->finished = true;
+	HASH_DEL(s_calls, call);
+	pthread_cond_broadcast(&s_cond);
+
+	release_call(call);
+
+	pthread_mutex_unlock(&s_mtx);
+}
+
+bool singleflight_wait(struct singleflight_call* call, void* result, size_t result_size) {
+	bool status;
+
+	assert(call != NULL);
+	assert(result != NULL);
+
+	pthread_mutex_lock(&s_mtx);
+
+	while (!call->finished) {
+		pthread_cond_wait(&s_cond, &s_mtx);
+	}
+
+	status = call->result != NULL && call->result_size == result_size;
+	if (status) {
+		memcpy(result, call->result, result_size);
+	}
+
+	release_call(call);
+
+	pthread_mutex_unlock(&s_mtx);
+
+	return status;
+}
+
+/* Must be called with the lock held. */
+static void release_call(struct singleflight_call* call) {
+	if (--call->ref_count > 0) {
+		return;
+	}
+
+	if (call->result) {
+		free(call->result);
+	}
+	free(call->key);
+	free(call);
+}
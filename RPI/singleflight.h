@@ -0,0 +1,18 @@
+#pragma once
+
+#include "common.h"
+
+struct singleflight_call;
+
+/*
+ * Joins the in-flight call for key, or starts a new one with the caller as its leader.
+ * Leader does the work and publishes its result with singleflight_finish(), everyone else calls singleflight_wait().
+ * Returns false if no call could be set up, the caller should just do the work alone then.
+ */
+bool singleflight_begin(const char* key, struct singleflight_call** call, bool* leader);
+
+/* Publishes result to all waiters and removes key, so later callers start a new call. */
+void singleflight_finish(struct singleflight_call* call, const void* result, size_t result_size);
+
+/* Blocks until the leader has finished, then copies its result. Returns false if no result could be shared. */
+bool singleflight_wait(struct singleflight_call* call, void* result, size_t result_size);
@@ -0,0 +1,297 @@
+#include "storage.h"
+#include "progress.h"
+#include "util.h"
+
+#include <pthread.h>
+
+#include "utlist.h"
+
+#define STORAGE_MFSNAMELEN 16
+#define STORAGE_MNAMELEN 88
+
+/* Layout of struct statfs used by the kernel. */
+struct kernel_statfs {
+	uint32_t f_version;
+	uint32_t f_type;
+	uint64_t f_flags;
+	uint64_t f_bsize;
+	uint64_t f_iosize;
+	uint64_t f_blocks;
+	uint64_t f_bfree;
+	int64_t f_bavail;
+	uint64_t f_files;
+	int64_t f_ffree;
+	uint64_t f_syncwrites;
+	uint64_t f_asyncwrites;
+	uint64_t f_syncreads;
+	uint64_t f_asyncreads;
+	uint64_t f_spare[10];
+	uint32_t f_namemax;
+	uint32_t f_owner;
+	int32_t f_fsid[2];
+	char f_charspare[80];
+	char f_fstypename[STORAGE_MFSNAMELEN];
+	char f_mntfromname[STORAGE_MNAMELEN];
+	char f_mntonname[STORAGE_MNAMELEN];
+};
+
+struct reservation {
+	int id;
+	int task_id; /* -1 until registered */
+	uint64_t size;
+	struct reservation* prev;
+	struct reservation* next;
+};
+
+static struct reservation* s_reservations = NULL;
+static int s_next_reservation_id = 1;
+
+static char* s_path = NULL;
+static uint64_t s_margin_size = 0;
+
+static pthread_mutex_t s_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static bool s_storage_initialized = false;
+
+static bool get_free_size(uint64_t* free_size, int* error);
+static uint64_t get_reserved_size(void);
+static struct reservation* add_reservation(int task_id, uint64_t size);
+static void delete_reservations(int id, int task_id);
+
+bool storage_init(const char* path, uint64_t margin_size) {
+	if (s_storage_initialized) {
+		goto done;
+	}
+
+	if (!path) {
+		EPRINTF("No path specified.\n");
+		goto err;
+	}
+
+	s_path = strdup(path);
+	if (!s_path) {
+		EPRINTF("No memory.\n");
+		goto err;
+	}
+
+	s_margin_size = margin_size;
+
+	s_storage_initialized = true;
+
+done:
+	return true;
+
+err:
+	return false;
+}
+
+void storage_fini(void) {
+	if (!s_storage_initialized) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	delete_reservations(-1, -1);
+	pthread_mutex_unlock(&s_mtx);
+
+	free(s_path);
+	s_path = NULL;
+
+	s_storage_initialized = false;
+}
+
+bool storage_reserve(uint64_t size, int* reservation_id, struct storage_usage* usage, int* error) {
+	struct reservation* r;
+	uint64_t free_size, reserved_size;
+	bool status = false;
+
+	assert(reservation_id != NULL);
+
+	*reservation_id = 0;
+
+	if (!s_storage_initialized) {
+		/* Nothing to check against, let BGFT decide. */
+		return true;
+	}
+
+	/* Held over the whole check, so concurrent installs can not overcommit. */
+	pthread_mutex_lock(&s_mtx);
+
+	if (!get_free_size(&free_size, error)) {
+		goto err;
+	}
+	reserved_size = get_reserved_size();
+
+	if (usage) {
+		usage->free_size = free_size;
+		usage->reserved_size = reserved_size;
+		usage->margin_size = s_margin_size;
+	}
+
+	if (free_size < s_margin_size || free_size - s_margin_size < reserved_size || free_size - s_margin_size - reserved_size < size) {
+		if (error) {
+			*error = ENOSPC;
+		}
+		goto err;
+	}
+
+	r = add_reservation(-1, size);
+	if (!r) {
+		if (error) {
+			*error = ENOMEM;
+		}
+		goto err;
+	}
+
+	*reservation_id = r->id;
+
+	status = true;
+
+err:
+	pthread_mutex_unlock(&s_mtx);
+
+	return status;
+}
+
+void storage_bind_task(int reservation_id, int task_id) {
+	struct reservation* r;
+
+	if (!s_storage_initialized || reservation_id <= 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	DL_FOREACH(s_reservations, r) {
+		if (r->id == reservation_id) {
+			r->task_id = task_id;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+}
+
+void storage_release(int reservation_id) {
+	if (!s_storage_initialized || reservation_id <= 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	delete_reservations(reservation_id, -1);
+	pthread_mutex_unlock(&s_mtx);
+}
+
+void storage_reserve_task(int task_id, uint64_t size) {
+	if (!s_storage_initialized || task_id < 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	delete_reservations(-1, task_id);
+	add_reservation(task_id, size);
+	pthread_mutex_unlock(&s_mtx);
+}
+
+void storage_release_task(int task_id) {
+	if (!s_storage_initialized || task_id < 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	delete_reservations(-1, task_id);
+	pthread_mutex_unlock(&s_mtx);
+}
+
+bool storage_get_usage(struct storage_usage* usage, int* error) {
+	bool status;
+
+	assert(usage != NULL);
+
+	memset(usage, 0, sizeof(*usage));
+
+	if (!s_storage_initialized) {
+		return false;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	status = get_free_size(&usage->free_size, error);
+	usage->reserved_size = get_reserved_size();
+	usage->margin_size = s_margin_size;
+	pthread_mutex_unlock(&s_mtx);
+
+	return status;
+}
+
+static bool get_free_size(uint64_t* free_size, int* error) {
+	struct kernel_statfs buf;
+	int ret;
+
+	memset(&buf, 0, sizeof(buf));
+
+	ret = syscall(SYS_statfs, s_path, &buf);
+	if (ret < 0) {
+		EPRINTF("statfs(%s) failed: %d\n", s_path, errno);
+		if (error) {
+			*error = errno;
+		}
+		return false;
+	}
+
+	*free_size = buf.f_bavail > 0 ? (uint64_t)buf.f_bavail * buf.f_bsize : 0;
+
+	return true;
+}
+
+/* Must be called with the lock held. Bytes a registered task already wrote are part of used space, so only the rest counts. */
+static uint64_t get_reserved_size(void) {
+	struct reservation* r;
+	struct progress_snapshot snapshot;
+	uint64_t total = 0;
+	uint64_t written;
+
+	DL_FOREACH(s_reservations, r) {
+		written = 0;
+		if (r->task_id >= 0 && progress_get_snapshot(r->task_id, &snapshot) && snapshot.valid) {
+			written = snapshot.info.transferred_total;
+		}
+		total += written < r->size ? r->size - written : 0;
+	}
+
+	return total;
+}
+
+/* Must be called with the lock held. */
+static struct reservation* add_reservation(int task_id, uint64_t size) {
+	struct reservation* r;
+
+	r = (struct reservation*)malloc(sizeof(*r));
+	if (!r) {
+		EPRINTF("No memory.\n");
+		return NULL;
+	}
+	memset(r, 0, sizeof(*r));
+
+	r->id = s_next_reservation_id++;
+	if (s_next_reservation_id <= 0) {
+		s_next_reservation_id = 1;
+	}
+	r->task_id = task_id;
+	r->size = size;
+	DL_APPEND(s_reservations, r);
+
+	return r;
+}
+
+/* Must be called with the lock held. Negative values match everything. */
+static void delete_reservations(int id, int task_id) {
+	struct reservation* r;
+	struct reservation* tmp;
+
+	DL_FOREACH_SAFE(s_reservations, r, tmp) {
+		if ((id < 0 || r->id == id) && (task_id < 0 || r->task_id == task_id)) {
+			DL_DELETE(s_reservations, r);
+			free(r);
+		}
+	}
+}
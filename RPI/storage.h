@@ -0,0 +1,27 @@
+#pragma once
+
+#include "common.h"
+
+struct storage_usage {
+	uint64_t free_size; /* as reported by the file system */
+	uint64_t reserved_size; /* still to be written by registered or pending tasks */
+	uint64_t margin_size;
+};
+
+/* Free space of the file system containing path is checked, margin is always kept free. */
+bool storage_init(const char* path, uint64_t margin_size);
+void storage_fini(void);
+
+/*
+ * Admission check, reserves size bytes if they fit into free space minus outstanding reservations.
+ * Reservation is not bound to a task yet, usage is filled either way if given.
+ */
+bool storage_reserve(uint64_t size, int* reservation_id, struct storage_usage* usage, int* error);
+void storage_bind_task(int reservation_id, int task_id);
+void storage_release(int reservation_id);
+
+/* Reserves space for an already registered task, without admission check. */
+void storage_reserve_task(int task_id, uint64_t size);
+void storage_release_task(int task_id);
+
+bool storage_get_usage(struct storage_usage* usage, int* error);
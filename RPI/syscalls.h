@@ -9,6 +9,7 @@ extern "C" {
 #define SYS_unmount 22
 #define	SYS_getdents 272
 #define	SYS_nmount 378
+#define SYS_statfs 396
 #define SYS_supercall 394
 #define SYS_gain_privileges 410
 #define SYS_dynlib_get_info 593
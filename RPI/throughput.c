@@ -0,0 +1,346 @@
+#include "throughput.h"
+#include "util.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "utringbuffer.h"
+
+#define THROUGHPUT_MAX_SAMPLES 32
+
+/* Samples closer than this are dropped, rates get too noisy otherwise. */
+#define THROUGHPUT_MIN_INTERVAL_MSECS 200
+
+/* Time constant of the moving average, roughly how far back it looks. */
+#define THROUGHPUT_EWMA_TAU_MSECS 8000
+
+#define THROUGHPUT_STALL_MSECS 15000
+
+struct throughput_sample {
+	uint64_t msecs;
+	uint64_t transferred;
+	uint64_t length;
+};
+
+struct throughput_slot {
+	int task_id; /* -1 if slot is free */
+	UT_ringbuffer samples;
+	bool has_rate;
+	double rate;
+	uint64_t peak_rate;
+	bool has_moved;
+	uint64_t moved_msecs; /* of last sample with new bytes, or of first one */
+};
+
+static const UT_icd s_sample_icd = { sizeof(struct throughput_sample), NULL, NULL, NULL };
+
+static struct throughput_slot s_slots[THROUGHPUT_MAX_TASKS];
+static uint64_t s_peak_total_rate = 0;
+
+static pthread_mutex_t s_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static bool s_throughput_initialized = false;
+
+static struct throughput_slot* find_slot(int task_id);
+static void reset_slot(struct throughput_slot* slot, int task_id);
+static void get_info(const struct throughput_slot* slot, uint64_t now, struct throughput_info* info);
+static uint64_t now_msecs(void);
+
+bool throughput_init(void) {
+	size_t i;
+
+	if (s_throughput_initialized) {
+		goto done;
+	}
+
+	memset(s_slots, 0, sizeof(s_slots));
+
+	for (i = 0; i < ARRAY_SIZE(s_slots); ++i) {
+		s_slots[i].task_id = -1;
+
+		utringbuffer_init(&s_slots[i].samples, THROUGHPUT_MAX_SAMPLES, &s_sample_icd);
+		if (!s_slots[i].samples.d) {
+			EPRINTF("No memory.\n");
+			goto err_free_samples;
+		}
+	}
+
+	s_peak_total_rate = 0;
+
+	s_throughput_initialized = true;
+
+done:
+	return true;
+
+err_free_samples:
+	for (i = 0; i < ARRAY_SIZE(s_slots); ++i) {
+		utringbuffer_done(&s_slots[i].samples);
+	}
+
+	return false;
+}
+
+void throughput_fini(void) {
+	size_t i;
+
+	if (!s_throughput_initialized) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	for (i = 0; i < ARRAY_SIZE(s_slots); ++i) {
+		utringbuffer_done(&s_slots[i].samples);
+		s_slots[i].task_id = -1;
+	}
+	pthread_mutex_unlock(&s_mtx);
+
+	s_throughput_initialized = false;
+}
+
+void throughput_add_sample(int task_id, uint64_t transferred, uint64_t length) {
+	struct throughput_sample sample;
+	struct throughput_sample* last;
+	struct throughput_slot* slot;
+	uint64_t total_rate = 0;
+	double rate, alpha;
+	uint64_t now, dt;
+	size_t i;
+
+	if (!s_throughput_initialized || task_id < 0) {
+		return;
+	}
+
+	now = now_msecs();
+
+	pthread_mutex_lock(&s_mtx);
+
+	slot = find_slot(task_id);
+	if (!slot) {
+		slot = find_slot(-1);
+		if (!slot) {
+			goto done;
+		}
+		reset_slot(slot, task_id);
+	}
+
+	last = (struct throughput_sample*)utringbuffer_back(&slot->samples);
+	if (last && (transferred < last->transferred || length != last->length)) {
+		/* Task started over. */
+		reset_slot(slot, task_id);
+		last = NULL;
+	}
+
+	if (last) {
+		dt = now - last->msecs;
+		if (dt < THROUGHPUT_MIN_INTERVAL_MSECS) {
+			goto done;
+		}
+
+		/* Weight grows with the time a sample covers, so uneven poll intervals do not skew it. */
+		rate = (double)(transferred - last->transferred) * 1000.0 / (double)dt;
+		alpha = (double)dt / (double)(THROUGHPUT_EWMA_TAU_MSECS + dt);
+		slot->rate = slot->has_rate ? slot->rate + alpha * (rate - slot->rate) : rate;
+		slot->has_rate = true;
+
+		if ((uint64_t)slot->rate > slot->peak_rate) {
+			slot->peak_rate = (uint64_t)slot->rate;
+		}
+
+		if (transferred != last->transferred) {
+			slot->has_moved = true;
+			slot->moved_msecs = now;
+		}
+	} else {
+		slot->moved_msecs = now;
+	}
+
+	memset(&sample, 0, sizeof(sample));
+	sample.msecs = now;
+	sample.transferred = transferred;
+	sample.length = length;
+	utringbuffer_push_back(&slot->samples, &sample);
+
+	for (i = 0; i < ARRAY_SIZE(s_slots); ++i) {
+		slot = &s_slots[i];
+		last = (struct throughput_sample*)utringbuffer_back(&slot->samples);
+		if (slot->task_id >= 0 && slot->has_rate && last && last->transferred < last->length) {
+			total_rate += (uint64_t)slot->rate;
+		}
+	}
+	if (total_rate > s_peak_total_rate) {
+		s_peak_total_rate = total_rate;
+	}
+
+done:
+	pthread_mutex_unlock(&s_mtx);
+}
+
+void throughput_remove(int task_id) {
+	struct throughput_slot* slot;
+
+	if (!s_throughput_initialized || task_id < 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	slot = find_slot(task_id);
+	if (slot) {
+		reset_slot(slot, -1);
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+}
+
+bool throughput_get(int task_id, struct throughput_info* info) {
+	struct throughput_slot* slot;
+
+	assert(info != NULL);
+
+	if (!s_throughput_initialized || task_id < 0) {
+		return false;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	slot = find_slot(task_id);
+	if (slot) {
+		get_info(slot, now_msecs(), info);
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+
+	return slot != NULL;
+}
+
+size_t throughput_get_all(int* task_ids, struct throughput_info* infos, size_t max_count, struct throughput_totals* totals) {
+	struct throughput_info info;
+	struct throughput_slot* slot;
+	size_t count = 0;
+	uint64_t now;
+	size_t i;
+
+	assert(task_ids != NULL || max_count == 0);
+	assert(infos != NULL || max_count == 0);
+	assert(totals != NULL);
+
+	memset(totals, 0, sizeof(*totals));
+
+	if (!s_throughput_initialized) {
+		return 0;
+	}
+
+	now = now_msecs();
+
+	pthread_mutex_lock(&s_mtx);
+
+	for (i = 0; i < ARRAY_SIZE(s_slots); ++i) {
+		slot = &s_slots[i];
+		if (slot->task_id < 0) {
+			continue;
+		}
+
+		get_info(slot, now, &info);
+
+		if (count < max_count) {
+			task_ids[count] = slot->task_id;
+			memcpy(&infos[count], &info, sizeof(info));
+			++count;
+		}
+
+		++totals->task_count;
+		if (info.finished) {
+			continue;
+		}
+
+		if (info.stalled) {
+			++totals->stalled_count;
+		} else if (info.rate > 0) {
+			++totals->active_count;
+		}
+
+		totals->rate += info.rate;
+		if (info.length > info.transferred) {
+			totals->remaining += info.length - info.transferred;
+		}
+	}
+
+	totals->peak_rate = s_peak_total_rate;
+
+	pthread_mutex_unlock(&s_mtx);
+
+	if (totals->rate > 0 && totals->remaining > 0) {
+		totals->has_eta = true;
+		totals->eta_secs = (unsigned int)MIN(totals->remaining / totals->rate, (uint64_t)UINT_MAX);
+	}
+
+	return count;
+}
+
+/* Must be called with the lock held. */
+static struct throughput_slot* find_slot(int task_id) {
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(s_slots); ++i) {
+		if (s_slots[i].task_id == task_id) {
+			return &s_slots[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Must be called with the lock held. */
+static void reset_slot(struct throughput_slot* slot, int task_id) {
+	slot->task_id = task_id;
+	utringbuffer_clear(&slot->samples);
+	slot->has_rate = false;
+	slot->rate = 0.0;
+	slot->peak_rate = 0;
+	slot->has_moved = false;
+	slot->moved_msecs = 0;
+}
+
+/* Must be called with the lock held. */
+static void get_info(const struct throughput_slot* slot, uint64_t now, struct throughput_info* info) {
+	const struct throughput_sample* first;
+	const struct throughput_sample* last;
+	uint64_t idle_msecs;
+
+	memset(info, 0, sizeof(*info));
+
+	first = (const struct throughput_sample*)utringbuffer_front(&slot->samples);
+	last = (const struct throughput_sample*)utringbuffer_back(&slot->samples);
+	if (!first || !last) {
+		return;
+	}
+
+	info->transferred = last->transferred;
+	info->length = last->length;
+	info->finished = last->length > 0 && last->transferred >= last->length;
+
+	info->has_rate = slot->has_rate;
+	info->rate = (uint64_t)slot->rate;
+	info->peak_rate = slot->peak_rate;
+	if (last->msecs > first->msecs) {
+		info->window_rate = (last->transferred - first->transferred) * 1000 / (last->msecs - first->msecs);
+	}
+
+	idle_msecs = now > slot->moved_msecs ? now - slot->moved_msecs : 0;
+	info->idle_secs = (unsigned int)(idle_msecs / 1000);
+	info->stalled = !info->finished && slot->has_moved && idle_msecs >= THROUGHPUT_STALL_MSECS;
+
+	if (!info->finished && !info->stalled && info->rate > 0 && last->length > last->transferred) {
+		info->has_eta = true;
+		info->eta_secs = (unsigned int)MIN((last->length - last->transferred) / info->rate, (uint64_t)UINT_MAX);
+	}
+}
+
+static uint64_t now_msecs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / NSEC_PER_MSEC;
+}
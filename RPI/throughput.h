@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common.h"
+
+#define THROUGHPUT_MAX_TASKS 64
+
+struct throughput_info {
+	bool has_rate; /* false until two samples are known */
+	uint64_t rate; /* bytes per second, smoothed */
+	uint64_t window_rate; /* average over the kept samples */
+	uint64_t peak_rate; /* highest smoothed rate seen */
+	bool has_eta; /* false if done or not moving */
+	unsigned int eta_secs;
+	bool finished;
+	bool stalled; /* no bytes moved for a while after having started, paused tasks included */
+	unsigned int idle_secs; /* since bytes moved last */
+	uint64_t transferred;
+	uint64_t length;
+};
+
+struct throughput_totals {
+	size_t task_count;
+	size_t active_count; /* not finished and not stalled */
+	size_t stalled_count;
+	uint64_t rate; /* sum of smoothed rates */
+	uint64_t peak_rate; /* highest sum seen */
+	uint64_t remaining; /* bytes left over all unfinished tasks */
+	bool has_eta;
+	unsigned int eta_secs;
+};
+
+bool throughput_init(void);
+void throughput_fini(void);
+
+/* Called by the progress poller for each successful poll, moving or not. */
+void throughput_add_sample(int task_id, uint64_t transferred, uint64_t length);
+void throughput_remove(int task_id);
+
+/* Returns false if the task has no samples. */
+bool throughput_get(int task_id, struct throughput_info* info);
+
+/* Returns number of tasks copied. */
+size_t throughput_get_all(int* task_ids, struct throughput_info* infos, size_t max_count, struct throughput_totals* totals);
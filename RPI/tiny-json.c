@@ -28,21 +28,33 @@
 */
 
 #include <string.h>
+#include <stddef.h>
 #include <ctype.h>
+/* JSON_NO_SIMD forces the scalar paths, the host bench builds both. */
+#if defined(__SSE2__) && !defined(JSON_NO_SIMD)
+#define JSON_USE_SSE2
+#include <emmintrin.h>
+#endif
 #include "tiny-json.h"
 
-/** Structure to handle a heap of JSON properties. */
-typedef struct jsonPool_s {
-    json_t* const mem;      /**< Pointer to array of json properties.      */
-    unsigned int const qty; /**< Length of the array of json properties.   */
+/** Get the address of a structure from the address of one of its members. */
+#define json_containerOf( ptr, type, member ) \
+    ((type*)( (char*)ptr - offsetof( type, member ) ))
+
+/** Structure to handle a static heap of JSON properties. */
+typedef struct jsonStaticPool_s {
+    json_t* mem;            /**< Pointer to array of json properties.      */
+    unsigned int qty;       /**< Length of the array of json properties.   */
     unsigned int nextFree;  /**< The index of the next free json property. */
-} jsonPool_t;
+    jsonPool_t pool;
+} jsonStaticPool_t;
 
 /* Search a property by its name in a JSON object. */
 json_t const* json_getProperty( json_t const* obj, char const* property ) {
     json_t const* sibling;
+    /* Most names differ in the first character already. */
     for( sibling = obj->u.c.child; sibling; sibling = sibling->sibling )
-        if ( sibling->name && !strcmp( sibling->name, property ) )
+        if ( sibling->name && sibling->name[0] == property[0] && !strcmp( sibling->name, property ) )
             return sibling;
     return 0;
 }
@@ -60,21 +72,31 @@ char const* json_getPropertyValue( json_t const* obj, char const* property ) {
 static char* goBlank( char* str );
 static char* goNum( char* str );
 static json_t* poolInit( jsonPool_t* pool );
-static json_t* poolNew( jsonPool_t* pool );
+static json_t* poolAlloc( jsonPool_t* pool );
 static char* objValue( char* ptr, json_t* obj, jsonPool_t* pool );
 static char* setToNull( char* ch );
 static bool isEndOfPrimitive( char ch );
 
 /* Parse a string to get a json. */
 json_t const* json_create( char* str, json_t mem[], unsigned int qty ) {
+    jsonStaticPool_t spool;
+    spool.mem = mem;
+    spool.qty = qty;
+    spool.pool.init = poolInit;
+    spool.pool.alloc = poolAlloc;
+    return json_createWithPool( str, &spool.pool );
+}
+
+/* Parse a string to get a json using a custom pool. */
+json_t const* json_createWithPool( char* str, jsonPool_t* pool ) {
     char* ptr = goBlank( str );
     if ( !ptr || *ptr != '{' ) return 0;
-    jsonPool_t pool = { .mem = mem, .qty = qty };
-    json_t* obj = poolInit( &pool );
+    json_t* obj = pool->init( pool );
+    if ( !obj ) return 0;
     obj->name    = 0;
     obj->sibling = 0;
     obj->u.c.child = 0;
-    ptr = objValue( ptr, obj, &pool );
+    ptr = objValue( ptr, obj, pool );
     if ( !ptr ) return 0;
     return obj;
 }
@@ -109,6 +131,39 @@ static unsigned char getCharFromUnicode( unsigned char const* str ) {
     return '?';
 }
 
+/** Check whether a character ends the plain part of a string. */
+static inline bool isSpecial( unsigned char ch ) {
+    return ch == '\"' || ch == '\\' || ch < ' ';
+}
+
+/** Find the first quote, backslash or control character, null included.
+  * @param str Pointer to first character.
+  * @return Pointer to the found character. */
+static unsigned char* findSpecial( unsigned char* str ) {
+#ifdef JSON_USE_SSE2
+    /* Only aligned blocks are loaded, so a block holding the terminating
+       null never crosses into the next page. */
+    for( ; (uintptr_t)str & 15; ++str )
+        if ( isSpecial( *str ) )
+            return str;
+    __m128i const quote = _mm_set1_epi8( '\"' );
+    __m128i const bslash = _mm_set1_epi8( '\\' );
+    __m128i const ctrl = _mm_set1_epi8( ' ' - 1 );
+    for(;; str += 16 ) {
+        __m128i const v = _mm_load_si128( (__m128i const*)str );
+        __m128i m = _mm_or_si128( _mm_cmpeq_epi8( v, quote ), _mm_cmpeq_epi8( v, bslash ) );
+        m = _mm_or_si128( m, _mm_cmpeq_epi8( _mm_max_epu8( v, ctrl ), ctrl ) );
+        int const mask = _mm_movemask_epi8( m );
+        if ( mask )
+            return str + __builtin_ctz( (unsigned int)mask );
+    }
+#else
+    while( !isSpecial( *str ) )
+        ++str;
+    return str;
+#endif
+}
+
 /** Parse a string and replace the scape characters by their meaning characters.
   * This parser stops when finds the character '\"'. Then replaces '\"' by '\0'.
   * @param str Pointer to first character.
@@ -117,27 +172,31 @@ static unsigned char getCharFromUnicode( unsigned char const* str ) {
 static char* parseString( char* str ) {
     unsigned char* head = (unsigned char*)str;
     unsigned char* tail = (unsigned char*)str;
-    for( ; *head >= ' '; ++head, ++tail ) {
+    for(;;) {
+        unsigned char* const special = findSpecial( head );
+        size_t const len = special - head;
+        if ( tail != head ) memmove( tail, head, len );
+        head += len;
+        tail += len;
         if ( *head == '\"' ) {
             *tail = '\0';
             return (char*)++head;
         }
-        if ( *head == '\\' ) {
-            if ( *++head == 'u' ) {
-                char const ch = getCharFromUnicode( ++head );
-                if ( ch == '\0' ) return 0;
-                *tail = ch;
-                head += 3;
-            }
-            else {
-                char const esc = getEscape( *head );
-                if ( esc == '\0' ) return 0;
-                *tail = esc;
-            }
+        if ( *head != '\\' ) return 0;
+        if ( *++head == 'u' ) {
+            char const ch = getCharFromUnicode( ++head );
+            if ( ch == '\0' ) return 0;
+            *tail = ch;
+            head += 3;
+        }
+        else {
+            char const esc = getEscape( *head );
+            if ( esc == '\0' ) return 0;
+            *tail = esc;
         }
-        else *tail = *head;
+        ++head;
+        ++tail;
     }
-    return 0;
 }
 
 /** Parse a string to get the name of a property.
@@ -335,7 +394,7 @@ static char* objValue( char* ptr, json_t* obj, jsonPool_t* pool ) {
             ++ptr;
             continue;
         }
-        json_t* property = poolNew( pool );
+        json_t* property = pool->alloc( pool );
         if ( !property ) return 0;
         if( obj->type != JSON_ARRAY ) {
             if ( *ptr != '\"' ) return 0;
@@ -374,17 +433,20 @@ static char* objValue( char* ptr, json_t* obj, jsonPool_t* pool ) {
   * @param pool The handler of the pool.
   * @return a instance of a json. */
 static json_t* poolInit( jsonPool_t* pool ) {
-    pool->nextFree = 1;
-    return &pool->mem[0];
+    jsonStaticPool_t* spool = json_containerOf( pool, jsonStaticPool_t, pool );
+    if ( spool->qty == 0 ) return 0;
+    spool->nextFree = 1;
+    return &spool->mem[0];
 }
 
 /** Create an instance of a json from a pool.
   * @param pool The handler of the pool.
   * @retval The handler of the new instance if success.
   * @retval Null pointer if the pool was empty. */
-static json_t* poolNew( jsonPool_t* pool ) {
-    if ( pool->nextFree >= pool->qty ) return 0;
-    return &pool->mem[pool->nextFree++];
+static json_t* poolAlloc( jsonPool_t* pool ) {
+    jsonStaticPool_t* spool = json_containerOf( pool, jsonStaticPool_t, pool );
+    if ( spool->nextFree >= spool->qty ) return 0;
+    return &spool->mem[spool->nextFree++];
 }
 
 /** Checks whether an character belongs to set.
@@ -398,6 +460,7 @@ static bool isOneOfThem( char ch, char const* set ) {
     return false;
 }
 
+#ifndef JSON_USE_SSE2
 /** Increases a pointer while it points to a character that belongs to a set.
   * @param str The initial pointer value.
   * @param set Set of characters. It is just a null-terminated string.
@@ -409,6 +472,7 @@ static char* goWhile( char* str, char const* set ) {
     }
     return 0;
 }
+#endif
 
 /** Set of characters that defines a blank. */
 static char const* const blank = " \n\r\t\f";
@@ -417,7 +481,33 @@ static char const* const blank = " \n\r\t\f";
   * @param str The initial pointer value.
   * @return The final pointer value or null pointer if the null character was found. */
 static char* goBlank( char* str ) {
+#ifdef JSON_USE_SSE2
+    /* Most values are not preceded by blanks at all. */
+    if ( !isOneOfThem( *str, blank ) )
+        return *str ? str : 0;
+    for( ; (uintptr_t)str & 15; ++str )
+        if ( !isOneOfThem( *str, blank ) )
+            return *str ? str : 0;
+    __m128i const sp = _mm_set1_epi8( ' ' );
+    __m128i const nl = _mm_set1_epi8( '\n' );
+    __m128i const cr = _mm_set1_epi8( '\r' );
+    __m128i const tab = _mm_set1_epi8( '\t' );
+    __m128i const ff = _mm_set1_epi8( '\f' );
+    for(;; str += 16 ) {
+        __m128i const v = _mm_load_si128( (__m128i const*)str );
+        __m128i m = _mm_or_si128( _mm_cmpeq_epi8( v, sp ), _mm_cmpeq_epi8( v, nl ) );
+        m = _mm_or_si128( m, _mm_cmpeq_epi8( v, cr ) );
+        m = _mm_or_si128( m, _mm_cmpeq_epi8( v, tab ) );
+        m = _mm_or_si128( m, _mm_cmpeq_epi8( v, ff ) );
+        int const mask = ~_mm_movemask_epi8( m ) & 0xFFFF;
+        if ( mask ) {
+            str += __builtin_ctz( (unsigned int)mask );
+            return *str ? str : 0;
+        }
+    }
+#else
     return goWhile( str, blank );
+#endif
 }
 
 /** Increases a pointer while it points to a decimal digit character.
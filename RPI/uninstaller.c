@@ -0,0 +1,387 @@
+#include "uninstaller.h"
+#include "installer.h"
+#include "inventory.h"
+#include "util.h"
+
+#include <pthread.h>
+#include <time.h>
+
+#include "utlist.h"
+
+/* Finished jobs are kept around for status queries until this many jobs exist. */
+#define UNINSTALLER_MAX_JOBS 32
+
+typedef bool uninstall_cb(const char* id, int* error);
+
+struct uninstall_type_desc {
+	const char* name;
+	uninstall_cb* uninstall;
+	bool uses_content_id;
+};
+
+struct uninstall_job {
+	int id;
+	struct uninstall_item items[UNINSTALLER_MAX_ITEMS];
+	size_t item_count;
+	size_t next_item;
+	bool finished;
+	struct uninstall_job* prev;
+	struct uninstall_job* next;
+};
+
+/* Indexed by enum uninstall_type. */
+static const struct uninstall_type_desc s_types[] = {
+	{ "patch", &app_inst_util_uninstall_patch, false },
+	{ "ac", &app_inst_util_uninstall_ac, true },
+	{ "theme", &app_inst_util_uninstall_theme, true },
+	{ "game", &app_inst_util_uninstall_game, false },
+};
+
+/* In submission order. */
+static struct uninstall_job* s_jobs = NULL;
+static size_t s_job_count = 0;
+static int s_next_job_id = 1;
+
+static pthread_mutex_t s_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t s_change_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t s_thread;
+static bool s_stop_requested = false;
+static unsigned int s_generation = 0;
+
+static bool s_uninstaller_initialized = false;
+
+static void* worker_thread(void* arg);
+static struct uninstall_job* find_pending_job(void);
+static bool drop_oldest_finished_job(void);
+static bool contains_item(const struct uninstall_job* job, const struct uninstall_item* item);
+static void notify_change(void);
+
+bool uninstaller_init(void) {
+	int ret;
+
+	if (s_uninstaller_initialized) {
+		goto done;
+	}
+
+	s_stop_requested = false;
+
+	ret = pthread_create(&s_thread, NULL, &worker_thread, NULL);
+	if (ret) {
+		EPRINTF("pthread_create failed: %d\n", ret);
+		goto err;
+	}
+
+	s_uninstaller_initialized = true;
+
+done:
+	return true;
+
+err:
+	return false;
+}
+
+void uninstaller_fini(void) {
+	struct uninstall_job* job;
+	struct uninstall_job* tmp;
+
+	if (!s_uninstaller_initialized) {
+		return;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	s_stop_requested = true;
+	pthread_cond_signal(&s_cond);
+	pthread_cond_broadcast(&s_change_cond);
+	pthread_mutex_unlock(&s_mtx);
+
+	/* Item being uninstalled right now is finished first, the rest is discarded. */
+	pthread_join(s_thread, NULL);
+
+	pthread_mutex_lock(&s_mtx);
+	DL_FOREACH_SAFE(s_jobs, job, tmp) {
+		DL_DELETE(s_jobs, job);
+		free(job);
+	}
+	s_job_count = 0;
+	pthread_mutex_unlock(&s_mtx);
+
+	s_uninstaller_initialized = false;
+}
+
+bool uninstaller_submit(const struct uninstall_item* items, size_t count, int* job_id) {
+	struct uninstall_job* job = NULL;
+	struct uninstall_item tmp;
+	size_t i, j;
+
+	assert(items != NULL || count == 0);
+	assert(job_id != NULL);
+
+	if (!s_uninstaller_initialized) {
+		EPRINTF("Uninstaller is not initialized.\n");
+		goto err;
+	}
+
+	if (count > UNINSTALLER_MAX_ITEMS) {
+		EPRINTF("Too many items: %" PRIuMAX "\n", (uintmax_t)count);
+		goto err;
+	}
+
+	job = (struct uninstall_job*)malloc(sizeof(*job));
+	if (!job) {
+		EPRINTF("No memory.\n");
+		goto err;
+	}
+	memset(job, 0, sizeof(*job));
+
+	for (i = 0; i < count; ++i) {
+		if ((size_t)items[i].type >= ARRAY_SIZE(s_types)) {
+			EPRINTF("Invalid uninstall type: %d\n", (int)items[i].type);
+			goto err;
+		}
+		if (contains_item(job, &items[i])) {
+			continue;
+		}
+
+		/* Stable insertion by type, jobs are small. */
+		memcpy(&tmp, &items[i], sizeof(tmp));
+		tmp.state = UNINSTALL_STATE_PENDING;
+		tmp.error = 0;
+
+		j = job->item_count++;
+		while (j > 0 && job->items[j - 1].type > tmp.type) {
+			memcpy(&job->items[j], &job->items[j - 1], sizeof(job->items[j]));
+			--j;
+		}
+		memcpy(&job->items[j], &tmp, sizeof(job->items[j]));
+	}
+
+	job->finished = job->item_count == 0;
+
+	pthread_mutex_lock(&s_mtx);
+
+	if (s_job_count >= UNINSTALLER_MAX_JOBS && !drop_oldest_finished_job()) {
+		pthread_mutex_unlock(&s_mtx);
+		EPRINTF("Too many pending uninstall jobs.\n");
+		goto err;
+	}
+
+	job->id = s_next_job_id++;
+	if (s_next_job_id <= 0) {
+		s_next_job_id = 1;
+	}
+
+	DL_APPEND(s_jobs, job);
+	++s_job_count;
+
+	*job_id = job->id;
+
+	pthread_cond_signal(&s_cond);
+	notify_change();
+
+	pthread_mutex_unlock(&s_mtx);
+
+	return true;
+
+err:
+	if (job) {
+		free(job);
+	}
+
+	return false;
+}
+
+bool uninstaller_get_job(int job_id, struct uninstall_item* items, size_t* count, bool* finished) {
+	struct uninstall_job* job;
+
+	assert(items != NULL);
+	assert(count != NULL);
+	assert(finished != NULL);
+
+	if (!s_uninstaller_initialized) {
+		return false;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+
+	DL_FOREACH(s_jobs, job) {
+		if (job->id == job_id) {
+			memcpy(items, job->items, job->item_count * sizeof(*items));
+			*count = job->item_count;
+			*finished = job->finished;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&s_mtx);
+
+	return job != NULL;
+}
+
+bool uninstaller_wait_for_change(unsigned int* generation, unsigned int timeout_msecs, bool* changed) {
+	struct timespec deadline;
+	bool running;
+	int ret = 0;
+
+	assert(generation != NULL);
+	assert(changed != NULL);
+
+	*changed = false;
+
+	if (!s_uninstaller_initialized) {
+		return false;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout_msecs / 1000;
+	deadline.tv_nsec += (timeout_msecs % 1000) * NSEC_PER_MSEC;
+	if (deadline.tv_nsec >= NSEC_PER_SEC) {
+		deadline.tv_nsec -= NSEC_PER_SEC;
+		++deadline.tv_sec;
+	}
+
+	pthread_mutex_lock(&s_mtx);
+	while (*generation == s_generation && !s_stop_requested && ret == 0) {
+		ret = pthread_cond_timedwait(&s_change_cond, &s_mtx, &deadline);
+	}
+	*changed = *generation != s_generation;
+	*generation = s_generation;
+	running = !s_stop_requested;
+	pthread_mutex_unlock(&s_mtx);
+
+	return running;
+}
+
+bool uninstall_type_from_name(const char* name, enum uninstall_type* type) {
+	size_t i;
+
+	assert(name != NULL);
+	assert(type != NULL);
+
+	for (i = 0; i < ARRAY_SIZE(s_types); ++i) {
+		if (strcmp(s_types[i].name, name) == 0) {
+			*type = (enum uninstall_type)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const char* uninstall_type_name(enum uninstall_type type) {
+	return (size_t)type < ARRAY_SIZE(s_types) ? s_types[type].name : "unknown";
+}
+
+bool uninstall_type_uses_content_id(enum uninstall_type type) {
+	return (size_t)type < ARRAY_SIZE(s_types) && s_types[type].uses_content_id;
+}
+
+const char* uninstall_state_name(enum uninstall_state state) {
+	if (state == UNINSTALL_STATE_RUNNING) {
+		return "running";
+	} else if (state == UNINSTALL_STATE_DONE) {
+		return "done";
+	} else if (state == UNINSTALL_STATE_FAILED) {
+		return "failed";
+	} else {
+		return "pending";
+	}
+}
+
+static void* worker_thread(void* arg) {
+	struct uninstall_job* job;
+	struct uninstall_item* item;
+	const struct uninstall_type_desc* desc;
+	char id[UNINSTALLER_ID_SIZE];
+	int error;
+	bool ok;
+
+	UNUSED(arg);
+
+	for (;;) {
+		pthread_mutex_lock(&s_mtx);
+		while (!s_stop_requested && !(job = find_pending_job())) {
+			pthread_cond_wait(&s_cond, &s_mtx);
+		}
+		if (s_stop_requested) {
+			pthread_mutex_unlock(&s_mtx);
+			break;
+		}
+
+		/* Job is not dropped while unfinished, so the item stays valid without the lock. */
+		item = &job->items[job->next_item];
+		item->state = UNINSTALL_STATE_RUNNING;
+		desc = &s_types[item->type];
+		strlcpy(id, item->id, sizeof(id));
+		notify_change();
+		pthread_mutex_unlock(&s_mtx);
+
+		error = 0;
+		ok = (*desc->uninstall)(id, &error);
+		if (ok) {
+			if (desc->uses_content_id) {
+				inventory_invalidate_content(id);
+			} else {
+				inventory_invalidate(id);
+			}
+		}
+
+		pthread_mutex_lock(&s_mtx);
+		item->state = ok ? UNINSTALL_STATE_DONE : UNINSTALL_STATE_FAILED;
+		item->error = ok ? 0 : error;
+		if (++job->next_item >= job->item_count) {
+			job->finished = true;
+		}
+		notify_change();
+		pthread_mutex_unlock(&s_mtx);
+	}
+
+	return NULL;
+}
+
+/* Must be called with the lock held. Jobs are run in submission order. */
+static struct uninstall_job* find_pending_job(void) {
+	struct uninstall_job* job;
+
+	DL_FOREACH(s_jobs, job) {
+		if (!job->finished) {
+			return job;
+		}
+	}
+
+	return NULL;
+}
+
+/* Must be called with the lock held. */
+static bool drop_oldest_finished_job(void) {
+	struct uninstall_job* job;
+
+	DL_FOREACH(s_jobs, job) {
+		if (job->finished) {
+			DL_DELETE(s_jobs, job);
+			free(job);
+			--s_job_count;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool contains_item(const struct uninstall_job* job, const struct uninstall_item* item) {
+	size_t i;
+
+	for (i = 0; i < job->item_count; ++i) {
+		if (job->items[i].type == item->type && strcmp(job->items[i].id, item->id) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Must be called with the lock held. */
+static void notify_change(void) {
+	++s_generation;
+	pthread_cond_broadcast(&s_change_cond);
+}
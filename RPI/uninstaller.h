@@ -0,0 +1,49 @@
+#pragma once
+
+#include "common.h"
+#include "pkg.h"
+
+#define UNINSTALLER_MAX_ITEMS 64
+#define UNINSTALLER_ID_SIZE (PKG_CONTENT_ID_SIZE + 1)
+
+/* Items of a job are run in this order, so patches and add-ons go before their base game. */
+enum uninstall_type {
+	UNINSTALL_TYPE_PATCH,
+	UNINSTALL_TYPE_AC,
+	UNINSTALL_TYPE_THEME,
+	UNINSTALL_TYPE_GAME,
+};
+
+enum uninstall_state {
+	UNINSTALL_STATE_PENDING,
+	UNINSTALL_STATE_RUNNING,
+	UNINSTALL_STATE_DONE,
+	UNINSTALL_STATE_FAILED,
+};
+
+struct uninstall_item {
+	enum uninstall_type type;
+	char id[UNINSTALLER_ID_SIZE]; /* title id for games and patches, content id otherwise */
+	enum uninstall_state state;
+	int error;
+};
+
+bool uninstaller_init(void);
+void uninstaller_fini(void);
+
+/* Queues a job for the worker thread, items are reordered by type and duplicates are dropped. */
+bool uninstaller_submit(const struct uninstall_item* items, size_t count, int* job_id);
+
+/* Copies items of a job in execution order. Returns false if the job is unknown or expired. */
+bool uninstaller_get_job(int job_id, struct uninstall_item* items, size_t* count, bool* finished);
+
+/*
+ * Blocks until any job changes after the given generation, or until timeout expires.
+ * Returns false once the worker is shutting down.
+ */
+bool uninstaller_wait_for_change(unsigned int* generation, unsigned int timeout_msecs, bool* changed);
+
+bool uninstall_type_from_name(const char* name, enum uninstall_type* type);
+const char* uninstall_type_name(enum uninstall_type type);
+bool uninstall_type_uses_content_id(enum uninstall_type type);
+const char* uninstall_state_name(enum uninstall_state state);
@@ -0,0 +1,345 @@
+#include "uri.h"
+
+#include <ctype.h>
+#include <pthread.h>
+
+/* URI_NO_SIMD forces the scalar paths, the host bench builds both. */
+#if defined(__SSE2__) && !defined(URI_NO_SIMD)
+#	define URI_USE_SSE2
+#	include <emmintrin.h>
+#endif
+
+#define HEX_INVALID 0xFF
+
+static const char s_hex_digits[] = "0123456789ABCDEF";
+
+static uint8_t s_hex_values[256];
+static bool s_safe_chars[256];
+
+static pthread_once_t s_tables_once = PTHREAD_ONCE_INIT;
+
+static void init_tables(void);
+static size_t find_percent(const char* str, size_t len);
+static size_t safe_prefix_length(const char* str, size_t len);
+
+size_t uri_decode_in_place(char* str) {
+	size_t len, run, r, w;
+	uint8_t hi, lo;
+
+	assert(str != NULL);
+
+	pthread_once(&s_tables_once, &init_tables);
+
+	len = strlen(str);
+
+	for (r = w = 0; r < len; ) {
+		run = find_percent(str + r, len - r);
+		if (run > 0) {
+			if (w != r) {
+				memmove(str + w, str + r, run);
+			}
+			r += run;
+			w += run;
+			if (r == len) {
+				break;
+			}
+		}
+
+		/* Terminator stops the lookup before it can run past the end. */
+		hi = s_hex_values[(uint8_t)str[r + 1]];
+		lo = hi != HEX_INVALID ? s_hex_values[(uint8_t)str[r + 2]] : HEX_INVALID;
+		if (lo != HEX_INVALID) {
+			str[w++] = (char)((hi << 4) | lo);
+			r += 3;
+		} else {
+			str[w++] = str[r++];
+		}
+	}
+
+	str[w] = '\0';
+
+	return w;
+}
+
+char* uri_decode(const char* in, size_t* out_len) {
+	char* out;
+	size_t len;
+
+	assert(in != NULL);
+
+	out = strdup(in);
+	if (!out) {
+		EPRINTF("No memory.\n");
+		goto err;
+	}
+
+	len = uri_decode_in_place(out);
+
+	if (out_len) {
+		*out_len = len;
+	}
+
+err:
+	return out;
+}
+
+size_t uri_encoded_length(const char* in, size_t len) {
+	size_t result = 0;
+	size_t run;
+
+	assert(in != NULL);
+
+	pthread_once(&s_tables_once, &init_tables);
+
+	while (len > 0) {
+		run = safe_prefix_length(in, len);
+		result += run;
+		in += run;
+		len -= run;
+
+		if (len > 0) {
+			result += 3;
+			++in;
+			--len;
+		}
+	}
+
+	return result;
+}
+
+char* uri_encode(const char* in, size_t* out_len) {
+	size_t in_len, len, run;
+	uint8_t ch;
+	char* out;
+	char* p;
+
+	assert(in != NULL);
+
+	in_len = strlen(in);
+	len = uri_encoded_length(in, in_len);
+
+	out = (char*)malloc(len + 1);
+	if (!out) {
+		EPRINTF("No memory.\n");
+		goto err;
+	}
+
+	for (p = out; in_len > 0; ) {
+		run = safe_prefix_length(in, in_len);
+		memcpy(p, in, run);
+		p += run;
+		in += run;
+		in_len -= run;
+
+		if (in_len > 0) {
+			ch = (uint8_t)*in++;
+			--in_len;
+
+			*p++ = '%';
+			*p++ = s_hex_digits[ch >> 4];
+			*p++ = s_hex_digits[ch & 0xF];
+		}
+	}
+	*p = '\0';
+
+	if (out_len) {
+		*out_len = len;
+	}
+
+err:
+	return out;
+}
+
+bool uri_get_host(const char* url, char* host, size_t host_size) {
+	const char* start;
+	const char* end;
+	const char* p;
+	size_t len, i;
+
+	assert(url != NULL);
+	assert(host != NULL);
+	assert(host_size > 0);
+
+	*host = '\0';
+
+	start = strstr(url, "://");
+	if (!start) {
+		goto err;
+	}
+	start += 3;
+
+	end = start + strcspn(start, "/?#");
+
+	/* Skip user info. */
+	for (p = start; p < end; ++p) {
+		if (*p == '@') {
+			start = p + 1;
+		}
+	}
+
+	len = (size_t)(end - start);
+	if (len == 0 || len >= host_size) {
+		goto err;
+	}
+
+	for (i = 0; i < len; ++i) {
+		host[i] = (char)tolower((unsigned char)start[i]);
+	}
+	host[len] = '\0';
+
+	return true;
+
+err:
+	return false;
+}
+
+static void init_tables(void) {
+	static const char* const extra_safe_chars = "-_.~+:/@";
+	const char* p;
+	int i;
+
+	memset(s_hex_values, HEX_INVALID, sizeof(s_hex_values));
+	for (i = 0; i < 10; ++i) {
+		s_hex_values['0' + i] = (uint8_t)i;
+	}
+	for (i = 0; i < 6; ++i) {
+		s_hex_values['a' + i] = s_hex_values['A' + i] = (uint8_t)(10 + i);
+	}
+
+	memset(s_safe_chars, 0, sizeof(s_safe_chars));
+	for (i = 0; i < 256; ++i) {
+		s_safe_chars[i] = (i >= '0' && i <= '9') || (i >= 'a' && i <= 'z') || (i >= 'A' && i <= 'Z');
+	}
+	for (p = extra_safe_chars; *p != '\0'; ++p) {
+		s_safe_chars[(uint8_t)*p] = true;
+	}
+}
+
+#ifdef URI_USE_SSE2
+/* Signed compares, so bytes above 0x7F never fall into a range. */
+static inline __m128i in_range(__m128i v, char lo, char hi) {
+	return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+#endif
+
+static size_t find_percent(const char* str, size_t len) {
+	size_t i = 0;
+
+#ifdef URI_USE_SSE2
+	const __m128i percent = _mm_set1_epi8('%');
+	int mask;
+
+	for (; i + 16 <= len; i += 16) {
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(str + i)), percent));
+		if (mask) {
+			return i + __builtin_ctz((unsigned int)mask);
+		}
+	}
+#endif
+
+	while (i < len && str[i] != '%') {
+		++i;
+	}
+
+	return i;
+}
+
+static size_t safe_prefix_length(const char* str, size_t len) {
+	size_t i = 0;
+
+#ifdef URI_USE_SSE2
+	__m128i v, m;
+	int mask;
+
+	/* Safe set is -./ 0-9: @A-Z a-z plus _ ~ + */
+	for (; i + 16 <= len; i += 16) {
+		v = _mm_loadu_si128((const __m128i*)(str + i));
+		m = _mm_or_si128(in_range(v, '-', ':'), in_range(v, '@', 'Z'));
+		m = _mm_or_si128(m, in_range(v, 'a', 'z'));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('~')));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('+')));
+		mask = _mm_movemask_epi8(m);
+		if (mask != 0xFFFF) {
+			return i + __builtin_ctz((unsigned int)~mask);
+		}
+	}
+#endif
+
+	while (i < len && s_safe_chars[(uint8_t)str[i]]) {
+		++i;
+	}
+
+	return i;
+}
+
+char* uri_normalize(const char* url) {
+	const char* scheme_end;
+	const char* host_start;
+	const char* host_end;
+	const char* port;
+	const char* p;
+	char* out = NULL;
+	char* q;
+	size_t scheme_len;
+
+	assert(url != NULL);
+
+	pthread_once(&s_tables_once, &init_tables);
+
+	scheme_end = strstr(url, "://");
+	if (!scheme_end || scheme_end == url) {
+		goto err;
+	}
+	scheme_len = (size_t)(scheme_end - url);
+
+	host_start = scheme_end + 3;
+	host_end = host_start + strcspn(host_start, "/?#");
+	for (p = host_start; p < host_end; ++p) {
+		if (*p == '@') {
+			host_start = p + 1;
+		}
+	}
+
+	/* Port is dropped if it is the default one of the scheme. */
+	port = memchr(host_start, ':', (size_t)(host_end - host_start));
+	if (port && ((scheme_len == 4 && strncasecmp(url, "http", 4) == 0 && host_end - port == 3 && strncmp(port, ":80", 3) == 0) ||
+		(scheme_len == 5 && strncasecmp(url, "https", 5) == 0 && host_end - port == 4 && strncmp(port, ":443", 4) == 0))) {
+		host_end = port;
+	}
+
+	/* One extra byte for an implied root path. */
+	out = (char*)malloc(strlen(url) + 2);
+	if (!out) {
+		EPRINTF("No memory.\n");
+		goto err;
+	}
+
+	q = out;
+	for (p = url; p < host_start; ++p) {
+		/* User info is kept verbatim. */
+		*q++ = p < scheme_end ? (char)tolower((unsigned char)*p) : *p;
+	}
+	for (p = host_start; p < host_end; ++p) {
+		*q++ = (char)tolower((unsigned char)*p);
+	}
+
+	p = host_start + strcspn(host_start, "/?#");
+	if (*p != '/') {
+		*q++ = '/';
+	}
+	for (; *p != '\0' && *p != '#'; ++p) {
+		if (*p == '%' && s_hex_values[(uint8_t)p[1]] != HEX_INVALID && s_hex_values[(uint8_t)p[2]] != HEX_INVALID) {
+			*q++ = '%';
+			*q++ = (char)toupper((unsigned char)p[1]);
+			*q++ = (char)toupper((unsigned char)p[2]);
+			p += 2;
+		} else {
+			*q++ = *p;
+		}
+	}
+	*q = '\0';
+
+err:
+	return out;
+}
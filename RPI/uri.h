@@ -0,0 +1,24 @@
+#pragma once
+
+#include "common.h"
+
+#define URI_HOST_SIZE 256
+
+/* Decodes percent escapes in place, malformed escapes are kept as is. Returns new length. */
+size_t uri_decode_in_place(char* str);
+
+/* Returns a newly allocated decoded copy. */
+char* uri_decode(const char* in, size_t* out_len);
+
+/* Escapes everything except alphanumerics and -_.~+:/@, so an already formed URL keeps its structure. */
+size_t uri_encoded_length(const char* in, size_t len);
+char* uri_encode(const char* in, size_t* out_len);
+
+/* Extracts lowercased host with port, if any, from an absolute URL. */
+bool uri_get_host(const char* url, char* host, size_t host_size);
+
+/*
+ * Returns a newly allocated canonical form of an absolute URL, suitable as a lookup key.
+ * Scheme and host are lowercased, default ports and fragment are dropped, escapes use uppercase hex digits.
+ */
+char* uri_normalize(const char* url);